@@ -205,6 +205,12 @@ ATTR(real_dpi)
 ATTR(underground_alpha)
 ATTR(sunrise_degrees)
 ATTR(distance)
+ATTR(build_threads)
+ATTR(route_engine)
+ATTR(route_heuristic)
+ATTR(route_expansions)
+ATTR(cache_spill_size)
+ATTR(name_index_ref)
 ATTR2(0x00027500,type_rel_abs_begin)
 /* These attributes are int that can either hold relative or absolute values. See the
  * documentation of ATTR_REL_RELSHIFT for details.
@@ -269,6 +275,7 @@ ATTR(oneway)
 ATTR(tunnel_nightlayout)
 ATTR(layout_daynightauto)
 ATTR(town_use_postal)
+ATTR(thread_safe)
 ATTR2(0x0002ffff,type_int_end)
 ATTR2(0x00030000,type_string_begin)
 ATTR(type)
@@ -410,6 +417,7 @@ ATTR(exit_to)
 ATTR(street_destination_forward)
 ATTR(street_destination_backward)
 ATTR(outputdir)
+ATTR(cache_file)
 ATTR2(0x0003ffff,type_string_end)
 ATTR2(0x00040000,type_special_begin)
 ATTR(order)
@@ -0,0 +1,425 @@
+/**
+ * Navit, a modular navigation system.
+ * Copyright (C) 2005-2019 Navit Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public License
+ * version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+/**
+ * @file draw_benchmark.c
+ *
+ * @brief Measures how long it takes to redraw the map
+ *
+ * The maps and the layout given on the command line are drawn for a series of views, each given by center, scale,
+ * yaw and pitch, using a graphics plugin which does not need a display (`null` by default, `svg_debug` to look at
+ * the result). Each redraw is done the same way navit does it, but synchronously, and its phases are timed where
+ * `do_draw()` marks them for `profile()`: reading the maps, processing the selection, drawing the displaylist and
+ * calling the callback. The counters of the displaylist are printed, one line per run.
+ *
+ * Only a bare navit object is created to hold the layout; it is neither initialized nor connected to the graphics.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+#include <glib.h>
+#include "config.h"
+#include "debug.h"
+#include "atom.h"
+#include "main.h"
+#include "file.h"
+#include "item.h"
+#include "attr.h"
+#include "coord.h"
+#include "point.h"
+#include "projection.h"
+#include "map.h"
+#include "mapset.h"
+#include "plugin.h"
+#include "linguistics.h"
+#include "geom.h"
+#include "route.h"
+#include "transform.h"
+#include "graphics.h"
+#include "xmlconfig.h"
+#include "layout.h"
+#include "navit.h"
+
+#ifndef USE_PLUGINS
+extern void builtin_init(void);
+#endif /* USE_PLUGINS*/
+
+/**
+ * @brief A view to be drawn
+ */
+struct benchmark_view {
+    struct pcoord center;            /**< Center of the view */
+    long scale;                      /**< Scale, as for the zoom attribute of navit */
+    int yaw;                         /**< Orientation in degrees */
+    int pitch;                       /**< Pitch in degrees, 0 for a flat map */
+};
+
+/** Scales drawn when no view is given */
+static long benchmark_scales[] = {2, 8, 32, 128, 512, 2048, 8192, 32768};
+
+/**
+ * @brief Adds attributes given as text to an attribute list
+ *
+ * @param attrs The attribute list, can be NULL
+ * @param text Space-separated `name=value` pairs
+ * @return The new attribute list, NULL if `text` is invalid
+ */
+static struct attr **benchmark_attrs_add(struct attr **attrs, const char *text) {
+    char **words=g_strsplit(text, " ", -1);
+    char *value;
+    struct attr *attr;
+    int i;
+
+    for (i = 0 ; words[i] ; i++) {
+        value=strchr(words[i], '=');
+        if (!value) {
+            fprintf(stderr, "Expected name=value instead of '%s'\n", words[i]);
+            break;
+        }
+        *value++='\0';
+        attr=attr_new_from_text(words[i], value);
+        if (!attr || attr->type == attr_none) {
+            fprintf(stderr, "Unknown attribute '%s'\n", words[i]);
+            attr_free(attr);
+            break;
+        }
+        attrs=attr_generic_add_attr(attrs, attr);
+        attr_free(attr);
+    }
+    if (words[i]) {
+        attr_list_free(attrs);
+        attrs=NULL;
+    }
+    g_strfreev(words);
+    return attrs;
+}
+
+static GList *benchmark_view_add(GList *views, struct pcoord *center, long scale, int yaw, int pitch) {
+    struct benchmark_view *view=g_new(struct benchmark_view, 1);
+
+    view->center=*center;
+    view->scale=scale;
+    view->yaw=yaw;
+    view->pitch=pitch;
+    return g_list_append(views, view);
+}
+
+/**
+ * @brief Reads views from a file
+ *
+ * Each line holds scale, yaw and pitch, followed by the center in any format understood by `pcoord_parse()`.
+ */
+static GList *benchmark_views_read(GList *views, const char *filename) {
+    FILE *f=fopen(filename, "r");
+    char line[1024];
+    struct pcoord center;
+    long scale;
+    int yaw,pitch,pos;
+
+    if (!f) {
+        fprintf(stderr, "Could not open '%s'\n", filename);
+        exit(1);
+    }
+    while (fgets(line, sizeof(line), f)) {
+        g_strstrip(line);
+        if (!line[0] || line[0] == '#')
+            continue;
+        if (sscanf(line, "%ld %d %d %n", &scale, &yaw, &pitch, &pos) < 3
+                || !pcoord_parse(line+pos, projection_mg, &center)) {
+            fprintf(stderr, "Invalid view '%s' in '%s'\n", line, filename);
+            exit(1);
+        }
+        views=benchmark_view_add(views, &center, scale, yaw, pitch);
+    }
+    fclose(f);
+    return views;
+}
+
+static double benchmark_now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec*1000.0+ts.tv_nsec/1000000.0;
+}
+
+/**
+ * @brief Draws one view and prints the results
+ */
+static void benchmark_run(struct graphics *gra, struct displaylist *dl, struct mapset *ms, struct layout *layout,
+                          struct benchmark_view *view, int width, int height, int index, int run) {
+    struct transformation *trans;
+    struct map_selection sel;
+    struct displaylist_stats stats;
+    double start,end;
+
+    trans=transform_new(&view->center, view->scale, view->yaw);
+    memset(&sel, 0, sizeof(sel));
+    sel.u.p_rect.rl.x=width;
+    sel.u.p_rect.rl.y=height;
+    transform_set_screen_selection(trans, &sel);
+    transform_set_pitch(trans, view->pitch);
+    start=benchmark_now();
+    transform_setup_source_rect(trans);
+    graphics_draw(gra, dl, ms, trans, layout, 0, NULL, 1);
+    end=benchmark_now();
+    graphics_displaylist_get_stats(dl, &stats);
+    printf("%d\t%d\t%ld\t%d\t%d\t%d\t%d\t%d\t%d\t%ld\t%ld\t%ld\t%ld\t%ld\t%.0f\n", index, run, view->scale,
+           transform_get_order(trans), view->yaw, view->pitch, stats.items_read, stats.items_created, stats.items,
+           stats.points, stats.fetch_usec, stats.selection_usec, stats.draw_usec, stats.callback_usec,
+           (end-start)*1000);
+    fflush(stdout);
+    transform_destroy(trans);
+}
+
+static void usage(FILE *f) {
+    fprintf(f,"draw_benchmark - measure redrawing the map\n\n");
+    fprintf(f,"Usage:\n");
+    fprintf(f,"draw_benchmark [options]\n");
+    fprintf(f,"Options:\n");
+    fprintf(f,"-A name=value     : set an attribute of the graphics, e.g. build_threads=4\n");
+    fprintf(f,"-c center         : center of the views, as for the navit command line, e.g. \"11.57 48.14\"\n");
+    fprintf(f,"-d level          : set the debug level\n");
+    fprintf(f,"-f file           : read views from file, one per line: scale yaw pitch center\n");
+    fprintf(f,"-G type           : graphics plugin to draw with (default null)\n");
+    fprintf(f,"-h                : this screen\n");
+    fprintf(f,"-l file           : read layouts from file, e.g. navit_layout_car_shipped.xml\n");
+    fprintf(f,"-L name           : use the layout with this name (default the first one read)\n");
+    fprintf(f,"-m file           : use a binfile map, can be given more than once\n");
+    fprintf(f,"-n count          : repeat each run count times (default 1)\n");
+#ifdef USE_PLUGINS
+    fprintf(f,"-P path           : load plugins from path (default $NAVIT_LIBDIR/*/${NAVIT_LIBPREFIX}lib*.so)\n");
+#endif
+    fprintf(f,"-s WxH            : size of the screen (default 800x480)\n");
+    fprintf(f,"-t pitch          : pitch of the views given with -c and -z (default 0)\n");
+    fprintf(f,"-y yaw            : orientation of the views given with -c and -z (default 0)\n");
+    fprintf(f,"-z scale          : scale, as for the zoom attribute of navit, can be given more than once\n");
+    fprintf(f,"\nWith a center and no scale, a series of scales from street to country level is drawn.\n");
+    fprintf(f,"To look at the result, use e.g. -G svg_debug -A name=null -A outputdir=/tmp\n");
+    fprintf(f,"Output columns: view, run, scale, order, yaw, pitch, items read, displayitems created,\n");
+    fprintf(f,"displayitems, points transformed, us reading maps, processing selection, drawing, callback, total\n");
+}
+
+int main(int argc, char **argv) {
+    GList *maps=NULL,*scales=NULL,*views=NULL,*p;
+    struct attr **gra_attrs=NULL,*attr,*attrs[3],*navit_attrs[1];
+    char *layout_file=NULL,*layout_name=NULL,*graphics_type="null",*center_text=NULL;
+    int opt,repeat=1,yaw=0,pitch=0,width=800,height=480,index,run,i;
+    struct pcoord center;
+    struct mapset *ms;
+    struct map *m;
+    struct attr map_attr,type,data,navit_attr,layout_attr;
+    struct attr_iter *iter;
+    struct point_rect r;
+    struct navit *nav;
+    struct layout *layout=NULL;
+    struct graphics *gra;
+    struct displaylist *dl;
+    xmlerror *error=NULL;
+#ifdef USE_PLUGINS
+    char *plugin_path="$NAVIT_LIBDIR/*/${NAVIT_LIBPREFIX}lib*.so";
+    struct plugins *plugins;
+    struct attr plugins_attr,path,ondemand;
+#endif
+
+    atom_init();
+    main_init(argv[0]);
+    debug_init(argv[0]);
+    file_init();
+#ifndef USE_PLUGINS
+    builtin_init();
+#endif
+    route_init();
+    linguistics_init();
+    geom_init();
+
+    while ((opt=getopt(argc, argv, "A:c:d:f:G:hl:L:m:n:P:s:t:y:z:")) != -1) {
+        switch (opt) {
+        case 'A':
+            gra_attrs=benchmark_attrs_add(gra_attrs, optarg);
+            if (!gra_attrs)
+                exit(1);
+            break;
+        case 'c':
+            center_text=optarg;
+            break;
+        case 'd':
+            debug_set_global_level(atoi(optarg), 1);
+            break;
+        case 'f':
+            views=benchmark_views_read(views, optarg);
+            break;
+        case 'G':
+            graphics_type=optarg;
+            break;
+        case 'h':
+            usage(stdout);
+            exit(0);
+        case 'l':
+            layout_file=optarg;
+            break;
+        case 'L':
+            layout_name=optarg;
+            break;
+        case 'm':
+            maps=g_list_append(maps, optarg);
+            break;
+        case 'n':
+            repeat=atoi(optarg);
+            break;
+#ifdef USE_PLUGINS
+        case 'P':
+            plugin_path=optarg;
+            break;
+#endif
+        case 's':
+            if (sscanf(optarg, "%dx%d", &width, &height) != 2 || width <= 0 || height <= 0) {
+                fprintf(stderr, "Invalid screen size '%s'\n", optarg);
+                exit(1);
+            }
+            break;
+        case 't':
+            pitch=atoi(optarg);
+            break;
+        case 'y':
+            yaw=atoi(optarg);
+            break;
+        case 'z':
+            scales=g_list_append(scales, GINT_TO_POINTER(atoi(optarg)));
+            break;
+        default:
+            usage(stderr);
+            exit(1);
+        }
+    }
+    if (optind < argc || !maps || !layout_file) {
+        usage(stderr);
+        exit(1);
+    }
+    if (center_text) {
+        if (!pcoord_parse(center_text, projection_mg, &center)) {
+            fprintf(stderr, "Invalid center '%s'\n", center_text);
+            exit(1);
+        }
+        if (scales) {
+            for (p = scales ; p ; p = g_list_next(p))
+                views=benchmark_view_add(views, &center, GPOINTER_TO_INT(p->data), yaw, pitch);
+        } else {
+            for (i = 0 ; i < sizeof(benchmark_scales)/sizeof(*benchmark_scales) ; i++)
+                views=benchmark_view_add(views, &center, benchmark_scales[i], yaw, pitch);
+        }
+    }
+    if (!views) {
+        fprintf(stderr, "No views given\n");
+        exit(1);
+    }
+
+#ifdef USE_PLUGINS
+    plugins=plugins_new(NULL, NULL);
+    plugins_attr.type=attr_plugins;
+    plugins_attr.u.plugins=plugins;
+    path.type=attr_path;
+    path.u.str=plugin_path;
+    ondemand.type=attr_ondemand;
+    ondemand.u.num=1;
+    attrs[0]=&path;
+    attrs[1]=&ondemand;
+    attrs[2]=NULL;
+    plugin_new(&plugins_attr, attrs);
+    plugins_init(plugins);
+#endif
+
+    ms=mapset_new(NULL, NULL);
+    map_attr.type=attr_map;
+    type.type=attr_type;
+    type.u.str="binfile";
+    data.type=attr_data;
+    attrs[0]=&type;
+    attrs[1]=&data;
+    attrs[2]=NULL;
+    for (p = maps ; p ; p = g_list_next(p)) {
+        data.u.str=p->data;
+        m=map_new(NULL, attrs);
+        if (!m) {
+            fprintf(stderr, "Could not open map '%s'\n", (char *)p->data);
+            exit(1);
+        }
+        map_attr.u.map=m;
+        mapset_add_attr(ms, &map_attr);
+    }
+
+    navit_attrs[0]=NULL;
+    nav=navit_new(NULL, navit_attrs);
+    navit_attr.type=attr_navit;
+    navit_attr.u.navit=nav;
+    if (!config_load_into(layout_file, &navit_attr, &error)) {
+        fprintf(stderr, "Could not load layouts from '%s': %s\n", layout_file, error ? error->message : "");
+        exit(1);
+    }
+    iter=navit_attr_iter_new(NULL);
+    while (navit_get_attr(nav, attr_layout, &layout_attr, iter)) {
+        if (!layout_name || (layout_attr.u.layout->name && !strcmp(layout_attr.u.layout->name, layout_name))) {
+            layout=layout_attr.u.layout;
+            break;
+        }
+    }
+    navit_attr_iter_destroy(iter);
+    if (!layout) {
+        fprintf(stderr, "No layout %s%sfound in '%s'\n", layout_name ? layout_name : "", layout_name ? " " : "",
+                layout_file);
+        exit(1);
+    }
+
+    if (!gra_attrs || !attr_search(gra_attrs, attr_type)) {
+        attr=attr_new_from_text("type", graphics_type);
+        gra_attrs=attr_generic_add_attr(gra_attrs, attr);
+        attr_free(attr);
+    }
+    gra=graphics_new(&navit_attr, gra_attrs);
+    if (!gra) {
+        fprintf(stderr, "Could not create graphics of type '%s'\n", graphics_type);
+        exit(1);
+    }
+    graphics_init(gra);
+    r.lu.x=0;
+    r.lu.y=0;
+    r.rl.x=width;
+    r.rl.y=height;
+    graphics_set_rect(gra, &r);
+    dl=graphics_displaylist_new();
+
+    printf("view\trun\tscale\torder\tyaw\tpitch\titems_read\titems_created\tdisplayitems\tpoints\t"
+           "fetch_us\tselection_us\tdraw_us\tcallback_us\ttotal_us\n");
+    for (p = views, index = 0 ; p ; p = g_list_next(p), index++) {
+        for (run = 0 ; run < repeat ; run++)
+            benchmark_run(gra, dl, ms, layout, p->data, width, height, index, run);
+    }
+
+    graphics_displaylist_destroy(dl);
+    for (p = views ; p ; p = g_list_next(p))
+        g_free(p->data);
+    g_list_free(views);
+    g_list_free(scales);
+    g_list_free(maps);
+    attr_list_free(gra_attrs);
+    mapset_destroy(ms);
+    return 0;
+}
@@ -0,0 +1,317 @@
+/**
+ * Navit, a modular navigation system.
+ * Copyright (C) 2005-2019 Navit Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public License
+ * version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+/**
+ * @file linguistics_benchmark.c
+ *
+ * @brief Measures comparing names with search keys
+ *
+ * A list of names, either generated town and street names or read from a file, is compared with each search key in
+ * each of the comparison modes used by the search, the way the search checks every candidate item. Each comparison is
+ * done with `linguistics_compare()`, which casefolds and expands the names while comparing them, and with a copy of
+ * the former implementation, which allocates a casefolded and up to two expanded copies of each name. Both must agree
+ * on which names match and on the sign of every result. One line per mode, key and run is printed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+#include <glib.h>
+#include "config.h"
+#include "debug.h"
+#include "linguistics.h"
+
+/**
+ * @brief The names to compare
+ */
+struct benchmark_names {
+    char **names;
+    int count;
+    int size;                        /**< Allocated size of `names` */
+};
+
+/**
+ * @brief A comparison mode to be measured
+ */
+struct benchmark_mode {
+    char *name;                      /**< Name printed in the output */
+    enum linguistics_cmp_mode mode;  /**< Flags passed to `linguistics_compare()` */
+};
+
+static struct benchmark_mode benchmark_modes[] = {
+    {"exact", 0},
+    {"partial", linguistics_cmp_partial},
+    {"partial_words", linguistics_cmp_partial|linguistics_cmp_words},
+    {"partial_expand_words", linguistics_cmp_partial|linguistics_cmp_expand|linguistics_cmp_words},
+};
+
+/** Search keys used when none are given */
+static char *benchmark_keys[] = {"haupt", "muenchen", "st", "grossberg", "ober"};
+
+/** Parts of the generated names, including characters which are casefolded or expanded */
+static char *benchmark_prefixes[] = {"Ober", "Unter", "Neu", "Alt", "Groß", "Klein", "Sankt ", "Bad ", "Äußere ",
+                                     "Saint-", "Le ", "", "", ""
+                                    };
+static char *benchmark_stems[] = {"berg", "bach", "au", "dorf", "hausen", "heim", "feld", "kirchen", "stadt", "brunn",
+                                  "münchen", "mühl", "göß", "œuvre", "élan", "Haupt", "Bahnhof", "Linden", "Schön"
+                                 };
+static char *benchmark_suffixes[] = {"straße", "weg", "gasse", "allee", "platz", "ring", " am See", "-Süd", "", ""};
+
+/**
+ * @brief Returns the next number of a simple generator, so that the same names are generated on every platform
+ */
+static unsigned int benchmark_random(unsigned int *state) {
+    *state^=*state << 13;
+    *state^=*state >> 17;
+    *state^=*state << 5;
+    return *state;
+}
+
+#define benchmark_pick(array, state) (array[benchmark_random(state) % (sizeof(array)/sizeof(*array))])
+
+static void benchmark_names_add(struct benchmark_names *names, char *name) {
+    if (names->count == names->size) {
+        names->size=names->size ? names->size*2 : 1024;
+        names->names=g_renew(char *, names->names, names->size);
+    }
+    names->names[names->count++]=name;
+}
+
+/**
+ * @brief Generates town and street names
+ *
+ * @param count Number of names to generate
+ * @param seed Seed of the generator
+ * @return The names
+ */
+static struct benchmark_names *benchmark_names_generate(int count, unsigned int seed) {
+    struct benchmark_names *ret=g_new0(struct benchmark_names, 1);
+    unsigned int state=seed ? seed : 1;
+    int i;
+
+    for (i = 0 ; i < count ; i++) {
+        char *stem=g_strdup(benchmark_pick(benchmark_stems, &state));
+        char *name;
+        /* Names start with a capital letter, which has to be casefolded */
+        if (i % 2 && stem[0] >= 'a' && stem[0] <= 'z')
+            stem[0]+='A'-'a';
+        name=g_strconcat(benchmark_pick(benchmark_prefixes, &state), stem, benchmark_pick(benchmark_suffixes, &state),
+                         NULL);
+        g_free(stem);
+        benchmark_names_add(ret, name);
+    }
+    return ret;
+}
+
+/**
+ * @brief Reads names from a file, one per line
+ *
+ * @param filename The file
+ * @return The names, or NULL if the file could not be read
+ */
+static struct benchmark_names *benchmark_names_read(char *filename) {
+    struct benchmark_names *ret;
+    FILE *f=fopen(filename, "r");
+    char line[1024];
+    int len;
+
+    if (!f) {
+        fprintf(stderr, "Could not open '%s'\n", filename);
+        return NULL;
+    }
+    ret=g_new0(struct benchmark_names, 1);
+    while (fgets(line, sizeof(line), f)) {
+        len=strlen(line);
+        while (len && (line[len-1] == '\n' || line[len-1] == '\r'))
+            line[--len]='\0';
+        if (len)
+            benchmark_names_add(ret, g_strdup(line));
+    }
+    fclose(f);
+    return ret;
+}
+
+/**
+ * @brief The former implementation of `linguistics_compare()`, which allocates casefolded and expanded copies
+ */
+static int benchmark_compare_allocating(const char *s1, const char *s2, enum linguistics_cmp_mode mode) {
+    int ret=0;
+    int i;
+    int s2len=strlen(s2);
+    char *s1f;
+    s1f=linguistics_casefold(s1);
+    for(i=0; i<3; i++) {
+        char *s, *word;
+        if(i>0)
+            s=linguistics_expand_special(s1f,i);
+        else
+            s=s1f;
+        word=s;
+        while(word) {
+            if(mode & linguistics_cmp_partial)
+                ret=strncmp(word,s2,s2len);
+            else
+                ret=strcmp(word,s2);
+            if(!ret || !(mode & linguistics_cmp_words))
+                break;
+            word=linguistics_next_word(word);
+        }
+        if(i>0)
+            g_free(s);
+        if(!ret || !(mode & linguistics_cmp_expand))
+            break;
+    }
+    g_free(s1f);
+    return ret;
+}
+
+static int benchmark_sign(int val) {
+    return (val > 0) - (val < 0);
+}
+
+/**
+ * @brief Returns the current time in nanoseconds
+ */
+static double benchmark_now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec*1000000000.0+ts.tv_nsec;
+}
+
+/**
+ * @brief Compares all names with a key in one mode and prints the results
+ *
+ * @return The number of names on which both implementations disagree
+ */
+static int benchmark_run(struct benchmark_names *names, struct benchmark_mode *mode, char *key, int run, int *results) {
+    double start,compared,allocated;
+    int i,matches=0,differences=0;
+
+    start=benchmark_now();
+    for (i = 0 ; i < names->count ; i++)
+        results[i]=linguistics_compare(names->names[i], key, mode->mode);
+    compared=benchmark_now();
+    for (i = 0 ; i < names->count ; i++)
+        results[names->count+i]=benchmark_compare_allocating(names->names[i], key, mode->mode);
+    allocated=benchmark_now();
+    for (i = 0 ; i < names->count ; i++) {
+        if (!results[i])
+            matches++;
+        if (benchmark_sign(results[i]) != benchmark_sign(results[names->count+i]))
+            differences++;
+    }
+    printf("%s\t%s\t%d\t%d\t%d\t%d\t%.1f\t%.1f\n", mode->name, key, run, names->count, matches, differences,
+           (compared-start)/names->count, (allocated-compared)/names->count);
+    fflush(stdout);
+    return differences;
+}
+
+static void usage(FILE *f) {
+    fprintf(f,"linguistics_benchmark - measure comparing names with search keys\n\n");
+    fprintf(f,"Usage:\n");
+    fprintf(f,"linguistics_benchmark [options]\n");
+    fprintf(f,"Options:\n");
+    fprintf(f,"-c count          : number of names to generate (default 100000)\n");
+    fprintf(f,"-d level          : set the debug level\n");
+    fprintf(f,"-f file           : read names from file, one per line, instead of generating them\n");
+    fprintf(f,"-h                : this screen\n");
+    fprintf(f,"-k key            : search key, casefolded before use, can be given more than once\n");
+    fprintf(f,"-n count          : repeat each run count times (default 1)\n");
+    fprintf(f,"-s seed           : seed for generating names (default 1)\n");
+    fprintf(f,"\nWithout a key, some keys matching parts of the generated names are used.\n");
+    fprintf(f,"Output columns: mode, key, run, names, matches, differences between both implementations,\n");
+    fprintf(f,"ns per call of linguistics_compare(), ns per call of the allocating implementation\n");
+}
+
+int main(int argc, char **argv) {
+    GList *keys=NULL,*p;
+    struct benchmark_names *names;
+    char *filename=NULL;
+    int opt,count=100000,repeat=1,differences=0,run,i,*results;
+    unsigned int seed=1;
+
+    debug_init(argv[0]);
+    linguistics_init();
+
+    while ((opt=getopt(argc, argv, "c:d:f:hk:n:s:")) != -1) {
+        switch (opt) {
+        case 'c':
+            count=atoi(optarg);
+            break;
+        case 'd':
+            debug_set_global_level(atoi(optarg), 1);
+            break;
+        case 'f':
+            filename=optarg;
+            break;
+        case 'h':
+            usage(stdout);
+            exit(0);
+        case 'k':
+            keys=g_list_append(keys, linguistics_casefold(optarg));
+            break;
+        case 'n':
+            repeat=atoi(optarg);
+            break;
+        case 's':
+            seed=strtoul(optarg, NULL, 0);
+            break;
+        default:
+            usage(stderr);
+            exit(1);
+        }
+    }
+    if (optind < argc || count < 1) {
+        usage(stderr);
+        exit(1);
+    }
+    if (!keys)
+        for (i = 0 ; i < sizeof(benchmark_keys)/sizeof(*benchmark_keys) ; i++)
+            keys=g_list_append(keys, g_strdup(benchmark_keys[i]));
+    names=filename ? benchmark_names_read(filename) : benchmark_names_generate(count, seed);
+    if (!names)
+        exit(1);
+    if (!names->count) {
+        fprintf(stderr, "No names given\n");
+        exit(1);
+    }
+
+    results=g_new(int, names->count*2);
+    printf("mode\tkey\trun\tnames\tmatches\tdifferences\tcompare_ns\tallocating_ns\n");
+    for (i = 0 ; i < sizeof(benchmark_modes)/sizeof(*benchmark_modes) ; i++) {
+        for (p = keys ; p ; p = g_list_next(p)) {
+            for (run = 0 ; run < repeat ; run++)
+                differences+=benchmark_run(names, &benchmark_modes[i], p->data, run, results);
+        }
+    }
+
+    g_free(results);
+    for (i = 0 ; i < names->count ; i++)
+        g_free(names->names[i]);
+    g_free(names->names);
+    g_free(names);
+    for (p = keys ; p ; p = g_list_next(p))
+        g_free(p->data);
+    g_list_free(keys);
+    linguistics_free();
+    return differences ? 1 : 0;
+}
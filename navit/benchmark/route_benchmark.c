@@ -0,0 +1,970 @@
+/**
+ * Navit, a modular navigation system.
+ * Copyright (C) 2005-2019 Navit Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public License
+ * version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+/**
+ * @file route_benchmark.c
+ *
+ * @brief Measures how long it takes to build and flood route graphs
+ *
+ * For each vehicle profile and each pair of route points, the route graph between the two points is built from the
+ * maps given on the command line, then flooded from the destination until the start is reached, the same way
+ * `struct route` does it. The size of the graph, the time taken by each step, the heap operations and the peak
+ * memory use of the process are printed, one line per run.
+ *
+ * Instead of real maps, a synthetic map can be used: a square grid of streets, with a major street on every 8th line.
+ * This makes results comparable between machines and independent of the map data at hand. The major streets carry
+ * a speed limit, and some of them are segmented or carry a dangerous goods restriction, so that route graph segments
+ * of every size are built.
+ *
+ * After each run, every point and segment of the route graph, and every pointer between them, is checked for 8 byte
+ * alignment. Misaligned pointers are reported and make the benchmark exit with an error.
+ *
+ * No navit object, graphics or event loop is created; everything runs synchronously in the main thread.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+#include <glib.h>
+#include "config.h"
+#include "debug.h"
+#include "atom.h"
+#include "main.h"
+#include "file.h"
+#include "item.h"
+#include "attr.h"
+#include "coord.h"
+#include "projection.h"
+#include "map.h"
+#include "mapset.h"
+#include "plugin.h"
+#include "linguistics.h"
+#include "geom.h"
+#include "route.h"
+#include "route_protected.h"
+#include "route_heap.h"
+#include "route_cache.h"
+#include "xmlconfig.h"
+#include "vehicleprofile.h"
+#include "roadprofile.h"
+
+#ifndef USE_PLUGINS
+extern void builtin_init(void);
+#endif /* USE_PLUGINS*/
+
+/** Distance between neighbouring points of the synthetic grid, in map units */
+#define GRID_SPACING 100
+
+/** Every this many lines of the synthetic grid is a major street */
+#define GRID_MAJOR 8
+
+/** Lowest order at which the minor streets of the synthetic grid are returned */
+#define GRID_MINOR_ORDER 12
+
+/** Speed limit of the major streets of the synthetic grid, the same as their speed in the car profile */
+#define GRID_MAJOR_MAXSPEED 50
+
+/** Whether a pointer is not aligned to 8 bytes */
+#define BENCHMARK_MISALIGNED(ptr) (((size_t)(ptr) & 7) != 0)
+
+/**
+ * @brief A vehicle profile built into the benchmark
+ *
+ * The values are those of the shipped navit.xml. Attributes are given as space-separated `name=value` pairs.
+ */
+struct benchmark_profile {
+    char *name;                      /**< Name of the vehicle profile */
+    char *attrs;                     /**< Other attributes of the vehicle profile */
+    char *roadprofiles[16];          /**< Attributes of each road profile, NULL-terminated */
+};
+
+static struct benchmark_profile benchmark_profiles[] = {
+    {
+        "car", "route_depth=4:25%:4,8:40000:2,18:10000 flags=0x4000000 flags_forward_mask=0x4040002 "
+        "flags_reverse_mask=0x4040001 maxspeed_handling=0 route_mode=0", {
+            "item_types=street_0,street_1_city,living_street,street_service,track_gravelled,track_unpaved,"
+            "street_parking_lane speed=10 route_weight=10",
+            "item_types=street_2_city,track_paved speed=30 route_weight=30",
+            "item_types=street_3_city speed=40 route_weight=40",
+            "item_types=street_4_city speed=50 route_weight=50",
+            "item_types=highway_city speed=80 route_weight=80",
+            "item_types=street_1_land speed=60 route_weight=60",
+            "item_types=street_2_land speed=65 route_weight=65",
+            "item_types=street_3_land speed=70 route_weight=70",
+            "item_types=street_4_land speed=80 route_weight=80",
+            "item_types=street_n_lanes speed=120 route_weight=120",
+            "item_types=highway_land speed=120 route_weight=120",
+            "item_types=ramp speed=40 route_weight=40",
+            "item_types=roundabout speed=10 route_weight=10",
+            "item_types=ferry speed=40 route_weight=40",
+            NULL
+        }
+    },
+    {
+        "car_shortest", "flags=0x4000000 flags_forward_mask=0x4000002 flags_reverse_mask=0x4000001 "
+        "maxspeed_handling=0 route_mode=0", {
+            "item_types=street_0,street_1_city,living_street,street_service,track_gravelled,track_unpaved,"
+            "street_parking_lane speed=10 route_weight=60",
+            "item_types=street_2_city,track_paved speed=30 route_weight=60",
+            "item_types=street_3_city speed=40 route_weight=60",
+            "item_types=street_4_city speed=50 route_weight=60",
+            "item_types=highway_city speed=80 route_weight=60",
+            "item_types=street_1_land speed=60 route_weight=60",
+            "item_types=street_2_land speed=65 route_weight=60",
+            "item_types=street_3_land speed=70 route_weight=60",
+            "item_types=street_4_land speed=80 route_weight=60",
+            "item_types=street_n_lanes speed=120 route_weight=60",
+            "item_types=highway_land speed=120 route_weight=60",
+            "item_types=ramp speed=40 route_weight=60",
+            "item_types=roundabout speed=10 route_weight=60",
+            "item_types=ferry speed=40 route_weight=60",
+            NULL
+        }
+    },
+    {
+        "bike", "route_depth=18:25%,18:40000 flags=0x40000000 flags_forward_mask=0x40000002 "
+        "flags_reverse_mask=0x40000001 maxspeed_handling=1 route_mode=0", {
+            "item_types=track_paved,cycleway speed=20 route_weight=20",
+            "item_types=street_0,street_1_city,street_1_land,living_street speed=20 route_weight=20",
+            "item_types=street_pedestrian,footway speed=17 route_weight=17",
+            "item_types=street_service,street_parking_lane speed=17 route_weight=15",
+            "item_types=street_2_city,street_2_land speed=20 route_weight=15",
+            "item_types=street_3_city,street_3_land speed=20 route_weight=15",
+            "item_types=street_4_land,street_4_city speed=20 route_weight=12",
+            "item_types=street_n_lanes,ramp speed=20 route_weight=10",
+            "item_types=path,track_ground speed=7 route_weight=7",
+            "item_types=track_gravelled speed=17 route_weight=12",
+            "item_types=steps speed=2 route_weight=2",
+            "item_types=roundabout speed=20 route_weight=10",
+            "item_types=ferry speed=40 route_weight=40",
+            NULL
+        }
+    },
+    {
+        "pedestrian", "route_depth=18:25%,18:10000 flags=0x80000000 flags_forward_mask=0x80000000 "
+        "flags_reverse_mask=0x80000000 maxspeed_handling=1 route_mode=0", {
+            "item_types=footway,bridleway,path,steps speed=5 route_weight=5",
+            "item_types=hiking_mountain speed=4 route_weight=4",
+            "item_types=living_street,street_pedestrian speed=5 route_weight=5",
+            "item_types=track_gravelled,track_unpaved,track_grass,track_ground,hiking speed=5 route_weight=5",
+            "item_types=track_paved speed=5 route_weight=5",
+            "item_types=cycleway speed=5 route_weight=5",
+            "item_types=street_0,street_1_city,street_2_city speed=5 route_weight=5",
+            "item_types=street_3_city,street_4_city,street_service,street_parking_lane speed=5 route_weight=5",
+            "item_types=street_1_land,street_2_land speed=5 route_weight=5",
+            "item_types=street_3_land,street_4_land speed=5 route_weight=5",
+            "item_types=roundabout speed=5 route_weight=5",
+            "item_types=ferry speed=40 route_weight=40",
+            NULL
+        }
+    },
+};
+
+/**
+ * @brief A pair of route points
+ */
+struct benchmark_pair {
+    struct pcoord from;              /**< The start of the route */
+    struct pcoord to;                /**< The destination */
+};
+
+/**
+ * @brief The synthetic grid map
+ */
+struct map_priv {
+    int size;                        /**< Number of points along each side of the grid */
+};
+
+struct map_rect_priv {
+    struct map_priv *m;
+    struct map_selection *sel;
+    struct item item;
+    int next;                        /**< Index of the next segment to check */
+    int count;                       /**< Number of segments in the grid */
+    struct coord c[2];               /**< Coordinates of the current segment */
+    int pos;                         /**< Position of the next coordinate to return */
+    int flags;                       /**< Flags of the current segment, 0 if it has no attributes */
+    int attrs_read;                  /**< Attributes returned since the last rewind, one bit per attribute */
+};
+
+static void grid_coord_rewind(void *priv_data) {
+    struct map_rect_priv *mr=priv_data;
+    mr->pos=0;
+}
+
+static int grid_coord_get(void *priv_data, struct coord *c, int count) {
+    struct map_rect_priv *mr=priv_data;
+    int ret=0;
+
+    while (count-- > 0 && mr->pos < 2)
+        c[ret++]=mr->c[mr->pos++];
+    return ret;
+}
+
+static void grid_attr_rewind(void *priv_data) {
+    struct map_rect_priv *mr=priv_data;
+    mr->attrs_read=0;
+}
+
+static int grid_attr_get(void *priv_data, enum attr_type attr_type, struct attr *attr) {
+    struct map_rect_priv *mr=priv_data;
+    int bit;
+
+    if (!mr->flags)
+        return 0;
+    switch (attr_type) {
+    case attr_flags:
+        bit=1;
+        attr->u.num=mr->flags;
+        break;
+    case attr_maxspeed:
+        bit=2;
+        attr->u.num=GRID_MAJOR_MAXSPEED;
+        break;
+    case attr_vehicle_dangerous_goods:
+        if (!(mr->flags & AF_DANGEROUS_GOODS))
+            return 0;
+        bit=4;
+        attr->u.num=1;
+        break;
+    default:
+        return 0;
+    }
+    if (mr->attrs_read & bit)
+        return 0;
+    mr->attrs_read|=bit;
+    attr->type=attr_type;
+    return 1;
+}
+
+static struct item_methods grid_item_methods = {
+    grid_coord_rewind,
+    grid_coord_get,
+    grid_attr_rewind,
+    grid_attr_get,
+};
+
+/**
+ * @brief Computes the segment with the given index
+ *
+ * Horizontal segments come first, row by row, then vertical segments, column by column.
+ */
+static void grid_segment(struct map_rect_priv *mr, int id) {
+    int size=mr->m->size,line,pos,i=id;
+
+    if (i < size*(size-1)) {
+        line=i/(size-1);
+        pos=i%(size-1);
+        mr->c[0].x=pos*GRID_SPACING;
+        mr->c[0].y=line*GRID_SPACING;
+        mr->c[1].x=mr->c[0].x+GRID_SPACING;
+        mr->c[1].y=mr->c[0].y;
+    } else {
+        i-=size*(size-1);
+        line=i/(size-1);
+        pos=i%(size-1);
+        mr->c[0].x=line*GRID_SPACING;
+        mr->c[0].y=pos*GRID_SPACING;
+        mr->c[1].x=mr->c[0].x;
+        mr->c[1].y=mr->c[0].y+GRID_SPACING;
+    }
+    mr->item.type=(line % GRID_MAJOR) ? type_street_1_city : type_street_4_city;
+    mr->item.id_hi=0;
+    mr->item.id_lo=id;
+    mr->pos=0;
+    mr->flags=0;
+    mr->attrs_read=0;
+    if (!(line % GRID_MAJOR)) {
+        mr->flags=*item_get_default_flags(mr->item.type) | AF_SPEED_LIMIT;
+        if ((line / GRID_MAJOR) % 3 > 0)
+            mr->flags|=AF_SEGMENTED;
+        if ((line / GRID_MAJOR) % 3 > 1)
+            mr->flags|=AF_DANGEROUS_GOODS;
+    }
+}
+
+static int grid_segment_selected(struct map_rect_priv *mr) {
+    struct map_selection *sel=mr->sel;
+    struct coord_rect r;
+
+    if (!sel)
+        return 1;
+    r.lu.x=mr->c[0].x;
+    r.lu.y=mr->c[1].y;
+    r.rl.x=mr->c[1].x;
+    r.rl.y=mr->c[0].y;
+    while (sel) {
+        if (mr->item.type >= sel->range.min && mr->item.type <= sel->range.max
+                && (mr->item.type == type_street_4_city || sel->order >= GRID_MINOR_ORDER)
+                && coord_rect_overlap(&sel->u.c_rect, &r))
+            return 1;
+        sel=sel->next;
+    }
+    return 0;
+}
+
+static void grid_destroy(struct map_priv *m) {
+    g_free(m);
+}
+
+static struct map_rect_priv *grid_rect_new(struct map_priv *m, struct map_selection *sel) {
+    struct map_rect_priv *mr=g_new0(struct map_rect_priv, 1);
+
+    mr->m=m;
+    mr->sel=sel;
+    mr->count=2*m->size*(m->size-1);
+    mr->item.meth=&grid_item_methods;
+    mr->item.priv_data=mr;
+    return mr;
+}
+
+static void grid_rect_destroy(struct map_rect_priv *mr) {
+    g_free(mr);
+}
+
+static struct item *grid_rect_get_item(struct map_rect_priv *mr) {
+    while (mr->next < mr->count) {
+        grid_segment(mr, mr->next++);
+        if (grid_segment_selected(mr))
+            return &mr->item;
+    }
+    return NULL;
+}
+
+static struct item *grid_rect_get_item_byid(struct map_rect_priv *mr, int id_hi, int id_lo) {
+    if (id_hi || id_lo < 0 || id_lo >= mr->count)
+        return NULL;
+    grid_segment(mr, id_lo);
+    return &mr->item;
+}
+
+static struct map_methods grid_map_methods = {
+    projection_mg,
+    "utf-8",
+    grid_destroy,
+    grid_rect_new,
+    grid_rect_destroy,
+    grid_rect_get_item,
+    grid_rect_get_item_byid,
+};
+
+static struct map_priv *grid_new(struct map_methods *meth, struct attr **attrs, struct callback_list *cbl) {
+    struct map_priv *m;
+    struct attr *width=attr_search(attrs, attr_width);
+
+    if (!width || width->u.num < 2)
+        return NULL;
+    *meth=grid_map_methods;
+    m=g_new0(struct map_priv, 1);
+    m->size=width->u.num;
+    return m;
+}
+
+/**
+ * @brief Adds attributes given as text to an attribute list
+ *
+ * @param attrs The attribute list, can be NULL
+ * @param text Space-separated `name=value` pairs
+ * @return The new attribute list, NULL if `text` is invalid
+ */
+static struct attr **benchmark_attrs_add(struct attr **attrs, const char *text) {
+    char **words=g_strsplit(text, " ", -1);
+    char *value;
+    struct attr *attr;
+    int i;
+
+    for (i = 0 ; words[i] ; i++) {
+        value=strchr(words[i], '=');
+        if (!value) {
+            fprintf(stderr, "Expected name=value instead of '%s'\n", words[i]);
+            break;
+        }
+        *value++='\0';
+        attr=attr_new_from_text(words[i], value);
+        if (!attr || attr->type == attr_none) {
+            fprintf(stderr, "Unknown attribute '%s'\n", words[i]);
+            attr_free(attr);
+            break;
+        }
+        attrs=attr_generic_add_attr(attrs, attr);
+        attr_free(attr);
+    }
+    if (words[i]) {
+        attr_list_free(attrs);
+        attrs=NULL;
+    }
+    g_strfreev(words);
+    return attrs;
+}
+
+/**
+ * @brief Creates one of the built-in vehicle profiles
+ *
+ * @param name The name of the profile
+ * @param extra Additional vehicle profile attributes, as for `benchmark_attrs_add()`, can be NULL
+ * @return The vehicle profile, NULL if there is no such profile or `extra` is invalid
+ */
+static struct vehicleprofile *benchmark_profile_new(const char *name, const char *extra) {
+    struct benchmark_profile *bp=NULL;
+    struct vehicleprofile *ret;
+    struct roadprofile *rp;
+    struct attr **attrs,**extra_attrs=NULL,**attr,profile_name,roadprofile;
+    int i;
+
+    for (i = 0 ; i < sizeof(benchmark_profiles)/sizeof(*benchmark_profiles) ; i++)
+        if (!strcmp(benchmark_profiles[i].name, name))
+            bp=&benchmark_profiles[i];
+    if (!bp) {
+        fprintf(stderr, "Unknown vehicle profile '%s'\n", name);
+        return NULL;
+    }
+    if (extra && !(extra_attrs=benchmark_attrs_add(NULL, extra)))
+        return NULL;
+    profile_name.type=attr_name;
+    profile_name.u.str=bp->name;
+    attrs=attr_generic_add_attr(benchmark_attrs_add(NULL, bp->attrs), &profile_name);
+    ret=vehicleprofile_new(NULL, attrs);
+    attr_list_free(attrs);
+    roadprofile.type=attr_roadprofile;
+    for (i = 0 ; bp->roadprofiles[i] ; i++) {
+        attrs=benchmark_attrs_add(NULL, bp->roadprofiles[i]);
+        rp=roadprofile_new(NULL, attrs);
+        attr_list_free(attrs);
+        roadprofile.u.navit_object=(struct navit_object *)rp;
+        vehicleprofile_add_attr(ret, &roadprofile);
+    }
+    for (attr = extra_attrs ; attr && *attr ; attr++)
+        vehicleprofile_set_attr(ret, *attr);
+    attr_list_free(extra_attrs);
+    return ret;
+}
+
+/**
+ * @brief Parses a pair of route points
+ *
+ * @param text The two points, separated by a comma, each in any format understood by `coord_parse()`
+ * @param pair Receives the points
+ * @return True on success, false if `text` is invalid
+ */
+static int benchmark_pair_parse(const char *text, struct benchmark_pair *pair) {
+    char *to=strchr(text, ',');
+    char *from;
+    int ret;
+
+    if (!to)
+        return 0;
+    from=g_strndup(text, to-text);
+    ret=pcoord_parse(from, projection_mg, &pair->from) && pcoord_parse(to+1, projection_mg, &pair->to);
+    g_free(from);
+    return ret;
+}
+
+static GList *benchmark_pairs_read(GList *pairs, const char *filename) {
+    FILE *f=fopen(filename, "r");
+    char line[1024];
+    struct benchmark_pair *pair;
+
+    if (!f) {
+        fprintf(stderr, "Could not open '%s'\n", filename);
+        exit(1);
+    }
+    while (fgets(line, sizeof(line), f)) {
+        g_strstrip(line);
+        if (!line[0] || line[0] == '#')
+            continue;
+        pair=g_new(struct benchmark_pair, 1);
+        if (!benchmark_pair_parse(line, pair)) {
+            fprintf(stderr, "Invalid pair '%s' in '%s'\n", line, filename);
+            exit(1);
+        }
+        pairs=g_list_append(pairs, pair);
+    }
+    fclose(f);
+    return pairs;
+}
+
+static GList *benchmark_grid_pair_add(GList *pairs, int x1, int y1, int x2, int y2) {
+    struct benchmark_pair *pair=g_new(struct benchmark_pair, 1);
+
+    pair->from.pro=projection_mg;
+    pair->from.x=x1*GRID_SPACING;
+    pair->from.y=y1*GRID_SPACING;
+    pair->to.pro=projection_mg;
+    pair->to.x=x2*GRID_SPACING;
+    pair->to.y=y2*GRID_SPACING;
+    return g_list_append(pairs, pair);
+}
+
+static double benchmark_now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec*1000.0+ts.tv_nsec/1000000.0;
+}
+
+/**
+ * @brief Returns the peak resident set size of the process in kB, 0 if unknown
+ */
+static long benchmark_max_rss(void) {
+#ifndef _WIN32
+    struct rusage usage;
+
+    if (!getrusage(RUSAGE_SELF, &usage))
+        return usage.ru_maxrss;
+#endif
+    return 0;
+}
+
+/**
+ * @brief Checks that every point and segment of a route graph, and every pointer between them, is aligned to 8 bytes
+ *
+ * @return The number of misaligned pointers
+ */
+static int benchmark_check_alignment(struct route_graph *graph) {
+    struct route_graph_point *p=NULL;
+    struct route_graph_segment *s=NULL;
+    struct route_graph_point_iterator it;
+    int ret=0;
+
+    while ((p=route_graph_next_point(graph, p))) {
+        ret+=BENCHMARK_MISALIGNED(p)+BENCHMARK_MISALIGNED(p->links)+BENCHMARK_MISALIGNED(p->seg)
+             +BENCHMARK_MISALIGNED(p->dst_seg);
+        it=rp_iterator_new(graph, p);
+        while ((s=rp_iterator_next(&it)))
+            ret+=BENCHMARK_MISALIGNED(s);
+    }
+    while ((s=route_graph_next_segment(graph, s)))
+        ret+=BENCHMARK_MISALIGNED(s)+BENCHMARK_MISALIGNED(s->start)+BENCHMARK_MISALIGNED(s->end);
+    return ret;
+}
+
+/**
+ * @brief Builds and floods the route graph for one pair of route points and prints the results
+ *
+ * @return The number of misaligned pointers in the route graph
+ */
+static int benchmark_run(struct mapset *ms, struct vehicleprofile *profile, struct benchmark_pair *pair,
+                          int index, int run, int threads, struct route_cache *cache) {
+    struct attr name;
+    struct route_info *pos,*dst;
+    struct route_graph *graph;
+    struct route_graph_segment *s;
+    struct route_heap_stats stats;
+    struct route_cache_stats before,after;
+    struct coord c[2];
+    double start,located,built,flooded;
+    int segments=0,misaligned;
+
+    vehicleprofile_get_attr(profile, attr_name, &name, NULL);
+    start=benchmark_now();
+    pos=route_find_nearest_street(profile, ms, &pair->from);
+    dst=route_find_nearest_street(profile, ms, &pair->to);
+    located=benchmark_now();
+    if (!pos || !dst) {
+        printf("%s\t%d\t%d\tno street found near the %s\n", name.u.str, index, run, pos ? "destination" : "start");
+        route_info_free(pos);
+        route_info_free(dst);
+        return 0;
+    }
+    c[0].x=pair->from.x;
+    c[0].y=pair->from.y;
+    c[1].x=pair->to.x;
+    c[1].y=pair->to.y;
+    memset(&before, 0, sizeof(before));
+    memset(&after, 0, sizeof(after));
+    if (cache)
+        route_cache_get_stats(cache, &before);
+    graph=route_graph_build(ms, route_calc_selection(c, 2, profile, 0), 0, NULL, 0, profile, threads, cache);
+    while (graph->busy)
+        route_graph_build_idle(graph, profile);
+    built=benchmark_now();
+    if (cache)
+        route_cache_get_stats(cache, &after);
+    route_graph_set_focus(graph, profile, pos);
+    route_graph_init(graph, dst, profile);
+    route_graph_compute_shortest_path(graph, profile, NULL);
+    flooded=benchmark_now();
+    s=NULL;
+    while ((s=route_graph_next_segment(graph, s)))
+        segments++;
+    route_heap_get_stats(graph->heap, &stats);
+    printf("%s\t%d\t%d\t%d\t%d\t%.1f\t%.1f\t%.1f\t%d\t%d\t%d\t%d\t%d\t%d\t%ld\t%d\t%d\n", name.u.str, index,
+           run, graph->num_points, segments, located-start, built-located, flooded-built, graph->expanded,
+           stats.inserts, stats.updates, stats.removes, stats.extracts, stats.max_size, benchmark_max_rss(),
+           after.hits-before.hits, after.misses-before.misses);
+    fflush(stdout);
+    misaligned=benchmark_check_alignment(graph);
+    if (misaligned)
+        fprintf(stderr, "%d misaligned pointers in the route graph\n", misaligned);
+    route_graph_destroy(graph);
+    route_info_free(pos);
+    route_info_free(dst);
+    return misaligned;
+}
+
+/** Attributes read by the batch check, the ones the route graph reads in batches */
+static enum attr_type benchmark_batch_attrs[] = {attr_flags, attr_maxspeed, attr_delay, attr_vehicle_width, attr_none};
+
+/**
+ * @brief Returns the next item of a map rect, waiting while the map is busy
+ */
+static struct item *benchmark_next_item(struct map_rect *mr) {
+    struct item *item;
+
+    while ((item=map_rect_get_item(mr)) == &busy_item);
+    return item;
+}
+
+/**
+ * @brief Returns the next batch of a map rect, waiting while the map is busy
+ */
+static int benchmark_next_batch(struct map_rect *mr, struct map_batch *batch) {
+    int count;
+
+    while ((count=map_rect_get_batch(mr, batch)) < 0);
+    return count;
+}
+
+/**
+ * @brief Compares an item of a batch with the same item read through the item methods
+ *
+ * @return The number of differences
+ */
+static int benchmark_batch_compare(struct map_batch *batch, struct map_batch_item *bi, struct item *item) {
+    struct coord c;
+    struct attr attr;
+    int i,j,k,ret=0;
+
+    if (bi->type != item->type || bi->id_hi != item->id_hi || bi->id_lo != item->id_lo)
+        return 1;
+    item_coord_rewind(item);
+    for (i = 0 ; i < bi->coord_count ; i++) {
+        if (item_coord_get(item, &c, 1) != 1 || c.x != batch->coords[bi->coord_start+i].x
+                || c.y != batch->coords[bi->coord_start+i].y)
+            ret++;
+    }
+    if (item_coord_get(item, &c, 1))
+        ret++;
+    for (i = 0 ; benchmark_batch_attrs[i] != attr_none ; i++) {
+        item_attr_rewind(item);
+        k=bi->attr_start;
+        while (item_attr_get(item, benchmark_batch_attrs[i], &attr)) {
+            for (j = k ; j < bi->attr_start+bi->attr_count && batch->attrs[j].type != attr.type ; j++);
+            if (j == bi->attr_start+bi->attr_count || batch->attrs[j].num != attr.u.num)
+                ret++;
+            k=j+1;
+        }
+        for (j = k ; j < bi->attr_start+bi->attr_count ; j++)
+            if (batch->attrs[j].type == benchmark_batch_attrs[i])
+                ret++;
+    }
+    return ret;
+}
+
+/**
+ * @brief Reads the route selection of one pair of route points from every map, item by item and in batches
+ *
+ * Both ways must return the same items with the same coordinates and attributes. One line per map is printed with
+ * the items, coordinates and attributes read, the time each way took and the number of differences.
+ *
+ * @return The number of differences
+ */
+static int benchmark_batch_run(struct mapset *ms, struct vehicleprofile *profile, struct benchmark_pair *pair,
+                               int index, int run) {
+    struct attr name,attr;
+    struct mapset_handle *h;
+    struct map_selection *sel;
+    struct map *m;
+    struct map_rect *mr,*mr_items;
+    struct map_batch *batch;
+    struct item *item;
+    struct coord c[2];
+    double start,by_item,by_batch;
+    int i,count,items,coords,attrs,differences,ret=0,map_index=0;
+
+    vehicleprofile_get_attr(profile, attr_name, &name, NULL);
+    c[0].x=pair->from.x;
+    c[0].y=pair->from.y;
+    c[1].x=pair->to.x;
+    c[1].y=pair->to.y;
+    sel=route_calc_selection(c, 2, profile, 0);
+    batch=map_batch_new(benchmark_batch_attrs, 256);
+    h=mapset_open(ms);
+    while ((m=mapset_next(h, 2))) {
+        items=coords=attrs=differences=0;
+        start=benchmark_now();
+        mr=map_rect_new(m, sel);
+        while ((item=benchmark_next_item(mr))) {
+            while (item_coord_get(item, c, 2))
+                coords++;
+            for (i = 0 ; benchmark_batch_attrs[i] != attr_none ; i++) {
+                item_attr_rewind(item);
+                while (item_attr_get(item, benchmark_batch_attrs[i], &attr))
+                    attrs++;
+            }
+        }
+        map_rect_destroy(mr);
+        by_item=benchmark_now();
+        mr=map_rect_new(m, sel);
+        while ((count=benchmark_next_batch(mr, batch)))
+            items+=count;
+        map_rect_destroy(mr);
+        by_batch=benchmark_now();
+        mr=map_rect_new(m, sel);
+        mr_items=map_rect_new(m, sel);
+        while ((count=benchmark_next_batch(mr, batch))) {
+            for (i = 0 ; i < count ; i++) {
+                item=benchmark_next_item(mr_items);
+                differences+=item ? benchmark_batch_compare(batch, &batch->items[i], item) : 1;
+            }
+        }
+        if (benchmark_next_item(mr_items))
+            differences++;
+        map_rect_destroy(mr_items);
+        map_rect_destroy(mr);
+        printf("%s\t%d\t%d\t%d\t%d\t%d\t%d\t%.1f\t%.1f\t%d\n", name.u.str, index, run, map_index, items,
+               coords, attrs, by_item-start, by_batch-by_item, differences);
+        ret+=differences;
+        map_index++;
+    }
+    mapset_close(h);
+    map_batch_destroy(batch);
+    map_selection_destroy(sel);
+    fflush(stdout);
+    return ret;
+}
+
+static void usage(FILE *f) {
+    fprintf(f,"route_benchmark - measure building and flooding of route graphs\n\n");
+    fprintf(f,"Usage:\n");
+    fprintf(f,"route_benchmark [options]\n");
+    fprintf(f,"Options:\n");
+    fprintf(f,"-a name=value     : set an attribute of every vehicle profile, e.g. route_heuristic=0\n");
+    fprintf(f,"-b                : check reading in batches against reading item by item instead of routing\n");
+    fprintf(f,"-C size           : keep the items read from the maps in a route cache of size bytes (default 0, no cache)\n");
+    fprintf(f,"-d level          : set the debug level\n");
+    fprintf(f,"-f file           : read pairs of route points from file, one pair per line\n");
+    fprintf(f,"-g size           : use a synthetic grid map of size x size points\n");
+    fprintf(f,"-h                : this screen\n");
+    fprintf(f,"-m file           : use a binfile map, can be given more than once\n");
+    fprintf(f,"-n count          : repeat each run count times (default 1)\n");
+    fprintf(f,"-p profile        : use a vehicle profile, can be given more than once (default car)\n");
+    fprintf(f,"                    available: car, car_shortest, bike, pedestrian\n");
+#ifdef USE_PLUGINS
+    fprintf(f,"-P path           : load plugins from path (default $NAVIT_LIBDIR/*/${NAVIT_LIBPREFIX}lib*.so)\n");
+#endif
+    fprintf(f,"-r from,to        : route from one point to another, can be given more than once\n");
+    fprintf(f,"                    points are given as for the navit command line, e.g. \"11.57 48.14\"\n");
+    fprintf(f,"-t threads        : number of threads to read maps with (0 for one per CPU, default 1)\n");
+    fprintf(f,"\nWith a grid map and no route points, some default pairs across the grid are used.\n");
+    fprintf(f,"Output columns: profile, pair, run, points, segments, locate ms, build ms, flood ms, expanded,\n");
+    fprintf(f,"heap inserts, updates, removes, extracts, max size, peak RSS in kB, route cache hits, misses\n");
+    fprintf(f,"Output columns with -b: profile, pair, run, map, items, coords, attrs, item ms, batch ms, differences\n");
+}
+
+int main(int argc, char **argv) {
+    GList *maps=NULL,*profile_names=NULL,*pairs=NULL,*profiles=NULL,*p,*q;
+    char *extra=NULL,*s;
+    int opt,grid=0,repeat=1,threads=1,batch=0,differences=0,index,run;
+    long cache_size=0;
+    struct route_cache *cache=NULL;
+    struct mapset *ms;
+    struct map *m;
+    struct attr map_attr,type,data,width,thread_safe,*attrs[4];
+    struct benchmark_pair *pair;
+    struct vehicleprofile *profile;
+#ifdef USE_PLUGINS
+    char *plugin_path="$NAVIT_LIBDIR/*/${NAVIT_LIBPREFIX}lib*.so";
+    struct plugins *plugins;
+    struct attr plugins_attr,path,ondemand;
+#endif
+
+    atom_init();
+    main_init(argv[0]);
+    debug_init(argv[0]);
+    file_init();
+#ifndef USE_PLUGINS
+    builtin_init();
+#endif
+    route_init();
+    linguistics_init();
+    geom_init();
+    plugin_register_category_map("benchmark_grid", grid_new);
+
+    while ((opt=getopt(argc, argv, "a:bC:d:f:g:hm:n:p:P:r:t:")) != -1) {
+        switch (opt) {
+        case 'a':
+            s=extra;
+            extra=s ? g_strconcat(s, " ", optarg, NULL) : g_strdup(optarg);
+            g_free(s);
+            break;
+        case 'b':
+            batch=1;
+            break;
+        case 'C':
+            cache_size=atol(optarg);
+            break;
+        case 'd':
+            debug_set_global_level(atoi(optarg), 1);
+            break;
+        case 'f':
+            pairs=benchmark_pairs_read(pairs, optarg);
+            break;
+        case 'g':
+            grid=atoi(optarg);
+            break;
+        case 'h':
+            usage(stdout);
+            exit(0);
+        case 'm':
+            maps=g_list_append(maps, optarg);
+            break;
+        case 'n':
+            repeat=atoi(optarg);
+            break;
+        case 'p':
+            profile_names=g_list_append(profile_names, optarg);
+            break;
+#ifdef USE_PLUGINS
+        case 'P':
+            plugin_path=optarg;
+            break;
+#endif
+        case 'r':
+            pair=g_new(struct benchmark_pair, 1);
+            if (!benchmark_pair_parse(optarg, pair)) {
+                fprintf(stderr, "Invalid pair '%s'\n", optarg);
+                exit(1);
+            }
+            pairs=g_list_append(pairs, pair);
+            break;
+        case 't':
+            threads=atoi(optarg);
+            break;
+        default:
+            usage(stderr);
+            exit(1);
+        }
+    }
+    if (optind < argc || (!maps && grid < 2)) {
+        usage(stderr);
+        exit(1);
+    }
+
+#ifdef USE_PLUGINS
+    plugins=plugins_new(NULL, NULL);
+    plugins_attr.type=attr_plugins;
+    plugins_attr.u.plugins=plugins;
+    path.type=attr_path;
+    path.u.str=plugin_path;
+    ondemand.type=attr_ondemand;
+    ondemand.u.num=1;
+    attrs[0]=&path;
+    attrs[1]=&ondemand;
+    attrs[2]=NULL;
+    plugin_new(&plugins_attr, attrs);
+    plugins_init(plugins);
+#endif
+
+    ms=mapset_new(NULL, NULL);
+    map_attr.type=attr_map;
+    type.type=attr_type;
+    attrs[0]=&type;
+    attrs[1]=NULL;
+    attrs[2]=NULL;
+    if (grid >= 2) {
+        type.u.str="benchmark_grid";
+        width.type=attr_width;
+        width.u.num=grid;
+        attrs[1]=&width;
+        thread_safe.type=attr_thread_safe;
+        thread_safe.u.num=1;
+        attrs[2]=&thread_safe;
+        attrs[3]=NULL;
+        map_attr.u.map=map_new(NULL, attrs);
+        attrs[2]=NULL;
+        mapset_add_attr(ms, &map_attr);
+        if (!pairs) {
+            pairs=benchmark_grid_pair_add(pairs, grid/2, grid/2, grid/2+grid/8, grid/2+grid/8);
+            pairs=benchmark_grid_pair_add(pairs, grid/4, grid/4, grid-1-grid/4, grid-1-grid/4);
+            pairs=benchmark_grid_pair_add(pairs, 0, 0, grid-1, grid-1);
+        }
+    }
+    for (p = maps ; p ; p = g_list_next(p)) {
+        type.u.str="binfile";
+        data.type=attr_data;
+        data.u.str=p->data;
+        attrs[1]=&data;
+        m=map_new(NULL, attrs);
+        if (!m) {
+            fprintf(stderr, "Could not open map '%s'\n", (char *)p->data);
+            exit(1);
+        }
+        map_attr.u.map=m;
+        mapset_add_attr(ms, &map_attr);
+    }
+    if (!pairs) {
+        fprintf(stderr, "No route points given\n");
+        exit(1);
+    }
+
+    if (!profile_names)
+        profile_names=g_list_append(profile_names, "car");
+    for (p = profile_names ; p ; p = g_list_next(p)) {
+        profile=benchmark_profile_new(p->data, extra);
+        if (!profile)
+            exit(1);
+        profiles=g_list_append(profiles, profile);
+    }
+
+    if (batch)
+        printf("profile\tpair\trun\tmap\titems\tcoords\tattrs\titem_ms\tbatch_ms\tdifferences\n");
+    else
+        printf("profile\tpair\trun\tpoints\tsegments\tlocate_ms\tbuild_ms\tflood_ms\texpanded\t"
+           "inserts\tupdates\tremoves\textracts\theap_max\tmax_rss_kb\tcache_hits\tcache_misses\n");
+    if (cache_size > 0) {
+        cache=mapset_get_route_cache(ms);
+        route_cache_set_size(cache, cache_size);
+    }
+    for (p = profiles ; p ; p = g_list_next(p)) {
+        for (q = pairs, index = 0 ; q ; q = g_list_next(q), index++) {
+            for (run = 0 ; run < repeat ; run++) {
+                if (batch)
+                    differences+=benchmark_batch_run(ms, p->data, q->data, index, run);
+                else
+                    differences+=benchmark_run(ms, p->data, q->data, index, run, threads, cache);
+            }
+        }
+    }
+
+    g_list_free(profiles);
+    for (p = pairs ; p ; p = g_list_next(p))
+        g_free(p->data);
+    g_list_free(pairs);
+    g_list_free(profile_names);
+    g_list_free(maps);
+    g_free(extra);
+    mapset_destroy(ms);
+    return differences ? 1 : 0;
+}
@@ -180,6 +180,17 @@ void *cache_entry_new(struct cache *cache, void *id, int size) {
     return &ret->id[cache->id_size];
 }
 
+/* Frees an entry from cache_entry_new() which has not been inserted into the cache */
+void cache_entry_free(struct cache *cache, void *data) {
+    struct cache_entry *entry=(struct cache_entry *)((char *)data-cache->entry_size);
+    g_slice_free1(entry->size, entry);
+}
+
+void *cache_entry_get_id(struct cache *cache, void *data) {
+    struct cache_entry *entry=(struct cache_entry *)((char *)data-cache->entry_size);
+    return entry->id;
+}
+
 void cache_entry_destroy(struct cache *cache, void *data) {
     struct cache_entry *entry=(struct cache_entry *)((char *)data-cache->entry_size);
     dbg(lvl_debug,"destroy 0x%x 0x%x 0x%x 0x%x 0x%x", entry->id[0], entry->id[1], entry->id[2], entry->id[3], entry->id[4]);
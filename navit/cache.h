@@ -4,6 +4,8 @@ struct cache;
 struct cache *cache_new(int id_size, int size);
 void cache_resize(struct cache *cache, int size);
 void *cache_entry_new(struct cache *cache, void *id, int size);
+void cache_entry_free(struct cache *cache, void *data);
+void *cache_entry_get_id(struct cache *cache, void *data);
 void cache_entry_destroy(struct cache *cache, void *data);
 void *cache_lookup(struct cache *cache, void *id);
 void cache_insert(struct cache *cache, void *data);
@@ -84,6 +84,8 @@ static int config_set_attr_int(struct config *this_, struct attr *attr) {
         return 1;
     case attr_cache_size:
         return file_set_cache_size(attr->u.num);
+    case attr_cache_spill_size:
+        return file_set_cache_spill_size(attr->u.num);
     default:
         return 0;
     }
@@ -128,6 +128,27 @@ void coord_rect_extend(struct coord_rect *r, struct coord *c) {
         r->lu.y=c->y;
 }
 
+/**
+ * @brief Returns the rectangle covered by a cell of a grid whose cells are 2^shift map units wide
+ *
+ * Cell (x, y) covers the coordinates which give x and y when shifted right by `shift`. Cell indices are negative west
+ * of the prime meridian and south of the equator, so they are multiplied rather than shifted left, and in long long,
+ * as the last corner of the outermost cell at shift 30 does not fit into an int before subtracting 1.
+ *
+ * @param r Receives the rectangle
+ * @param x Column of the cell
+ * @param y Row of the cell
+ * @param shift Binary logarithm of the cell size
+ */
+void coord_rect_from_grid(struct coord_rect *r, int x, int y, int shift) {
+    long long size=1LL << shift;
+
+    r->lu.x=x*size;
+    r->lu.y=(y+1)*size-1;
+    r->rl.x=(x+1)*size-1;
+    r->rl.y=y*size;
+}
+
 /**
  * Parses \c char \a *coord_input and writes back the coordinates to \c coord \a *result, using \c projection \a output_projection.
  * \a *coord_input may specify its projection at the beginning.
@@ -158,6 +158,7 @@ void coord_rect_destroy(struct coord_rect *r);
 int coord_rect_overlap(struct coord_rect *r1, struct coord_rect *r2);
 int coord_rect_contains(struct coord_rect *r, struct coord *c);
 void coord_rect_extend(struct coord_rect *r, struct coord *c);
+void coord_rect_from_grid(struct coord_rect *r, int x, int y, int shift);
 void coord_format_with_sep(float lat,float lng, enum coord_format fmt, char *buffer, int size, const char *sep);
 void coord_format(float lat,float lng, enum coord_format fmt, char *buffer, int size);
 void coord_geo_format_short(const struct coord_geo *gc, char *buffer, int size, char *sep);
@@ -181,6 +182,7 @@ void coord_rect_destroy(struct coord_rect *r);
 int coord_rect_overlap(struct coord_rect *r1, struct coord_rect *r2);
 int coord_rect_contains(struct coord_rect *r, struct coord *c);
 void coord_rect_extend(struct coord_rect *r, struct coord *c);
+void coord_rect_from_grid(struct coord_rect *r, int x, int y, int shift);
 int coord_parse(const char *c_str, enum projection pro, struct coord *c_ret);
 int pcoord_parse(const char *c_str, enum projection pro, struct pcoord *pc_ret);
 void coord_print(enum projection pro, struct coord *c, FILE *out);
@@ -43,12 +43,65 @@
 #include <sys/socket.h>
 #include <netdb.h>
 #endif
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
 
 #ifdef CACHE_SIZE
 static GHashTable *file_name_hash;
 #endif
 
-static struct cache *file_cache;
+/**
+ * @brief One part of the tile cache
+ *
+ * Entries are distributed over the shards by their ID, so that threads reading different tiles rarely wait for each
+ * other. Each shard gets an equal share of the total cache size, which is therefore also the largest tile the cache
+ * keeps: a tile larger than `CACHE_SIZE / FILE_CACHE_SHARDS` (or the `cache_size` attribute divided by
+ * `FILE_CACHE_SHARDS`) is evicted as soon as other tiles are inserted into its shard.
+ */
+struct file_cache_shard {
+    struct cache *cache;
+#ifdef HAVE_PTHREAD
+    pthread_mutex_t mutex;
+#endif
+};
+
+static struct file_cache_shard file_cache[FILE_CACHE_SHARDS];
+
+/**
+ * @brief A memory-mapped file holding uncompressed tiles which no longer fit into the tile cache
+ *
+ * The spill file is filled from start to end. When it is full, all entries are dropped and filling starts over.
+ */
+struct file_spill {
+    int fd;
+    unsigned char *begin;
+    long long size;
+    long long used;
+    GHashTable *index;          /**< Maps a `struct file_cache_id` to the `long long` offset of its data */
+};
+
+static struct file_spill *file_spill;
+
+#ifdef HAVE_PTHREAD
+/* Map rects may be read from several threads at once (see route_extract.c). Each cache shard has its own lock, which
+ * is held while an entry is looked up or filled; decompression happens outside of it. The statistics of a file are
+ * counted per shard, under the lock of the shard. `file_spill_mutex` protects the spill file and `file_io_mutex` the
+ * file position of non-mapped files where pread() is not available. */
+static pthread_mutex_t file_spill_mutex=PTHREAD_MUTEX_INITIALIZER;
+#ifndef HAVE_PREAD
+static pthread_mutex_t file_io_mutex=PTHREAD_MUTEX_INITIALIZER;
+#endif
+#define file_cache_lock(shard) pthread_mutex_lock(&(shard)->mutex)
+#define file_cache_unlock(shard) pthread_mutex_unlock(&(shard)->mutex)
+#define file_lock(name) pthread_mutex_lock(&file_##name##_mutex)
+#define file_unlock(name) pthread_mutex_unlock(&file_##name##_mutex)
+#else
+#define file_cache_lock(shard)
+#define file_cache_unlock(shard)
+#define file_lock(name)
+#define file_unlock(name)
+#endif
 
 #ifdef HAVE_PRAGMA_PACK
 #pragma pack(push)
@@ -66,6 +119,42 @@ struct file_cache_id {
 #pragma pack(pop)
 #endif
 
+static struct file_cache_shard *file_cache_get_shard(struct file_cache_id *id) {
+    unsigned int hash=(unsigned int)(id->offset ^ (id->offset >> 32)) ^ id->size ^ id->file_name_id ^ id->method;
+    return &file_cache[((hash * 2654435761U) >> 16) % FILE_CACHE_SHARDS];
+}
+
+static struct file_cache_shard *file_cache_get_shard_data(void *data) {
+    return file_cache_get_shard(cache_entry_get_id(file_cache[0].cache, data));
+}
+
+static guint file_cache_id_hash(gconstpointer key) {
+    const struct file_cache_id *id=key;
+    return (guint)(id->offset ^ (id->offset >> 32)) ^ id->size ^ id->file_name_id ^ id->method;
+}
+
+static gboolean file_cache_id_equal(gconstpointer a, gconstpointer b) {
+    return !memcmp(a, b, sizeof(struct file_cache_id));
+}
+
+/**
+ * @brief Reads from a given position of a file without changing the file position
+ *
+ * @return true if `size` bytes were read, false if not
+ */
+static int file_read_at(struct file *file, long long offset, void *buffer, int size) {
+    int ret;
+#ifdef HAVE_PREAD
+    ret=(pread(file->fd, buffer, size, offset) == size);
+#else
+    file_lock(io);
+    lseek(file->fd, offset, SEEK_SET);
+    ret=(read(file->fd, buffer, size) == size);
+    file_unlock(io);
+#endif
+    return ret;
+}
+
 #ifdef HAVE_SOCKET
 static int file_socket_connect(char *host, char *service) {
     struct addrinfo hints;
@@ -316,27 +405,46 @@ int file_mmap(struct file *file) {
     return 1;
 }
 
+/**
+ * @brief Returns the statistics of a file to be counted while a shard of the tile cache is locked
+ */
+static struct file_cache_stats *file_stats(struct file *file, struct file_cache_shard *shard) {
+    return &file->stats[shard-file_cache];
+}
+
 unsigned char *file_data_read(struct file *file, long long offset, int size) {
+    struct file_cache_id id= {offset,size,file->name_id,0};
+    struct file_cache_shard *shard;
     void *ret;
     if (file->special)
         return NULL;
     if (file->begin)
         return file->begin+offset;
-    if (file->cache) {
-        struct file_cache_id id= {offset,size,file->name_id,0};
-        ret=cache_lookup(file_cache,&id);
-        if (ret)
-            return ret;
-        ret=cache_insert_new(file_cache,&id,size);
-    } else
+    if (!file->cache) {
         ret=g_malloc(size);
-    lseek(file->fd, offset, SEEK_SET);
-    if (read(file->fd, ret, size) != size) {
-        file_data_free(file, ret);
+        if (!file_read_at(file, offset, ret, size)) {
+            g_free(ret);
+            ret=NULL;
+        }
+        return ret;
+    }
+    shard=file_cache_get_shard(&id);
+    file_cache_lock(shard);
+    ret=cache_lookup(shard->cache,&id);
+    if (ret) {
+        file_stats(file, shard)->hits++;
+        file_cache_unlock(shard);
+        return ret;
+    }
+    /* the entry is filled while the shard is locked, so no other thread can see it half-filled */
+    ret=cache_insert_new(shard->cache,&id,size);
+    if (!file_read_at(file, offset, ret, size)) {
+        cache_entry_destroy(shard->cache, ret);
         ret=NULL;
     }
+    file_stats(file, shard)->misses++;
+    file_cache_unlock(shard);
     return ret;
-
 }
 
 static void file_process_headers(struct file *file, unsigned char *headers) {
@@ -431,7 +539,10 @@ unsigned char *file_data_read_all(struct file *file) {
 void file_data_flush(struct file *file, long long offset, int size) {
     if (file->cache) {
         struct file_cache_id id= {offset,size,file->name_id,0};
-        cache_flush(file_cache,&id);
+        struct file_cache_shard *shard=file_cache_get_shard(&id);
+        file_cache_lock(shard);
+        cache_flush(shard->cache,&id);
+        file_cache_unlock(shard);
         dbg(lvl_debug,"Flushing "LONGLONG_FMT" %d bytes",offset,size);
     }
 }
@@ -487,38 +598,123 @@ static int uncompress_int(Bytef *dest, uLongf *destLen, const Bytef *source, uLo
     return err;
 }
 
+/**
+ * @brief Copies an uncompressed tile from the spill file
+ *
+ * @return true if the tile was found and copied to `data`, false if not
+ */
+static int file_spill_get(struct file_cache_id *id, void *data, int size) {
+    long long *offset;
+    int ret=0;
+
+    file_lock(spill);
+    if (file_spill && (offset=g_hash_table_lookup(file_spill->index, id))) {
+        memcpy(data, file_spill->begin+*offset, size);
+        ret=1;
+    }
+    file_unlock(spill);
+    return ret;
+}
+
+/**
+ * @brief Stores an uncompressed tile in the spill file, if there is one
+ */
+static void file_spill_put(struct file_cache_id *id, void *data, int size) {
+    long long *offset;
+
+    file_lock(spill);
+    if (file_spill && size <= file_spill->size && !g_hash_table_lookup(file_spill->index, id)) {
+        if (file_spill->used + size > file_spill->size) {
+            dbg(lvl_debug,"spill file full, starting over");
+            g_hash_table_remove_all(file_spill->index);
+            file_spill->used=0;
+        }
+        memcpy(file_spill->begin+file_spill->used, data, size);
+        offset=g_new(long long, 1);
+        *offset=file_spill->used;
+        g_hash_table_insert(file_spill->index, g_memdup(id, sizeof(*id)), offset);
+        file_spill->used+=size;
+    }
+    file_unlock(spill);
+}
+
+/**
+ * @brief Reads and uncompresses a deflated block of a file
+ *
+ * Uncompressed data is kept in the tile cache, and also in the spill file if one has been set up with
+ * `file_set_cache_spill_size()`. Thus a tile which is read again, possibly from another thread, does not need to be
+ * uncompressed again. The result must be released with `file_data_free()`.
+ *
+ * @param file The file
+ * @param offset Offset of the compressed data in the file
+ * @param size Size of the compressed data
+ * @param size_uncomp Size of the uncompressed data
+ *
+ * @return The uncompressed data, or NULL on error
+ */
 unsigned char *file_data_read_compressed(struct file *file, long long offset, int size, int size_uncomp) {
-    void *ret;
-    char *buffer = 0;
+    void *ret,*cached=NULL;
+    unsigned char *buffer;
+    unsigned char *data;
     uLongf destLen=size_uncomp;
+    struct file_cache_id id= {offset,size,file->name_id,1};
+    struct file_cache_shard *shard=file_cache_get_shard(&id);
 
+    file_cache_lock(shard);
     if (file->cache) {
-        struct file_cache_id id= {offset,size,file->name_id,1};
-        ret=cache_lookup(file_cache,&id);
-        if (ret)
-            return ret;
-        ret=cache_insert_new(file_cache,&id,size_uncomp);
-    } else
+        cached=cache_lookup(shard->cache,&id);
+        if (cached) {
+            file_stats(file, shard)->hits++;
+        } else {
+            /* the entry is only inserted once it has been filled, so no other thread can see it half-filled */
+            ret=cache_entry_new(shard->cache,&id,size_uncomp);
+            if (file_spill_get(&id, ret, size_uncomp)) {
+                file_stats(file, shard)->spill_hits++;
+                cache_insert(shard->cache,ret);
+                cached=ret;
+            } else
+                file_stats(file, shard)->misses++;
+        }
+    } else {
         ret=g_malloc(size_uncomp);
-    lseek(file->fd, offset, SEEK_SET);
-
-    buffer = (char *)g_malloc(size);
-    if (read(file->fd, buffer, size) != size) {
-        g_free(ret);
-        ret=NULL;
+        file_stats(file, shard)->misses++;
+    }
+    file_cache_unlock(shard);
+    if (cached)
+        return cached;
+    if (file->begin) {
+        buffer=NULL;
+        data=file->begin+offset;
     } else {
-        if (uncompress_int(ret, &destLen, (Bytef *)buffer, size) != Z_OK) {
-            dbg(lvl_error,"uncompress failed");
-            g_free(ret);
-            ret=NULL;
-        }
+        buffer=g_malloc(size);
+        data=file_read_at(file, offset, buffer, size) ? buffer : NULL;
+    }
+    if (data && uncompress_int(ret, &destLen, (Bytef *)data, size) != Z_OK) {
+        dbg(lvl_error,"uncompress failed");
+        data=NULL;
     }
     g_free(buffer);
-
-    return ret;
+    if (data && file->cache)
+        file_spill_put(&id, ret, size_uncomp);
+    file_cache_lock(shard);
+    if (data)
+        file_stats(file, shard)->uncompressed+=size_uncomp;
+    if (!file->cache) {
+        cached=data ? ret : NULL;
+        if (!data)
+            g_free(ret);
+    } else if (data && !(cached=cache_lookup(shard->cache,&id))) {
+        /* no other thread has inserted the same data while this one was uncompressing it */
+        cache_insert(shard->cache,ret);
+        cached=ret;
+    } else
+        cache_entry_free(shard->cache,ret);
+    file_cache_unlock(shard);
+    return cached;
 }
 
 void file_data_free(struct file *file, unsigned char *data) {
+    struct file_cache_shard *shard;
     if (file->begin) {
         if (data == file->begin)
             return;
@@ -526,12 +722,16 @@ void file_data_free(struct file *file, unsigned char *data) {
             return;
     }
     if (file->cache && data) {
-        cache_entry_destroy(file_cache, data);
+        shard=file_cache_get_shard_data(data);
+        file_cache_lock(shard);
+        cache_entry_destroy(shard->cache, data);
+        file_cache_unlock(shard);
     } else
         g_free(data);
 }
 
 void file_data_remove(struct file *file, unsigned char *data) {
+    struct file_cache_shard *shard;
     if (file->begin) {
         if (data == file->begin)
             return;
@@ -539,7 +739,10 @@ void file_data_remove(struct file *file, unsigned char *data) {
             return;
     }
     if (file->cache && data) {
-        cache_flush_data(file_cache, data);
+        shard=file_cache_get_shard_data(data);
+        file_cache_lock(shard);
+        cache_flush_data(shard->cache, data);
+        file_cache_unlock(shard);
     } else
         g_free(data);
 }
@@ -660,6 +863,12 @@ void file_fsync(struct file *f) {
 }
 
 void file_destroy(struct file *f) {
+    struct file_cache_stats stats;
+
+    file_get_cache_stats(f, &stats);
+    if (stats.hits || stats.misses)
+        dbg(lvl_debug,"%s: %d cache hits, %d from spill file, %d misses, "LONGLONG_FMT" bytes uncompressed", f->name,
+            stats.hits, stats.spill_hits, stats.misses, stats.uncompressed);
     if (f->headers)
         g_hash_table_destroy(f->headers);
     switch (f->special) {
@@ -750,20 +959,120 @@ void *file_get_os_handle(struct file *file) {
     return GINT_TO_POINTER(file->fd);
 }
 
+/**
+ * @brief Sets the total size of the tile cache
+ *
+ * The size is divided equally among the `FILE_CACHE_SHARDS` shards of the cache, so a single tile can use no more
+ * than `cache_size / FILE_CACHE_SHARDS` bytes of it; larger tiles are not kept.
+ *
+ * @param cache_size The size in bytes
+ *
+ * @return true on success, false if the tile cache is not supported
+ */
 int file_set_cache_size(int cache_size) {
 #ifdef CACHE_SIZE
-    cache_resize(file_cache, cache_size);
+    int i;
+    for (i = 0 ; i < FILE_CACHE_SHARDS ; i++) {
+        file_cache_lock(&file_cache[i]);
+        cache_resize(file_cache[i].cache, cache_size/FILE_CACHE_SHARDS);
+        file_cache_unlock(&file_cache[i]);
+    }
     return 1;
 #else
     return 0;
 #endif
 }
 
+/**
+ * @brief Sets up a spill file for uncompressed tiles
+ *
+ * Tiles which have been uncompressed are also copied to a temporary, memory-mapped file of the given size. When a tile
+ * has been dropped from the tile cache, it is copied back from there instead of being uncompressed again. Any
+ * previous spill file is discarded.
+ *
+ * @param spill_size Size of the spill file in bytes, 0 to disable it
+ *
+ * @return true on success, false if the spill file could not be created or is not supported
+ */
+int file_set_cache_spill_size(int spill_size) {
+#if defined(CACHE_SIZE) && !defined(_WIN32) && !defined(__CEGCC__)
+    struct file_spill *spill=NULL;
+    char *name;
+    int fd;
+
+    if (spill_size > 0) {
+        name=g_strdup_printf("%s/navit-tiles-XXXXXX", getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp");
+        fd=mkstemp(name);
+        if (fd != -1)
+            unlink(name);
+        g_free(name);
+        if (fd == -1 || ftruncate(fd, spill_size)) {
+            dbg(lvl_error,"Failed to create spill file of %d bytes", spill_size);
+            if (fd != -1)
+                close(fd);
+            return 0;
+        }
+        spill=g_new0(struct file_spill, 1);
+        spill->fd=fd;
+        spill->size=spill_size;
+        spill->begin=mmap(NULL, spill_size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+        if (spill->begin == MAP_FAILED) {
+            perror("mmap");
+            close(fd);
+            g_free(spill);
+            return 0;
+        }
+        spill->index=g_hash_table_new_full(file_cache_id_hash, file_cache_id_equal, g_free, g_free);
+    }
+    file_lock(spill);
+    if (file_spill) {
+        g_hash_table_destroy(file_spill->index);
+        munmap(file_spill->begin, file_spill->size);
+        close(file_spill->fd);
+        g_free(file_spill);
+    }
+    file_spill=spill;
+    file_unlock(spill);
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+/**
+ * @brief Returns statistics on how reads from a file were served
+ *
+ * @param file The file
+ * @param stats Receives the statistics
+ */
+void file_get_cache_stats(struct file *file, struct file_cache_stats *stats) {
+    int i;
+
+    memset(stats, 0, sizeof(*stats));
+    for (i = 0 ; i < FILE_CACHE_SHARDS ; i++) {
+        file_cache_lock(&file_cache[i]);
+        stats->hits+=file->stats[i].hits;
+        stats->spill_hits+=file->stats[i].spill_hits;
+        stats->misses+=file->stats[i].misses;
+        stats->uncompressed+=file->stats[i].uncompressed;
+        file_cache_unlock(&file_cache[i]);
+    }
+}
+
 void file_init(void) {
+    int i;
 #ifdef CACHE_SIZE
     file_name_hash=g_hash_table_new(g_str_hash, g_str_equal);
-    file_cache=cache_new(sizeof(struct file_cache_id), CACHE_SIZE);
 #endif
+    for (i = 0 ; i < FILE_CACHE_SHARDS ; i++) {
+#ifdef CACHE_SIZE
+        file_cache[i].cache=cache_new(sizeof(struct file_cache_id), CACHE_SIZE/FILE_CACHE_SHARDS);
+#endif
+#ifdef HAVE_PTHREAD
+        /* also used to count the statistics of files which are not cached */
+        pthread_mutex_init(&file_cache[i].mutex, NULL);
+#endif
+    }
     if(sizeof(off_t)<8)
         dbg(lvl_error,"Maps larger than 2GB are not supported by this binary, sizeof(off_t)=%zu",sizeof(off_t));
 }
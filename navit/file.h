@@ -33,6 +33,19 @@ extern "C" {
 #include "param.h"
 #include <stdio.h>
 
+/** Number of independently locked parts of the tile cache, each getting an equal share of the cache size */
+#define FILE_CACHE_SHARDS 8
+
+/**
+ * @brief Statistics on how reads from a file were served by the tile cache
+ */
+struct file_cache_stats {
+	int hits;				/**< Reads served from the in-memory cache */
+	int spill_hits;				/**< Compressed reads served from the spill file, without uncompressing */
+	int misses;				/**< Reads which had to access the file */
+	long long uncompressed;			/**< Number of bytes uncompressed */
+};
+
 struct file {
 	struct file *next;
 	unsigned char *begin;
@@ -57,6 +70,9 @@ struct file {
 	unsigned char *buffer;
 	int buffer_len;
 	GHashTable *headers;
+	struct file_cache_stats stats[FILE_CACHE_SHARDS]; /**< Statistics, counted separately for each shard of the
+	                                                     tile cache under the lock of the shard, see
+	                                                     `file_get_cache_stats()` */
 };
 
 struct attr;
@@ -95,6 +111,8 @@ int file_get_param(struct file *file, struct param_list *param, int count);
 int file_version(struct file *file, int byname);
 void *file_get_os_handle(struct file *file);
 int file_set_cache_size(int cache_size);
+int file_set_cache_spill_size(int spill_size);
+void file_get_cache_stats(struct file *file, struct file_cache_stats *stats);
 void file_init(void);
 void file_data_remove(struct file *file, unsigned char *data);
 /* end of prototypes */
@@ -30,7 +30,17 @@
 #include <glib.h>
 #include <stdio.h>
 #include <math.h>
+#include <time.h>
+#ifndef _MSC_VER
+#include <sys/time.h>
+#endif /* _MSC_VER */
 #include "config.h"
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
 #include "debug.h"
 #include "string.h"
 #include "draw_info.h"
@@ -95,6 +105,8 @@ struct graphics {
     GHashTable *image_cache_hash;
     /* for dpi compensation */
     int dpi_factor;
+    /* number of threads to read maps with, 0 for one per CPU, 1 (the default) to read them on the main thread */
+    int draw_threads;
 };
 
 struct display_context {
@@ -108,14 +120,42 @@ struct display_context {
     struct transformation *trans;
     enum item_type type;
     int maxlen;
+    long points;
 };
 
 #define HASH_SIZE 1024
 struct hash_entry {
     enum item_type type;
     struct displayitem *di;
+    int count;
 };
 
+/**
+ * @brief A block of memory in a displaylist arena
+ */
+struct displaylist_arena_block {
+    struct displaylist_arena_block *next;   /**< The next block */
+    int size;                               /**< Size of `data`, in bytes */
+    int used;                               /**< Bytes of `data` in use */
+    char data[0];                           /**< The memory handed out */
+};
+
+/**
+ * @brief Memory for displayitems
+ *
+ * Displayitems are allocated by bumping a pointer in the current block, and all of them are freed at once when the
+ * arena is reset for the next redraw. The arena then shrinks to a single block of the size needed for the redraw
+ * just finished, so usually no memory has to be allocated while a redraw of the same area is built.
+ */
+struct displaylist_arena {
+    struct displaylist_arena_block *blocks;     /**< The blocks, the current one first */
+    long size;                                  /**< Total size of all blocks, in bytes */
+    long used;                                  /**< Bytes handed out since the last reset */
+    long hint;                                  /**< Size for the first block after a reset */
+};
+
+
+struct displaylist_workers;
 
 struct displaylist {
     int busy;
@@ -133,6 +173,18 @@ struct displaylist {
     struct callback *idle_cb;
     struct event_idle *idle_ev;
     unsigned int seq;
+    struct displaylist_workers *workers;
+    struct displaylist_arena arena;
+    GList *cells;
+    int cells_order;
+    struct layout *cells_layout;
+    enum projection cells_pro;
+    int items_read;                   /**< Items read from the maps for the current redraw */
+    int items_created;                /**< Displayitems created for the current redraw */
+    long fetch_usec;                  /**< Time spent reading the maps for the current redraw */
+    long selection_usec;              /**< Time spent in `graphics_process_selection()` */
+    long draw_usec;                   /**< Time spent in `graphics_displaylist_draw()` */
+    long callback_usec;               /**< Time spent in the callback of the redraw */
     struct hash_entry hash_entries[HASH_SIZE];
 };
 
@@ -220,7 +272,8 @@ static struct hash_entry *set_hash_entry(struct displaylist *dl, enum item_type
  * @brief Sets a generic attribute of the graphics instance
  *
  * This will only set one of the supported generic graphics attributes (currently {@code gamma},
- * {@code brightness}, {@code contrast} or {@code font_size}) and fail for other attribute types.
+ * {@code brightness}, {@code contrast}, {@code font_size} or {@code build_threads}) and fail for other attribute
+ * types.
  *
  * To set an attribute provided by a graphics plugin, use {@link graphics_set_attr(struct graphics *, struct attr *)}
  * instead.
@@ -244,6 +297,9 @@ static int graphics_set_attr_do(struct graphics *gra, struct attr *attr) {
     case attr_font_size:
         gra->font_size=attr->u.num;
         return 1;
+    case attr_build_threads:
+        gra->draw_threads=attr->u.num;
+        return 1;
     default:
         return 0;
     }
@@ -362,6 +418,8 @@ struct graphics * graphics_new(struct attr *parent, struct attr **attrs) {
     this_->contrast=65536;
     this_->gamma=65536;
     this_->font_size=20;
+    /* drawing on worker threads is opt-in, as for the route: build_threads="0" or higher than 1 */
+    this_->draw_threads=1;
     this_->image_cache_hash = g_hash_table_new_full(g_str_hash, g_str_equal,g_free,g_free);
     /*get dpi */
     virtual_dpi_attr=attr_search(attrs, attr_virtual_dpi);
@@ -1421,23 +1479,98 @@ struct displayitem {
     struct coord c[0];
 };
 
+/** Minimum size of a block of a displaylist arena, in bytes */
+#define DISPLAYLIST_ARENA_BLOCK 65536
+
+/** Alignment of allocations from a displaylist arena */
+#define DISPLAYLIST_ARENA_ALIGN(size) (((size) + 7) & ~7)
+
 /**
- * FIXME
- * @param <>
- * @returns <>
- * @author Martin Schaller (04/2008)
-*/
+ * @brief Allocates memory from a displaylist arena
+ *
+ * @param arena The arena
+ * @param len The number of bytes needed
+ * @returns Pointer to the memory, valid until the arena is reset
+ */
+static void *displaylist_arena_alloc(struct displaylist_arena *arena, int len) {
+    struct displaylist_arena_block *b=arena->blocks;
+    void *ret;
+
+    len=DISPLAYLIST_ARENA_ALIGN(len);
+    if (!b || b->used + len > b->size) {
+        long size=arena->blocks ? arena->used : arena->hint + arena->hint/8;
+        if (size < DISPLAYLIST_ARENA_BLOCK)
+            size=DISPLAYLIST_ARENA_BLOCK;
+        if (size < len)
+            size=len;
+        b=g_malloc(sizeof(*b)+size);
+        b->next=arena->blocks;
+        b->size=size;
+        b->used=0;
+        arena->blocks=b;
+        arena->size+=size;
+    }
+    ret=b->data+b->used;
+    b->used+=len;
+    arena->used+=len;
+    return ret;
+}
+
+static void displaylist_arena_free_blocks(struct displaylist_arena_block *b) {
+    while (b) {
+        struct displaylist_arena_block *next=b->next;
+        g_free(b);
+        b=next;
+    }
+}
+
+/**
+ * @brief Frees all memory handed out by an arena
+ *
+ * Unless the arena already consists of a single block which is large enough, but not much larger than needed
+ * since the last reset, its blocks are freed, and the first block allocated afterwards is sized to fit all memory
+ * handed out since the last reset.
+ */
+static void displaylist_arena_reset(struct displaylist_arena *arena) {
+    struct displaylist_arena_block *b=arena->blocks;
+
+    if (b && !b->next && b->size >= arena->used
+            && (b->size <= DISPLAYLIST_ARENA_BLOCK || b->size <= 2 * arena->used + arena->used/4)) {
+        b->used=0;
+        arena->size=b->size;
+    } else {
+        displaylist_arena_free_blocks(b);
+        arena->blocks=NULL;
+        arena->size=0;
+    }
+    arena->hint=arena->used;
+    arena->used=0;
+}
+
+/**
+ * @brief Frees all memory of an arena
+ */
+static void displaylist_arena_destroy(struct displaylist_arena *arena) {
+    displaylist_arena_free_blocks(arena->blocks);
+    memset(arena, 0, sizeof(*arena));
+}
+
+/**
+ * @brief Removes all displayitems from a displaylist
+ *
+ * The memory of the displayitems is kept for the next redraw, see `displaylist_arena_reset()`. Displayitems of
+ * static maps stay in their cells, see `struct displaylist_cell`.
+ *
+ * @param dl The displaylist
+ */
 static void xdisplay_free(struct displaylist *dl) {
     int i;
     for (i = 0 ; i < HASH_SIZE ; i++) {
-        struct displayitem *di=dl->hash_entries[i].di;
-        while (di) {
-            struct displayitem *next=di->next;
-            g_free(di);
-            di=next;
-        }
         dl->hash_entries[i].di=NULL;
+        dl->hash_entries[i].count=0;
     }
+    dbg(lvl_debug,"arena used %ld of %ld bytes", dl->arena.used, dl->arena.size);
+    displaylist_arena_reset(&dl->arena);
 }
 
 /**
@@ -1470,13 +1603,21 @@ static inline struct displayitem_poly_holes *  display_add_holes(struct item *it
 }
 
 /**
- * FIXME
- * @param <>
- * @returns <>
- * @author Martin Schaller (04/2008)
-*/
-static void display_add(struct hash_entry *entry, struct item *item, int count, struct coord *c, char **label,
-                        int label_count) {
+ * @brief Creates a displayitem for an item
+ *
+ * The displayitem is allocated as one block from an arena, including its coordinates, holes and labels. Its
+ * `next` member is not set.
+ *
+ * @param arena The arena to allocate the displayitem from
+ * @param item The item, whose attributes are read to get its flags and holes
+ * @param count Number of coordinates in `c`
+ * @param c The coordinates of the item
+ * @param label Labels of the item, entries may be NULL
+ * @param label_count Number of entries in `label`
+ * @returns The new displayitem
+ */
+static struct displayitem *display_new(struct displaylist_arena *arena, struct item *item, int count,
+                                       struct coord *c, char **label, int label_count) {
     struct displayitem *di;
     int len,i;
     char *p;
@@ -1515,7 +1656,7 @@ static void display_add(struct hash_entry *entry, struct item *item, int count,
         dbg(lvl_debug,"got %d holes with %d coords total", hole_count, hole_total_coords);
     len += holes_length;
 
-    p=g_malloc(len);
+    p=displaylist_arena_alloc(arena, len);
 
     di=(struct displayitem *)p;
     p+=sizeof(*di)+count*sizeof(*c);
@@ -1539,8 +1680,19 @@ static void display_add(struct hash_entry *entry, struct item *item, int count,
         di->label=NULL;
     di->count=count;
     memcpy(di->c, c, count*sizeof(*c));
+    return di;
+}
+
+/**
+ * @brief Adds a displayitem to the list of its hash entry
+ *
+ * @param entry The hash entry for the type of the item
+ * @param di The displayitem
+ */
+static void display_add(struct hash_entry *entry, struct displayitem *di) {
     di->next=entry->di;
     entry->di=di;
+    entry->count++;
 }
 
 
@@ -2985,6 +3137,7 @@ static void displayitem_draw(struct displayitem *di, struct layout *l, struct di
             count=limit_count(di->c, count);
         if (dc->type == type_poly_water_tiled)
             mindist=0;
+        dc->points+=count;
         if (dc->e->type == element_polyline)
             count=transform_point_buf(dc->trans, dc->pro, di->c, pa, pa_buf_size, count, mindist, e->u.polyline.width,
                                       width);
@@ -3096,6 +3249,7 @@ void graphics_draw_itemgra(struct graphics *gra, struct itemgra *itm, struct tra
     dc.trans=t;
     dc.type=type_none;
     dc.maxlen=max_coord;
+    dc.points=0;
     while (es) {
         struct element *e=es->data;
         if (e->coord_count) {
@@ -3160,6 +3314,7 @@ static void xdisplay_draw(struct displaylist *display_list, struct graphics *gra
             if (lay->ref)
                 lay=lay->ref;
             xdisplay_draw_layer(display_list, gra, lay, order, l);
+            dbg(lvl_debug,"layer %s: %d items", lay->name, graphics_displaylist_get_layer_items(display_list, lay));
         }
         lays=g_list_next(lays);
     }
@@ -3250,29 +3405,696 @@ GList *displaylist_get_clicked_list(struct displaylist *displaylist, struct poin
 
 
 
+/**
+ * @brief Buffer for the coordinates of an item which is converted into a displayitem
+ */
+struct displaylist_coords {
+    struct coord *c;    /**< The buffer */
+    int max;            /**< Number of coordinates `c` can hold */
+    int allocated;      /**< Whether `c` has been allocated with `g_malloc()`, rather than on the stack */
+    int used;           /**< Peak number of coordinates actually used */
+};
+
+/**
+ * @brief Reads an item from a map and converts it into a displayitem
+ *
+ * @param arena The arena to allocate the displayitem from
+ * @param item The item
+ * @param m The map of the item
+ * @param conv Whether strings of `m` require conversion
+ * @param pro The projection of the display, to which coordinates are converted
+ * @param sel The selection which `m` is read with, only coordinates of items intersecting it are used
+ * @param ca Buffer for the coordinates, grown if the item has more coordinates than fit into it
+ * @param bbox Receives the bounding box of the item in the coordinates of `m`, may be NULL
+ *
+ * @return The new displayitem, or NULL if the item has no coordinates within `sel`
+ */
+static struct displayitem *display_convert(struct displaylist_arena *arena, struct item *item, struct map *m, int conv,
+        enum projection pro, struct map_selection *sel, struct displaylist_coords *ca, struct coord_rect *bbox) {
+    struct displayitem *di;
+    struct attr attr,attr2;
+    enum projection map_pro=map_projection(m);
+    int label_count=0;
+    char *labels[2];
+    int count,coords_left,i;
+
+    count=item_coord_get_within_selection(item, ca->c, item->type < type_line ? 1: ca->max, sel);
+    /* abort if no coordinates within selection at all */
+    if (! count)
+        return NULL;
+    /* handle overflow */
+    if (count == ca->max) {
+        /* get required space */
+        item_coord_rewind(item);
+        coords_left=item_coords_left(item);
+        /* increase to required space, or double space if we couldn't get required space */
+        if(coords_left > 0) {
+            ca->max=coords_left+2;
+        } else {
+            ca->max*=2;
+        }
+        dbg(lvl_error,"point count overflow %d for %s "ITEM_ID_FMT". Increase to %d", count,item_to_name(item->type),
+            ITEM_ID_ARGS(*item), ca->max);
+        /* get more memory */
+        if(ca->allocated)
+            g_free(ca->c);
+        ca->c=g_malloc(sizeof(struct coord)*ca->max);
+        ca->allocated=1;
+        /* try again to get coordinates */
+        item_coord_rewind(item);
+        count=item_coord_get_within_selection(item, ca->c, item->type < type_line ? 1: ca->max, sel);
+        /* check if we got valid coordinates in second attempt. If not don't try to draw this at all */
+        if(count <= 0) {
+            return NULL;
+        }
+    }
+    if (bbox) {
+        bbox->lu=ca->c[0];
+        bbox->rl=ca->c[0];
+        for (i = 1 ; i < count ; i++)
+            coord_rect_extend(bbox, &ca->c[i]);
+    }
+    /* transform the coordinates */
+    if (map_pro != pro)
+        transform_from_to_count(ca->c, map_pro, ca->c, pro, count);
+
+    /* remember the peak coordinates actually used */
+    if(ca->used < count)
+        ca->used=count;
+
+    if (item_is_custom_poi(*item)) {
+        if (item_attr_get(item, attr_icon_src, &attr2))
+            labels[1]=map_convert_string(m, attr2.u.str);
+        else
+            labels[1]=NULL;
+        label_count=2;
+    } else {
+        labels[1]=NULL;
+        label_count=0;
+    }
+    if (item_attr_get(item, attr_label, &attr)) {
+        labels[0]=attr.u.str;
+        if (!label_count)
+            label_count=2;
+    } else
+        labels[0]=NULL;
+    if (conv && label_count) {
+        labels[0]=map_convert_string(m, labels[0]);
+        di=display_new(arena, item, count, ca->c, labels, label_count);
+        map_convert_free(labels[0]);
+    } else
+        di=display_new(arena, item, count, ca->c, labels, label_count);
+    if (labels[1])
+        map_convert_free(labels[1]);
+    return di;
+}
+
+/** Time in milliseconds an asynchronous redraw waits for the draw workers before returning to the main loop */
+#define DISPLAYLIST_WORKER_WAIT 20
+
+/** Number of cells along the larger side of the selection of a map when the cells of the map are laid out anew */
+#define DISPLAYLIST_CELLS_PER_SIDE 4
+
+/**
+ * @brief A cell of a static map, whose displayitems are kept from one redraw to the next
+ *
+ * Maps which report `attr_thread_safe` do not change while they are open. Their selection is covered with a grid of
+ * square cells, in the coordinates of the map, and the items of each cell are read once and kept as long as the cell
+ * intersects the selection and order, layout and projection stay the same. When the view is panned, only the cells
+ * which come into view are read; cells which left it are dropped.
+ *
+ * A cell holds the displayitems of all items intersecting it, along with their bounding boxes, so that only those
+ * intersecting the current selection are drawn. Items lying entirely within the cell are in `items`. Items which
+ * extend beyond the cell are in `shared`, as the neighbouring cells may hold them as well.
+ */
+struct displaylist_cell_item {
+    struct displayitem *di;           /**< The displayitem */
+    struct coord_rect bbox;           /**< Bounding box of the item, in the coordinates of the map */
+};
+
+struct displaylist_cell {
+    struct map *map;                  /**< The map */
+    int shift;                        /**< Log2 of the side of the cell */
+    int x,y;                          /**< Position of the cell in the grid */
+    struct map_selection sel;         /**< The area of the cell, `next` is always NULL */
+    struct displaylist_arena arena;   /**< The memory of the displayitems */
+    struct displaylist_cell_item *items;  /**< The items lying within the cell */
+    int count;                        /**< Number of entries in `items` */
+    struct displaylist_cell_item *shared; /**< The items extending beyond the cell */
+    int shared_count;                 /**< Number of entries in `shared` */
+    int used;                         /**< Peak number of coordinates used by an item */
+    int read;                         /**< Number of items read from the map */
+    int loaded;                       /**< Whether the items of the cell have been read */
+};
+
+static struct displaylist_cell *displaylist_cell_new(struct map *m, struct map_selection *sel, int shift, int x,
+        int y) {
+    struct displaylist_cell *cell=g_new0(struct displaylist_cell, 1);
+
+    cell->map=m;
+    cell->shift=shift;
+    cell->x=x;
+    cell->y=y;
+    cell->sel=*sel;
+    cell->sel.next=NULL;
+    coord_rect_from_grid(&cell->sel.u.c_rect, x, y, shift);
+    return cell;
+}
+
+/**
+ * @brief Discards the displayitems of a cell
+ */
+static void displaylist_cell_clear(struct displaylist_cell *cell) {
+    displaylist_arena_destroy(&cell->arena);
+    g_free(cell->items);
+    g_free(cell->shared);
+    cell->items=NULL;
+    cell->count=0;
+    cell->shared=NULL;
+    cell->shared_count=0;
+    cell->loaded=0;
+}
+
+static void displaylist_cell_destroy(struct displaylist_cell *cell) {
+    displaylist_cell_clear(cell);
+    g_free(cell);
+}
+
+static void displaylist_cells_free(GList *cells) {
+    while (cells) {
+        displaylist_cell_destroy(cells->data);
+        cells=g_list_delete_link(cells, cells);
+    }
+}
+
+/**
+ * @brief Appends a displayitem to an array, growing it as needed
+ */
+static void displaylist_cell_append(struct displaylist_cell_item **array, int *count, struct displayitem *di,
+                                    struct coord_rect *bbox) {
+    if (!(*count & (*count - 1)))
+        *array=g_renew(struct displaylist_cell_item, *array, *count ? *count * 2 : 16);
+    (*array)[*count].di=di;
+    (*array)[*count].bbox=*bbox;
+    (*count)++;
+}
+
+struct displaylist_workers;
+static int displaylist_workers_cancelled(struct displaylist_workers *this_);
+
+/** Number of items a draw worker reads between two checks for cancellation */
+#define DISPLAYLIST_CANCEL_CHECK 256
+
+/**
+ * @brief Reads the items of a cell
+ *
+ * This only reads the hash of the displaylist, so it may run on a worker thread while the main thread reads other
+ * maps into the displaylist.
+ *
+ * @param dl The displaylist
+ * @param cell The cell
+ * @param pro The projection of the display
+ * @param maxlen Initial size of the coordinate buffer
+ * @param workers The draw workers if called on a worker thread, NULL if called on the main thread
+ *
+ * @return True if the cell has been read completely, false if the workers have been cancelled
+ */
+static int displaylist_cell_load(struct displaylist *dl, struct displaylist_cell *cell, enum projection pro,
+                                 int maxlen, struct displaylist_workers *workers) {
+    struct displaylist_coords ca;
+    struct coord_rect bbox;
+    struct map_rect *mr;
+    struct item *item;
+    struct displayitem *di;
+    int conv=map_requires_conversion(cell->map);
+    int count=0,ret=1;
+
+    mr=map_rect_new(cell->map, &cell->sel);
+    if (!mr)
+        return 1;
+    ca.max=maxlen;
+    ca.c=g_new(struct coord, ca.max);
+    ca.allocated=1;
+    ca.used=0;
+    while ((item=map_rect_get_item(mr))) {
+        if (++count % DISPLAYLIST_CANCEL_CHECK == 0 && workers && displaylist_workers_cancelled(workers)) {
+            ret=0;
+            break;
+        }
+        if (item == &busy_item || !get_hash_entry(dl, item->type))
+            continue;
+        di=display_convert(&cell->arena, item, cell->map, conv, pro, &cell->sel, &ca, &bbox);
+        if (!di)
+            continue;
+        if (coord_rect_contains(&cell->sel.u.c_rect, &bbox.lu) && coord_rect_contains(&cell->sel.u.c_rect, &bbox.rl))
+            displaylist_cell_append(&cell->items, &cell->count, di, &bbox);
+        else
+            displaylist_cell_append(&cell->shared, &cell->shared_count, di, &bbox);
+    }
+    map_rect_destroy(mr);
+    cell->used=ca.used;
+    cell->read=count;
+    g_free(ca.c);
+    return ret;
+}
+
+/**
+ * @brief Lays out the cells of the static maps for a redraw
+ *
+ * Cells which still intersect the selection of their map are kept, along with their displayitems; new cells are
+ * created empty, and cells which are no longer needed are freed. All cells are dropped if order, layout or
+ * projection have changed since the last redraw. The grid of a map is kept as long as the selection spans a
+ * reasonable number of cells.
+ *
+ * The hash of the displaylist has to be up to date.
+ *
+ * @param dl The displaylist
+ */
+static void displaylist_cells_update(struct displaylist *dl) {
+    enum projection pro=transform_get_projection(dl->dc.trans);
+    struct mapset_handle *h;
+    struct map_selection *sel,*s;
+    struct map *m;
+    struct attr attr;
+    GList *cells=NULL,*l;
+    int shift,side,x,y;
+
+    if (route_selection || dl->order != dl->cells_order || dl->layout != dl->cells_layout || pro != dl->cells_pro) {
+        displaylist_cells_free(dl->cells);
+        dl->cells=NULL;
+        dl->cells_order=dl->order;
+        dl->cells_layout=dl->layout;
+        dl->cells_pro=pro;
+    }
+    if (route_selection)
+        return;
+    h=mapset_open(dl->ms);
+    while ((m=mapset_next(h, 1))) {
+        if (!map_get_attr(m, attr_thread_safe, &attr, NULL) || !attr.u.num)
+            continue;
+        sel=transform_get_selection(dl->dc.trans, map_projection(m), dl->order);
+        if (!sel)
+            continue;
+        side=0;
+        for (s = sel ; s ; s = s->next) {
+            if (side < s->u.c_rect.rl.x-s->u.c_rect.lu.x)
+                side=s->u.c_rect.rl.x-s->u.c_rect.lu.x;
+            if (side < s->u.c_rect.lu.y-s->u.c_rect.rl.y)
+                side=s->u.c_rect.lu.y-s->u.c_rect.rl.y;
+        }
+        shift=-1;
+        for (l = dl->cells ; l ; l = g_list_next(l)) {
+            struct displaylist_cell *cell=l->data;
+            if (cell->map == m) {
+                shift=cell->shift;
+                break;
+            }
+        }
+        if (shift < 0 || (side >> shift) < 1 || (side >> shift) > 2 * DISPLAYLIST_CELLS_PER_SIDE)
+            for (shift = 10 ; (DISPLAYLIST_CELLS_PER_SIDE << shift) < side && shift < 30 ; shift++);
+        for (s = sel ; s ; s = s->next) {
+            for (y = s->u.c_rect.lu.y >> shift ; y >= s->u.c_rect.rl.y >> shift ; y--) {
+                for (x = s->u.c_rect.lu.x >> shift ; x <= s->u.c_rect.rl.x >> shift ; x++) {
+                    struct displaylist_cell *cell=NULL;
+                    for (l = cells ; l && !cell ; l = g_list_next(l)) {
+                        cell=l->data;
+                        if (cell->map != m || cell->shift != shift || cell->x != x || cell->y != y)
+                            cell=NULL;
+                    }
+                    if (cell)
+                        continue;
+                    for (l = dl->cells ; l && !cell ; l = g_list_next(l)) {
+                        cell=l->data;
+                        if (cell->map != m || cell->shift != shift || cell->x != x || cell->y != y)
+                            cell=NULL;
+                        else
+                            dl->cells=g_list_delete_link(dl->cells, l);
+                    }
+                    if (!cell)
+                        cell=displaylist_cell_new(m, s, shift, x, y);
+                    cells=g_list_prepend(cells, cell);
+                }
+            }
+        }
+        map_selection_destroy(sel);
+    }
+    mapset_close(h);
+    displaylist_cells_free(dl->cells);
+    dl->cells=g_list_reverse(cells);
+}
+
+/**
+ * @brief Whether the items of a map are kept in cells
+ */
+static int displaylist_cells_handle_map(struct displaylist *dl, struct map *m) {
+    GList *l;
+
+    for (l = dl->cells ; l ; l = g_list_next(l))
+        if (((struct displaylist_cell *)l->data)->map == m)
+            return 1;
+    return 0;
+}
+
+/**
+ * @brief Reads the cells which have not been read yet on the main thread
+ *
+ * @param dl The displaylist
+ * @param workload Number of items read in this step of the redraw, updated
+ * @param used Updated with the peak number of coordinates used by an item
+ *
+ * @return True if all cells have been read, false if the workload of the displaylist has been exhausted
+ */
+static int displaylist_cells_load(struct displaylist *dl, int *workload, int *used) {
+    enum projection pro=transform_get_projection(dl->dc.trans);
+    GList *l;
+
+    for (l = dl->cells ; l ; l = g_list_next(l)) {
+        struct displaylist_cell *cell=l->data;
+        if (cell->loaded)
+            continue;
+        if (dl->workload && *workload >= dl->workload)
+            return 0;
+        displaylist_cell_load(dl, cell, pro, dl->dc.maxlen, NULL);
+        cell->loaded=1;
+        if (*used < cell->used)
+            *used=cell->used;
+        *workload+=cell->count+cell->shared_count;
+        dl->items_read+=cell->read;
+        dl->items_created+=cell->count+cell->shared_count;
+    }
+    return 1;
+}
+
+static guint displaylist_item_hash(gconstpointer key) {
+    const struct item *item=key;
+    return item->id_hi ^ item->id_lo ^ GPOINTER_TO_INT(item->map);
+}
+
+static gboolean displaylist_item_equal(gconstpointer a, gconstpointer b) {
+    const struct item *item_a=a,*item_b=b;
+    return item_is_equal(*item_a, *item_b);
+}
+
+static int displaylist_selection_overlaps(struct map_selection *sel, struct coord_rect *r) {
+    for ( ; sel ; sel = sel->next)
+        if (coord_rect_overlap(&sel->u.c_rect, r))
+            return 1;
+    return 0;
+}
+
+/**
+ * @brief Adds the displayitems of all cells which intersect the selection to the displaylist
+ *
+ * Cells are added in the order in which they are laid out. Items held by more than one cell are added only once.
+ */
+static void displaylist_cells_link(struct displaylist *dl) {
+    GHashTable *shared=g_hash_table_new(displaylist_item_hash, displaylist_item_equal);
+    struct map_selection *sel=NULL;
+    struct map *m=NULL;
+    GList *l;
+    int i;
+
+    for (l = dl->cells ; l ; l = g_list_next(l)) {
+        struct displaylist_cell *cell=l->data;
+        if (cell->map != m) {
+            map_selection_destroy(sel);
+            m=cell->map;
+            sel=transform_get_selection(dl->dc.trans, map_projection(m), dl->order);
+        }
+        for (i = 0 ; i < cell->count ; i++) {
+            struct displaylist_cell_item *ci=&cell->items[i];
+            if (displaylist_selection_overlaps(sel, &ci->bbox))
+                display_add(get_hash_entry(dl, ci->di->item.type), ci->di);
+        }
+        for (i = 0 ; i < cell->shared_count ; i++) {
+            struct displaylist_cell_item *ci=&cell->shared[i];
+            if (!displaylist_selection_overlaps(sel, &ci->bbox) || g_hash_table_lookup(shared, &ci->di->item))
+                continue;
+            g_hash_table_insert(shared, &ci->di->item, ci->di);
+            display_add(get_hash_entry(dl, ci->di->item.type), ci->di);
+        }
+    }
+    map_selection_destroy(sel);
+    g_hash_table_destroy(shared);
+}
+
+#ifdef HAVE_PTHREAD
+
+/**
+ * @brief A draw job: a cell to be read by a worker
+ */
+struct displaylist_job {
+    struct displaylist_cell *cell;    /**< The cell */
+    int complete;                     /**< Whether the cell has been read completely */
+    int done;                         /**< Whether the job has been completed by a worker, protected by `mutex` */
+};
+
+/**
+ * @brief Worker threads which read the cells of the static maps of a displaylist
+ *
+ * Each cell which has not been read yet becomes a job. Workers only read the hash of the displaylist, which is set up
+ * before they are started and does not change until they are destroyed, and write to the cell of their job only.
+ * The displayitems are added to the displaylist on the main thread once all cells have been read, see
+ * `displaylist_cells_link()`, so the result does not depend on thread scheduling.
+ */
+struct displaylist_workers {
+    struct displaylist *dl;               /**< The displaylist */
+    enum projection pro;                  /**< The projection of the display */
+    int maxlen;                           /**< Initial size of the coordinate buffer of a job */
+    struct displaylist_job *jobs;         /**< All jobs */
+    int job_count;                        /**< Number of jobs */
+    int next_job;                         /**< Next job to be picked up by a worker, protected by `mutex` */
+    int current;                          /**< Next job to be waited for */
+    int cancel;                           /**< Set to stop the workers, protected by `mutex` */
+    pthread_t *threads;                   /**< The worker threads */
+    int thread_count;                     /**< Number of worker threads */
+    pthread_mutex_t mutex;                /**< Protects the job queue and the `done` flags */
+    pthread_cond_t cond;                  /**< Signalled when a job is done */
+};
+
+static void displaylist_workers_destroy(struct displaylist_workers *this_);
+
+/**
+ * @brief Whether the draw workers have been asked to stop
+ */
+static int displaylist_workers_cancelled(struct displaylist_workers *this_) {
+    int ret;
+
+    pthread_mutex_lock(&this_->mutex);
+    ret=this_->cancel;
+    pthread_mutex_unlock(&this_->mutex);
+    return ret;
+}
+
+/**
+ * @brief Main function of a draw worker: runs jobs until there are none left
+ */
+static void *displaylist_worker(void *data) {
+    struct displaylist_workers *this_=data;
+    struct displaylist_job *job;
+
+    pthread_mutex_lock(&this_->mutex);
+    while (!this_->cancel && this_->next_job < this_->job_count) {
+        job=&this_->jobs[this_->next_job++];
+        pthread_mutex_unlock(&this_->mutex);
+        job->complete=displaylist_cell_load(this_->dl, job->cell, this_->pro, this_->maxlen, this_);
+        pthread_mutex_lock(&this_->mutex);
+        job->done=1;
+        pthread_cond_broadcast(&this_->cond);
+    }
+    pthread_mutex_unlock(&this_->mutex);
+    return NULL;
+}
+
+/**
+ * @brief Starts reading the cells of a displaylist which have not been read yet on worker threads
+ *
+ * The hash of the displaylist has to be up to date, and must not change until the workers are destroyed.
+ *
+ * @param dl The displaylist
+ * @param threads The number of worker threads, 0 for one per online CPU
+ *
+ * @return The new workers, or NULL if there is no cell to read, or fewer than two threads would be used
+ */
+static struct displaylist_workers *displaylist_workers_new(struct displaylist *dl, int threads) {
+    struct displaylist_workers *this_;
+    GList *l;
+    int i;
+
+#if defined(HAVE_UNISTD_H) && defined(_SC_NPROCESSORS_ONLN)
+    if (threads <= 0)
+        threads=sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    if (threads < 2)
+        return NULL;
+    this_=g_new0(struct displaylist_workers, 1);
+    this_->dl=dl;
+    this_->pro=transform_get_projection(dl->dc.trans);
+    this_->maxlen=dl->dc.maxlen;
+    for (l = dl->cells ; l ; l = g_list_next(l)) {
+        struct displaylist_cell *cell=l->data;
+        if (cell->loaded)
+            continue;
+        this_->jobs=g_renew(struct displaylist_job, this_->jobs, this_->job_count+1);
+        memset(&this_->jobs[this_->job_count], 0, sizeof(*this_->jobs));
+        this_->jobs[this_->job_count++].cell=cell;
+    }
+    if (!this_->job_count) {
+        displaylist_workers_destroy(this_);
+        return NULL;
+    }
+    pthread_mutex_init(&this_->mutex, NULL);
+    pthread_cond_init(&this_->cond, NULL);
+    if (threads > this_->job_count)
+        threads=this_->job_count;
+    this_->threads=g_new(pthread_t, threads);
+    for (i = 0 ; i < threads ; i++) {
+        if (pthread_create(&this_->threads[i], NULL, displaylist_worker, this_))
+            break;
+        this_->thread_count++;
+    }
+    if (!this_->thread_count) {
+        dbg(lvl_error,"failed to start draw threads");
+        displaylist_workers_destroy(this_);
+        return NULL;
+    }
+    dbg(lvl_debug,"%d jobs on %d threads", this_->job_count, this_->thread_count);
+    return this_;
+}
+
+/**
+ * @brief Waits for the draw workers to read all cells
+ *
+ * @param this_ The workers
+ * @param timeout Time in milliseconds to wait for the next job if it is not completed yet, -1 to wait as long as it
+ * takes
+ * @param used Updated with the peak number of coordinates used by an item
+ *
+ * @return True if all jobs have been completed, false if the next job was not completed within `timeout`
+ */
+static int displaylist_workers_wait(struct displaylist_workers *this_, int timeout, int *used) {
+    struct displaylist_job *job;
+    struct timespec until;
+    int done;
+
+    while (this_->current < this_->job_count) {
+        job=&this_->jobs[this_->current];
+        pthread_mutex_lock(&this_->mutex);
+        if (timeout < 0) {
+            while (!job->done)
+                pthread_cond_wait(&this_->cond, &this_->mutex);
+        } else if (timeout > 0 && !job->done) {
+            clock_gettime(CLOCK_REALTIME, &until);
+            until.tv_sec+=timeout/1000;
+            until.tv_nsec+=(timeout%1000)*1000000L;
+            if (until.tv_nsec >= 1000000000L) {
+                until.tv_sec++;
+                until.tv_nsec-=1000000000L;
+            }
+            while (!job->done && !pthread_cond_timedwait(&this_->cond, &this_->mutex, &until));
+        }
+        done=job->done;
+        pthread_mutex_unlock(&this_->mutex);
+        if (!done)
+            return 0;
+        job->cell->loaded=job->complete;
+        if (*used < job->cell->used)
+            *used=job->cell->used;
+        if (job->complete) {
+            this_->dl->items_read+=job->cell->read;
+            this_->dl->items_created+=job->cell->count+job->cell->shared_count;
+        }
+        this_->current++;
+    }
+    return 1;
+}
+
+/**
+ * @brief Stops the draw workers and frees them
+ *
+ * Cells which have been read completely are kept; the displayitems of all others are discarded.
+ *
+ * @param this_ The workers, may be NULL
+ */
+static void displaylist_workers_destroy(struct displaylist_workers *this_) {
+    int i;
+
+    if (!this_)
+        return;
+    if (this_->thread_count) {
+        pthread_mutex_lock(&this_->mutex);
+        this_->cancel=1;
+        pthread_mutex_unlock(&this_->mutex);
+        for (i = 0 ; i < this_->thread_count ; i++)
+            pthread_join(this_->threads[i], NULL);
+    }
+    if (this_->threads) {
+        pthread_mutex_destroy(&this_->mutex);
+        pthread_cond_destroy(&this_->cond);
+    }
+    for (i = this_->current ; i < this_->job_count ; i++) {
+        if (this_->jobs[i].done && this_->jobs[i].complete)
+            this_->jobs[i].cell->loaded=1;
+        else
+            displaylist_cell_clear(this_->jobs[i].cell);
+    }
+    g_free(this_->jobs);
+    g_free(this_->threads);
+    g_free(this_);
+}
+
+#else
+
+static int displaylist_workers_cancelled(struct displaylist_workers *this_) {
+    return 0;
+}
+
+static struct displaylist_workers *displaylist_workers_new(struct displaylist *dl, int threads) {
+    return NULL;
+}
+
+static int displaylist_workers_wait(struct displaylist_workers *this_, int timeout, int *used) {
+    return 1;
+}
+
+static void displaylist_workers_destroy(struct displaylist_workers *this_) {
+}
+
+#endif
+
+/**
+ * @brief Returns the time elapsed since `last` in microseconds, and sets `last` to the current time
+ */
+static long displaylist_elapsed(struct timeval *last) {
+    struct timeval curr;
+    long ret;
+
+    gettimeofday(&curr, NULL);
+    ret=(curr.tv_sec-last->tv_sec)*1000000L+curr.tv_usec-last->tv_usec;
+    *last=curr;
+    return ret;
+}
+
 static void do_draw(struct displaylist *displaylist, int cancel, int flags) {
     struct item *item;
-    int count,max=displaylist->dc.maxlen,workload=0;
-    int used=0;
-    struct coord *ca;
-    struct attr attr,attr2;
+    struct displayitem *di;
+    struct displaylist_coords ca;
+    int workload=0;
     enum projection pro;
-    int need_free=0;
+    struct timeval tv;
 
-    if (max < ALLOCA_COORD_LIMIT) {
-        ca=g_alloca(sizeof(struct coord)*max);
-        need_free=0;
+    ca.max=displaylist->dc.maxlen;
+    if (ca.max < ALLOCA_COORD_LIMIT) {
+        ca.c=g_alloca(sizeof(struct coord)*ca.max);
+        ca.allocated=0;
     } else {
-        ca=g_malloc(sizeof(struct coord)*max);
-        need_free=1;
+        ca.c=g_malloc(sizeof(struct coord)*ca.max);
+        ca.allocated=1;
     }
+    ca.used=0;
 
-    if (displaylist->order != displaylist->order_hashed || displaylist->layout != displaylist->layout_hashed) {
-        displaylist_update_hash(displaylist);
-        displaylist->order_hashed=displaylist->order;
-        displaylist->layout_hashed=displaylist->layout;
-    }
     profile(0,NULL);
+    gettimeofday(&tv, NULL);
     pro=transform_get_projection(displaylist->dc.trans);
     while (!cancel) {
         if (!displaylist->msh)
@@ -3280,10 +4102,24 @@ static void do_draw(struct displaylist *displaylist, int cancel, int flags) {
         if (!displaylist->m) {
             displaylist->m=mapset_next(displaylist->msh, 1);
             if (!displaylist->m) {
+                if ((displaylist->workers && !displaylist_workers_wait(displaylist->workers,
+                        displaylist->workload ? DISPLAYLIST_WORKER_WAIT : -1, &ca.used))
+                        || !displaylist_cells_load(displaylist, &workload, &ca.used)) {
+                    displaylist->fetch_usec+=displaylist_elapsed(&tv);
+                    if (ca.allocated) {
+                        g_free(ca.c);
+                    }
+                    return;
+                }
+                displaylist_cells_link(displaylist);
                 mapset_close(displaylist->msh);
                 displaylist->msh=NULL;
                 break;
             }
+            if (displaylist_cells_handle_map(displaylist, displaylist->m)) {
+                displaylist->m=NULL;
+                continue;
+            }
             displaylist->dc.pro=map_projection(displaylist->m);
             displaylist->conv=map_requires_conversion(displaylist->m);
             if (route_selection)
@@ -3294,90 +4130,34 @@ static void do_draw(struct displaylist *displaylist, int cancel, int flags) {
         }
         if (displaylist->mr) {
             while ((item=map_rect_get_item(displaylist->mr))) {
-                int label_count=0;
-                char *labels[2];
                 struct hash_entry *entry;
-                int coords_left;
                 if (item == &busy_item) {
                     if (displaylist->workload) {
-                        if (need_free) {
-                            g_free(ca);
+                        displaylist->fetch_usec+=displaylist_elapsed(&tv);
+                        if (ca.allocated) {
+                            g_free(ca.c);
                         }
                         return;
                     } else
                         continue;
                 }
+                displaylist->items_read++;
                 entry=get_hash_entry(displaylist, item->type);
                 if (!entry)
                     continue;
-                count=item_coord_get_within_selection(item, ca, item->type < type_line ? 1: max, displaylist->sel);
-                /* abort if no coordinates within selection at all */
-                if (! count)
+                di=display_convert(&displaylist->arena, item, displaylist->m, displaylist->conv, pro, displaylist->sel,
+                                   &ca, NULL);
+                /* remember the new maximum */
+                displaylist->dc.maxlen=ca.max;
+                if (!di)
                     continue;
-                /* handle overflow */
-                if (count == max) {
-                    /* get required space */
-                    item_coord_rewind(item);
-                    coords_left=item_coords_left(item);
-                    /* increase to required space, or double space if we couldn't get required space */
-                    if(coords_left > 0) {
-                        displaylist->dc.maxlen=(coords_left+2);
-                    } else {
-                        displaylist->dc.maxlen=max*2;
-                    }
-                    dbg(lvl_error,"point count overflow %d for %s "ITEM_ID_FMT". Increase to %d", count,item_to_name(item->type),
-                        ITEM_ID_ARGS(*item), displaylist->dc.maxlen);
-                    /* remember the new maximum */
-                    max=displaylist->dc.maxlen;
-                    /* get more memory */
-                    if(need_free)
-                        g_free(ca);
-                    ca=g_malloc(sizeof(struct coord)*(displaylist->dc.maxlen));
-                    need_free=1;
-                    /* try again to get coordinates */
-                    item_coord_rewind(item);
-                    count=item_coord_get_within_selection(item, ca, item->type < type_line ? 1: max, displaylist->sel);
-                    /* check if we got valid coordinates in second attempt. If not don't try to draw this at all */
-                    if(count <= 0) {
-                        continue;
-                    }
-                }
-                /* transform the coordinates */
-                if (displaylist->dc.pro != pro)
-                    transform_from_to_count(ca, displaylist->dc.pro, ca, pro, count);
-
-                /* remember the peak coordinates actually used */
-                if(used < count)
-                    used=count;
-
-                if (item_is_custom_poi(*item)) {
-                    if (item_attr_get(item, attr_icon_src, &attr2))
-                        labels[1]=map_convert_string(displaylist->m, attr2.u.str);
-                    else
-                        labels[1]=NULL;
-                    label_count=2;
-                } else {
-                    labels[1]=NULL;
-                    label_count=0;
-                }
-                if (item_attr_get(item, attr_label, &attr)) {
-                    labels[0]=attr.u.str;
-                    if (!label_count)
-                        label_count=2;
-                } else
-                    labels[0]=NULL;
-                if (displaylist->conv && label_count) {
-                    labels[0]=map_convert_string(displaylist->m, labels[0]);
-                    display_add(entry, item, count, ca, labels, label_count);
-                    map_convert_free(labels[0]);
-                } else
-                    display_add(entry, item, count, ca, labels, label_count);
-                if (labels[1])
-                    map_convert_free(labels[1]);
+                display_add(entry, di);
+                displaylist->items_created++;
                 workload++;
                 if (workload == displaylist->workload) {
-                    if (need_free) {
-                        g_free(ca);
+                    displaylist->fetch_usec+=displaylist_elapsed(&tv);
+                    if (ca.allocated) {
+                        g_free(ca.c);
                     }
                     return;
                 }
@@ -3391,6 +4171,9 @@ static void do_draw(struct displaylist *displaylist, int cancel, int flags) {
         displaylist->m=NULL;
     }
     profile(1,"process_selection\n");
+    displaylist->fetch_usec+=displaylist_elapsed(&tv);
+    displaylist_workers_destroy(displaylist->workers);
+    displaylist->workers=NULL;
     if (displaylist->idle_ev)
         event_remove_idle(displaylist->idle_ev);
     displaylist->idle_ev=NULL;
@@ -3399,6 +4182,7 @@ static void do_draw(struct displaylist *displaylist, int cancel, int flags) {
     displaylist->busy=0;
     graphics_process_selection(displaylist->dc.gra, displaylist);
     profile(1,"draw\n");
+    displaylist->selection_usec+=displaylist_elapsed(&tv);
     if (! cancel)
         graphics_displaylist_draw(displaylist->dc.gra, displaylist, displaylist->dc.trans, displaylist->layout, flags);
     map_rect_destroy(displaylist->mr);
@@ -3410,15 +4194,17 @@ static void do_draw(struct displaylist *displaylist, int cancel, int flags) {
     displaylist->m=NULL;
     displaylist->msh=NULL;
     profile(1,"callback\n");
+    displaylist->draw_usec+=displaylist_elapsed(&tv);
     callback_call_1(displaylist->cb, cancel);
+    displaylist->callback_usec+=displaylist_elapsed(&tv);
     /* check if we can shrink item buffer next time */
-    if((displaylist->dc.maxlen > ALLOCA_COORD_LIMIT) && (used < ALLOCA_COORD_LIMIT)) {
-        dbg(lvl_debug, "Shrink memory. %d actually used", used);
+    if((displaylist->dc.maxlen > ALLOCA_COORD_LIMIT) && (ca.used < ALLOCA_COORD_LIMIT)) {
+        dbg(lvl_debug, "Shrink memory. %d actually used", ca.used);
         displaylist->dc.maxlen=ALLOCA_COORD_LIMIT;
     }
     /* clean up if required */
-    if (need_free) {
-        g_free(ca);
+    if (ca.allocated) {
+        g_free(ca.c);
     }
     profile(0,"end\n");
 }
@@ -3438,6 +4224,7 @@ void graphics_displaylist_draw(struct graphics *gra, struct displaylist *display
         displaylist->dc.trans=transform_dup(trans);
     displaylist->dc.gra=gra;
     displaylist->dc.mindist=flags&512?15:2;
+    displaylist->dc.points=0;
     // FIXME find a better place to set the background color
     if (l) {
         graphics_gc_set_background(gra->gc[0], &l->color);
@@ -3473,6 +4260,12 @@ static void graphics_load_mapset(struct graphics *gra, struct displaylist *displ
     }
     xdisplay_free(displaylist);
     dbg(lvl_debug,"order=%d", order);
+    displaylist->items_read=0;
+    displaylist->items_created=0;
+    displaylist->fetch_usec=0;
+    displaylist->selection_usec=0;
+    displaylist->draw_usec=0;
+    displaylist->callback_usec=0;
 
     displaylist->dc.gra=gra;
     displaylist->ms=mapset;
@@ -3488,6 +4281,13 @@ static void graphics_load_mapset(struct graphics *gra, struct displaylist *displ
     displaylist->order=order>0?order:0;
     displaylist->busy=1;
     displaylist->layout=l;
+    if (displaylist->order != displaylist->order_hashed || displaylist->layout != displaylist->layout_hashed) {
+        displaylist_update_hash(displaylist);
+        displaylist->order_hashed=displaylist->order;
+        displaylist->layout_hashed=displaylist->layout;
+    }
+    displaylist_cells_update(displaylist);
+    displaylist->workers=displaylist_workers_new(displaylist, gra->draw_threads);
     if (async) {
         if (! displaylist->idle_cb)
             displaylist->idle_cb=callback_new_3(callback_cast(do_draw), displaylist, 0, flags);
@@ -3592,12 +4392,75 @@ struct displaylist * graphics_displaylist_new(void) {
 }
 
 void graphics_displaylist_destroy(struct displaylist *displaylist) {
+    displaylist_workers_destroy(displaylist->workers);
+    displaylist_cells_free(displaylist->cells);
+    displaylist_arena_destroy(&displaylist->arena);
     if(displaylist->dc.trans)
         transform_destroy(displaylist->dc.trans);
     g_free(displaylist);
 
 }
 
+/**
+ * @brief Gets the counters of a displaylist
+ *
+ * @param displaylist The displaylist
+ * @param stats Receives the counters
+ */
+void graphics_displaylist_get_stats(struct displaylist *displaylist, struct displaylist_stats *stats) {
+    GList *l;
+    int i;
+
+    stats->items=0;
+    for (i = 0 ; i < HASH_SIZE ; i++)
+        stats->items+=displaylist->hash_entries[i].count;
+    stats->arena_size=displaylist->arena.size;
+    stats->arena_used=displaylist->arena.used;
+    stats->cells=0;
+    for (l = displaylist->cells ; l ; l = g_list_next(l)) {
+        struct displaylist_cell *cell=l->data;
+        stats->arena_size+=cell->arena.size;
+        stats->arena_used+=cell->arena.used;
+        stats->cells++;
+    }
+    stats->items_read=displaylist->items_read;
+    stats->items_created=displaylist->items_created;
+    stats->points=displaylist->dc.points;
+    stats->fetch_usec=displaylist->fetch_usec;
+    stats->selection_usec=displaylist->selection_usec;
+    stats->draw_usec=displaylist->draw_usec;
+    stats->callback_usec=displaylist->callback_usec;
+}
+
+/**
+ * @brief Gets the number of displayitems drawn by a layer
+ *
+ * Items of a type which the layer draws with more than one itemgra are counted once per itemgra.
+ *
+ * @param displaylist The displaylist
+ * @param lay The layer
+ * @returns The number of displayitems of the types drawn by `lay` at the order of `displaylist`
+ */
+int graphics_displaylist_get_layer_items(struct displaylist *displaylist, struct layer *lay) {
+    GList *itemgras,*types;
+    struct hash_entry *entry;
+    int ret=0;
+
+    if (lay->ref)
+        lay=lay->ref;
+    for (itemgras = lay->itemgras ; itemgras ; itemgras = g_list_next(itemgras)) {
+        struct itemgra *itm=itemgras->data;
+        if (displaylist->order < itm->order.min || displaylist->order > itm->order.max)
+            continue;
+        for (types = itm->type ; types ; types = g_list_next(types)) {
+            entry=get_hash_entry(displaylist, GPOINTER_TO_INT(types->data));
+            if (entry)
+                ret+=entry->count;
+        }
+    }
+    return ret;
+}
+
 
 /**
  * Get the map item which given displayitem is based on.
@@ -200,6 +200,23 @@ struct graphics_data_image {
     int size;
 };
 
+/**
+ * @brief Counters of a displaylist, see `graphics_displaylist_get_stats()`
+ */
+struct displaylist_stats {
+    int items;              /**< Number of displayitems */
+    long arena_size;        /**< Bytes allocated for displayitems */
+    long arena_used;        /**< Bytes used by displayitems */
+    int cells;              /**< Number of cells in which displayitems of static maps are kept */
+    int items_read;         /**< Items read from the maps for the last redraw */
+    int items_created;      /**< Displayitems created for the last redraw, not counting those of cells kept */
+    long points;            /**< Coordinates transformed to the screen by the last draw */
+    long fetch_usec;        /**< Time spent reading the maps for the last redraw */
+    long selection_usec;    /**< Time spent adding the selection to the displaylist */
+    long draw_usec;         /**< Time spent drawing the displaylist */
+    long callback_usec;     /**< Time spent in the callback of the last redraw */
+};
+
 /* prototypes */
 enum attr_type;
 enum draw_mode_num;
@@ -211,12 +228,14 @@ struct color;
 struct displayitem;
 struct displaylist;
 struct displaylist_handle;
+struct displaylist_stats;
 struct graphics;
 struct graphics_font;
 struct graphics_gc;
 struct graphics_image;
 struct item;
 struct itemgra;
+struct layer;
 struct layout;
 struct mapset;
 struct point;
@@ -278,6 +297,8 @@ struct displayitem *graphics_displaylist_next(struct displaylist_handle *dlh);
 void graphics_displaylist_close(struct displaylist_handle *dlh);
 struct displaylist *graphics_displaylist_new(void);
 void graphics_displaylist_destroy(struct displaylist *displaylist);
+void graphics_displaylist_get_stats(struct displaylist *displaylist, struct displaylist_stats *stats);
+int graphics_displaylist_get_layer_items(struct displaylist *displaylist, struct layer *lay);
 struct map_selection *displaylist_get_selection(struct displaylist *displaylist);
 GList *displaylist_get_clicked_list(struct displaylist *displaylist, struct point *p, int radius);
 struct item *graphics_displayitem_get_item(struct displayitem *di);
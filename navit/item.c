@@ -543,9 +543,20 @@ void item_id_from_ptr(struct item *item, void *id) {
 
 struct item_hash *
 item_hash_new(void) {
+    return item_hash_new_full(NULL);
+}
+
+/**
+ * @brief Creates a hash of items which frees its values
+ *
+ * @param value_destroy Called for each value when it is removed from the hash or the hash is destroyed, may be NULL
+ * @return The new hash
+ */
+struct item_hash *
+item_hash_new_full(void (*value_destroy)(void *)) {
     struct item_hash *ret=g_new(struct item_hash, 1);
 
-    ret->h=g_hash_table_new_full(item_hash_hash, item_hash_equal, g_free, NULL);
+    ret->h=g_hash_table_new_full(item_hash_hash, item_hash_equal, g_free, value_destroy);
     return ret;
 }
 
@@ -167,6 +167,7 @@ unsigned int item_id_hash(const void *key);
 int item_id_equal(const void *a, const void *b);
 void item_id_from_ptr(struct item *item, void *id);
 struct item_hash *item_hash_new(void);
+struct item_hash *item_hash_new_full(void (*value_destroy)(void *));
 void item_hash_insert(struct item_hash *h, struct item *item, void *val);
 int item_hash_remove(struct item_hash *h, struct item *item);
 void *item_hash_lookup(struct item_hash *h, struct item *item);
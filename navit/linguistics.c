@@ -277,8 +277,44 @@ static const char *upperlower[]= {
     NULL
 };
 
-static GHashTable *casefold_hash, *special_hash;
+/**
+ * @brief Properties of a two byte UTF-8 character, see linguistics_init()
+ *
+ * All characters in `upperlower` and `special` are encoded with two bytes, so they can be looked up by their code
+ * point instead of hashing them.
+ */
+struct linguistics_char {
+    unsigned short lower;           /**< Code point of the lower case character, or 0 if there is none */
+    const char *special[2];         /**< Replacements used by linguistics_expand_special() mode 1 and 2, or NULL */
+};
 
+/** Code points U+0000 to U+07FF, which are the ones encoded with two bytes */
+#define LINGUISTICS_CHARS 0x800
+
+static struct linguistics_char linguistics_chars[LINGUISTICS_CHARS];
+
+/**
+ * @brief Looks up the UTF-8 character from `str` to `end` in the character table
+ *
+ * @return The properties of the character, or NULL if it is not a two byte character
+ */
+static inline struct linguistics_char *linguistics_get_char(const char *str, const char *end) {
+    if (end-str != 2 || (str[0] & 0xe0) != 0xc0)
+        return NULL;
+    return &linguistics_chars[((str[0] & 0x1f) << 6) | (str[1] & 0x3f)];
+}
+
+/**
+ * @brief Returns the end of the UTF-8 character starting at `str`
+ *
+ * This is what g_utf8_find_next_char() returns for a zero terminated string.
+ */
+static inline const char *linguistics_char_end(const char *str) {
+    if (*str)
+        for (str++ ; (*str & 0xc0) == 0x80 ; str++)
+            ;
+    return str;
+}
 
 /*
  * @brief Prepare an utf-8 string for case insensitive comparison.
@@ -290,49 +326,134 @@ char* linguistics_casefold(const char *in) {
     const char *src=in;
     char *ret=g_new(char,len+1);
     char *dest=ret;
-    char buf[10];
-    while(*src && dest-ret<len) {
+    while(*src) {
         if(*src>='A' && *src<='Z') {
             *dest++=*src++ - 'A' + 'a';
         } else if (!(*src&128)) {
             *dest++=*src++;
         } else {
-            int charlen;
-            char *tmp, *folded;
-            tmp=g_utf8_find_next_char(src,NULL);
-            charlen=tmp-src+1;
-            g_strlcpy(buf,src,charlen>10?10:charlen);
-            folded=g_hash_table_lookup(casefold_hash,buf);
-            if(folded) {
-                while(*folded && dest-ret<len)
-                    *dest++=*folded++;
+            const char *tmp=linguistics_char_end(src);
+            struct linguistics_char *c=linguistics_get_char(src, tmp);
+            /* Lower case characters are encoded with two bytes as well, so the result never gets longer */
+            if(c && c->lower) {
+                *dest++=0xc0 | (c->lower >> 6);
+                *dest++=0x80 | (c->lower & 0x3f);
                 src=tmp;
             } else {
-                while(src<tmp && dest-ret<len)
+                while(src<tmp)
                     *dest++=*src++;
             }
         }
     }
     *dest=0;
-    if(*src)
-        dbg(lvl_error,"Casefolded string for '%s' needs extra space, result is truncated to '%s'.",in,ret);
     return ret;
 }
 
-static char** linguistics_get_special(const char *str, const char *end) {
-    char *buf;
-    int len;
-    if(!end)
-        end=g_utf8_find_next_char(str,NULL);
-    len=end-str+1;
-    buf=g_alloca(len);
-    g_strlcpy(buf,str,len);
-    return g_hash_table_lookup(special_hash,buf);
+/**
+ * @brief Iterator over the bytes of a string as linguistics_expand_special() would return them for its casefolded
+ * version, without allocating either
+ */
+struct linguistics_stream {
+    const char *in;                 /**< Next character of the input */
+    const char *out;                /**< Next byte of the current character to return */
+    const char *out_end;            /**< End of the current character to return */
+    char buf[2];                    /**< Buffer for casefolded characters */
+    int mode;                       /**< Expansion mode, see linguistics_expand_special() */
+};
+
+/**
+ * @brief Returns the next byte of a stream
+ *
+ * @return The next byte, or 0 at the end of the string
+ */
+static inline unsigned char linguistics_stream_next(struct linguistics_stream *s) {
+    const char *in,*end;
+    struct linguistics_char *c;
+
+    if (s->out < s->out_end)
+        return *s->out++;
+    in=s->in;
+    if (!*in)
+        return 0;
+    if (!(*in & 128)) {
+        s->in++;
+        if (*in >= 'A' && *in <= 'Z')
+            return *in - 'A' + 'a';
+        return *in;
+    }
+    end=linguistics_char_end(in);
+    s->in=end;
+    c=linguistics_get_char(in, end);
+    if (!c) {
+        s->out=in+1;
+        s->out_end=end;
+        return *in;
+    }
+    if (c->lower) {
+        c=&linguistics_chars[c->lower];
+        s->buf[0]=0xc0 | (c-linguistics_chars) >> 6;
+        s->buf[1]=0x80 | ((c-linguistics_chars) & 0x3f);
+        in=s->buf;
+        end=s->buf+2;
+    }
+    if (s->mode && c->special[s->mode-1]) {
+        in=c->special[s->mode-1];
+        end=in+strlen(in);
+    }
+    s->out=in+1;
+    s->out_end=end;
+    return *in;
+}
+
+/**
+ * @brief Checks whether linguistics_expand_special() would replace any character of the casefolded string
+ */
+static int linguistics_has_special(const char *str, int mode) {
+    const char *end;
+    struct linguistics_char *c;
+
+    while (*str) {
+        end=linguistics_char_end(str);
+        c=linguistics_get_char(str, end);
+        if (c) {
+            if (c->lower)
+                c=&linguistics_chars[c->lower];
+            if (c->special[mode-1])
+                return 1;
+        }
+        str=end;
+    }
+    return 0;
+}
+
+/**
+ * @brief Compares a string, casefolded and expanded on the fly, with another one like strcmp() or strncmp()
+ */
+static int linguistics_compare_stream(const char *s1, const char *s2, int s2len, int mode, int partial) {
+    struct linguistics_stream s;
+    const unsigned char *p=(const unsigned char *)s2;
+    unsigned char c;
+
+    s.in=s1;
+    s.out=s.out_end=NULL;
+    s.mode=mode;
+    for (;;) {
+        if (partial && p-(const unsigned char *)s2 == s2len)
+            return 0;
+        c=linguistics_stream_next(&s);
+        if (c != *p)
+            return c-*p;
+        if (!c)
+            return 0;
+        p++;
+    }
 }
 
 /**
  * @brief Compare two strings, trying to replace special characters (e.g. umlauts) in first string with plain letters.
  *
+ * The first string is casefolded and expanded while comparing it, so this does not allocate memory.
+ *
  * @param s1 First string to process, for example, an item name from the map. Will be linguistics_casefold()ed before comparison.
  * @param s2 Second string to process, usually user supplied search string. Should be linguistics_casefold()ed before calling this function.
  * @param mode set to composition of linguistics_cmp_mode flags to have s1 linguistics_expand_special()ed, allow matches shorter than whole s1, or
@@ -343,32 +464,22 @@ int linguistics_compare(const char *s1, const char *s2, enum linguistics_cmp_mod
     int ret=0;
     int i;
     int s2len=strlen(s2);
-    char *s1f;
-    /* Calling linguistics_casefold() before linguistics_expand_special() requires that result is independent of calling order. This seems
-       to be true at the time of writing this comment. */
-    s1f=linguistics_casefold(s1);
+    int partial=(mode & linguistics_cmp_partial) != 0;
     for(i=0; i<3; i++) {
-        char *s, *word;
-        if(i>0)
-            s=linguistics_expand_special(s1f,i);
-        else
-            s=s1f;
-        word=s;
+        const char *word=s1;
+        /* Expanding a string without special characters gives the same string again, which has been compared already */
+        if(i>0 && !linguistics_has_special(s1,i))
+            continue;
         while(word) {
-            if(mode & linguistics_cmp_partial)
-                ret=strncmp(word,s2,s2len);
-            else
-                ret=strcmp(word,s2);
+            ret=linguistics_compare_stream(word,s2,s2len,i,partial);
             if(!ret || !(mode & linguistics_cmp_words))
                 break;
-            word=linguistics_next_word(word);
+            /* Separators are ASCII, so words start at the same places before and after casefolding and expanding */
+            word=linguistics_next_word((char *)word);
         }
-        if(i>0)
-            g_free(s);
         if(!ret || !(mode & linguistics_cmp_expand))
             break;
     }
-    g_free(s1f);
     return ret;
 }
 
@@ -404,9 +515,9 @@ char *linguistics_expand_special(const char *str, int mode) {
         in_rest-=len;
 
         if (len > 1) {
-            char **spc=linguistics_get_special(in, next);
-            if (spc) {
-                const char *replace=spc[mode];
+            struct linguistics_char *spc=linguistics_get_char(in, next);
+            if (spc && mode <= 2) {
+                const char *replace=spc->special[mode-1];
                 if (replace) {
                     int replace_len=strlen(replace);
                     if(out-ret+replace_len+in_rest>ret_len) {
@@ -416,7 +527,7 @@ char *linguistics_expand_special(const char *str, int mode) {
                         out=new_ret+(out-ret);
                         ret=new_ret;
                     }
-                    dbg(lvl_debug,"found %s %s %d %s %d",in,spc[0],len,replace,replace_len);
+                    dbg(lvl_debug,"found %s %d %s %d",in,len,replace,replace_len);
                     strcpy(out, replace);
                     out+=replace_len;
                     match=1;
@@ -459,46 +570,36 @@ int linguistics_search(const char *str) {
 }
 
 /**
- * @brief Copy one utf8 encoded char to newly allocated buffer.
- *
- * @param s pointer to the beginning of the char.
- * @return  newly allocated nul-terminated string containing one utf8 encoded character.
+ * @brief Fills the character table from `upperlower` and `special`.
  */
-static char
-*linguistics_dup_utf8_char(const char *s) {
-    char *ret, *next;
-    next=g_utf8_find_next_char(s,NULL);
-    ret=g_new(char, next-s+1);
-    g_strlcpy(ret,s,next-s+1);
-    return ret;
-}
-
 void linguistics_init(void) {
     int i;
 
-    casefold_hash=g_hash_table_new_full(g_str_hash, g_str_equal,g_free,g_free);
-
     for (i = 0 ; upperlower[i]; i+=2) {
-        int j,k;
-        for(j=0,k=0; upperlower[i][j] && upperlower[i+1][k];) {
-            char *s1=linguistics_dup_utf8_char(upperlower[i]+j);
-            char *s2=linguistics_dup_utf8_char(upperlower[i+1]+k);
-            g_hash_table_insert(casefold_hash,s1,s2);
-            j+=strlen(s1);
-            k+=strlen(s2);
+        const char *u=upperlower[i],*l=upperlower[i+1];
+        while (*u && *l) {
+            const char *uend=linguistics_char_end(u),*lend=linguistics_char_end(l);
+            struct linguistics_char *uc=linguistics_get_char(u, uend),*lc=linguistics_get_char(l, lend);
+            if (uc && lc)
+                uc->lower=lc-linguistics_chars;
+            else
+                dbg(lvl_error,"Case conversion of '%.*s' to '%.*s' is not supported, only two byte characters are",
+                    (int)(uend-u), u, (int)(lend-l), l);
+            u=uend;
+            l=lend;
         }
     }
 
-    special_hash=g_hash_table_new(g_str_hash, g_str_equal);
-    for (i = 0 ; i < sizeof(special)/sizeof(special[0]); i++)
-        g_hash_table_insert(special_hash,(gpointer)special[i][0],special[i]);
-
+    for (i = 0 ; i < sizeof(special)/sizeof(special[0]); i++) {
+        struct linguistics_char *c=linguistics_get_char(special[i][0], linguistics_char_end(special[i][0]));
+        if (c) {
+            c->special[0]=special[i][1];
+            c->special[1]=special[i][2];
+        } else
+            dbg(lvl_error,"Replacement of '%s' is not supported, only two byte characters are", special[i][0]);
+    }
 }
 
 void linguistics_free(void) {
-    g_hash_table_destroy(casefold_hash);
-    g_hash_table_destroy(special_hash);
-    casefold_hash=NULL;
-    special_hash=NULL;
+    memset(linguistics_chars, 0, sizeof(linguistics_chars));
 }
-
@@ -353,6 +353,166 @@ map_rect_get_item_byid(struct map_rect *mr, int id_hi, int id_lo) {
     return ret;
 }
 
+/** Number of coordinates read from an item at once when emulating `map_rect_get_batch()` */
+#define MAP_BATCH_COORD_CHUNK 64
+
+/**
+ * @brief Creates a new batch to read items with
+ *
+ * @param attr_types The attributes to read for each item, terminated by `attr_none`, or NULL to read none. Only integer
+ * attributes can be read. The list is not copied and must stay valid as long as the batch is used.
+ * @param item_size The maximum number of items read at once
+ * @return The new batch, see `struct map_batch`
+ */
+struct map_batch *map_batch_new(enum attr_type *attr_types, int item_size) {
+    struct map_batch *batch=g_new0(struct map_batch, 1);
+    int i;
+
+    for (i = 0 ; attr_types && attr_types[i] != attr_none ; i++)
+        dbg_assert(ATTR_IS_INT(attr_types[i]));
+    batch->attr_types=attr_types;
+    batch->item_size=item_size > 0 ? item_size : 1;
+    batch->items=g_new(struct map_batch_item, batch->item_size);
+    return batch;
+}
+
+/**
+ * @brief Makes room for more coordinates in a batch
+ *
+ * This is used by map plugins filling a batch. The coordinates are not counted in `coord_count` yet.
+ *
+ * @param batch The batch
+ * @param count The number of coordinates to make room for
+ * @return Where to store the coordinates, invalidated by the next call
+ */
+struct coord *map_batch_reserve_coords(struct map_batch *batch, int count) {
+    if (batch->coord_count + count > batch->coord_size) {
+        while (batch->coord_count + count > batch->coord_size)
+            batch->coord_size=batch->coord_size ? batch->coord_size*2 : 1024;
+        batch->coords=g_renew(struct coord, batch->coords, batch->coord_size);
+        batch->nodes=g_renew(unsigned char, batch->nodes, batch->coord_size);
+    }
+    return batch->coords+batch->coord_count;
+}
+
+/**
+ * @brief Makes room for more attributes in a batch
+ *
+ * This is used by map plugins filling a batch. The attributes are not counted in `attr_count` yet.
+ *
+ * @param batch The batch
+ * @param count The number of attributes to make room for
+ * @return Where to store the attributes, invalidated by the next call
+ */
+struct map_batch_attr *map_batch_reserve_attrs(struct map_batch *batch, int count) {
+    if (batch->attr_count + count > batch->attr_size) {
+        while (batch->attr_count + count > batch->attr_size)
+            batch->attr_size=batch->attr_size ? batch->attr_size*2 : 256;
+        batch->attrs=g_renew(struct map_batch_attr, batch->attrs, batch->attr_size);
+    }
+    return batch->attrs+batch->attr_count;
+}
+
+/**
+ * @brief Adds an item to a batch using the item methods
+ *
+ * This is what `map_rect_get_batch()` does for maps which do not read batches themselves.
+ */
+static void map_batch_add_item(struct map_batch *batch, struct item *item) {
+    struct map_batch_item *bi=&batch->items[batch->item_count++];
+    struct attr attr;
+    int i,rc;
+
+    bi->type=item->type;
+    bi->id_hi=item->id_hi;
+    bi->id_lo=item->id_lo;
+    bi->coord_start=batch->coord_count;
+    bi->has_nodes=item->meth->item_coord_is_node != NULL;
+    item_coord_rewind(item);
+    for (;;) {
+        struct coord *c=map_batch_reserve_coords(batch, MAP_BATCH_COORD_CHUNK);
+        if (bi->has_nodes) {
+            batch->nodes[batch->coord_count]=item_coord_is_node(item);
+            rc=item_coord_get(item, c, 1);
+        } else
+            rc=item_coord_get(item, c, MAP_BATCH_COORD_CHUNK);
+        if (rc <= 0)
+            break;
+        batch->coord_count+=rc;
+    }
+    bi->coord_count=batch->coord_count-bi->coord_start;
+    bi->attr_start=batch->attr_count;
+    for (i = 0 ; batch->attr_types && batch->attr_types[i] != attr_none ; i++) {
+        item_attr_rewind(item);
+        while (item_attr_get(item, batch->attr_types[i], &attr)) {
+            struct map_batch_attr *a=map_batch_reserve_attrs(batch, 1);
+            a->type=attr.type;
+            a->num=attr.u.num;
+            batch->attr_count++;
+        }
+    }
+    bi->attr_count=batch->attr_count-bi->attr_start;
+}
+
+/**
+ * @brief Reads the next items of a map rect into a batch
+ *
+ * This returns the items calling `map_rect_get_item()` repeatedly would return, except for those rejected by the
+ * filter of the batch, along with their coordinates and the attributes asked for when creating the batch. Maps which
+ * support it fill the batch directly, which saves the calls to the item methods for each item. Callers must not mix
+ * calls to this function and to `map_rect_get_item()` on the same map rect.
+ *
+ * @param mr The map rect to read from
+ * @param batch The batch to fill, its previous contents are discarded
+ * @return The number of items read, 0 if there are no more items, or -1 if the map is busy (e.g. still loading data)
+ * and no item could be read yet, in which case the function should be called again
+ */
+int map_rect_get_batch(struct map_rect *mr, struct map_batch *batch) {
+    struct item *item;
+    int ret;
+
+    dbg_assert(mr != NULL);
+    dbg_assert(batch != NULL);
+    batch->item_count=0;
+    batch->coord_count=0;
+    batch->attr_count=0;
+    if (mr->m->meth.map_rect_get_batch) {
+        ret=mr->m->meth.map_rect_get_batch(mr->priv, batch);
+        if (ret >= 0)
+            return ret;
+        /* the map leaves it to the item methods, e.g. because it is busy */
+        batch->item_count=0;
+        batch->coord_count=0;
+        batch->attr_count=0;
+    }
+    while (batch->item_count < batch->item_size && (item=map_rect_get_item(mr))) {
+        if (item == &busy_item) {
+            if (!batch->item_count)
+                return -1;
+            break;
+        }
+        if (batch->filter && !batch->filter(item->type, batch->filter_data))
+            continue;
+        map_batch_add_item(batch, item);
+    }
+    return batch->item_count;
+}
+
+/**
+ * @brief Destroys a batch
+ *
+ * @param batch The batch
+ */
+void map_batch_destroy(struct map_batch *batch) {
+    if (!batch)
+        return;
+    g_free(batch->items);
+    g_free(batch->coords);
+    g_free(batch->nodes);
+    g_free(batch->attrs);
+    g_free(batch);
+}
+
 /**
  * @brief Destroys a map rect
  *
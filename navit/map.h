@@ -65,6 +65,56 @@ struct map_selection {
 	struct item_range range;	/**< Range of items which should be delivered */
 };
 
+/**
+ * @brief An item read as part of a batch, see `struct map_batch`
+ */
+struct map_batch_item {
+	enum item_type type;        /**< Type of the item */
+	int id_hi, id_lo;           /**< ID of the item */
+	int coord_start;            /**< Index of the first coordinate of the item in `coords` of the batch */
+	int coord_count;            /**< Number of coordinates of the item */
+	int attr_start;             /**< Index of the first attribute of the item in `attrs` of the batch */
+	int attr_count;             /**< Number of attributes of the item */
+	int has_nodes;              /**< Whether `nodes` of the batch holds node flags for the coordinates of the item */
+};
+
+/**
+ * @brief An attribute of an item read as part of a batch, see `struct map_batch`
+ */
+struct map_batch_attr {
+	enum attr_type type;        /**< Type of the attribute */
+	long num;                   /**< Value of the attribute */
+};
+
+/**
+ * @brief A batch of items read from a map rect in one go
+ *
+ * A batch is filled by `map_rect_get_batch()` with the next items of a map rect, their coordinates and the attributes
+ * asked for, each stored contiguously, so that loops over many items need not call the item methods for every item.
+ * The buffers are owned by the batch and reused for each call; they are grown as needed, except for `items`, which
+ * holds at most `item_size` entries.
+ *
+ * A batch is created with `map_batch_new()`. Its fields are read-only, except for `filter` and `filter_data`.
+ */
+struct map_batch {
+	enum attr_type *attr_types; /**< Attributes to read, terminated by `attr_none`. Only integer attributes can be read. */
+	int (*filter)(enum item_type type, void *data); /**< If not NULL, only items for which this returns true are read */
+	void *filter_data;          /**< Passed to `filter` */
+	struct map_batch_item *items; /**< The items */
+	int item_count;             /**< Number of items */
+	int item_size;              /**< Maximum number of items */
+	struct coord *coords;       /**< Coordinates of all items */
+	unsigned char *nodes;       /**< Node flags of the coordinates (see `item_coord_is_node()`), for items with
+	                                 `has_nodes` */
+	int coord_count;            /**< Number of coordinates */
+	int coord_size;             /**< Allocated size of `coords` and `nodes` */
+	struct map_batch_attr *attrs; /**< Attributes of all items. The attributes of an item are in the order of the map,
+	                                 or in the order of `attr_types`; the order of several attributes of one type
+	                                 is always kept. */
+	int attr_count;             /**< Number of attributes */
+	int attr_size;              /**< Allocated size of `attrs` */
+};
+
 /**
  * @brief Holds all functions a map plugin has to implement to be usable
  *
@@ -91,6 +141,10 @@ struct map_methods {
 	struct item *		(*map_rect_create_item)(struct map_rect_priv *mr, enum item_type type); /**< Function to create a new item in the map */
 	int			(*map_get_attr)(struct map_priv *priv, enum attr_type type, struct attr *attr); /**< Function to get a map attribute, can be NULL */
     int			(*map_set_attr)(struct map_priv *priv, struct attr *attr); /**< Function to set a map attribute, can be NULL */
+	int			(*map_rect_get_batch)(struct map_rect_priv *mr, struct map_batch *batch); /**< Function to read the next items
+	                                 from a map rect into a batch, returns like `map_rect_get_batch()`, except that -1
+	                                 has the batch read item by item instead (e.g. when the map is busy, or when the
+	                                 items need processing the function does not do), can be NULL */
 };
 
 /**
@@ -306,6 +360,11 @@ struct map_rect *map_rect_new(struct map *m, struct map_selection *sel);
 struct item *map_rect_get_item(struct map_rect *mr);
 struct item *map_rect_get_item_byid(struct map_rect *mr, int id_hi, int id_lo);
 struct item *map_rect_create_item(struct map_rect *mr, enum item_type type_);
+struct map_batch *map_batch_new(enum attr_type *attr_types, int item_size);
+struct coord *map_batch_reserve_coords(struct map_batch *batch, int count);
+struct map_batch_attr *map_batch_reserve_attrs(struct map_batch *batch, int count);
+int map_rect_get_batch(struct map_rect *mr, struct map_batch *batch);
+void map_batch_destroy(struct map_batch *batch);
 void map_rect_destroy(struct map_rect *mr);
 struct map_search *map_search_new(struct map *m, struct item *item, struct attr *search_attr, int partial);
 struct item *map_search_get_item(struct map_search *this_);
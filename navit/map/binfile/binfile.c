@@ -132,6 +132,7 @@ struct map_priv {
     long download_enabled;
     int last_searched_town_id_hi;
     int last_searched_town_id_lo;
+    struct tile name_index;      //!< Name index of the country searched last, see binmap_search_name_index().
 };
 
 struct map_rect_priv {
@@ -174,6 +175,11 @@ struct map_search_priv {
     struct coord_rect rect_new;
     char *parent_name;
     GHashTable *search_results;
+    int indexed; /**< Were the candidates looked up in the name index of the country? */
+    int walked; /**< Has the walk through the country index finished? */
+    int *candidates; /**< Items whose name matches the search, as id_hi/id_lo pairs */
+    int candidate_count;
+    int candidate_pos;
 };
 
 
@@ -1594,6 +1600,181 @@ static int selection_contains(struct map_selection *sel, struct coord_rect *r, s
     return 0;
 }
 
+/**
+ * @brief Checks that a name index read from a map can be searched safely
+ *
+ * The index starts with the number of entries, followed by the entries (four integers each) and the strings they
+ * refer to. Every entry must point into the strings, and the last string must be terminated within the member.
+ *
+ * @param t The zip member holding the name index
+ * @return True if the index is valid
+ */
+static int binmap_name_index_valid(struct tile *t) {
+    int count,i,offset,size;
+    char *strings;
+
+    if (t->end <= t->start)
+        return 0;
+    count=le32_to_cpu(t->start[0]);
+    if (count < 0 || count > (t->end-t->start-1)/4)
+        return 0;
+    strings=(char *)(t->start+1+count*4);
+    size=(char *)t->end-strings;
+    if (!count)
+        return 1;
+    if (size <= 0 || strings[size-1])
+        return 0;
+    for (i = 0 ; i < count ; i++) {
+        offset=le32_to_cpu(t->start[1+i*4+1]);
+        if (offset < 0 || offset >= size)
+            return 0;
+    }
+    return 1;
+}
+
+/**
+ * @brief Loads the name index of a country
+ *
+ * The index of the country searched last is kept by the map, so that an incremental search does not read it again
+ * for every keystroke.
+ *
+ * @param m The map
+ * @param zipfile Number of the zip member holding the name index
+ * @return The name index, or NULL if it could not be read
+ */
+static int *binmap_name_index_get(struct map_priv *m, int zipfile) {
+    struct zip_cd *cd;
+    struct tile t;
+
+    t.start=NULL;
+    if (m->name_index.start && m->name_index.zipfile_num == zipfile)
+        return m->name_index.start;
+    if (m->name_index.start) {
+        file_data_free(m->name_index.fi, (unsigned char *)m->name_index.start);
+        m->name_index.start=NULL;
+    }
+    cd=binfile_read_cd(m, zipfile*m->cde_size, -1);
+    if (!cd)
+        return NULL;
+    if (cd->zipcunc && zipfile_to_tile(m, cd, &t) && binmap_name_index_valid(&t)) {
+        t.zipfile_num=zipfile;
+        m->name_index=t;
+    } else if (t.start) {
+        dbg(lvl_warning,"invalid name index in zip member %d", zipfile);
+        file_data_free(t.fi, (unsigned char *)t.start);
+    }
+    file_data_free(m->fi, (unsigned char *)cd);
+    return m->name_index.start;
+}
+
+/**
+ * @brief Compares an entry of a name index with a key
+ *
+ * Entries are sorted by the attribute they were made from, then by their casefolded name.
+ */
+static int binmap_name_index_compare(int *entry, char *strings, enum attr_type type, char *key) {
+    enum attr_type entry_type=le32_to_cpu(entry[0]);
+    if (entry_type != type)
+        return entry_type < type ? -1 : 1;
+    return strcmp(strings+le32_to_cpu(entry[1]), key);
+}
+
+/**
+ * @brief Adds the items of a name index whose name matches the search to the candidates of a search
+ *
+ * @param msp The search
+ * @param data The name index
+ * @param type The kind of names to look up, `attr_town_name`, `attr_district_name` or `attr_town_postal`
+ */
+static void binmap_search_name_index_lookup(struct map_search_priv *msp, int *data, enum attr_type type) {
+    int count=le32_to_cpu(data[0]);
+    int *entries=data+1,*entry;
+    char *strings=(char *)(entries+count*4);
+    char *key=msp->search.u.str;
+    int len=strlen(key);
+    int lo=0,hi=count,mid;
+
+    while (lo < hi) {
+        mid=lo+(hi-lo)/2;
+        if (binmap_name_index_compare(entries+mid*4, strings, type, key) < 0)
+            lo=mid+1;
+        else
+            hi=mid;
+    }
+    for ( ; lo < count ; lo++) {
+        entry=entries+lo*4;
+        if (le32_to_cpu(entry[0]) != type)
+            break;
+        /* Names equal to the key sort before all longer names starting with it */
+        if (msp->partial ? strncmp(strings+le32_to_cpu(entry[1]), key, len) : strcmp(strings+le32_to_cpu(entry[1]), key))
+            break;
+        if (!(msp->candidate_count % 256))
+            msp->candidates=g_renew(int, msp->candidates, (msp->candidate_count+256)*2);
+        msp->candidates[msp->candidate_count*2]=le32_to_cpu(entry[2]);
+        msp->candidates[msp->candidate_count*2+1]=le32_to_cpu(entry[3]);
+        msp->candidate_count++;
+    }
+}
+
+static int binmap_search_candidate_compare(const void *a, const void *b) {
+    const int *ia=a,*ib=b;
+    if (ia[0] != ib[0])
+        return ia[0] < ib[0] ? -1 : 1;
+    if (ia[1] != ib[1])
+        return ia[1] < ib[1] ? -1 : 1;
+    return 0;
+}
+
+/**
+ * @brief Looks up the candidates of a town search in the name index of a country
+ *
+ * The candidates are all items whose name (or postal code) matches the search, in the order the walk through the
+ * country index would have returned them. They still have to be checked by binmap_search_get_item(), just like the
+ * items found by the walk.
+ *
+ * @param msp The search
+ * @param zipfile Number of the zip member holding the name index
+ * @return 1 if the name index was used, 0 if the country index has to be walked instead
+ */
+static int binmap_search_name_index(struct map_search_priv *msp, int zipfile) {
+    int *data=binmap_name_index_get(msp->mr->m, zipfile);
+    int i,j;
+
+    if (!data)
+        return 0;
+    switch (msp->search.type) {
+    case attr_town_postal:
+        binmap_search_name_index_lookup(msp, data, attr_town_postal);
+        binmap_search_name_index_lookup(msp, data, attr_town_name);
+        binmap_search_name_index_lookup(msp, data, attr_district_name);
+        break;
+    case attr_town_name:
+        binmap_search_name_index_lookup(msp, data, attr_town_name);
+        break;
+    case attr_district_name:
+        binmap_search_name_index_lookup(msp, data, attr_district_name);
+        break;
+    case attr_town_or_district_name:
+        binmap_search_name_index_lookup(msp, data, attr_town_name);
+        binmap_search_name_index_lookup(msp, data, attr_district_name);
+        break;
+    default:
+        return 0;
+    }
+    qsort(msp->candidates, msp->candidate_count, sizeof(int)*2, binmap_search_candidate_compare);
+    for (i = 0, j = 0 ; i < msp->candidate_count ; i++) {
+        if (j && !binmap_search_candidate_compare(msp->candidates+i*2, msp->candidates+(j-1)*2))
+            continue;
+        msp->candidates[j*2]=msp->candidates[i*2];
+        msp->candidates[j*2+1]=msp->candidates[i*2+1];
+        j++;
+    }
+    msp->candidate_count=j;
+    msp->indexed=1;
+    dbg(lvl_debug,"%d candidates for '%s' from name index %d", j, msp->search.u.str, zipfile);
+    return 1;
+}
+
 static void map_parse_country_binfile(struct map_rect_priv *mr) {
     struct attr at;
 
@@ -1608,6 +1789,9 @@ static void map_parse_country_binfile(struct map_rect_priv *mr) {
 
     if(mr->msp) {
         struct attr *search=&mr->msp->search;
+        struct attr ni;
+        if(binfile_attr_get(mr->item.priv_data, attr_name_index_ref, &ni) && binmap_search_name_index(mr->msp, ni.u.num))
+            return;
         if(search->type==attr_town_name || search->type==attr_district_name || search->type==attr_town_or_district_name) {
             struct attr af, al;
             if(binfile_attr_get(mr->item.priv_data, attr_first_key, &af)) {
@@ -1723,6 +1907,113 @@ static struct item *map_rect_get_item_binfile(struct map_rect_priv *mr) {
     }
 }
 
+/**
+ * @brief Attributes which `map_rect_get_batch_binfile()` can copy straight from the tile data
+ *
+ * These are the integer attributes evaluated by the route graph, which `binfile_attr_get()` returns unchanged (apart
+ * from adding `AF_CAR` to the flags of old maps). Attributes needing more work, such as labels, URLs or groups, are
+ * not among them.
+ */
+static enum attr_type binfile_batch_attrs[] = {
+    attr_flags,
+    attr_maxspeed,
+    attr_delay,
+    attr_vehicle_dangerous_goods,
+    attr_vehicle_width,
+    attr_vehicle_height,
+    attr_vehicle_length,
+    attr_vehicle_weight,
+    attr_vehicle_axle_weight,
+    attr_none,
+};
+
+/**
+ * @brief Whether all attributes of a batch are in `binfile_batch_attrs`
+ */
+static int binfile_batch_attrs_supported(struct map_batch *batch) {
+    int i,j;
+
+    for (i = 0 ; batch->attr_types && batch->attr_types[i] != attr_none ; i++) {
+        for (j = 0 ; binfile_batch_attrs[j] != attr_none ; j++)
+            if (binfile_batch_attrs[j] == batch->attr_types[i])
+                break;
+        if (binfile_batch_attrs[j] == attr_none)
+            return 0;
+    }
+    return 1;
+}
+
+/**
+ * @brief Reads the next items of a map rect into a batch
+ *
+ * Coordinates and attributes are copied straight from the tile data, reading the attributes of each item in a single
+ * pass, see `map_rect_get_batch()`. This is only done if all attributes asked for are in `binfile_batch_attrs` and the
+ * map has no changes overlay, whose items replace those of the tiles; otherwise, and if the map is busy, -1 is returned
+ * to have the batch read item by item.
+ */
+static int map_rect_get_batch_binfile(struct map_rect_priv *mr, struct map_batch *batch) {
+    struct item *item;
+    struct map_batch_item *bi;
+    struct tile *t;
+    enum attr_type type;
+    int *pos;
+    int i,count,size;
+
+    if (mr->m->changes || !binfile_batch_attrs_supported(batch))
+        return -1;
+    while (batch->item_count < batch->item_size) {
+        item=map_rect_get_item_binfile(mr);
+        if (!item)
+            break;
+        if (item == &busy_item) {
+            if (!batch->item_count)
+                return -1;
+            break;
+        }
+        if (batch->filter && !batch->filter(item->type, batch->filter_data))
+            continue;
+        t=mr->t;
+        bi=&batch->items[batch->item_count++];
+        bi->type=item->type;
+        bi->id_hi=item->id_hi;
+        bi->id_lo=item->id_lo;
+        bi->has_nodes=0;
+        bi->coord_start=batch->coord_count;
+        count=(t->pos_attr_start-t->pos_coord_start)/2;
+#if __BYTE_ORDER == __LITTLE_ENDIAN
+        memcpy(map_batch_reserve_coords(batch, count), t->pos_coord_start, count*sizeof(struct coord));
+#else
+        {
+            int *dst=(int *)map_batch_reserve_coords(batch, count);
+            for (i = 0 ; i < count*2 ; i++)
+                dst[i]=le32_to_cpu(t->pos_coord_start[i]);
+        }
+#endif
+        batch->coord_count+=count;
+        bi->coord_count=count;
+        bi->attr_start=batch->attr_count;
+        pos=t->pos_attr_start;
+        while (batch->attr_types && pos < t->pos_next) {
+            size=le32_to_cpu(*pos++);
+            type=le32_to_cpu(pos[0]);
+            for (i = 0 ; batch->attr_types[i] != attr_none ; i++) {
+                if (batch->attr_types[i] == type) {
+                    struct map_batch_attr *a=map_batch_reserve_attrs(batch, 1);
+                    a->type=type;
+                    a->num=le32_to_cpu(pos[1]);
+                    if (type == attr_flags && mr->m->map_version < 1)
+                        a->num |= AF_CAR;
+                    batch->attr_count++;
+                    break;
+                }
+            }
+            pos+=size;
+        }
+        bi->attr_count=batch->attr_count-bi->attr_start;
+    }
+    return batch->item_count;
+}
+
 static struct item *map_rect_get_item_byid_binfile(struct map_rect_priv *mr, int id_hi, int id_lo) {
     struct tile *t;
     if (mr->m->eoc) {
@@ -2153,13 +2444,49 @@ static int item_inside_poly_list(struct item *it, GList *l) {
     return 0;
 }
 
+/**
+ * @brief Returns the next item to be checked by binmap_search_get_item()
+ *
+ * These are the items of the walk through the map rect of the search, followed by the candidates found in the name
+ * index, if the country had one.
+ */
+static struct item *binmap_search_next_item(struct map_search_priv *msp) {
+    struct map_rect_priv *mr=msp->mr;
+    struct item *it;
+    struct tile *t;
+    int id_hi,id_lo;
+
+    if (!msp->walked) {
+        it=map_rect_get_item_binfile(mr);
+        if (it || !msp->indexed)
+            return it;
+        msp->walked=1;
+    }
+    if (msp->candidate_pos >= msp->candidate_count)
+        return NULL;
+    id_hi=msp->candidates[msp->candidate_pos*2];
+    id_lo=msp->candidates[msp->candidate_pos*2+1];
+    msp->candidate_pos++;
+    /* Candidates are sorted by tile, so reuse the tile of the previous one if possible */
+    if (mr->m->changes || mr->tile_depth < 2 || mr->t->zipfile_num != id_hi)
+        return map_rect_get_item_byid_binfile(mr, id_hi, id_lo);
+    t=mr->t;
+    t->pos=t->start+id_lo;
+    mr->item.id_hi=id_hi;
+    mr->item.id_lo=id_lo;
+    setup_pos(mr);
+    binfile_coord_rewind(mr);
+    binfile_attr_rewind(mr);
+    return &mr->item;
+}
+
 static struct item *binmap_search_get_item(struct map_search_priv *map_search) {
     struct item* it;
     struct attr at;
     enum linguistics_cmp_mode mode=(map_search->partial?linguistics_cmp_partial:0);
 
     for (;;) {
-        while ((it  = map_rect_get_item_binfile(map_search->mr))) {
+        while ((it  = binmap_search_next_item(map_search))) {
             int has_house_number=0;
             switch (map_search->search.type) {
             case attr_town_postal:
@@ -2317,6 +2644,7 @@ static struct item *binmap_search_get_item(struct map_search_priv *map_search) {
 static void binmap_search_destroy(struct map_search_priv *ms) {
     if (ms->search_results)
         g_hash_table_destroy(ms->search_results);
+    g_free(ms->candidates);
     if(ATTR_IS_STRING(ms->search.type))
         g_free(ms->search.u.str);
     if(ms->parent_name)
@@ -2346,6 +2674,11 @@ static int binmap_get_attr(struct map_priv *m, enum attr_type type, struct attr
             attr->u.str=m->progress;
             return 1;
         }
+        break;
+    case attr_thread_safe:
+        /* Map rects of local files which are not reopened on change only read shared state */
+        attr->u.num=(m->fi && !m->url && !m->check_version);
+        return 1;
     default:
         break;
     }
@@ -2377,6 +2710,7 @@ static struct map_methods map_methods_binfile = {
     NULL,
     binmap_get_attr,
     binmap_set_attr,
+    map_rect_get_batch_binfile,
 };
 
 static int binfile_get_index(struct map_priv *m) {
@@ -2453,6 +2787,11 @@ static int map_binfile_zip_setup(struct map_priv *m, char *filename, int mmap) {
     m->zip_members=m->index_offset/m->cde_size+1;
     dbg(lvl_debug,"cde_size %d", m->cde_size);
     dbg(lvl_debug,"members %d",m->zip_members);
+    if (first_cd->zipint & zip_int_page_aligned) {
+        /* written by maptool -A: tiles are stored uncompressed, mapping the file lets us use them in place */
+        dbg(lvl_debug,"map file %s: members are page-aligned, using mmap", filename);
+        mmap=1;
+    }
     file_data_free(m->fi, (unsigned char *)first_cd);
     if (mmap)
         file_mmap(m->fi);
@@ -2610,6 +2949,10 @@ static int map_binfile_open(struct map_priv *m) {
 
 static void map_binfile_close(struct map_priv *m) {
     int i;
+    if (m->name_index.start) {
+        file_data_free(m->name_index.fi, (unsigned char *)m->name_index.start);
+        m->name_index.start=NULL;
+    }
     file_data_free(m->fi, (unsigned char *)m->index_cd);
     file_data_free(m->fi, (unsigned char *)m->eoc);
     file_data_free(m->fi, (unsigned char *)m->eoc64);
@@ -35,10 +35,14 @@
 #include "projection.h"
 #include "map.h"
 #include "xmlconfig.h"
+#include "street_index.h"
+#include "route_cache.h"
 
 struct mapset {
     NAVIT_OBJECT
     GList *maps; /**< Linked list of all the maps in the mapset */
+    struct street_index *street_index; /**< Index of the streets in the maps, created on first use */
+    struct route_cache *route_cache; /**< Cache of the routable items of the maps, created on first use */
 };
 
 struct attr_iter {
@@ -88,6 +92,8 @@ int mapset_add_attr(struct mapset *ms, struct attr *attr) {
     case attr_map:
         ms->attrs=attr_generic_add_attr(ms->attrs,attr);
         ms->maps=g_list_append(ms->maps, attr->u.map);
+        if (ms->street_index)
+            street_index_flush(ms->street_index);
         return 1;
     default:
         return 0;
@@ -99,6 +105,10 @@ int mapset_remove_attr(struct mapset *ms, struct attr *attr) {
     case attr_map:
         ms->attrs=attr_generic_remove_attr(ms->attrs,attr);
         ms->maps=g_list_remove(ms->maps, attr->u.map);
+        if (ms->street_index)
+            street_index_flush(ms->street_index);
+        if (ms->route_cache)
+            route_cache_flush(ms->route_cache, attr->u.map);
         return 1;
     default:
         return 0;
@@ -136,6 +146,10 @@ int mapset_get_attr(struct mapset *ms, enum attr_type type, struct attr *attr, s
  * @param ms The mapset to be destroyed
  */
 void mapset_destroy(struct mapset *ms) {
+    if (ms->street_index)
+        street_index_destroy(ms->street_index);
+    if (ms->route_cache)
+        route_cache_destroy(ms->route_cache);
     g_list_free(ms->maps);
     attr_list_free(ms->attrs);
     g_free(ms);
@@ -247,6 +261,38 @@ mapset_get_map_by_name(struct mapset *ms, const char*map_name) {
     return curr_map;
 }
 
+/**
+ * @brief Returns the street index of a mapset
+ *
+ * The street index is created on first use and shared by all users of the mapset. It is flushed whenever a map is
+ * added to or removed from the mapset.
+ *
+ * @param ms The mapset
+ * @return The street index
+ */
+struct street_index *
+mapset_get_street_index(struct mapset *ms) {
+    if (!ms->street_index)
+        ms->street_index=street_index_new();
+    return ms->street_index;
+}
+
+/**
+ * @brief Returns the route cache of a mapset
+ *
+ * The route cache is created on first use and shared by all users of the mapset. The tiles of a map are dropped
+ * when the map is removed from the mapset.
+ *
+ * @param ms The mapset
+ * @return The route cache
+ */
+struct route_cache *
+mapset_get_route_cache(struct mapset *ms) {
+    if (!ms->route_cache)
+        ms->route_cache=route_cache_new();
+    return ms->route_cache;
+}
+
 /**
  * @brief Closes a mapset handle after it is no longer used
  *
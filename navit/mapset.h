@@ -30,6 +30,8 @@ struct attr;
 struct attr_iter;
 struct item;
 struct map;
+struct route_cache;
+struct street_index;
 
 /**
  * @brief A mapset.
@@ -50,6 +52,8 @@ int mapset_remove_attr(struct mapset *ms, struct attr *attr);
 int mapset_get_attr(struct mapset *ms, enum attr_type type, struct attr *attr, struct attr_iter *iter);
 void mapset_destroy(struct mapset *ms);
 struct map *mapset_get_map_by_name(struct mapset *ms, const char*map_name);
+struct street_index *mapset_get_street_index(struct mapset *ms);
+struct route_cache *mapset_get_route_cache(struct mapset *ms);
 struct mapset_handle *mapset_open(struct mapset *ms);
 struct map *mapset_next(struct mapset_handle *msh, int active);
 void mapset_close(struct mapset_handle *msh);
@@ -417,6 +417,7 @@ void ch_generate_tiles(char *map_suffix, char *suffix, FILE *tilesdir_out, struc
     info.suffix=suffix;
     info.tiles_list=NULL;
     info.tilesdir_out=tilesdir_out;
+    info.capture=NULL;
     graphfiles=g_alloca(sizeof(FILE*)*(ch_levels+1));
 
     ch_create_tempfiles(suffix, graphfiles, ch_levels, 1);
@@ -454,6 +455,7 @@ void ch_assemble_map(char *map_suffix, char *suffix, struct zip_info *zip_info)
     info.suffix=suffix;
     info.tiles_list=NULL;
     info.tilesdir_out=NULL;
+    info.capture=NULL;
     ref=tempfile(suffix,"sgr_ref",1);
 
     create_tile_hash();
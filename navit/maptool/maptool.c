@@ -53,6 +53,7 @@ long long slice_size=SLIZE_SIZE_DEFAULT_GB*1024ll*1024*1024;
 int attr_debug_level=1;
 int ignore_unknown = 0;
 int thread_count=8; /* good default even on single cores */
+int dense_nodes;
 GHashTable *dedupe_ways_hash;
 int phase;
 int slices;
@@ -282,6 +283,7 @@ static void usage(void) {
     fprintf(f,"-3 (--32bit)                      : set zip 32 bit compression\n");
     fprintf(f,"-6 (--64bit)                      : set zip 64 bit compression (default)\n");
     fprintf(f,"-a (--attr-debug-level)  <level>  : control which data is included in the debug attribute\n");
+    fprintf(f,"-A (--page-align)                 : store tiles uncompressed and page-aligned, for use without copying\n");
     fprintf(f,"-c (--dump-coordinates)           : dump coordinates after phase 1\n");
 #ifdef HAVE_POSTGRESQL
     fprintf(f,
@@ -292,6 +294,8 @@ static void usage(void) {
     fprintf(f,"-E (--experimental)               : Enable experimental features (%s)\n",
             experimental_feature_description ? experimental_feature_description : "-not available in this version-");
     fprintf(f,"-i (--input-file) <file>          : specify the input file name (OSM), overrules default stdin\n");
+    fprintf(f,
+            "-I (--dense-nodes)                : keep nodes in a sparse file indexed by node id, so ways are resolved in one pass (64 bit only, -S does not apply to nodes)\n");
     fprintf(f,"-k (--keep-tmpfiles)              : do not delete tmp files after processing. useful to reuse them\n");
     fprintf(f,"-M (--o5m)                        : input data is in o5m format\n");
     fprintf(f,"-n (--ignore-unknown)             : do not output ways and nodes with unknown type\n");
@@ -334,6 +338,7 @@ struct maptool_params {
     int dump;
     int o5m;
     int compression_level;
+    int page_align;
     int protobuf;
     int dump_coordinates;
     int input;
@@ -362,12 +367,14 @@ static int parse_option(struct maptool_params *p, char **argv, int argc, int *op
         {"32bit", 0, 0, '3'},
         {"64bit", 0, 0, '6'},
         {"attr-debug-level", 1, 0, 'a'},
+        {"page-align", 0, 0, 'A'},
         {"binfile", 0, 0, 'b'},
         {"compression-level", 1, 0, 'z'},
 #ifdef HAVE_POSTGRESQL
         {"db", 1, 0, 'd'},
 #endif
         {"dedupe-ways", 0, 0, 'w'},
+        {"dense-nodes", 0, 0, 'I'},
         {"dump", 0, 0, 'D'},
         {"dump-coordinates", 0, 0, 'c'},
         {"end", 1, 0, 'e'},
@@ -392,7 +399,7 @@ static int parse_option(struct maptool_params *p, char **argv, int argc, int *op
         {"index-size", 0, 0, 'x'},
         {0, 0, 0, 0}
     };
-    c = getopt_long (argc, argv, "36B:DEMNO:PS:Wa:bc"
+    c = getopt_long (argc, argv, "36AB:DEIMNO:PS:Wa:bc"
 #ifdef HAVE_POSTGRESQL
                      "d:"
 #endif
@@ -406,6 +413,9 @@ static int parse_option(struct maptool_params *p, char **argv, int argc, int *op
     case '6':
         p->zip64=1;
         break;
+    case 'A':
+        p->page_align=1;
+        break;
     case 'B':
         p->protobufdb=optarg;
         break;
@@ -415,6 +425,9 @@ static int parse_option(struct maptool_params *p, char **argv, int argc, int *op
     case 'E':
         experimental=1;
         break;
+    case 'I':
+        dense_nodes=1;
+        break;
     case 'M':
         p->o5m=1;
         break;
@@ -600,7 +613,7 @@ static void osm_read_input_data(struct maptool_params *p, char *suffix) {
         else
             map_collect_data_osm(p->input_file,&p->osm);
 
-    if (node_buffer.size==0 && !p->map_handles) {
+    if (node_table_count()==0 && !p->map_handles) {
         fprintf(stderr,"No nodes found - looks like an invalid input file.\n");
         exit(1);
     }
@@ -821,6 +834,7 @@ static void maptool_assemble_map(struct maptool_params *p, char *suffix, char **
         zip_set_timestamp(zip_info, p->timestamp);
         zip_set_maxnamelen(zip_info, 14+strlen(suffix0));
         zip_set_compression_level(zip_info, p->compression_level);
+        zip_set_page_align(zip_info, p->page_align);
         if(!zip_open(zip_info, p->result, zipdir, zipindex)) {
             fprintf(stderr,"Fatal: Could not write output file.\n");
             exit(1);
@@ -889,7 +903,10 @@ static void maptool_assemble_map(struct maptool_params *p, char *suffix, char **
 }
 
 static void maptool_load_node_table(struct maptool_params *p, int last) {
-    if (!p->node_table_loaded) {
+    if (!p->node_table_loaded && dense_nodes) {
+        node_store_load("coords.tmp");
+        p->node_table_loaded=1;
+    } else if (!p->node_table_loaded) {
         slices=(sizeof_buffer("coords.tmp")+(long long)slice_size-(long long)1)/(long long)slice_size;
         assert(slices>0);
         load_buffer("coords.tmp",&node_buffer,last?(slices-1)*slice_size:0, slice_size);
@@ -967,6 +984,14 @@ int main(int argc, char **argv) {
     if (experimental && (!experimental_feature_description )) {
         exit_with_error("No experimental features available in this version, aborting. \n");
     }
+#ifdef _WIN32
+    if (dense_nodes) {
+        exit_with_error("Option -I not yet supported on Windows\n");
+    }
+#endif
+    if (dense_nodes && sizeof(void *) < 8) {
+        exit_with_error("Option -I needs a 64 bit system\n");
+    }
     if (optind < argc -1) {
         exit_with_error("Only one non-option argument allowed.\n");
     }
@@ -1015,6 +1040,7 @@ int main(int argc, char **argv) {
         node_buffer.base=NULL;
         node_buffer.malloced=0;
         node_buffer.size=0;
+        node_store_close();
         p.node_table_loaded=0;
     } else {
         if (start_phase(&p,"reading data")) {
@@ -54,6 +54,7 @@ struct tile_info {
     char *suffix;
     GList **tiles_list;
     FILE *tilesdir_out;
+    struct buffer *capture; /* if set, items are appended here instead of being written, see tile_write_item_to_tile() */
 };
 
 extern struct tile_head {
@@ -241,6 +242,7 @@ void itembin_nicer_slicer(struct tile_info *info, struct item_bin *ib, FILE *ref
 
 extern long long slice_size;
 extern int thread_count;
+extern int dense_nodes;
 extern int attr_debug_level;
 extern char *suffix;
 extern int ignore_unknown;
@@ -309,6 +311,9 @@ void osm_end_way(struct maptool_osm *osm);
 void osm_end_node(struct maptool_osm *osm);
 void osm_add_nd(osmid ref);
 osmid item_bin_get_id(struct item_bin *ib);
+void node_store_close(void);
+void node_store_load(char *filename);
+long long node_table_count(void);
 void flush_nodes(int final);
 void sort_countries(int keep_tmpfiles);
 void process_associated_streets(FILE *in, struct files_relation_processing *files_relproc);
@@ -359,6 +364,29 @@ int osm_xml_get_attribute(char *xml, char *attribute, char *buffer, int buffer_s
 void osm_xml_decode_entities(char *buffer);
 int map_collect_data_osm(FILE *in, struct maptool_osm *osm);
 
+/* pipeline.c */
+
+/** Number of output buffers of a pipeline block */
+#define PIPELINE_OUTPUTS 4
+
+/** A block of items processed by one thread of a pipeline, see pipeline_run(). */
+struct pipeline_block {
+    /** Items read, each preceded by a struct range, see pipeline_block_get_item(). */
+    struct buffer in;
+    /** Output buffers, written by the process function and read by the finish function. */
+    struct buffer out[PIPELINE_OUTPUTS];
+    /** Number of nodes and ways processed, to be added to the progress counters. */
+    int nodes, ways;
+    /** Whether the block has been processed, only used by the main thread. */
+    int done;
+};
+
+typedef void (*pipeline_func)(struct pipeline_block *block, void *data);
+
+void *pipeline_buffer_reserve(struct buffer *b, long long size);
+void pipeline_block_write(struct pipeline_block *block, int out, void *data, int size);
+struct item_bin *pipeline_block_get_item(struct pipeline_block *block, long long *pos, int *min, int *max);
+void pipeline_run(FILE *in, int with_range, pipeline_func process, pipeline_func finish, void *data);
 
 /* sourcesink.c */
 
@@ -400,6 +428,7 @@ void tile_bbox(char *tile, struct rect *r, int overlap);
 int tile_len(char *tile);
 void load_tilesdir(FILE *in);
 void tile_write_item_to_tile(struct tile_info *info, struct item_bin *ib, FILE *reference, char *name);
+void tile_write_captured(struct tile_info *info, struct buffer *capture, FILE *reference);
 void tile_write_item_minmax(struct tile_info *info, struct item_bin *ib, FILE *reference, int min, int max);
 int add_aux_tile(struct zip_info *zip_info, char *name, char *filename, int size);
 int write_aux_tiles(struct zip_info *zip_info);
@@ -417,6 +446,7 @@ int zip_write_directory(struct zip_info *info);
 struct zip_info *zip_new(void);
 void zip_set_zip64(struct zip_info *info, int on);
 void zip_set_compression_level(struct zip_info *info, int level);
+void zip_set_page_align(struct zip_info *info, int on);
 void zip_set_maxnamelen(struct zip_info *info, int max);
 int zip_get_maxnamelen(struct zip_info *info);
 int zip_add_member(struct zip_info *info);
@@ -219,42 +219,64 @@ static inline int filter_unknown(struct item_bin * ib) {
     return 0;
 }
 
-static void phase34_process_file(struct tile_info *info, FILE *in, FILE *reference) {
+/**
+ * @brief State of phase34_process_file()
+ */
+struct phase34_file {
+    struct tile_info *info;
+    FILE *reference;
+    int with_range;
+};
+
+/**
+ * @brief Determines the tiles of the items of a block
+ *
+ * The items are written to a copy of the tile info which captures them in output 0 of the block, to be written to
+ * their tiles in order by phase34_finish().
+ */
+static void phase34_process(struct pipeline_block *block, void *data) {
+    struct phase34_file *file=data;
+    struct tile_info info=*file->info;
     struct item_bin *ib;
     struct attr_bin *a;
-    int max;
+    long long pos=0;
+    int min,max;
 
-    while ((ib=read_item(in))) {
+    info.capture=&block->out[0];
+    while ((ib=pipeline_block_get_item(block, &pos, &min, &max))) {
         if(filter_unknown(ib))
             continue;
         if (ib->type < 0x80000000)
-            processed_nodes++;
+            block->nodes++;
         else
-            processed_ways++;
-        max=item_order_by_type(ib->type);
-        a=item_bin_get_attr_bin(ib, attr_order, NULL);
-        if(a) {
-            int max2=((struct range *)(a+1))->max;
-            if(max>max2)
-                max=max2;
+            block->ways++;
+        if (!file->with_range) {
+            min=0;
+            max=item_order_by_type(ib->type);
+            a=item_bin_get_attr_bin(ib, attr_order, NULL);
+            if(a) {
+                int max2=((struct range *)(a+1))->max;
+                if(max>max2)
+                    max=max2;
+            }
         }
-        tile_write_item_minmax(info, ib, reference, 0, max);
+        tile_write_item_minmax(&info, ib, NULL, min, max);
     }
 }
 
-static void phase34_process_file_range(struct tile_info *info, FILE *in, FILE *reference) {
-    struct item_bin *ib;
-    int min,max;
+static void phase34_finish(struct pipeline_block *block, void *data) {
+    struct phase34_file *file=data;
 
-    while ((ib=read_item_range(in, &min, &max))) {
-        if(filter_unknown(ib))
-            continue;
-        if (ib->type < 0x80000000)
-            processed_nodes++;
-        else
-            processed_ways++;
-        tile_write_item_minmax(info, ib, reference, min, max);
-    }
+    tile_write_captured(file->info, &block->out[0], file->reference);
+}
+
+static void phase34_process_file(struct tile_info *info, FILE *in, FILE *reference, int with_range) {
+    struct phase34_file file;
+
+    file.info=info;
+    file.reference=reference;
+    file.with_range=with_range;
+    pipeline_run(in, with_range, phase34_process, phase34_finish, &file);
 }
 
 static int phase34(struct tile_info *info, struct zip_info *zip_info, FILE **in, FILE **reference, int in_count,
@@ -267,12 +289,8 @@ static int phase34(struct tile_info *info, struct zip_info *zip_info, FILE **in,
     if (! info->write)
         tile_hash=g_hash_table_new(g_str_hash, g_str_equal);
     for (i = 0 ; i < in_count ; i++) {
-        if (in[i]) {
-            if (with_range)
-                phase34_process_file_range(info, in[i], reference ? reference[i]:NULL);
-            else
-                phase34_process_file(info, in[i], reference ? reference[i]:NULL);
-        }
+        if (in[i])
+            phase34_process_file(info, in[i], reference ? reference[i]:NULL, with_range);
     }
     if (! info->write)
         merge_tiles(info);
@@ -301,6 +319,7 @@ int phase4(FILE **in, int in_count, int with_range, char *suffix, FILE *tilesdir
     info.suffix=suffix;
     info.tiles_list=NULL;
     info.tilesdir_out=tilesdir_out;
+    info.capture=NULL;
     return phase34(&info, zip_info, in, NULL, in_count, with_range);
 }
 
@@ -334,6 +353,7 @@ static int process_slice(FILE **in, FILE **reference, int in_count, int with_ran
     info.suffix=suffix;
     info.tiles_list=NULL;
     info.tilesdir_out=NULL;
+    info.capture=NULL;
     phase34(&info, zip_info, in, reference, in_count, with_range);
 
     for (th=tile_head_root; th; th=th->next) {
@@ -23,6 +23,10 @@
 #else
 #include <unistd.h>
 #endif
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#endif
 #include <string.h>
 #include <stdlib.h>
 #include <math.h>
@@ -1386,8 +1390,161 @@ static void node_buffer_to_hash(void) {
         g_hash_table_insert(node_hash, (gpointer)(long long)(ni[i].nd_id), (gpointer)(long long)i);
 }
 
+/** Minimum number of node ids the node store grows by. */
+#define NODE_STORE_STEP (64*1024*1024)
+
+/** The dense node store, an array of nodes indexed by node id, or NULL if it is not in use. */
+static struct node_item *node_store;
+/** Number of node ids the node store has room for. */
+static long long node_store_size;
+/** Highest node id in the node store. */
+static osmid node_store_max_id;
+/** Number of nodes in the node store. */
+static long long node_store_count;
+static int node_store_fd=-1;
+
+#ifndef _WIN32
+/**
+ * @brief Makes the node store large enough to hold a node id
+ *
+ * The node store is a sparse file mapped into memory, so only the pages holding nodes take up disk space.
+ * The file is unlinked as soon as it is created, so it goes away when maptool exits.
+ *
+ * @param id The node id
+ */
+static void node_store_extend(osmid id) {
+    long long size=node_store_size;
+    char *filename;
+
+    while (id >= size)
+        size+=size > NODE_STORE_STEP ? size : NODE_STORE_STEP;
+    if (node_store)
+        munmap(node_store, node_store_size*sizeof(struct node_item));
+    else {
+        filename=tempfile_name("","node_store");
+        node_store_fd=open(filename, O_RDWR|O_CREAT|O_TRUNC, 0644);
+        if (node_store_fd == -1) {
+            perror(filename);
+            exit(1);
+        }
+        unlink(filename);
+        g_free(filename);
+    }
+    if (ftruncate(node_store_fd, size*sizeof(struct node_item))) {
+        perror("ftruncate");
+        exit(1);
+    }
+    node_store=mmap(NULL, size*sizeof(struct node_item), PROT_READ|PROT_WRITE, MAP_SHARED, node_store_fd, 0);
+    if (node_store == MAP_FAILED) {
+        perror("mmap");
+        exit(1);
+    }
+    node_store_size=size;
+}
+
+/**
+ * @brief Frees the node store
+ */
+void node_store_close(void) {
+    if (!node_store)
+        return;
+    munmap(node_store, node_store_size*sizeof(struct node_item));
+    close(node_store_fd);
+    node_store=NULL;
+    node_store_fd=-1;
+    node_store_size=0;
+    node_store_max_id=0;
+    node_store_count=0;
+}
+#else
+static void node_store_extend(osmid id) {
+    fprintf(stderr,"The dense node store is not supported on this platform\n");
+    exit(1);
+}
+
+void node_store_close(void) {
+}
+#endif
+
+/**
+ * @brief Adds a node to the node store
+ *
+ * A slot of the node store is in use if its node id matches its index, so id 0 cannot be stored.
+ *
+ * @param id The node id
+ * @return The slot for the node, or NULL if the node is already stored
+ */
+static struct node_item *node_store_add(osmid id) {
+    if (id >= node_store_size)
+        node_store_extend(id);
+    if (!id || node_store[id].nd_id == id)
+        return NULL;
+    node_store_count++;
+    if (id > node_store_max_id)
+        node_store_max_id=id;
+    return &node_store[id];
+}
+
+/**
+ * @brief Writes the nodes of the node store to a file, ordered by node id
+ *
+ * The file has the same format as the one written by `flush_nodes()` without the node store, so later
+ * phases can read it the same way.
+ *
+ * @param filename The file to write
+ */
+static void node_store_save(char *filename) {
+    FILE *f;
+    osmid id;
+
+    f=fopen(filename,"wb");
+    dbg_assert(f != NULL);
+    for (id = 1 ; id <= node_store_max_id ; id++) {
+        if (node_store[id].nd_id == id)
+            dbg_assert(fwrite(&node_store[id], sizeof(struct node_item), 1, f)==1);
+    }
+    fclose(f);
+}
+
+/**
+ * @brief Fills the node store from a file written by `flush_nodes()`
+ *
+ * As all nodes fit into the node store, ways are resolved in a single slice afterwards.
+ *
+ * @param filename The file to read
+ */
+void node_store_load(char *filename) {
+    FILE *f;
+    struct node_item ni,*stored;
+
+    node_store_close();
+    f=fopen(filename,"rb");
+    dbg_assert(f != NULL);
+    while (fread(&ni, sizeof(ni), 1, f) == 1) {
+        stored=node_store_add(ni.nd_id);
+        if (stored)
+            *stored=ni;
+    }
+    fclose(f);
+    slices=1;
+}
+
+/**
+ * @brief Returns the number of nodes read so far
+ */
+long long node_table_count(void) {
+    if (dense_nodes)
+        return node_store_count;
+    return node_buffer.size/sizeof(struct node_item);
+}
+
 void flush_nodes(int final) {
     fprintf(stderr,"flush_nodes %d\n",final);
+    if (dense_nodes) {
+        node_store_save("coords.tmp");
+        slices=1;
+        return;
+    }
     save_buffer("coords.tmp",&node_buffer,slices*slice_size);
     if (!final) {
         node_buffer.size=0;
@@ -1424,12 +1581,22 @@ void osm_add_node(osmid id, double lat, double lon) {
     osmid_attr.len=3;
     osmid_attr_value=id;
 
-    current_node=allocate_node_item_in_buffer();
     dbg_assert(id < ((2ull<<NODE_ID_BITS)-1));
+    if (dense_nodes) {
+        static struct node_item duplicate;
+        current_node=node_store_add(id);
+        if (!current_node) {
+            current_node=&duplicate;
+            nodeid=0;
+        }
+    } else
+        current_node=allocate_node_item_in_buffer();
     current_node->nd_id=id;
     current_node->ref_way=0;
     current_node->c.x=lon*6371000.0*M_PI/180;
     current_node->c.y=log(tan(M_PI_4+lat*M_PI/360))*6371000.0;
+    if (dense_nodes)
+        return;
     if (! node_hash) {
         if (current_node->nd_id > id_last_node) {
             id_last_node=current_node->nd_id;
@@ -1499,6 +1666,11 @@ static long long node_item_find_index_in_ordered_list(osmid id) {
 static struct node_item *node_item_get(osmid id) {
     struct node_item *node_buffer_base=(struct node_item *)(node_buffer.base);
     long long result_index;
+    if (node_store) {
+        if (!id || id >= node_store_size || node_store[id].nd_id != id)
+            return NULL;
+        return &node_store[id];
+    }
     if (node_hash) {
         // Use g_hash_table_lookup_extended instead of g_hash_table_lookup
         // to distinguish a key with a value 0 from a missing key.
@@ -2751,6 +2923,7 @@ void process_house_number_interpolations(FILE *in, struct files_relation_process
 
 struct multipolygon {
     osmid relid;
+    long long seq;              /**< Position of the relation in the input */
     struct item_bin * rel;
     int inner_count;
     int outer_count;
@@ -2981,13 +3154,113 @@ static inline void dump_sequence(const char * string, int loop_count, int*scount
 #endif
 }
 
-static void process_multipolygons_finish(GList *tr, FILE *out) {
+/**
+ * @brief Output of the multipolygons of several threads, to be written in the order of the input
+ *
+ * Each thread writes its multipolygons to a temporary file of its own and the position of the output of each
+ * multipolygon is recorded. The outputs are then copied to the final file in the order of the relations in the input,
+ * so that the result does not depend on how the relations were spread over the threads.
+ */
+struct multipolygon_output {
+    FILE **files;               /**< Temporary file of each thread */
+    struct multipolygon_output_entry *entries;
+    int count;
+    int size;
+};
+
+struct multipolygon_output_entry {
+    long long seq;              /**< Position of the relation in the input */
+    int file;                   /**< Thread whose file holds the output */
+    long long start;            /**< Start of the output in the file */
+    long long end;              /**< End of the output in the file */
+};
+
+static struct multipolygon_output *multipolygon_output_new(int file_count) {
+    struct multipolygon_output *mo=g_new0(struct multipolygon_output, 1);
+    char name[32];
+    int i;
+
+    mo->files=g_new0(FILE *, file_count);
+    for (i = 0 ; i < file_count ; i++) {
+        sprintf(name,"multipolygons_thread%d",i);
+        mo->files[i]=tempfile("",name,1);
+        if (!mo->files[i]) {
+            perror(name);
+            exit(1);
+        }
+        tempfile_unlink("",name);
+    }
+    return mo;
+}
+
+static void multipolygon_output_add(struct multipolygon_output *mo, int file, long long seq, long long start) {
+    struct multipolygon_output_entry *e;
+
+    if (mo->count == mo->size) {
+        mo->size=mo->size ? mo->size*2 : 1024;
+        mo->entries=g_renew(struct multipolygon_output_entry, mo->entries, mo->size);
+    }
+    e=&mo->entries[mo->count++];
+    e->seq=seq;
+    e->file=file;
+    e->start=start;
+    e->end=ftello(mo->files[file]);
+}
+
+static int multipolygon_output_entry_compare(const void *a, const void *b) {
+    const struct multipolygon_output_entry *ea=a,*eb=b;
+    return (ea->seq > eb->seq) - (ea->seq < eb->seq);
+}
+
+/**
+ * @brief Copies the output of all threads to a file in the order of the input and frees it
+ *
+ * @param mo The output of the threads
+ * @param file_count Number of threads
+ * @param out The file to write to
+ */
+static void multipolygon_output_write(struct multipolygon_output *mo, int file_count, FILE *out) {
+    struct multipolygon_output_entry *e;
+    char buffer[65536];
+    long long len;
+    int i,size;
+
+    qsort(mo->entries, mo->count, sizeof(*mo->entries), multipolygon_output_entry_compare);
+    for (i = 0 ; i < mo->count ; i++) {
+        e=&mo->entries[i];
+        fseeko(mo->files[e->file], e->start, SEEK_SET);
+        for (len = e->end-e->start ; len > 0 ; len-=size) {
+            size=len > sizeof(buffer) ? sizeof(buffer) : len;
+            if (fread(buffer, size, 1, mo->files[e->file]) != 1) {
+                perror("multipolygon_output_write");
+                exit(1);
+            }
+            fwrite(buffer, size, 1, out);
+        }
+    }
+    for (i = 0 ; i < file_count ; i++)
+        fclose(mo->files[i]);
+    g_free(mo->files);
+    g_free(mo->entries);
+    g_free(mo);
+}
+
+/**
+ * @brief Writes the multipolygons of a thread
+ *
+ * @param tr The multipolygons, which are freed
+ * @param out The file to write to
+ * @param mo If not NULL, the positions of the output are recorded here, and `out` must be the file of the thread
+ * @param file The thread
+ */
+static void process_multipolygons_finish(GList *tr, FILE *out, struct multipolygon_output *mo, int file) {
     GList *l=tr;
     //fprintf(stderr,"process_multipolygons_finish\n");
     while(l) {
         int a;
         int b;
         struct multipolygon *multipolygon=l->data;
+        long long start=ftello(out);
         int inner_loop_count=0;
         int *inner_scount=NULL;
         int *inner_direction=NULL;
@@ -3065,6 +3338,8 @@ static void process_multipolygons_finish(GList *tr, FILE *out) {
             }
             item_bin_write(ib, out);
         }
+        if (mo)
+            multipolygon_output_add(mo, file, multipolygon->seq, start);
         /* just for fun...*/
         processed_relations ++;
         /* clean up the sequences */
@@ -3127,11 +3402,12 @@ static void process_multipolygons_member(void *func_priv, void *relation_priv, s
  * @brief prepare one multipolygon relation for relattion processing
  *
  * @param ib the relation
+ * @param seq position of the relation in the input
  * @param relations the relation processing structure
  * @param relations_func function to use for the members
  * @param multipolygons write the resulting multipolygons to the list
  */
-static void process_multipolygons_setup_one(struct item_bin * ib, struct relations * relations,
+static void process_multipolygons_setup_one(struct item_bin * ib, long long seq, struct relations * relations,
         struct relations_func * relations_func, GList ** multipolygons) {
     if(ib != NULL) {
         struct relation_member *outer=NULL;
@@ -3181,6 +3457,7 @@ static void process_multipolygons_setup_one(struct item_bin * ib, struct relatio
         } else {
             p_multipolygon=g_new0(struct multipolygon, 1);
             p_multipolygon->relid=relid;
+            p_multipolygon->seq=seq;
             p_multipolygon->rel=item_bin_dup(ib);
             for (a = 0; a < outer_count; a ++)
                 relations_add_relation_member_entry(relations, relations_func, p_multipolygon, (gpointer) 0, outer[a].type,
@@ -3208,10 +3485,18 @@ struct process_multipolygon_setup_thread {
     GThread * thread;
 };
 
+/**
+ * @brief A relation passed to a setup worker thread
+ */
+struct relation_setup_job {
+    long long seq;              /**< Position of the relation in the input */
+    struct item_bin *ib;        /**< Copy of the relation, freed by the worker */
+};
+
 /**
  * @brief dummy memory location to pass a end condition to worker threads, as NULL cannot be passed.
  */
-static struct item_bin killer;
+static struct relation_setup_job killer;
 
 /**
  * @brief multipolygons setup worker thread.
@@ -3221,17 +3506,18 @@ static struct item_bin killer;
  * @param data this threads local storage
  */
 static gpointer process_multipolygons_setup_worker (gpointer data) {
-    struct item_bin * ib;
+    struct relation_setup_job * job;
     //long long relid;
     struct process_multipolygon_setup_thread * me = (struct process_multipolygon_setup_thread*) data;
     fprintf(stderr,"worker %d up\n", me->number);
-    while((ib=g_async_queue_pop (me->queue)) != &killer) {
+    while((job=g_async_queue_pop (me->queue)) != &killer) {
         processed_relations ++;
-        //relid=item_bin_get_relationid(ib);
+        //relid=item_bin_get_relationid(job->ib);
         //fprintf(stderr,"worker %d processing %lld\n", me->number, relid);
-        process_multipolygons_setup_one(ib, me->relations, me->relations_func, &(me->multipolygons));
+        process_multipolygons_setup_one(job->ib, job->seq, me->relations, me->relations_func, &(me->multipolygons));
         /* done with that. Free the item_bin */
-        g_free(ib);
+        g_free(job->ib);
+        g_free(job);
     }
     fprintf(stderr,"worker %d exit\n", me->number);
     g_thread_exit(NULL);
@@ -3256,7 +3542,9 @@ static GList ** process_multipolygons_setup(FILE *in, int thread_count, struct r
     struct process_multipolygon_setup_thread *sthread;
 
     struct item_bin *ib;
+    struct relation_setup_job *job;
     struct relations_func *relations_func;
+    long long seq=0;
     int i;
     GList **multipolygons=NULL;
     /* allocate and reference async queue */
@@ -3280,12 +3568,14 @@ static GList ** process_multipolygons_setup(FILE *in, int thread_count, struct r
 
     while ((ib=read_item(in))) {
         /* get a duplicate of the returned item, as the one returned shares buffer */
-        struct item_bin * dup = item_bin_dup(ib);
+        job=g_new(struct relation_setup_job, 1);
+        job->seq=seq++;
+        job->ib=item_bin_dup(ib);
         //long long relid;
-        //relid=item_bin_get_relationid(dup);
+        //relid=item_bin_get_relationid(job->ib);
         //fprintf(stderr,"Pushing %lld\n", relid);
         /* the dup's will be freed by the thread processing them*/
-        g_async_queue_push(ib_queue,dup);
+        g_async_queue_push(ib_queue,job);
         /* limit queue size. This is ugly, but since GAsyncQueue doesn't support
          * push to block when the queue reached a decent size, I help myself
          * with this ugly hack */
@@ -3319,6 +3609,7 @@ void process_multipolygons(FILE *in, FILE *coords, FILE *ways, FILE *ways_index,
     int i;
     struct relations **relations;
     GList **multipolygons = NULL;
+    struct multipolygon_output *mo=NULL;
     sig_alrm(0);
 
     relations = g_malloc0(sizeof(struct relations *) * thread_count);
@@ -3338,6 +3629,9 @@ void process_multipolygons(FILE *in, FILE *coords, FILE *ways, FILE *ways_index,
     processed_relations=0;
     processed_ways=0;
     sig_alrm(0);
+    /* The output of several threads is put back into the order of the input */
+    if (thread_count > 1)
+        mo=multipolygon_output_new(thread_count);
     for( i=0; i < thread_count; i ++) {
         if(coords)
             fseek(coords, 0,SEEK_SET);
@@ -3348,9 +3642,11 @@ void process_multipolygons(FILE *in, FILE *coords, FILE *ways, FILE *ways_index,
          * use way more memory. */
         relations_process(relations[i], coords, ways);
         fprintf(stderr,"process_multipolygons:finish (thread %d)\n", i);
-        process_multipolygons_finish(multipolygons[i], out);
+        process_multipolygons_finish(multipolygons[i], mo ? mo->files[i] : out, mo, i);
         relations_destroy(relations[i]);
     }
+    if (mo)
+        multipolygon_output_write(mo, thread_count, out);
     if(multipolygons != NULL)
         g_free(multipolygons);
     g_free(relations);
@@ -3360,6 +3656,7 @@ void process_multipolygons(FILE *in, FILE *coords, FILE *ways, FILE *ways_index,
 
 struct turn_restriction {
     osmid relid;
+    long long seq;              /**< Position of the relation in the input */
     enum item_type type;
     struct coord *c[3];
     int c_count[3];
@@ -3422,6 +3719,11 @@ static void process_turn_restrictions_dump_coord(struct coord *c, int count) {
     }
 }
 
+static gint process_turn_restrictions_compare(gconstpointer a, gconstpointer b) {
+    const struct turn_restriction *ta=a,*tb=b;
+    return (ta->seq > tb->seq) - (ta->seq < tb->seq);
+}
+
 static void process_turn_restrictions_finish(GList *tr, FILE *out) {
     GList *l=tr;
     while (l) {
@@ -3489,11 +3791,12 @@ static void process_turn_restrictions_finish(GList *tr, FILE *out) {
  * @brief prepare one multipolygon relation for relattion processing
  *
  * @param ib the relation
+ * @param seq position of the relation in the input
  * @param relations the relation processing structure
  * @param relations_func function to use for the members
  * @param turn_restrictions write the resulting turn_restriction to the list
  */
-static void process_turn_restrictions_setup_one(struct item_bin * ib, struct relations * relations,
+static void process_turn_restrictions_setup_one(struct item_bin * ib, long long seq, struct relations * relations,
         struct relations_func * relations_func, GList ** turn_restrictions) {
     struct relation_member fromm,tom,viam,tmpm;
     long long relid;
@@ -3546,6 +3849,7 @@ static void process_turn_restrictions_setup_one(struct item_bin * ib, struct rel
         }
         turn_restriction=g_new0(struct turn_restriction, 1);
         turn_restriction->relid=relid;
+        turn_restriction->seq=seq;
         turn_restriction->type=ib->type;
         turn_restriction->r.l.x=1<<30;
         turn_restriction->order=255;
@@ -3576,17 +3880,19 @@ struct process_turn_restrictions_setup_thread {
  * @param data this threads local storage
  */
 static gpointer process_turn_restrictions_setup_worker (gpointer data) {
-    struct item_bin * ib;
+    struct relation_setup_job * job;
     //long long relid;
     struct process_turn_restrictions_setup_thread * me = (struct process_turn_restrictions_setup_thread*) data;
     fprintf(stderr,"worker %d up\n", me->number);
-    while((ib=g_async_queue_pop (me->queue)) != &killer) {
+    while((job=g_async_queue_pop (me->queue)) != &killer) {
         processed_relations ++;
-        //relid=item_bin_get_relationid(ib);
+        //relid=item_bin_get_relationid(job->ib);
         //fprintf(stderr,"worker %d processing %lld\n", me->number, relid);
-        process_turn_restrictions_setup_one(ib, me->relations, me->relations_func, &(me->turn_restrictions));
+        process_turn_restrictions_setup_one(job->ib, job->seq, me->relations, me->relations_func,
+                                            &(me->turn_restrictions));
         /* done with that. Free the item_bin */
-        g_free(ib);
+        g_free(job->ib);
+        g_free(job);
     }
     fprintf(stderr,"worker %d exit\n", me->number);
     g_thread_exit(NULL);
@@ -3611,7 +3917,9 @@ static GList ** process_turn_restrictions_setup(FILE *in, int thread_count, stru
     struct process_turn_restrictions_setup_thread *sthread;
 
     struct item_bin *ib;
+    struct relation_setup_job *job;
     struct relations_func *relations_func;
+    long long seq=0;
     int i;
     GList **turn_restrictions=NULL;
     /* allocate and reference async queue */
@@ -3635,12 +3943,14 @@ static GList ** process_turn_restrictions_setup(FILE *in, int thread_count, stru
 
     while ((ib=read_item(in))) {
         /* get a duplicate of the returned item, as the one returned shares buffer */
-        struct item_bin * dup = item_bin_dup(ib);
+        job=g_new(struct relation_setup_job, 1);
+        job->seq=seq++;
+        job->ib=item_bin_dup(ib);
         //long long relid;
-        //relid=item_bin_get_relationid(dup);
+        //relid=item_bin_get_relationid(job->ib);
         //fprintf(stderr,"Pushing %lld\n", relid);
         /* the dup's will be freed by the thread processing them*/
-        g_async_queue_push(ib_queue,dup);
+        g_async_queue_push(ib_queue,job);
         /* limit queue size. This is ugly, but since GAsyncQueue doesn't support
          * push to block when the queue reached a decent size, I help myself
          * with this ugly hack */
@@ -3699,12 +4009,15 @@ void process_turn_restrictions(FILE *in, FILE *coords, FILE *ways, FILE *ways_in
         fseek(ways, 0,SEEK_SET);
     fprintf(stderr,"process_multipolygons:process (thread %d)\n", i);
     relations_process_multi(relations, thread_count, coords, ways);
-    for( i=0; i < thread_count; i ++) {
-
-        fprintf(stderr,"process_turn_restrictions:finish (thread %d)\n", i);
-        process_turn_restrictions_finish(turn_restrictions[i], out);
+    /* Write the turn restrictions of all threads in the order of the input */
+    for( i=1; i < thread_count; i ++)
+        turn_restrictions[0]=g_list_concat(turn_restrictions[0], turn_restrictions[i]);
+    if (thread_count > 1)
+        turn_restrictions[0]=g_list_sort(turn_restrictions[0], process_turn_restrictions_compare);
+    fprintf(stderr,"process_turn_restrictions:finish\n");
+    process_turn_restrictions_finish(turn_restrictions[0], out);
+    for( i=0; i < thread_count; i ++)
         relations_destroy(relations[i]);
-    }
     if(turn_restrictions != NULL)
         g_free(turn_restrictions);
     g_free(relations);
@@ -3895,6 +4208,37 @@ static void nodes_ref_item_bin(struct item_bin *ib) {
         node_ref_way(GET_REF(c[i]));
 }
 
+/**
+ * @brief Looks up the nodes referenced by the ways of a block, see ref_ways()
+ *
+ * Only the lookup is done here; as several ways may reference the same node, the reference counts are increased by
+ * ref_ways_finish() in the main thread.
+ */
+static void ref_ways_process(struct pipeline_block *block, void *data) {
+    struct item_bin *ib;
+    struct node_item *ni;
+    struct coord *c;
+    long long pos=0;
+    int i;
+
+    while ((ib=pipeline_block_get_item(block, &pos, NULL, NULL))) {
+        c=(struct coord *)(ib+1);
+        for (i = 0 ; i < ib->clen/2 ; i++) {
+            ni=node_item_get(GET_REF(c[i]));
+            if (ni)
+                pipeline_block_write(block, 0, &ni, sizeof(ni));
+        }
+    }
+}
+
+static void ref_ways_finish(struct pipeline_block *block, void *data) {
+    struct node_item **ni=(struct node_item **)block->out[0].base;
+    long long i,count=block->out[0].size/sizeof(*ni);
+
+    for (i = 0 ; i < count ; i++)
+        ni[i]->ref_way++;
+}
+
 
 void osm_add_nd(osmid ref) {
     SET_REF(coord_buffer[coord_count], ref);
@@ -3905,11 +4249,10 @@ void osm_add_nd(osmid ref) {
     }
 }
 
-static void write_item_way_subsection_index(FILE *out, FILE *out_index, FILE *out_graph, struct item_bin *orig,
-        long long *last_id) {
+static void write_item_way_subsection_index(FILE *out_index, osmid wayid, long long offset, long long *last_id) {
     osmid idx[2];
-    idx[0]=item_bin_get_wayid(orig);
-    idx[1]=ftello(out);
+    idx[0]=wayid;
+    idx[1]=offset;
     if (way_hash) {
         if (!(g_hash_table_lookup_extended(way_hash, (gpointer)(long long)idx[0], NULL, NULL)))
             g_hash_table_insert(way_hash, (gpointer)(long long)idx[0], (gpointer)(long long)idx[1]);
@@ -3933,28 +4276,25 @@ static void write_item_way_subsection(FILE *out, FILE *out_index, FILE *out_grap
     new.clen=(last-first+1)*2;
     new.len=new.clen+attr_len+2;
     if (out_index)
-        write_item_way_subsection_index(out, out_index, out_graph, orig, last_id);
+        write_item_way_subsection_index(out_index, item_bin_get_wayid(orig), ftello(out), last_id);
     dbg_assert(fwrite(&new, sizeof(new), 1, out)==1);
     dbg_assert(fwrite(c+first, new.clen*4, 1, out)==1);
     dbg_assert(fwrite(attr, attr_len*4, 1, out)==1);
 }
 
 void ref_ways(FILE *in) {
-    struct item_bin *ib;
-
     fseek(in, 0, SEEK_SET);
-    while ((ib=read_item(in)))
-        nodes_ref_item_bin(ib);
+    pipeline_run(in, 0, ref_ways_process, ref_ways_finish, NULL);
 }
 
-void resolve_ways(FILE *in, FILE *out) {
+static void resolve_ways_process(struct pipeline_block *block, void *data) {
     struct item_bin *ib;
     struct coord *c;
-    int i;
     struct node_item *ni;
+    long long pos=0;
+    int i;
 
-    fseek(in, 0, SEEK_SET);
-    while ((ib=read_item(in))) {
+    while ((ib=pipeline_block_get_item(block, &pos, NULL, NULL))) {
         c=(struct coord *)(ib+1);
         for (i = 0 ; i < ib->clen/2 ; i++) {
             if(!IS_REF(c[i]))
@@ -3966,10 +4306,22 @@ void resolve_ways(FILE *in, FILE *out) {
             }
 
         }
-        item_bin_write(ib,out);
+        pipeline_block_write(block, 0, ib, (ib->len+1)*4);
     }
 }
 
+static void resolve_ways_finish(struct pipeline_block *block, void *data) {
+    FILE *out=data;
+
+    if (block->out[0].size)
+        dbg_assert(fwrite(block->out[0].base, block->out[0].size, 1, out)==1);
+}
+
+void resolve_ways(FILE *in, FILE *out) {
+    fseek(in, 0, SEEK_SET);
+    pipeline_run(in, 0, resolve_ways_process, resolve_ways_finish, out);
+}
+
 /**
   * Get POI coordinates from area/line coordinates.
   * @param in *in input file with area/line coordinates.
@@ -4009,17 +4361,71 @@ void process_way2poi(FILE *in, FILE *out, int type) {
 }
 
 
-int map_resolve_coords_and_split_at_intersections(FILE *in, FILE *out, FILE *out_index, FILE *out_graph,
-        FILE *out_coastline, int final) {
+/**
+ * @brief State of map_resolve_coords_and_split_at_intersections()
+ */
+struct resolve_coords {
+    FILE *out, *out_index, *out_coastline;
+    int final;
+    long long last_id;
+};
+
+/**
+ * @brief Entry of the index of the split ways as written by a worker, see resolve_coords_process()
+ */
+struct resolve_coords_index {
+    osmid wayid;
+    long long offset;         /**< Offset of the subsection within the output of the block */
+};
+
+/**
+ * @brief Entry of the list of missing nodes, reported by resolve_coords_finish()
+ */
+struct resolve_coords_missing {
+    osmid wayid;
+    osmid ndref;
+};
+
+/**
+ * @brief Writes a subsection of a way to an output buffer of a block, like write_item_way_subsection()
+ */
+static void resolve_coords_write_subsection(struct pipeline_block *block, int out, struct item_bin *orig, int first,
+        int last, int index) {
+    struct item_bin new;
+    struct coord *c=(struct coord *)(orig+1);
+    char *attr=(char *)(c+orig->clen/2);
+    int attr_len=orig->len-orig->clen-2;
+    block->ways++;
+    new.type=orig->type;
+    new.clen=(last-first+1)*2;
+    new.len=new.clen+attr_len+2;
+    if (index) {
+        struct resolve_coords_index idx;
+        idx.wayid=item_bin_get_wayid(orig);
+        idx.offset=block->out[out].size;
+        pipeline_block_write(block, 1, &idx, sizeof(idx));
+    }
+    pipeline_block_write(block, out, &new, sizeof(new));
+    pipeline_block_write(block, out, c+first, new.clen*4);
+    pipeline_block_write(block, out, attr, attr_len*4);
+}
+
+/**
+ * @brief Resolves the coordinates of the ways of a block and splits them at intersections
+ *
+ * The ways are written to output 0, their index entries to output 1, coastlines to output 2 and missing nodes to
+ * output 3.
+ */
+static void resolve_coords_process(struct pipeline_block *block, void *data) {
+    struct resolve_coords *rc=data;
     struct coord *c;
     int i,ccount,last,remaining;
     osmid ndref;
     struct item_bin *ib;
     struct node_item *ni;
-    long long last_id=0;
-    processed_nodes=processed_nodes_out=processed_ways=processed_relations=processed_tiles=0;
-    sig_alrm(0);
-    while ((ib=read_item(in))) {
+    long long pos=0;
+
+    while ((ib=pipeline_block_get_item(block, &pos, NULL, NULL))) {
         ccount=ib->clen/2;
         if (ccount <= 1)
             continue;
@@ -4032,12 +4438,14 @@ int map_resolve_coords_and_split_at_intersections(FILE *in, FILE *out, FILE *out
                 if (ni) {
                     c[i]=ni->c;
                     if (ni->ref_way > 1 && i != 0 && i != ccount-1 && i != last && item_get_default_flags(ib->type)) {
-                        write_item_way_subsection(out, out_index, out_graph, ib, last, i, &last_id);
+                        resolve_coords_write_subsection(block, 0, ib, last, i, rc->out_index != NULL);
                         last=i;
                     }
-                } else if (final) {
-                    osm_warning("way",item_bin_get_wayid(ib),0,"Non-existing reference to ");
-                    osm_warning("node",ndref,1,"\n");
+                } else if (rc->final) {
+                    struct resolve_coords_missing missing;
+                    missing.wayid=item_bin_get_wayid(ib);
+                    missing.ndref=ndref;
+                    pipeline_block_write(block, 3, &missing, sizeof(missing));
                     remaining=(ib->len+1)*4-sizeof(struct item_bin)-i*sizeof(struct coord);
                     memmove(&c[i], &c[i+1], remaining);
                     ib->clen-=2;
@@ -4048,20 +4456,51 @@ int map_resolve_coords_and_split_at_intersections(FILE *in, FILE *out, FILE *out
             }
         }
         if (ccount) {
-            write_item_way_subsection(out, out_index, out_graph, ib, last, ccount-1, &last_id);
-            if (final && ib->type == type_water_line && out_coastline) {
-                write_item_way_subsection(out_coastline, NULL, NULL, ib, last, ccount-1, NULL);
+            resolve_coords_write_subsection(block, 0, ib, last, ccount-1, rc->out_index != NULL);
+            if (rc->final && ib->type == type_water_line && rc->out_coastline) {
+                resolve_coords_write_subsection(block, 2, ib, last, ccount-1, 0);
             }
         }
     }
+}
+
+static void resolve_coords_finish(struct pipeline_block *block, void *data) {
+    struct resolve_coords *rc=data;
+    struct resolve_coords_index *idx=(struct resolve_coords_index *)block->out[1].base;
+    struct resolve_coords_missing *missing=(struct resolve_coords_missing *)block->out[3].base;
+    long long i,base=ftello(rc->out);
+
+    for (i = 0 ; i < block->out[3].size/sizeof(*missing) ; i++) {
+        osm_warning("way",missing[i].wayid,0,"Non-existing reference to ");
+        osm_warning("node",missing[i].ndref,1,"\n");
+    }
+    for (i = 0 ; i < block->out[1].size/sizeof(*idx) ; i++)
+        write_item_way_subsection_index(rc->out_index, idx[i].wayid, base+idx[i].offset, &rc->last_id);
+    if (block->out[0].size)
+        dbg_assert(fwrite(block->out[0].base, block->out[0].size, 1, rc->out)==1);
+    if (block->out[2].size)
+        dbg_assert(fwrite(block->out[2].base, block->out[2].size, 1, rc->out_coastline)==1);
+}
+
+int map_resolve_coords_and_split_at_intersections(FILE *in, FILE *out, FILE *out_index, FILE *out_graph,
+        FILE *out_coastline, int final) {
+    struct resolve_coords rc;
+    processed_nodes=processed_nodes_out=processed_ways=processed_relations=processed_tiles=0;
+    rc.out=out;
+    rc.out_index=out_index;
+    rc.out_coastline=out_coastline;
+    rc.final=final;
+    rc.last_id=0;
+    sig_alrm(0);
+    pipeline_run(in, 0, resolve_coords_process, resolve_coords_finish, &rc);
     sig_alrm(0);
     sig_alrm_end();
     return 0;
 }
 
-static void index_country_add(struct zip_info *info, int country_id, char*first_key, char *last_key, char *tile,
-                              char *filename,
-                              int size, FILE *out) {
+static int index_country_add(struct zip_info *info, int country_id, char*first_key, char *last_key, char *tile,
+                             char *filename,
+                             int size, int name_index, FILE *out) {
     struct item_bin *item_bin=init_item(type_countryindex);
     int num=0, zip_num;
     char tilename[32];
@@ -4081,7 +4520,148 @@ static void index_country_add(struct zip_info *info, int country_id, char*first_
         item_bin_add_attr_string(item_bin, attr_last_key, last_key);
 
     item_bin_add_attr_int(item_bin, attr_zipfile_ref, zip_num);
+    if (name_index != -1)
+        item_bin_add_attr_int(item_bin, attr_name_index_ref, name_index);
     item_bin_write(item_bin, out);
+    return zip_num;
+}
+
+/**
+ * @brief Entry of the name index of a country
+ *
+ * The name index maps the casefolded names and postal codes of the towns and districts of a country to the items
+ * in the country index parts, so that a town search does not need to walk all of them.
+ */
+struct name_index_entry {
+    enum attr_type type;    /**< attr_town_name, attr_district_name or attr_town_postal */
+    char *key;              /**< Casefolded name */
+    int id_hi;              /**< Zip member of the country index part holding the item */
+    int id_lo;              /**< Offset of the item in the part, in 32 bit words */
+};
+
+struct name_index {
+    struct name_index_entry *entries;
+    int count;
+    int size;
+    int part_start;         /**< First entry of the part being written */
+};
+
+static void name_index_add(struct name_index *ni, enum attr_type type, char *name, int id_lo) {
+    struct name_index_entry *e;
+    if (!name)
+        return;
+    if (ni->count == ni->size) {
+        ni->size=ni->size ? ni->size*2 : 1024;
+        ni->entries=g_renew(struct name_index_entry, ni->entries, ni->size);
+    }
+    e=&ni->entries[ni->count++];
+    e->type=type;
+    e->key=linguistics_casefold(name);
+    e->id_hi=-1;
+    e->id_lo=id_lo;
+}
+
+/**
+ * @brief Adds the names of an item to the name index
+ *
+ * The names are the ones binmap_search_get_item() compares against the search string.
+ *
+ * @param ni The name index
+ * @param ib The item
+ * @param id_lo Offset of the item in the part it is written to, in 32 bit words
+ */
+static void name_index_add_item(struct name_index *ni, struct item_bin *ib, int id_lo) {
+    char *name;
+    if (ib->type < type_town_label || ib->type > type_district_label_1e7)
+        return;
+    name=item_bin_get_attr(ib, attr_town_name_match, NULL);
+    if (!name)
+        name=item_bin_get_attr(ib, attr_town_name, NULL);
+    name_index_add(ni, attr_town_name, name, id_lo);
+    name_index_add(ni, attr_town_postal, item_bin_get_attr(ib, attr_town_postal, NULL), id_lo);
+    if (ib->type < type_district_label)
+        return;
+    name=item_bin_get_attr(ib, attr_district_name_match, NULL);
+    if (!name)
+        name=item_bin_get_attr(ib, attr_district_name, NULL);
+    name_index_add(ni, attr_district_name, name, id_lo);
+}
+
+static void name_index_part_done(struct name_index *ni, int zip_num) {
+    for ( ; ni->part_start < ni->count ; ni->part_start++)
+        ni->entries[ni->part_start].id_hi=zip_num;
+}
+
+static int name_index_entry_compare(const void *a, const void *b) {
+    const struct name_index_entry *ea=a,*eb=b;
+    int ret;
+    if (ea->type != eb->type)
+        return ea->type < eb->type ? -1 : 1;
+    ret=strcmp(ea->key, eb->key);
+    if (ret)
+        return ret;
+    if (ea->id_hi != eb->id_hi)
+        return ea->id_hi < eb->id_hi ? -1 : 1;
+    if (ea->id_lo != eb->id_lo)
+        return ea->id_lo < eb->id_lo ? -1 : 1;
+    return 0;
+}
+
+/**
+ * @brief Writes the name index of a country and adds it to the map
+ *
+ * The index is an int holding the number of entries, followed by the entries sorted by type and key, each made of four
+ * ints (type, offset of the key, id_hi, id_lo), followed by the zero terminated keys. Keys shared by several entries
+ * are only stored once.
+ *
+ * @param ni The name index, which is emptied
+ * @param info The zip file of the map
+ * @param tile Name of the tile of the country
+ * @param countrypart Name of the temporary files of the country
+ * @return The zip member number of the name index, or -1 if the country has no names
+ */
+static int name_index_write(struct name_index *ni, struct zip_info *info, char *tile, char *countrypart) {
+    FILE *f;
+    char *name;
+    char tilename[32];
+    int i,num=0,zip_num=-1,offset=0,size,pad=0;
+    int entry[4];
+
+    if (ni->count) {
+        qsort(ni->entries, ni->count, sizeof(*ni->entries), name_index_entry_compare);
+        f=tempfile("n",countrypart,1);
+        name=tempfile_name("n",countrypart);
+        fwrite(&ni->count, sizeof(ni->count), 1, f);
+        for (i = 0 ; i < ni->count ; i++) {
+            if (i && strcmp(ni->entries[i].key, ni->entries[i-1].key))
+                offset+=strlen(ni->entries[i-1].key)+1;
+            entry[0]=ni->entries[i].type;
+            entry[1]=offset;
+            entry[2]=ni->entries[i].id_hi;
+            entry[3]=ni->entries[i].id_lo;
+            fwrite(entry, sizeof(entry), 1, f);
+        }
+        for (i = 0 ; i < ni->count ; i++) {
+            if (!i || strcmp(ni->entries[i].key, ni->entries[i-1].key))
+                fwrite(ni->entries[i].key, strlen(ni->entries[i].key)+1, 1, f);
+        }
+        size=ftello(f);
+        if (size % 4)
+            fwrite(&pad, 4-size%4, 1, f);
+        size=ftello(f);
+        fclose(f);
+        do {
+            snprintf(tilename,sizeof(tilename),"%sn%d", tile, num);
+            num++;
+            zip_num=add_aux_tile(info, tilename, name, size);
+        } while (zip_num == -1);
+        g_free(name);
+    }
+    for (i = 0 ; i < ni->count ; i++)
+        g_free(ni->entries[i].key);
+    ni->count=0;
+    ni->part_start=0;
+    return zip_num;
 }
 
 void write_countrydir(struct zip_info *zip_info, int max_index_size) {
@@ -4089,6 +4669,7 @@ void write_countrydir(struct zip_info *zip_info, int max_index_size) {
     int max=11;
     char filename[32];
     struct country_table *co;
+    struct name_index name_index= {NULL,0,0,0};
     for (i = 0 ; i < sizeof(country_table)/sizeof(struct country_table) ; i++) {
         co=&country_table[i];
         if(co->size) {
@@ -4107,6 +4688,7 @@ void write_countrydir(struct zip_info *zip_info, int max_index_size) {
             char *countryindexname;
             FILE *countryindex;
             char key[1024]="",first_key[1024]="",last_key[1024]="";
+            int zip_num,name_index_num;
 
             tile(&co->r, "", tileco, max, overlap, NULL);
 
@@ -4147,8 +4729,9 @@ void write_countrydir(struct zip_info *zip_info, int max_index_size) {
                     partsize=ftello(out);
                     fclose(out);
                     out=NULL;
-                    index_country_add(zip_info,co->countryid,first_key,last_key,strlen(tileco)>strlen(tileprev)?tileco:tileprev,outname,
-                                      partsize,countryindex);
+                    zip_num=index_country_add(zip_info,co->countryid,first_key,last_key,strlen(tileco)>strlen(tileprev)?tileco:tileprev,
+                                              outname, partsize, -1, countryindex);
+                    name_index_part_done(&name_index, zip_num);
                     g_free(outname);
                     outname=NULL;
                     g_strlcpy(first_key,key,sizeof(first_key));
@@ -4167,19 +4750,23 @@ void write_countrydir(struct zip_info *zip_info, int max_index_size) {
                     partsize=0;
                 }
 
+                name_index_add_item(&name_index, ib, partsize/4);
                 item_bin_write(ib,out);
                 partsize+=ibsize;
                 g_strlcpy(last_key,key,sizeof(last_key));
             }
 
+            name_index_num=name_index_write(&name_index, zip_info, tileco, countrypart);
             partsize=ftello(countryindex);
             if(partsize)
-                index_country_add(zip_info,co->countryid,NULL,NULL,tileco,countryindexname, partsize, zip_get_index(zip_info));
+                index_country_add(zip_info,co->countryid,NULL,NULL,tileco,countryindexname, partsize, name_index_num,
+                                  zip_get_index(zip_info));
             fclose(countryindex);
             g_free(countryindexname);
             fclose(in);
         }
     }
+    g_free(name_index.entries);
 }
 
 void load_countries(void) {
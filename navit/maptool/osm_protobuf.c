@@ -242,10 +242,8 @@ static void process_relation(OSMPBF__PrimitiveBlock *primitive_block, OSMPBF__Re
     osm_end_relation(osm);
 }
 
-static void process_osmdata(OSMPBF__Blob *blob, unsigned char *data, struct maptool_osm *osm) {
+static void process_primitive_block(OSMPBF__PrimitiveBlock *primitive_block, struct maptool_osm *osm) {
     int i,j;
-    OSMPBF__PrimitiveBlock *primitive_block;
-    primitive_block=osmpbf__primitive_block__unpack(NULL, blob->raw_size, data);
     for (i = 0 ; i < primitive_block->n_primitivegroup ; i++) {
         OSMPBF__PrimitiveGroup *primitive_group=primitive_block->primitivegroup[i];
         process_dense(primitive_block, primitive_group->dense, osm);
@@ -254,11 +252,16 @@ static void process_osmdata(OSMPBF__Blob *blob, unsigned char *data, struct mapt
         for (j = 0 ; j < primitive_group->n_relations ; j++)
             process_relation(primitive_block, primitive_group->relations[j], osm);
     }
-    osmpbf__primitive_block__free_unpacked(primitive_block, NULL);
 }
 
+static void process_osmdata(OSMPBF__Blob *blob, unsigned char *data, struct maptool_osm *osm) {
+    OSMPBF__PrimitiveBlock *primitive_block;
+    primitive_block=osmpbf__primitive_block__unpack(NULL, blob->raw_size, data);
+    process_primitive_block(primitive_block, osm);
+    osmpbf__primitive_block__free_unpacked(primitive_block, NULL);
+}
 
-int map_collect_data_osm_protobuf(FILE *in, struct maptool_osm *osm) {
+static int map_collect_data_osm_protobuf_serial(FILE *in, struct maptool_osm *osm) {
     OSMPBF__BlobHeader *header;
     OSMPBF__Blob *blob;
     unsigned char *data;
@@ -283,3 +286,185 @@ int map_collect_data_osm_protobuf(FILE *in, struct maptool_osm *osm) {
     g_free(buffer);
     return 1;
 }
+
+/** Number of blobs per decoder thread which are read ahead, this bounds the memory used */
+#define BLOBS_PER_THREAD 2
+
+/**
+ * @brief A blob read by the main thread and decoded by a decoder thread
+ */
+struct decoded_blob {
+    OSMPBF__BlobHeader *header;
+    unsigned char *buffer;                      /**< The blob as read from the file, freed once decoded */
+    int len;                                    /**< Length of `buffer` */
+    OSMPBF__Blob *blob;
+    unsigned char *data;                        /**< The uncompressed data of the blob */
+    OSMPBF__PrimitiveBlock *primitive_block;    /**< The unpacked data if the blob holds OSMData */
+    int done;                                   /**< Whether the blob has been decoded, only used by the main thread */
+};
+
+/**
+ * @brief decoder thread private storage
+ */
+struct blob_decoder_thread {
+    GAsyncQueue *todo;
+    GAsyncQueue *done;
+    GThread *thread;
+};
+
+/**
+ * @brief dummy blob to pass an end condition to decoder threads, as NULL cannot be passed.
+ */
+static struct decoded_blob killer;
+
+static void decode_blob(struct decoded_blob *db) {
+    db->blob=osmpbf__blob__unpack(NULL, db->len, db->buffer);
+    g_free(db->buffer);
+    db->buffer=NULL;
+    if (db->blob)
+        db->data=uncompress_blob(db->blob);
+    if (db->data && !g_strcmp0(db->header->type,"OSMData"))
+        db->primitive_block=osmpbf__primitive_block__unpack(NULL, db->blob->raw_size, db->data);
+}
+
+static void decoded_blob_free(struct decoded_blob *db) {
+    if (db->primitive_block)
+        osmpbf__primitive_block__free_unpacked(db->primitive_block, NULL);
+    g_free(db->data);
+    if (db->blob)
+        osmpbf__blob__free_unpacked(db->blob, NULL);
+    g_free(db->buffer);
+    osmpbf__blob_header__free_unpacked(db->header, NULL);
+    memset(db, 0, sizeof(*db));
+}
+
+/**
+ * @brief blob decoder thread.
+ *
+ * This thread uncompresses and unpacks any blob passed to it via async queue and passes it back when done.
+ * @param data this threads local storage
+ */
+static gpointer blob_decoder_worker(gpointer data) {
+    struct blob_decoder_thread *me=data;
+    struct decoded_blob *db;
+
+    while ((db=g_async_queue_pop(me->todo)) != &killer) {
+        decode_blob(db);
+        g_async_queue_push(me->done, db);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Reads the next blob of a file
+ *
+ * @return True if a blob was read
+ */
+static int read_raw_blob(FILE *f, struct decoded_blob *db) {
+    db->header=read_header(f);
+    if (!db->header)
+        return 0;
+    db->len=db->header->datasize;
+    if (db->len > MAX_BLOB_LENGTH) {
+        fprintf(stderr,"Not a valid protobuf file. Invalid block size in input: %d, max is %d. \n", db->len,
+                MAX_BLOB_LENGTH);
+        return 0;
+    }
+    db->buffer=g_malloc(db->len);
+    if (fread(db->buffer, db->len, 1, f) != 1)
+        return 0;
+    return 1;
+}
+
+/**
+ * @brief Passes a decoded blob to the OSM data collector
+ *
+ * @return True if the blob could be processed
+ */
+static int process_decoded_blob(struct decoded_blob *db, struct maptool_osm *osm) {
+    if (!g_strcmp0(db->header->type,"OSMHeader")) {
+        if (!db->data) {
+            fprintf(stderr,"Could not decode fileblock of type '%s'\n", db->header->type);
+            return 0;
+        }
+        process_osmheader(db->blob, db->data);
+        return 1;
+    }
+    if (!g_strcmp0(db->header->type,"OSMData")) {
+        if (!db->primitive_block) {
+            fprintf(stderr,"Could not decode fileblock of type '%s'\n", db->header->type);
+            return 0;
+        }
+        process_primitive_block(db->primitive_block, osm);
+        return 1;
+    }
+    printf("skipping fileblock of unknown type '%s'\n", db->header->type);
+    return 0;
+}
+
+/**
+ * @brief Reads a protobuf file
+ *
+ * Blobs are independent of each other, so `thread_count` threads uncompress and unpack them while the main thread
+ * reads ahead. The OSM data is still passed to the collector by the main thread, in the order of the file. At most
+ * `BLOBS_PER_THREAD` blobs per thread are held in memory at once.
+ *
+ * @param in The file
+ * @param osm The OSM data collector
+ * @return True on success
+ */
+int map_collect_data_osm_protobuf(FILE *in, struct maptool_osm *osm) {
+    struct blob_decoder_thread *threads;
+    struct decoded_blob *blobs,*db;
+    GAsyncQueue *todo,*done;
+    long long next_read=0,next_process=0;
+    int i,count,eof=0,ret=1;
+
+    if (thread_count <= 1)
+        return map_collect_data_osm_protobuf_serial(in, osm);
+    count=thread_count*BLOBS_PER_THREAD;
+    blobs=g_new0(struct decoded_blob, count);
+    todo=g_async_queue_new();
+    done=g_async_queue_new();
+    threads=g_new0(struct blob_decoder_thread, thread_count);
+    for (i = 0 ; i < thread_count ; i++) {
+        threads[i].todo=todo;
+        threads[i].done=done;
+        threads[i].thread=g_thread_new("blob_decoder_worker", blob_decoder_worker, &threads[i]);
+    }
+    while ((!eof && ret) || next_process < next_read) {
+        if (!eof && ret && next_read - next_process < count) {
+            db=&blobs[next_read % count];
+            if (read_raw_blob(in, db)) {
+                g_async_queue_push(todo, db);
+                next_read++;
+            } else {
+                /* A header without a valid blob after it is a truncated or corrupt file, not its end */
+                if (db->header) {
+                    decoded_blob_free(db);
+                    ret=0;
+                }
+                eof=1;
+            }
+            continue;
+        }
+        db=g_async_queue_pop(done);
+        db->done=1;
+        while (next_process < next_read && blobs[next_process % count].done) {
+            db=&blobs[next_process % count];
+            if (ret)
+                ret=process_decoded_blob(db, osm);
+            decoded_blob_free(db);
+            next_process++;
+        }
+    }
+    for (i = 0 ; i < thread_count ; i++)
+        g_async_queue_push(todo, &killer);
+    for (i = 0 ; i < thread_count ; i++)
+        g_thread_join(threads[i].thread);
+    g_async_queue_unref(todo);
+    g_async_queue_unref(done);
+    g_free(blobs);
+    g_free(threads);
+    return ret;
+}
@@ -0,0 +1,273 @@
+/*
+ * Navit, a modular navigation system.
+ * Copyright (C) 2005-2019 Navit Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+/**
+ * @file pipeline.c
+ *
+ * @brief Processes the items of a file with several threads, keeping the output deterministic
+ *
+ * The main thread reads the input file in blocks of items. Each block is handed to one of `thread_count` worker
+ * threads, which runs the process function on it. The process function must only read shared data and writes its
+ * results to the output buffers of the block. The main thread then runs the finish function on the blocks strictly
+ * in the order they were read, which writes the results to the output files or applies them to shared data. Thus the
+ * output does not depend on the number of threads or on how fast they are.
+ */
+
+#include <string.h>
+#include "maptool.h"
+#include "debug.h"
+
+/** Size of the items read into a block, in bytes */
+#define PIPELINE_BLOCK_SIZE (4*1024*1024)
+
+/** Number of blocks per worker thread which are read ahead */
+#define PIPELINE_BLOCKS_PER_THREAD 2
+
+/**
+ * @brief worker thread private storage
+ */
+struct pipeline_thread {
+    GAsyncQueue *todo;
+    GAsyncQueue *done;
+    pipeline_func process;
+    void *data;
+    GThread *thread;
+};
+
+/**
+ * @brief dummy block to pass an end condition to worker threads, as NULL cannot be passed.
+ */
+static struct pipeline_block killer;
+
+/**
+ * @brief Makes room for `size` more bytes in a buffer
+ *
+ * @return Pointer to the first free byte; it is invalidated by the next call
+ */
+void *pipeline_buffer_reserve(struct buffer *b, long long size) {
+    if (b->size + size > b->malloced) {
+        while (b->size + size > b->malloced)
+            b->malloced+=b->malloced_step;
+        b->base=g_realloc(b->base, b->malloced);
+    }
+    return b->base+b->size;
+}
+
+/**
+ * @brief Appends data to an output buffer of a block
+ *
+ * @param block The block
+ * @param out Number of the output buffer, less than `PIPELINE_OUTPUTS`
+ * @param data The data to append
+ * @param size Size of `data` in bytes
+ */
+void pipeline_block_write(struct pipeline_block *block, int out, void *data, int size) {
+    memcpy(pipeline_buffer_reserve(&block->out[out], size), data, size);
+    block->out[out].size+=size;
+}
+
+/**
+ * @brief Returns the next item of a block
+ *
+ * @param block The block
+ * @param pos Position within the block, set to 0 to get the first item
+ * @param min Receives the minimum order of the item if the file was read with ranges, may be NULL
+ * @param max Receives the maximum order of the item if the file was read with ranges, may be NULL
+ * @return The item, or NULL if there are no more items. The item belongs to the block and may be modified.
+ */
+struct item_bin *pipeline_block_get_item(struct pipeline_block *block, long long *pos, int *min, int *max) {
+    struct range *r;
+    struct item_bin *ib;
+
+    if (*pos >= block->in.size)
+        return NULL;
+    r=(struct range *)(block->in.base+*pos);
+    ib=(struct item_bin *)(r+1);
+    if (min)
+        *min=r->min;
+    if (max)
+        *max=r->max;
+    *pos+=sizeof(*r)+(ib->len+1)*4;
+    return ib;
+}
+
+/**
+ * @brief Reads an item into a block
+ *
+ * Items are stored preceded by their range, as in files with ranges (see `read_item_range()`). Like `read_item()`,
+ * this skips empty items.
+ *
+ * @return True if an item was read, false at the end of the file
+ */
+static int pipeline_read_item(struct pipeline_block *block, FILE *in, int with_range) {
+    struct range r;
+    struct item_bin *ib;
+    int len;
+
+    r.min=r.max=0;
+    if (with_range && fread(&r, sizeof(r), 1, in) != 1)
+        return 0;
+    do {
+        if (fread(&len, sizeof(len), 1, in) != 1)
+            return 0;
+    } while (!len);
+    memcpy(pipeline_buffer_reserve(&block->in, sizeof(r)+(len+1)*4), &r, sizeof(r));
+    ib=(struct item_bin *)(block->in.base+block->in.size+sizeof(r));
+    ib->len=len;
+    if (fread((unsigned char *)ib+4, len*4, 1, in) != 1)
+        return 0;
+    block->in.size+=sizeof(r)+(len+1)*4;
+    bytes_read+=(len+1)*4;
+    return 1;
+}
+
+/**
+ * @brief Reads the next block of items
+ *
+ * @return True if at least one item was read
+ */
+static int pipeline_read_block(struct pipeline_block *block, FILE *in, int with_range) {
+    int i;
+
+    block->in.size=0;
+    for (i = 0 ; i < PIPELINE_OUTPUTS ; i++)
+        block->out[i].size=0;
+    block->nodes=0;
+    block->ways=0;
+    while (block->in.size < PIPELINE_BLOCK_SIZE && pipeline_read_item(block, in, with_range));
+    return block->in.size > 0;
+}
+
+static void pipeline_block_init(struct pipeline_block *block) {
+    int i;
+
+    memset(block, 0, sizeof(*block));
+    block->in.malloced_step=PIPELINE_BLOCK_SIZE;
+    for (i = 0 ; i < PIPELINE_OUTPUTS ; i++)
+        block->out[i].malloced_step=PIPELINE_BLOCK_SIZE;
+}
+
+static void pipeline_block_free(struct pipeline_block *block) {
+    int i;
+
+    g_free(block->in.base);
+    for (i = 0 ; i < PIPELINE_OUTPUTS ; i++)
+        g_free(block->out[i].base);
+}
+
+/**
+ * @brief Finishes a block in the main thread
+ */
+static void pipeline_finish_block(struct pipeline_block *block, pipeline_func finish, void *data) {
+    finish(block, data);
+    processed_nodes+=block->nodes;
+    processed_ways+=block->ways;
+}
+
+/**
+ * @brief pipeline worker thread.
+ *
+ * This thread processes any block passed to it via async queue and passes it back when done.
+ * @param data this threads local storage
+ */
+static gpointer pipeline_worker(gpointer data) {
+    struct pipeline_thread *me=data;
+    struct pipeline_block *block;
+
+    while ((block=g_async_queue_pop(me->todo)) != &killer) {
+        me->process(block, me->data);
+        g_async_queue_push(me->done, block);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Processes all items of a file with `thread_count` threads
+ *
+ * The file is read from its current position to its end. `process` may run at the same time as `finish` and must
+ * not touch anything `finish` changes. The progress counters `processed_nodes` and `processed_ways` are increased by
+ * the counts the process function sets in each block.
+ *
+ * @param in The file to read
+ * @param with_range Whether each item in the file is preceded by its range, see `read_item_range()`
+ * @param process Called by a worker thread for each block
+ * @param finish Called by the calling thread for each block processed, in the order the blocks were read
+ * @param data Passed to `process` and `finish`
+ */
+void pipeline_run(FILE *in, int with_range, pipeline_func process, pipeline_func finish, void *data) {
+    struct pipeline_thread *threads;
+    struct pipeline_block *blocks,*block;
+    GAsyncQueue *todo,*done;
+    long long next_read=0,next_finish=0;
+    int i,count,eof=0;
+
+    if (thread_count <= 1) {
+        struct pipeline_block single;
+        pipeline_block_init(&single);
+        while (pipeline_read_block(&single, in, with_range)) {
+            process(&single, data);
+            pipeline_finish_block(&single, finish, data);
+        }
+        pipeline_block_free(&single);
+        return;
+    }
+    count=thread_count*PIPELINE_BLOCKS_PER_THREAD;
+    blocks=g_new(struct pipeline_block, count);
+    for (i = 0 ; i < count ; i++)
+        pipeline_block_init(&blocks[i]);
+    todo=g_async_queue_new();
+    done=g_async_queue_new();
+    threads=g_new0(struct pipeline_thread, thread_count);
+    for (i = 0 ; i < thread_count ; i++) {
+        threads[i].todo=todo;
+        threads[i].done=done;
+        threads[i].process=process;
+        threads[i].data=data;
+        threads[i].thread=g_thread_new("pipeline_worker", pipeline_worker, &threads[i]);
+    }
+    while (!eof || next_finish < next_read) {
+        if (!eof && next_read - next_finish < count) {
+            block=&blocks[next_read % count];
+            if (pipeline_read_block(block, in, with_range)) {
+                block->done=0;
+                g_async_queue_push(todo, block);
+                next_read++;
+            } else
+                eof=1;
+            continue;
+        }
+        block=g_async_queue_pop(done);
+        block->done=1;
+        while (next_finish < next_read && blocks[next_finish % count].done) {
+            pipeline_finish_block(&blocks[next_finish % count], finish, data);
+            blocks[next_finish % count].done=0;
+            next_finish++;
+        }
+    }
+    for (i = 0 ; i < thread_count ; i++)
+        g_async_queue_push(todo, &killer);
+    for (i = 0 ; i < thread_count ; i++)
+        g_thread_join(threads[i].thread);
+    g_async_queue_unref(todo);
+    g_async_queue_unref(done);
+    for (i = 0 ; i < count ; i++)
+        pipeline_block_free(&blocks[i]);
+    g_free(blocks);
+    g_free(threads);
+}
@@ -326,13 +326,48 @@ static void write_item(char *tile, struct item_bin *ib, FILE *reference) {
     }
 }
 
+/**
+ * @brief Writes an item to a tile
+ *
+ * If the tile info captures items, the tile name and the item are appended to the capture buffer instead, to be
+ * written later with tile_write_captured().
+ */
 void tile_write_item_to_tile(struct tile_info *info, struct item_bin *ib, FILE *reference, char *name) {
-    if (info->write)
+    if (info->capture) {
+        int len=strlen(name)+1;
+        int size=(len+3)&~3;
+        char *data=pipeline_buffer_reserve(info->capture, sizeof(int)+size+(ib->len+1)*4);
+        memcpy(data, &size, sizeof(int));
+        memset(data+sizeof(int), 0, size);
+        memcpy(data+sizeof(int), name, len);
+        memcpy(data+sizeof(int)+size, ib, (ib->len+1)*4);
+        info->capture->size+=sizeof(int)+size+(ib->len+1)*4;
+    } else if (info->write)
         write_item(name, ib, reference);
     else
         tile_extend(name, ib, info->tiles_list);
 }
 
+/**
+ * @brief Writes the items captured by tile_write_item_to_tile()
+ *
+ * @param info The tile info to write the items with
+ * @param capture The captured items
+ * @param reference The reference file, see tile_write_item_to_tile()
+ */
+void tile_write_captured(struct tile_info *info, struct buffer *capture, FILE *reference) {
+    long long pos=0;
+    int size;
+    struct item_bin *ib;
+
+    while (pos < capture->size) {
+        memcpy(&size, capture->base+pos, sizeof(int));
+        ib=(struct item_bin *)(capture->base+pos+sizeof(int)+size);
+        tile_write_item_to_tile(info, ib, reference, (char *)capture->base+pos+sizeof(int));
+        pos+=sizeof(int)+size+(ib->len+1)*4;
+    }
+}
+
 void tile_write_item_minmax(struct tile_info *info, struct item_bin *ib, FILE *reference, int min, int max) {
     /*TODO: make slice_trigger and slice_target configurable by commandline parameter.
      * bonus: find out why there is a 'min' parameter here
@@ -25,11 +25,30 @@
 #include "config.h"
 #include "zipfile.h"
 
+/** Number of members per worker thread which are compressed ahead of being written */
+#define ZIP_MEMBERS_PER_THREAD 4
+
+/**
+ * @brief A member waiting to be written to the zip file
+ */
+struct zip_member {
+    char *name;                   /**< Name of the member */
+    int filelen;                  /**< Length the name is padded to */
+    char *data;                   /**< Uncompressed data */
+    int data_size;                /**< Size of `data` */
+    char *compbuffer;             /**< Compressed data, or NULL */
+    int comp_size;                /**< Size of the data to write */
+    int method;                   /**< Compression method, 8 (deflate) or 0 (stored) */
+    int crc;                      /**< CRC of the uncompressed data */
+    int done;                     /**< Set once a worker thread has compressed the member */
+};
+
 struct zip_info {
     int zipnum;
     int dir_size;
     long long offset;
     int compression_level;
+    int page_align;
     int maxnamelen;
     int zip64;
     short date;
@@ -37,8 +56,20 @@ struct zip_info {
     FILE *res2;
     FILE *index;
     FILE *dir;
+    struct zip_member *members;   /**< Members being compressed by the worker threads, used as a ring */
+    int member_count;             /**< Number of entries in `members` */
+    long long next_queue;         /**< Number of members handed to the worker threads so far */
+    long long next_write;         /**< Number of those members written so far */
+    GAsyncQueue *todo;
+    GAsyncQueue *done;
+    GThread **threads;
 };
 
+/**
+ * @brief dummy member to pass an end condition to worker threads, as NULL cannot be passed.
+ */
+static struct zip_member killer;
+
 static int zip_write(struct zip_info *info, void *data, int len) {
     if (fwrite(data, len, 1, info->res2) != 1)
         return 0;
@@ -75,7 +106,50 @@ static int compress2_int(Byte *dest, uLongf *destLen, const Bytef *source, uLong
 }
 #endif
 
-void write_zipmember(struct zip_info *zip_info, char *name, int filelen, char *data, int data_size) {
+/**
+ * @brief Computes the CRC of a member and compresses it
+ *
+ * This may run in a worker thread.
+ *
+ * @param m The member
+ * @param level The compression level, 0 to store the member uncompressed
+ */
+static void zip_member_compress(struct zip_member *m, int level) {
+    uLongf destlen=m->data_size+m->data_size/500+12;
+
+    m->compbuffer=NULL;
+    m->comp_size=m->data_size;
+    m->crc=crc32(0, NULL, 0);
+    m->crc=crc32(m->crc, (unsigned char *)m->data, m->data_size);
+    m->method=level ? 8:0;
+#ifdef HAVE_ZLIB
+    if (m->method) {
+        int error;
+        m->compbuffer=g_malloc(destlen);
+        error=compress2_int((Byte *)m->compbuffer, &destlen, (Bytef *)m->data, m->data_size, level);
+        if (error == Z_OK) {
+            if (destlen < m->data_size)
+                m->comp_size=destlen;
+            else
+                m->method=0;
+        } else {
+            fprintf(stderr,"compress2 returned %d\n", error);
+            m->method=0;
+        }
+    }
+#else
+    /* Without zlib there is no compressor, so the member is always stored */
+    m->method=0;
+#endif
+}
+
+/**
+ * @brief Writes a compressed member to the zip file and its entry to the zip directory
+ *
+ * @param zip_info The zip file
+ * @param m The member, as filled by `zip_member_compress()`
+ */
+static void zip_member_write(struct zip_info *zip_info, struct zip_member *m) {
     struct zip_lfh lfh = {
         0x04034b50,
         0x0a,
@@ -86,7 +160,7 @@ void write_zipmember(struct zip_info *zip_info, char *name, int filelen, char *d
         0x0,
         0x0,
         0x0,
-        filelen,
+        m->filelen,
         0x0,
     };
     struct zip_cd cd = {
@@ -102,7 +176,7 @@ void write_zipmember(struct zip_info *zip_info, char *name, int filelen, char *d
         0x0,
         0x0,
         0x0,
-        filelen,
+        m->filelen,
         0x0000,
         0x0000,
         0x0000,
@@ -116,51 +190,47 @@ void write_zipmember(struct zip_info *zip_info, char *name, int filelen, char *d
         zip_info->offset,
     };
     char *filename;
-    int crc=0,len,comp_size=data_size;
-    uLongf destlen=data_size+data_size/500+12;
-    char *compbuffer;
-
-    compbuffer = g_malloc(destlen);
-    crc=crc32(0, NULL, 0);
-    crc=crc32(crc, (unsigned char *)data, data_size);
-    lfh.zipmthd=zip_info->compression_level ? 8:0;
-#ifdef HAVE_ZLIB
-    if (zip_info->compression_level) {
-        int error=compress2_int((Byte *)compbuffer, &destlen, (Bytef *)data, data_size, zip_info->compression_level);
-        if (error == Z_OK) {
-            if (destlen < data_size) {
-                data=compbuffer;
-                comp_size=destlen;
-            } else
-                lfh.zipmthd=0;
-        } else {
-            fprintf(stderr,"compress2 returned %d\n", error);
-        }
-    }
-#endif
-    lfh.zipcrc=crc;
-    lfh.zipsize=comp_size;
-    lfh.zipuncmp=data_size;
-    cd.zipccrc=crc;
+    char *data=m->method ? m->compbuffer : m->data;
+    int len,filelen=m->filelen;
+
+    lfh.zipmthd=m->method;
+    lfh.zipcrc=m->crc;
+    lfh.zipsize=m->method ? m->comp_size : m->data_size;
+    lfh.zipuncmp=m->data_size;
+    cd.zipccrc=m->crc;
     cd.zipcsiz=lfh.zipsize;
-    cd.zipcunc=data_size;
+    cd.zipcunc=m->data_size;
     cd.zipcmthd=lfh.zipmthd;
     if (zip_info->zip64) {
         cd.zipofst=0xffffffff;
         cd.zipcxtl+=sizeof(cd_ext);
     }
     filename=g_alloca(filelen+1);
-    strcpy(filename, name);
+    strcpy(filename, m->name);
     len=strlen(filename);
     while (len < filelen) {
         filename[len++]='_';
     }
     filename[filelen]='\0';
+    if (zip_info->page_align) {
+        /* pad the local file header, so that the data starts at a page boundary */
+        long long data_offset=zip_info->offset+sizeof(lfh)+filelen+sizeof(struct zip_extra_align);
+        lfh.zipxtraln=sizeof(struct zip_extra_align)+(zip_page_size-data_offset%zip_page_size)%zip_page_size;
+        cd.zipint|=zip_int_page_aligned;
+    }
     zip_write(zip_info, &lfh, sizeof(lfh));
     zip_write(zip_info, filename, filelen);
     zip_info->offset+=sizeof(lfh)+filelen;
-    zip_write(zip_info, data, comp_size);
-    zip_info->offset+=comp_size;
+    if (lfh.zipxtraln) {
+        struct zip_extra_align align= {zip_extra_header_id_align, lfh.zipxtraln-4, zip_page_size};
+        char *padding=g_malloc0(lfh.zipxtraln-sizeof(align));
+        zip_write(zip_info, &align, sizeof(align));
+        zip_write(zip_info, padding, lfh.zipxtraln-sizeof(align));
+        zip_info->offset+=lfh.zipxtraln;
+        g_free(padding);
+    }
+    zip_write(zip_info, data, lfh.zipsize);
+    zip_info->offset+=lfh.zipsize;
     dbg_assert(fwrite(&cd, sizeof(cd), 1, zip_info->dir)==1);
     dbg_assert(fwrite(filename, filelen, 1, zip_info->dir)==1);
     zip_info->dir_size+=sizeof(cd)+filelen;
@@ -168,8 +238,122 @@ void write_zipmember(struct zip_info *zip_info, char *name, int filelen, char *d
         dbg_assert(fwrite(&cd_ext, sizeof(cd_ext), 1, zip_info->dir)==1);
         zip_info->dir_size+=sizeof(cd_ext);
     }
+}
+
+/**
+ * @brief zip compression worker thread.
+ *
+ * This thread compresses any member passed to it via async queue and passes it back when done.
+ * @param data the zip file
+ */
+static gpointer zip_compress_thread(gpointer data) {
+    struct zip_info *info=data;
+    struct zip_member *m;
+
+    while ((m=g_async_queue_pop(info->todo)) != &killer) {
+        zip_member_compress(m, info->compression_level);
+        g_async_queue_push(info->done, m);
+    }
+    return NULL;
+}
+
+static void zip_start_threads(struct zip_info *info) {
+    int i;
+
+    info->member_count=thread_count*ZIP_MEMBERS_PER_THREAD;
+    info->members=g_new0(struct zip_member, info->member_count);
+    info->todo=g_async_queue_new();
+    info->done=g_async_queue_new();
+    info->threads=g_new0(GThread *, thread_count);
+    for (i = 0 ; i < thread_count ; i++)
+        info->threads[i]=g_thread_new("zip_compress", zip_compress_thread, info);
+}
+
+/**
+ * @brief Waits for the oldest member handed to the worker threads to be compressed and writes it
+ */
+static void zip_write_next(struct zip_info *info) {
+    struct zip_member *m=&info->members[info->next_write % info->member_count];
+
+    while (!m->done) {
+        struct zip_member *done=g_async_queue_pop(info->done);
+        done->done=1;
+    }
+    zip_member_write(info, m);
+    g_free(m->name);
+    g_free(m->data);
+    g_free(m->compbuffer);
+    m->done=0;
+    info->next_write++;
+}
 
-    g_free(compbuffer);
+/**
+ * @brief Writes all members still being compressed, in the order they were added
+ */
+static void zip_flush(struct zip_info *info) {
+    while (info->next_write < info->next_queue)
+        zip_write_next(info);
+}
+
+static void zip_stop_threads(struct zip_info *info) {
+    int i;
+
+    if (!info->threads)
+        return;
+    zip_flush(info);
+    for (i = 0 ; i < thread_count ; i++)
+        g_async_queue_push(info->todo, &killer);
+    for (i = 0 ; i < thread_count ; i++)
+        g_thread_join(info->threads[i]);
+    g_async_queue_unref(info->todo);
+    g_async_queue_unref(info->done);
+    g_free(info->threads);
+    g_free(info->members);
+    info->threads=NULL;
+    info->members=NULL;
+}
+
+/**
+ * @brief Adds a member to the zip file
+ *
+ * If the member is to be compressed and maptool runs with several threads, the member is compressed by a worker
+ * thread and written later, when it is done and all members added before it have been written. This function
+ * copies `data`, so the caller may free it right away.
+ *
+ * @param zip_info The zip file
+ * @param name Name of the member
+ * @param filelen Length to pad the name to with '_'
+ * @param data Data of the member
+ * @param data_size Size of `data`
+ */
+void write_zipmember(struct zip_info *zip_info, char *name, int filelen, char *data, int data_size) {
+    struct zip_member *m,member;
+    int level=zip_info->page_align ? 0 : zip_info->compression_level;
+
+    if (!level || thread_count <= 1) {
+        zip_flush(zip_info);
+        member.name=name;
+        member.filelen=filelen;
+        member.data=data;
+        member.data_size=data_size;
+        zip_member_compress(&member, level);
+        zip_member_write(zip_info, &member);
+        g_free(member.compbuffer);
+        return;
+    }
+    if (!zip_info->threads)
+        zip_start_threads(zip_info);
+    if (zip_info->next_queue - zip_info->next_write >= zip_info->member_count)
+        zip_write_next(zip_info);
+    m=&zip_info->members[zip_info->next_queue % zip_info->member_count];
+    m->name=g_strdup(name);
+    m->filelen=filelen;
+    m->data=g_malloc(data_size);
+    memcpy(m->data, data, data_size);
+    m->data_size=data_size;
+    m->done=0;
+    g_async_queue_push(zip_info->todo, m);
+    zip_info->next_queue++;
 }
 
 int zip_write_index(struct zip_info *info) {
@@ -226,6 +410,7 @@ int zip_write_directory(struct zip_info *info) {
         0x0,
     };
 
+    zip_flush(info);
     fseek(info->dir, 0, SEEK_SET);
     zip_write_file_data(info, info->dir);
     if (info->zip64) {
@@ -273,6 +458,19 @@ void zip_set_compression_level(struct zip_info *info, int level) {
     info->compression_level=level;
 }
 
+/**
+ * @brief Makes all following members page-aligned
+ *
+ * Members are stored uncompressed, and the data of each member starts at a multiple of `zip_page_size`. Navit maps
+ * such a file into memory and uses the members in place, without copying or uncompressing them.
+ *
+ * @param info The zip file
+ * @param on True to align members, false to write them as usual
+ */
+void zip_set_page_align(struct zip_info *info, int on) {
+    info->page_align=on;
+}
+
 void zip_set_maxnamelen(struct zip_info *info, int max) {
     info->maxnamelen=max;
 }
@@ -329,6 +527,7 @@ void zip_set_zipnum(struct zip_info *info, int num) {
 }
 
 void zip_close(struct zip_info *info) {
+    zip_stop_threads(info);
     fclose(info->index);
     fclose(info->dir);
     fclose(info->res2);
@@ -154,7 +154,8 @@ enum nav_status_int {
     status_none = 0,
     status_busy = 1,
     status_has_ritem = 2,
-    status_has_sitem = 4
+    status_has_sitem = 4,
+    status_compare = 8			/**< Keep the items which the new route has in common with the old one */
 };
 
 
@@ -163,6 +164,8 @@ struct navigation {
     struct route *route;
     struct map *map;
     struct item_hash *hash;
+    struct item_hash *way_cache;		/**< Data of the map items of ways, see {@code navigation_way_cache_fill()} */
+    int way_cache_count;			/**< Number of items in {@code way_cache} */
     struct vehicleprofile *vehicleprofile;
     struct navigation_itm *first;
     struct navigation_itm *last;
@@ -186,6 +189,8 @@ struct navigation {
     int flags;
     struct map_rect *route_mr;			/**< Map rect on the route map, used for maneuver generation */
     enum nav_status_int status_int;		/**< Internal status information used during maneuver generation */
+    struct navigation_itm *keep_itm;		/**< While comparing a new route with the items, the last item found unchanged */
+    struct navigation_itm *maneuvers_from;	/**< First item whose maneuvers must be generated again, NULL for all */
     struct callback *idle_cb;			/**< Idle callback to process the route map */
     struct event_idle *idle_ev;			/**< The pointer to the idle event */
     int nav_status;						/**< Status of the navigation engine */
@@ -359,6 +364,7 @@ struct street_destination {
 
 
 static void navigation_flush(struct navigation *this_);
+static void navigation_way_data_destroy(void *data);
 
 /**
  * @brief Calculates the delta between two angles
@@ -778,6 +784,7 @@ navigation_new(struct attr *parent, struct attr **attrs) {
     struct attr * attr;
     struct navigation *ret=(struct navigation *)navit_object_new(attrs, &navigation_func, sizeof(struct navigation));
     ret->hash=item_hash_new();
+    ret->way_cache=item_hash_new_full(navigation_way_data_destroy);
     ret->callback=callback_list_new();
     ret->callback_speech=callback_list_new();
     ret->level_last=4;
@@ -1062,6 +1069,158 @@ static char *get_distance_str(struct navigation *nav, int dist_meters, enum attr
     }
 }
 
+/** Distance in meters after a maneuver which its analysis may look at, see {@code navigation_itms_truncate()} */
+#define NAVIGATION_MANEUVER_LOOKAHEAD 2000
+
+/** Maximum number of map items kept in the way cache of a navigation object */
+#define NAVIGATION_WAY_CACHE_SIZE 4096
+
+/**
+ * @brief The data of a map item needed to analyze a way, as kept in the way cache
+ */
+struct navigation_way_data {
+    enum item_type type;			/**< The type of the item, {@code type_none} if it was not found on the map */
+    int flags;				/**< The flags of the item */
+    char *name;				/**< The converted street name, or NULL */
+    char *name_systematic;			/**< The converted road number, or NULL */
+    int coord_count;			/**< Number of coordinates in {@code c} */
+    struct coord *c;			/**< The coordinates of the item */
+};
+
+static void navigation_way_data_destroy(void *data) {
+    struct navigation_way_data *d=data;
+
+    map_convert_free(d->name);
+    map_convert_free(d->name_systematic);
+    g_free(d->c);
+    g_free(d);
+}
+
+/**
+ * @brief Reads the data of a map item
+ *
+ * Only the attributes and coordinates of lines are read.
+ *
+ * @param mr A map rect on the map of the item, may be NULL
+ * @param item The item
+ * @return The data, to be freed with {@code navigation_way_data_destroy()}
+ */
+static struct navigation_way_data *navigation_way_data_new(struct map_rect *mr, struct item *item) {
+    struct navigation_way_data *ret=g_new0(struct navigation_way_data, 1);
+    struct item *realitem;
+    struct attr attr;
+    int size=16,count;
+
+    ret->type=type_none;
+    if (!mr)
+        return ret;
+    realitem = map_rect_get_item_byid(mr, item->id_hi, item->id_lo);
+    if (!realitem) {
+        dbg(lvl_warning,"Item from segment not found on map!");
+        return ret;
+    }
+    ret->type=realitem->type;
+    if (realitem->type < type_line || realitem->type >= type_area)
+        return ret;
+    if (item_attr_get(realitem, attr_flags, &attr))
+        ret->flags=attr.u.num;
+    if (item_attr_get(realitem, attr_street_name, &attr))
+        ret->name=map_convert_string(realitem->map,attr.u.str);
+    if (item_attr_get(realitem, attr_street_name_systematic, &attr))
+        ret->name_systematic=map_convert_string(realitem->map,attr.u.str);
+    ret->c=g_new(struct coord, size);
+    while ((count=item_coord_get(realitem, ret->c+ret->coord_count, size-ret->coord_count)) > 0) {
+        ret->coord_count+=count;
+        if (ret->coord_count == size) {
+            size*=2;
+            ret->c=g_renew(struct coord, ret->c, size);
+        }
+    }
+    return ret;
+}
+
+/**
+ * @brief Empties the way cache of a navigation object
+ *
+ * @param this_ The navigation object
+ */
+static void navigation_way_cache_clear(struct navigation *this_) {
+    item_hash_destroy(this_->way_cache);
+    this_->way_cache=item_hash_new_full(navigation_way_data_destroy);
+    this_->way_cache_count=0;
+}
+
+static int navigation_item_compare(const void *a, const void *b) {
+    const struct item *ia=*(struct item * const *)a;
+    const struct item *ib=*(struct item * const *)b;
+
+    if (ia->map != ib->map)
+        return (char *)ia->map < (char *)ib->map ? -1 : 1;
+    if (ia->id_hi != ib->id_hi)
+        return ia->id_hi < ib->id_hi ? -1 : 1;
+    if (ia->id_lo != ib->id_lo)
+        return ia->id_lo < ib->id_lo ? -1 : 1;
+    return 0;
+}
+
+/**
+ * @brief Reads the data of map items into the way cache
+ *
+ * Items already in the cache are skipped. The others are read sorted by map and id, using one map rect per map.
+ * As the id of an item in a binfile identifies its tile, this groups the lookups by tile, so each tile is opened
+ * only once. Data in the cache stays valid until the next call of this function.
+ *
+ * @param this_ The navigation object
+ * @param items The items
+ * @param count Number of items
+ */
+static void navigation_way_cache_fill(struct navigation *this_, struct item **items, int count) {
+    struct item **missing=g_new(struct item *, count);
+    struct map_rect *mr=NULL;
+    struct map *map=NULL;
+    int i,missing_count=0;
+
+    for (i = 0 ; i < count ; i++) {
+        if (!item_hash_lookup(this_->way_cache, items[i]))
+            missing[missing_count++]=items[i];
+    }
+    if (missing_count && this_->way_cache_count+missing_count > NAVIGATION_WAY_CACHE_SIZE)
+        navigation_way_cache_clear(this_);
+    qsort(missing, missing_count, sizeof(*missing), navigation_item_compare);
+    for (i = 0 ; i < missing_count ; i++) {
+        if (i && !navigation_item_compare(&missing[i], &missing[i-1]))
+            continue;
+        if (!mr || missing[i]->map != map) {
+            if (mr)
+                map_rect_destroy(mr);
+            map=missing[i]->map;
+            mr=map_rect_new(map, NULL);
+        }
+        item_hash_insert(this_->way_cache, missing[i], navigation_way_data_new(mr, missing[i]));
+        this_->way_cache_count++;
+    }
+    if (mr)
+        map_rect_destroy(mr);
+    g_free(missing);
+}
+
+/**
+ * @brief Returns the data of a map item from the way cache, reading it if needed
+ *
+ * @param this_ The navigation object
+ * @param item The item
+ * @return The data, which stays valid until the next item is read into the cache
+ */
+static struct navigation_way_data *navigation_way_cache_get(struct navigation *this_, struct item *item) {
+    struct navigation_way_data *ret=item_hash_lookup(this_->way_cache, item);
+
+    if (!ret) {
+        navigation_way_cache_fill(this_, &item, 1);
+        ret=item_hash_lookup(this_->way_cache, item);
+    }
+    return ret;
+}
+
 /**
  * @brief Initializes a navigation_way
  *
@@ -1072,70 +1231,35 @@ static char *get_distance_str(struct navigation *nav, int dist_meters, enum attr
  * Note that this function is not suitable for ways on the route (created in {@code navigation_itm_new})
  * as it may return incorrect coordinates for these ways.
  *
+ * @param this_ The navigation object, whose way cache holds the map item
  * @param w The way to initialize. The {@code item}, {@code id_hi}, {@code id_lo} and {@code dir}
  * members of this struct must be set prior to calling this function.
  */
-static void navigation_way_init(struct navigation_way *w) {
+static void navigation_way_init(struct navigation *this_, struct navigation_way *w) {
     struct coord cbuf[2];
-    struct item *realitem;
-    struct coord c;
-    struct map_rect *mr;
-    struct attr attr;
+    struct navigation_way_data *data;
 
     w->angle2 = invalid_angle;
-    mr = map_rect_new(w->item.map, NULL);
-    if (!mr)
-        return;
+    data = navigation_way_cache_get(this_, &w->item);
 
-    realitem = map_rect_get_item_byid(mr, w->item.id_hi, w->item.id_lo);
-    if (!realitem) {
-        dbg(lvl_warning,"Item from segment not found on map!");
-        map_rect_destroy(mr);
+    if (data->type < type_line || data->type >= type_area)
         return;
-    }
+    w->flags=data->flags;
+    w->name=data->name ? g_strdup(data->name) : NULL;
+    w->name_systematic=data->name_systematic ? g_strdup(data->name_systematic) : NULL;
 
-    if (realitem->type < type_line || realitem->type >= type_area) {
-        map_rect_destroy(mr);
+    if (data->coord_count < 2) {
+        dbg(lvl_warning,"Using calculate_angle() with a less-than-two-coords-item?");
         return;
     }
-    if (item_attr_get(realitem, attr_flags, &attr))
-        w->flags=attr.u.num;
-    else
-        w->flags=0;
-    if (item_attr_get(realitem, attr_street_name, &attr))
-        w->name=map_convert_string(realitem->map,attr.u.str);
-    else
-        w->name=NULL;
-    if (item_attr_get(realitem, attr_street_name_systematic, &attr))
-        w->name_systematic=map_convert_string(realitem->map,attr.u.str);
-    else
-        w->name_systematic=NULL;
-
     if (w->dir < 0) {
-        if (item_coord_get(realitem, cbuf, 2) != 2) {
-            dbg(lvl_warning,"Using calculate_angle() with a less-than-two-coords-item?");
-            map_rect_destroy(mr);
-            return;
-        }
-
-        while (item_coord_get(realitem, &c, 1)) {
-            cbuf[0] = cbuf[1];
-            cbuf[1] = c;
-        }
-
+        cbuf[0] = data->c[data->coord_count-2];
+        cbuf[1] = data->c[data->coord_count-1];
     } else {
-        if (item_coord_get(realitem, cbuf, 2) != 2) {
-            dbg(lvl_warning,"Using calculate_angle() with a less-than-two-coords-item?");
-            map_rect_destroy(mr);
-            return;
-        }
-        c = cbuf[0];
-        cbuf[0] = cbuf[1];
-        cbuf[1] = c;
+        cbuf[0] = data->c[1];
+        cbuf[1] = data->c[0];
     }
 
-    map_rect_destroy(mr);
-
     w->angle2=road_angle(&cbuf[1],&cbuf[0],0);
 }
 
@@ -1160,6 +1284,7 @@ static void navigation_way_init(struct navigation_way *w) {
  *
  * If {@code dist} exceeds the length of the way, the entire way is examined.
  *
+ * @param this_ The navigation object, whose way cache holds the map item
  * @param pro The projection used by the map
  * @param w The way to examine
  * @param angle The reference bearing
@@ -1169,36 +1294,22 @@ static void navigation_way_init(struct navigation_way *w) {
  *
  * @return The delta, {@code -180 < delta <= 180}, or {@code invalid_angle} if an error occurred.
  */
-static int navigation_way_get_max_delta(struct navigation_way *w, enum projection pro, int angle, double dist,
-                                        int dir) {
+static int navigation_way_get_max_delta(struct navigation *this_, struct navigation_way *w, enum projection pro,
+                                        int angle, double dist, int dir) {
     double dist_left = dist; /* distance from last examined point */
     int ret = invalid_angle;
     int tmp_delta;
     int eff_dir = dir * w->dir; /* effective direction: +1 to examine section from start of way, -1 from end of way  */
-    struct coord cbuf[2];
-    struct item *realitem;
-    struct coord c;
-    struct map_rect *mr;
-
-    mr = map_rect_new(w->item.map, NULL);
-    if (!mr)
-        return ret;
+    struct navigation_way_data *data;
+    int i;
 
-    realitem = map_rect_get_item_byid(mr, w->item.id_hi, w->item.id_lo);
-    if (!realitem) {
-        dbg(lvl_warning,"Item from segment not found on map!");
-        map_rect_destroy(mr);
-        return ret;
-    }
+    data = navigation_way_cache_get(this_, &w->item);
 
-    if (realitem->type < type_line || realitem->type >= type_area) {
-        map_rect_destroy(mr);
+    if (data->type < type_line || data->type >= type_area)
         return ret;
-    }
 
-    if (item_coord_get(realitem, &cbuf[1], 1) != 1) {
+    if (data->coord_count < 1) {
         dbg(lvl_warning,"item has no coords");
-        map_rect_destroy(mr);
         return ret;
     }
 
@@ -1206,11 +1317,8 @@ static int navigation_way_get_max_delta(struct navigation_way *w, enum projectio
         /* we're going against the direction of the item:
          * measure its total length and set dist_left to difference of total length and distance */
         dist_left = 0;
-        while (item_coord_get(realitem, &c, 1)) {
-            cbuf[0] = cbuf[1];
-            cbuf[1] = c;
-            dist_left += transform_distance(pro, &cbuf[0], &cbuf[1]);
-        }
+        for (i = 1 ; i < data->coord_count ; i++)
+            dist_left += transform_distance(pro, &data->c[i-1], &data->c[i]);
 
         /* if dist is less that the distance of the way, make dist_left the distance from the other end
          * else set it to zero (so we'll examine the whole way) */
@@ -1218,30 +1326,19 @@ static int navigation_way_get_max_delta(struct navigation_way *w, enum projectio
             dist_left -= dist;
         else
             dist_left = 0;
-
-        item_coord_rewind(realitem);
-
-        if (item_coord_get(realitem, &cbuf[1], 1) != 1) {
-            dbg(lvl_warning,"item has no more coords after rewind");
-            map_rect_destroy(mr);
-            return ret;
-        }
     }
 
-    while (item_coord_get(realitem, &c, 1)) {
+    for (i = 1 ; i < data->coord_count ; i++) {
         if ((eff_dir > 0) && (dist_left <= 0))
             break;
-        cbuf[0] = cbuf[1];
-        cbuf[1] = c;
-        dist_left -= transform_distance(pro, &cbuf[0], &cbuf[1]);
+        dist_left -= transform_distance(pro, &data->c[i-1], &data->c[i]);
         if ((eff_dir < 0) && (dist_left > 0))
             continue;
-        tmp_delta = angle_delta(angle, road_angle(&cbuf[0], &cbuf[1], w->dir));
+        tmp_delta = angle_delta(angle, road_angle(&data->c[i-1], &data->c[i], w->dir));
         if ((ret == invalid_angle) || (abs(ret) < abs(tmp_delta)) || ((abs(ret) == abs(tmp_delta)) && (eff_dir < 0)))
             ret = tmp_delta;
     }
 
-    map_rect_destroy(mr);
     return ret;
 }
 
@@ -1271,15 +1368,21 @@ static void navigation_itm_ways_clear(struct navigation_itm *itm) {
  * This updates the list of possible ways to drive to from itm. The item "itm" is on
  * and the next navigation item are excluded.
  *
+ * The map items of all ways are read into the way cache in one batch before the ways are initialized.
+ *
+ * @param this_ The navigation object
  * @param itm The item that should be updated
  * @param graph_map The route graph's map that these items are on
  */
-static void navigation_itm_ways_update(struct navigation_itm *itm, struct map *graph_map) {
+static void navigation_itm_ways_update(struct navigation *this_, struct navigation_itm *itm, struct map *graph_map) {
     struct map_selection coord_sel;
     struct map_rect *g_rect; /* Contains a map rectangle from the route graph's map */
     struct item *i,*sitem;
     struct attr sitem_attr,direction_attr;
     struct navigation_way *w, *l, *h;
+    struct navigation_way *ways=NULL;
+    struct item **items;
+    int j,way_count=0,ways_size=0;
 
     dbg(lvl_debug, "entering for item: %s %s %s", item_to_name(itm->way.item.type), itm->way.name_systematic,
         itm->way.name);
@@ -1330,12 +1433,30 @@ static void navigation_itm_ways_update(struct navigation_itm *itm, struct map *g
             continue;
         }
 
+        if (way_count == ways_size) {
+            ways_size = ways_size ? ways_size*2 : 8;
+            ways = g_renew(struct navigation_way, ways, ways_size);
+        }
+        ways[way_count].dir = direction_attr.u.num;
+        ways[way_count].item = *sitem;
+        way_count++;
+    }
+
+    map_rect_destroy(g_rect);
+
+    items = g_new(struct item *, way_count);
+    for (j = 0 ; j < way_count ; j++)
+        items[j] = &ways[j].item;
+    navigation_way_cache_fill(this_, items, way_count);
+    g_free(items);
+
+    for (j = 0 ; j < way_count ; j++) {
         l = w;
         w = g_new0(struct navigation_way, 1);
-        w->dir = direction_attr.u.num;
-        w->item = *sitem;
+        w->dir = ways[j].dir;
+        w->item = ways[j].item;
         w->next = l;
-        navigation_way_init(w);	/* calculate and set w->angle2 */
+        navigation_way_init(this_, w);	/* calculate and set w->angle2 */
 
         dbg(lvl_debug, "- retrieved way: %s %s %s", item_to_name(w->item.type), w->name_systematic, w->name);
 
@@ -1350,12 +1471,31 @@ static void navigation_itm_ways_update(struct navigation_itm *itm, struct map *g
             h = h->next;
         }
     }
-
-    map_rect_destroy(g_rect);
+    g_free(ways);
 
     itm->way.next = w;
 }
 
+/**
+ * @brief Frees a navigation item and removes it from the item hash of a navigation object
+ *
+ * The item must already have been unlinked from the list of items.
+ *
+ * @param this_ The navigation object
+ * @param itm The item
+ */
+static void navigation_itm_destroy(struct navigation *this_, struct navigation_itm *itm) {
+    if (item_hash_lookup(this_->hash, &itm->way.item) == itm)
+        item_hash_remove(this_->hash, &itm->way.item);
+    map_convert_free(itm->way.name);
+    map_convert_free(itm->way.name_systematic);
+    map_convert_free(itm->way.exit_ref);
+    map_convert_free(itm->way.exit_label);
+    free_list(itm->way.destination);
+    navigation_itm_ways_clear(itm);
+    g_free(itm);
+}
+
 /**
  * @brief Destroys navigation items associated with a navigation object.
  *
@@ -1376,10 +1516,13 @@ static void navigation_destroy_itms_cmds(struct navigation *this_, struct naviga
     while (this_->first && this_->first != end) {
         itm=this_->first;
         dbg(lvl_debug,"destroying %p", itm);
-        item_hash_remove(this_->hash, &itm->way.item);
         this_->first=itm->next;
         if (this_->first)
             this_->first->prev=NULL;
+        if (itm == this_->keep_itm)
+            this_->keep_itm=NULL;
+        if (itm == this_->maneuvers_from)
+            this_->maneuvers_from=this_->first;
         if (this_->cmd_first && this_->cmd_first->itm == itm->next) {
             cmd=this_->cmd_first;
             this_->cmd_first=cmd->next;
@@ -1391,13 +1534,7 @@ static void navigation_destroy_itms_cmds(struct navigation *this_, struct naviga
             g_free(cmd);
         }
 
-        map_convert_free(itm->way.name);
-        map_convert_free(itm->way.name_systematic);
-        map_convert_free(itm->way.exit_ref);
-        map_convert_free(itm->way.exit_label);
-        free_list(itm->way.destination);
-        navigation_itm_ways_clear(itm);
-        g_free(itm);
+        navigation_itm_destroy(this_, itm);
     }
     if (! this_->first)
         this_->last=NULL;
@@ -1545,7 +1682,7 @@ static struct navigation_itm *navigation_itm_new(struct navigation *this_, struc
         if (graph_map ) {
             if (this_->last)
                 ret->prev=this_->last;
-            navigation_itm_ways_update(ret,graph_map);
+            navigation_itm_ways_update(this_,ret,graph_map);
         }
 
         /* If we have a ramp, check the map for higway_exit info,
@@ -2429,7 +2566,7 @@ static void navigation_analyze_roundabout(struct navigation *this_, struct navig
                     dbg(lvl_debug,"items before roundabout: maximum distance reached, %dm left, item length %dm", dist_left, itm3->length);
                     break;
                 }
-                d = navigation_way_get_max_delta(&(itm3->way), map_projection(this_->map), itm2->prev->angle_end, dist_left, -1);
+                d = navigation_way_get_max_delta(this_, &(itm3->way), map_projection(this_->map), itm2->prev->angle_end, dist_left, -1);
                 if ((d != invalid_angle) && (abs(d) > abs(dmax)))
                     dmax = d;
                 w2 = itm3->way.next;
@@ -2455,7 +2592,7 @@ static void navigation_analyze_roundabout(struct navigation *this_, struct navig
             if (dist_left == 0) {
                 d = angle_delta(itm2->prev->angle_end, itm3->angle_end);
             } else if (dist_left < itm3->length) {
-                d = navigation_way_get_max_delta(&(itm3->way), map_projection(this_->map), itm2->prev->angle_end, dist_left, -1);
+                d = navigation_way_get_max_delta(this_, &(itm3->way), map_projection(this_->map), itm2->prev->angle_end, dist_left, -1);
             } else {
                 /* not enough objects in navigation map, use most distant one
                  * - or dist_left == itm3->length, this saves a few CPU cycles over the above */
@@ -2481,7 +2618,7 @@ static void navigation_analyze_roundabout(struct navigation *this_, struct navig
                     dbg(lvl_debug,"items after roundabout: maximum distance reached, %dm left, item length %dm", dist_left, itm3->length);
                     break;
                 }
-                d = navigation_way_get_max_delta(&(itm3->way), map_projection(this_->map), itm->way.angle2, dist_left, 1);
+                d = navigation_way_get_max_delta(this_, &(itm3->way), map_projection(this_->map), itm->way.angle2, dist_left, 1);
                 if ((d != invalid_angle) && (abs(d) > abs(dmax)))
                     dmax = d;
                 w2 = itm3->next->way.next;
@@ -2506,7 +2643,7 @@ static void navigation_analyze_roundabout(struct navigation *this_, struct navig
             if (dist_left == 0) {
                 d = angle_delta(itm->way.angle2, itm3->way.angle2);
             } else if (dist_left < itm3->length) {
-                d = navigation_way_get_max_delta(&(itm3->way), map_projection(this_->map), itm->way.angle2, dist_left, 1);
+                d = navigation_way_get_max_delta(this_, &(itm3->way), map_projection(this_->map), itm->way.angle2, dist_left, 1);
             } else {
                 /* not enough objects in navigation map, use most distant one
                  * - or dist_left == itm3->length, this saves a few CPU cycles over the above */
@@ -2775,24 +2912,23 @@ static struct navigation_command *command_new(struct navigation *this_, struct n
 
 
 /**
- * @brief Creates turn instructions where needed
+ * @brief Generates the maneuvers for the navigation items from a given one to the end of the route
  *
- * @param this_ The navigation object for which to create turn instructions
- * @param route Not used
+ * The commands are appended to those of the items before {@code from}, which must not have commands for later items.
+ *
+ * @param this_ The navigation object
+ * @param from The first item for which to generate maneuvers, NULL if there are no items
  */
-static void make_maneuvers(struct navigation *this_, struct route *route) {
-    struct navigation_itm *itm, *last=NULL, *last_itm=NULL;
+static void make_maneuvers_from(struct navigation *this_, struct navigation_itm *from) {
+    struct navigation_itm *itm, *last_itm;
     struct navigation_maneuver *maneuver;
-    itm=this_->first;
-    this_->cmd_last=NULL;
-    this_->cmd_first=NULL;
+
+    itm=from;
+    last_itm=from ? from->prev : NULL;
     while (itm) {
-        if (last) {
-            if (maneuver_required2(this_, last_itm, itm, &maneuver)) {
-                command_new(this_, itm, maneuver);
-            }
-        } else
-            last=itm;
+        if (last_itm && maneuver_required2(this_, last_itm, itm, &maneuver)) {
+            command_new(this_, itm, maneuver);
+        }
         last_itm=itm;
         itm=itm->next;
     }
@@ -2801,6 +2937,108 @@ static void make_maneuvers(struct navigation *this_, struct route *route) {
     command_new(this_, last_itm, maneuver);
 }
 
+/**
+ * @brief Creates turn instructions where needed
+ *
+ * @param this_ The navigation object for which to create turn instructions
+ * @param route Not used
+ */
+static void make_maneuvers(struct navigation *this_, struct route *route) {
+    this_->cmd_last=NULL;
+    this_->cmd_first=NULL;
+    make_maneuvers_from(this_, this_->first);
+}
+
+/**
+ * @brief Destroys the commands of the navigation items from a given one to the end of the route
+ *
+ * @param this_ The navigation object
+ * @param from The first item whose commands are destroyed
+ */
+static void navigation_destroy_cmds_from(struct navigation *this_, struct navigation_itm *from) {
+    struct navigation_itm *itm;
+    struct navigation_command *cmd=this_->cmd_first,*next;
+
+    for (itm = this_->first ; itm && itm != from ; itm = itm->next) {
+        while (cmd && cmd->itm == itm)
+            cmd=cmd->next;
+    }
+    if (!cmd)
+        return;
+    this_->cmd_last=cmd->prev;
+    if (cmd->prev)
+        cmd->prev->next=NULL;
+    else
+        this_->cmd_first=NULL;
+    while (cmd) {
+        next=cmd->next;
+        g_free(cmd->maneuver);
+        g_free(cmd);
+        cmd=next;
+    }
+}
+
+/**
+ * @brief Drops the navigation items after the last one a new route has in common with the old one
+ *
+ * The commands of the items kept are kept as well, except for those close enough to the first changed item for
+ * their analysis to look at it: maneuvers may be analyzed up to {@code NAVIGATION_MANEUVER_LOOKAHEAD} meters ahead,
+ * and across any ramps or roundabouts. The first item whose maneuvers must be generated again is stored in
+ * {@code maneuvers_from}.
+ *
+ * @param this_ The navigation object
+ * @param last The last item to keep
+ */
+static void navigation_itms_truncate(struct navigation *this_, struct navigation_itm *last) {
+    struct navigation_itm *from=last,*itm,*next;
+    int dist=0;
+
+    while (from->prev && (dist < NAVIGATION_MANEUVER_LOOKAHEAD || is_ramp(&from->way)
+                          || (from->way.flags & AF_ROUNDABOUT))) {
+        dist+=from->length;
+        from=from->prev;
+    }
+    dbg(lvl_debug,"keeping items up to %p, maneuvers from %p", last, from);
+    navigation_destroy_cmds_from(this_, from);
+    for (itm = last->next ; itm ; itm = next) {
+        next=itm->next;
+        navigation_itm_destroy(this_, itm);
+    }
+    last->next=NULL;
+    this_->last=last;
+    this_->maneuvers_from=from;
+}
+
+/**
+ * @brief Whether a route map item continues a navigation item unchanged
+ *
+ * @param itm The navigation item, may be NULL
+ * @param ritem An item from the route map
+ * @return True if {@code ritem} is on the same street item, in the same direction and with the same start and end
+ * as {@code itm}
+ */
+static int navigation_itm_matches(struct navigation_itm *itm, struct item *ritem) {
+    struct attr street_item,direction;
+    struct coord c,start,end;
+    int count=0;
+
+    if (!itm || !item_attr_get(ritem, attr_street_item, &street_item)
+            || !item_is_equal(itm->way.item, *street_item.u.item))
+        return 0;
+    if (!item_attr_get(ritem, attr_direction, &direction))
+        direction.u.num=0;
+    if (itm->way.dir != direction.u.num)
+        return 0;
+    while (item_coord_get(ritem, &c, 1)) {
+        if (!count)
+            start=c;
+        end=c;
+        count++;
+    }
+    item_coord_rewind(ritem);
+    return count && start.x == itm->start.x && start.y == itm->start.y && end.x == itm->end.x && end.y == itm->end.y;
+}
+
 static int contains_suffix(char *name, char *suffix) {
     if (!suffix)
         return 0;
@@ -3607,12 +3845,17 @@ static void navigation_update_done(struct navigation *this_, int cancel) {
     if (!cancel) {
         nav_status.type = attr_nav_status;
         nav_status.u.num = status_routing;
-        if (!(this_->status_int & status_has_sitem))
+        if (!(this_->status_int & status_has_sitem)) {
             navigation_destroy_itms_cmds(this_, NULL);
-        else {
+            this_->maneuvers_from=NULL;
+        } else {
             if (!(this_->status_int & status_has_ritem)) {
                 navigation_itm_new(this_, NULL);
-                make_maneuvers(this_,this_->route);
+                if (this_->maneuvers_from)
+                    make_maneuvers_from(this_, this_->maneuvers_from);
+                else
+                    make_maneuvers(this_,this_->route);
+                this_->maneuvers_from=NULL;
             }
             calculate_dest_distance(this_, incr);
             profile(0,"end");
@@ -3628,6 +3871,7 @@ static void navigation_update_done(struct navigation *this_, int cancel) {
      * status_int must be reset before the call to map_rect_destroy().
      */
     this_->status_int = status_none;
+    this_->keep_itm = NULL;
     this_->route_mr = NULL;
     map_rect_destroy(mr);
 }
@@ -3659,6 +3903,8 @@ static void navigation_update_idle(struct navigation *this_) {
     while (count > 0) {
         if (!(ritem = map_rect_get_item(this_->route_mr))) {
             this_->status_int &= ~(status_has_ritem);
+            if (this_->keep_itm)
+                navigation_itms_truncate(this_, this_->keep_itm);
             break;
         }
         this_->status_int |= status_has_ritem;
@@ -3683,9 +3929,22 @@ static void navigation_update_idle(struct navigation *this_) {
             navigation_destroy_itms_cmds(this_, itm);
             if (itm) {
                 navigation_itm_update(itm, ritem);
-                break;
+                if (!(this_->status_int & status_compare))
+                    break;
+                this_->keep_itm = itm;
+                count--;
+                continue;
             }
             dbg(lvl_debug,"not on track");
+        } else if (this_->keep_itm) {
+            if (navigation_itm_matches(this_->keep_itm->next, ritem)) {
+                this_->keep_itm = this_->keep_itm->next;
+                navigation_itm_update(this_->keep_itm, ritem);
+                count--;
+                continue;
+            }
+            navigation_itms_truncate(this_, this_->keep_itm);
+            this_->keep_itm = NULL;
         }
         navigation_itm_new(this_, ritem);
         count--;
@@ -3712,6 +3971,7 @@ static void navigation_update(struct navigation *this_, struct route *route, str
     struct map *map;
     struct attr vehicleprofile;
     struct attr nav_status;
+    int stale=0;
 
     if (attr->type != attr_route_status)
         return;
@@ -3737,15 +3997,20 @@ static void navigation_update(struct navigation *this_, struct route *route, str
     }
     navigation_set_attr(this_, &nav_status);
 
-    if (attr->u.num == route_status_no_destination || attr->u.num == route_status_not_found
-            || attr->u.num == route_status_path_done_new)
+    /* Cancel a pass still in progress. Unless it only compared the route with the items, the items it created have no
+     * maneuvers yet. */
+    if (this_->status_int & status_busy) {
+        stale=(this_->status_int & status_has_sitem) && !this_->keep_itm;
+        navigation_update_done(this_, 1);
+    }
+    /* A new route keeps the items it has in common with the old one, unless generating the maneuvers for the old
+     * one was interrupted */
+    if (attr->u.num == route_status_no_destination || attr->u.num == route_status_not_found || stale
+            || ((attr->u.num == route_status_path_done_new || attr->u.num == route_status_path_done_incremental)
+                && this_->maneuvers_from))
         navigation_flush(this_);
-    if (attr->u.num != route_status_path_done_new && attr->u.num != route_status_path_done_incremental) {
-        if (this_->status_int & status_busy) {
-            navigation_update_done(this_, 1);
-        }
+    if (attr->u.num != route_status_path_done_new && attr->u.num != route_status_path_done_incremental)
         return;
-    }
 
     if (! this_->route)
         return;
@@ -3762,6 +4027,8 @@ static void navigation_update(struct navigation *this_, struct route *route, str
     dbg(lvl_debug,"enter");
 
     this_->status_int = status_busy;
+    if (attr->u.num == route_status_path_done_new)
+        this_->status_int |= status_compare;
     if (route_get_flags(this_->route) & route_path_flag_async) {
         this_->idle_cb = callback_new_1(callback_cast(navigation_update_idle), this_);
         this_->idle_ev = event_add_idle(50, this_->idle_cb);
@@ -3775,12 +4042,16 @@ static void navigation_update(struct navigation *this_, struct route *route, str
 
 static void navigation_flush(struct navigation *this_) {
     navigation_destroy_itms_cmds(this_, NULL);
+    this_->keep_itm=NULL;
+    this_->maneuvers_from=NULL;
+    navigation_way_cache_clear(this_);
 }
 
 
 void navigation_destroy(struct navigation *this_) {
     navigation_flush(this_);
     item_hash_destroy(this_->hash);
+    item_hash_destroy(this_->way_cache);
     callback_list_destroy(this_->callback);
     callback_list_destroy(this_->callback_speech);
     g_free(this_);
@@ -50,8 +50,10 @@
  * introduced, as it became necessary to do fast partial recalculations of the route when the traffic situation
  * changes. Navit’s LPA* implementation differs from the canonical implementation in two important ways:
  *
- * \li The heuristic is not used (or assumed to be zero), for the reasons discussed above. However, this is not set in
- * stone and can be revisited if we find using a heuristic provides a true benefit.
+ * \li By default, the heuristic is not used (or assumed to be zero), for the reasons discussed above, and the whole
+ * route graph is flooded. If the vehicle profile sets `route_heuristic`, the straight-line distance to the start,
+ * divided by the highest speed of the profile, is used instead; see `route_graph_set_focus()`. Calculation then stops
+ * once the cost of the start is final and is resumed when the start moves to a point whose cost is not yet known.
  * \li Since the destination point may be off-road, Navit may initialize the route graph with multiple candidates for
  * the destination point, each of which will get a nonzero cost (which may still decrease if routing later determines
  * that it is cheaper to route from that candidate point to a different candidate point).
@@ -79,6 +81,13 @@
  * waypoints are used. This is done by calling `route_graph_reset()`, which resets all nodes to their initial state.
  * Then `route_graph_init()` is called, followed by `route_graph_compute_shortest_path()` and eventually creation of
  * the route path.
+ *
+ * If the vehicle profile selects `route_engine_ch` and the map carries a contraction hierarchy (see `route_ch.h`), the
+ * route graph is not built for the whole area around the route points. Instead, the contraction hierarchy is queried
+ * for each leg of the route first, and the graph is built only from a narrow corridor along the paths found, plus the
+ * area around each route point. Everything else works on this graph as described above. Since the contraction
+ * hierarchy does not know about one-way streets or turn restrictions, the corridor may not contain a valid route; in
+ * that case the full route graph is built instead.
  */
 
 #include <stdio.h>
@@ -102,7 +111,11 @@
 #include "track.h"
 #include "transform.h"
 #include "plugin.h"
-#include "fib.h"
+#include "route_heap.h"
+#include "route_cache.h"
+#include "route_extract.h"
+#include "route_ch.h"
+#include "street_index.h"
 #include "event.h"
 #include "callback.h"
 #include "vehicle.h"
@@ -121,6 +134,14 @@ int debug_route=0;
 #define RSD_SIZE_WEIGHT(x) *((struct size_weight_limit *)route_segment_data_field_pos((x), attr_vehicle_width))
 #define RSD_DANGEROUS_GOODS(x) *((int *)route_segment_data_field_pos((x), attr_vehicle_dangerous_goods))
 
+/** Maximum width and height of one rectangle of a route corridor, in map units, see `route_corridor_add()` */
+#define ROUTE_CORRIDOR_SPAN 5000
+/** Padding added around each rectangle of a route corridor, in map units */
+#define ROUTE_CORRIDOR_MARGIN 1000
+/** Share of the straight-line travel time used as the heuristic, in percent. This leaves room for the rounding of
+ *  segment lengths and costs, which would otherwise let the heuristic exceed the true cost over many short segments. */
+#define ROUTE_HEURISTIC_PERCENT 95
+
 
 /**
  * @brief A traffic distortion
@@ -218,6 +239,15 @@ struct route {
     struct vehicleprofile *vehicleprofile; /**< Routing preferences */
     int route_status;		/**< Route Status */
     int link_path;			/**< Link paths over multiple waypoints together */
+    int build_threads;		/**< Number of threads to read maps with, 0 for one per CPU, 1 (the default) to read
+				     them serially */
+    long cache_size;		/**< Size of the route cache of the mapset in bytes, 0 to not use it */
+    char *cache_file;		/**< File to keep the route cache in between sessions, NULL if none */
+    int cache_loaded;		/**< Whether `cache_file` has been loaded */
+    int corridor_fallback;	/**< Set when no route was found within the corridor while building synchronously */
+    struct callback *corridor_fallback_cb; /**< Callback building the full route graph after no route was found
+					    *   within the corridor */
+    struct event_idle *corridor_fallback_ev; /**< Idle event calling `corridor_fallback_cb`, NULL if not pending */
     struct pcoord pc;
     struct vehicle *v;
 };
@@ -225,43 +255,38 @@ struct route {
 #define HASHCOORD(c) ((((c)->x +(c)->y) * 2654435761UL) & (HASH_SIZE-1))
 
 /**
- * @brief Iterator to iterate through all route graph segments in a route graph point
- *
- * This structure can be used to iterate through all route graph segments connected to a
- * route graph point. Use this with the rp_iterator_* functions.
+ * @brief An individually allocated route graph point, along with its links
  */
-struct route_graph_point_iterator {
-    struct route_graph_point *p;		/**< The route graph point whose segments should be iterated */
-    int end;							/**< Indicates if we have finished iterating through the "start" segments */
-    struct route_graph_segment *next;	/**< The next segment to be returned */
+struct route_graph_point_node {
+    struct route_graph_point p;
+    struct route_graph_point_links links;
 };
 
+/** Rounds the size of a segment up to the alignment of the segments in the segment pool */
+#define ROUTE_GRAPH_ALIGN(size) (((size) + 7) & ~7)
+
 struct attr_iter {
     union {
         GList *list;
     } u;
 };
 
-static struct route_info * route_find_nearest_street(struct vehicleprofile *vehicleprofile, struct mapset *ms,
-        struct pcoord *c);
-static void route_graph_update(struct route *this, struct callback *cb, int async);
+static void route_graph_update(struct route *this, struct callback *cb, int async, enum route_engine engine);
+static void route_corridor_fallback_cancel(struct route *this);
+static void route_corridor_fallback(struct route *this);
 static struct route_path *route_path_new(struct route_graph *this, struct route_path *oldpath, struct route_info *pos,
         struct route_info *dst, struct vehicleprofile *profile);
 static void route_graph_add_street(struct route_graph *this, struct item *item, struct vehicleprofile *profile);
-static void route_graph_destroy(struct route_graph *this);
 static void route_path_update(struct route *this, int cancel, int async);
 static int route_time_seg(struct vehicleprofile *profile, struct route_segment_data *over,
                           struct route_traffic_distortion *dist);
-static void route_graph_compute_shortest_path(struct route_graph * graph, struct vehicleprofile * profile,
-        struct callback *cb);
 static int route_graph_is_path_computed(struct route_graph *this_);
 static struct route_graph_segment *route_graph_get_segment(struct route_graph *graph, struct street_data *sd,
         struct route_graph_segment *last);
-static int route_value_seg(struct vehicleprofile *profile, struct route_graph_point *from,
-                           struct route_graph_segment *over,
-                           int dir);
-static void route_graph_init(struct route_graph *this, struct route_info *dst, struct vehicleprofile *profile);
+static int route_value_seg(struct route_graph *graph, struct vehicleprofile *profile,
+                           struct route_graph_point *from, struct route_graph_segment *over, int dir);
 static void route_graph_reset(struct route_graph *this);
+static int route_graph_point_key(struct route_graph *graph, struct route_graph_point *p);
 
 
 /**
@@ -282,70 +307,10 @@ static enum projection route_projection(struct route *route) {
 }
 
 /**
- * @brief Creates a new graph point iterator
- *
- * This function creates a new route graph point iterator, that can be used to
- * iterate through all segments connected to the point.
- *
- * @param p The route graph point to create the iterator from
- * @return A new iterator.
- */
-static struct route_graph_point_iterator rp_iterator_new(struct route_graph_point *p) {
-    struct route_graph_point_iterator it;
-
-    it.p = p;
-    if (p->start) {
-        it.next = p->start;
-        it.end = 0;
-    } else {
-        it.next = p->end;
-        it.end = 1;
-    }
-
-    return it;
-}
-
-/**
- * @brief Gets the next segment connected to a route graph point from an iterator
- *
- * @param it The route graph point iterator to get the segment from
- * @return The next segment or NULL if there are no more segments
- */
-static struct route_graph_segment
-*rp_iterator_next(struct route_graph_point_iterator *it) {
-    struct route_graph_segment *ret;
-
-    ret = it->next;
-    if (!ret) {
-        return NULL;
-    }
-
-    if (!it->end) {
-        if (ret->start_next) {
-            it->next = ret->start_next;
-        } else {
-            it->next = it->p->end;
-            it->end = 1;
-        }
-    } else {
-        it->next = ret->end_next;
-    }
-
-    return ret;
-}
-
-/**
- * @brief Checks if the last segment returned from a route_graph_point_iterator comes from the end
- *
- * @param it The route graph point iterator to be checked
- * @return 1 if the last segment returned comes from the end of the route graph point, 0 otherwise
+ * @brief Whether a segment is stored in the segment pool of the compacted graph
  */
-static int rp_iterator_end(struct route_graph_point_iterator *it) {
-    if (it->end && (it->next != it->p->end)) {
-        return 1;
-    } else {
-        return 0;
-    }
+static inline int route_graph_segment_in_pool(struct route_graph *graph, struct route_graph_segment *s) {
+    return (char *)s >= graph->segment_pool && (char *)s < graph->segment_pool + graph->segment_pool_size;
 }
 
 static void route_path_get_distances(struct route_path *path, struct coord *c, int count, int *distances) {
@@ -422,6 +387,16 @@ route_new(struct attr *parent, struct attr **attrs) {
     } else {
         this->destination_distance = 50; // Default value
     }
+    if (attr_generic_get_attr(attrs, NULL, attr_build_threads, &dest_attr, NULL))
+        this->build_threads = dest_attr.u.num;
+    else
+        this->build_threads = 1; // Default value, as for graphics
+    if (attr_generic_get_attr(attrs, NULL, attr_cache_size, &dest_attr, NULL))
+        this->cache_size = dest_attr.u.num;
+    else
+        this->cache_size = 16*1024*1024; // Default value
+    if (attr_generic_get_attr(attrs, NULL, attr_cache_file, &dest_attr, NULL))
+        this->cache_file = g_strdup(dest_attr.u.str);
     this->cbl2=callback_list_new();
 
     return this;
@@ -440,6 +415,9 @@ route_dup(struct route *orig) {
     navit_object_ref((struct navit_object *)this);
     this->cbl2=callback_list_new();
     this->destination_distance=orig->destination_distance;
+    this->build_threads=orig->build_threads;
+    this->cache_size=orig->cache_size;
+    this->cache_file=g_strdup(orig->cache_file);
     this->ms=orig->ms;
     this->flags=orig->flags;
     this->vehicleprofile=orig->vehicleprofile;
@@ -452,14 +430,15 @@ route_dup(struct route *orig) {
  *
  * This function checks if a segment is part of a roundabout.
  *
+ * @param graph The route graph containing `seg`
  * @param seg The segment to be checked
  * @param level How deep to scan the route graph
  * @param direction Set this to 1 if we're entering the segment through its end, to 0 otherwise
  * @param origin Used internally, set to NULL
  * @return 1 If a roundabout was detected, 0 otherwise
  */
-static int route_check_roundabout(struct route_graph_segment *seg, int level, int direction,
-                                  struct route_graph_segment *origin) {
+static int route_check_roundabout(struct route_graph *graph, struct route_graph_segment *seg, int level,
+                                  int direction, struct route_graph_segment *origin) {
     struct route_graph_point_iterator it,it2;
     struct route_graph_segment *cur;
     int count=0;
@@ -481,9 +460,9 @@ static int route_check_roundabout(struct route_graph_segment *seg, int level, in
     }
 
     if (!direction) {
-        it = rp_iterator_new(seg->end);
+        it = rp_iterator_new(graph, seg->end);
     } else {
-        it = rp_iterator_new(seg->start);
+        it = rp_iterator_new(graph, seg->start);
     }
     it2=it;
 
@@ -510,7 +489,7 @@ static int route_check_roundabout(struct route_graph_segment *seg, int level, in
             return 1;
         }
 
-        if (route_check_roundabout(cur, (level-1), rp_iterator_end(&it), origin)) {
+        if (route_check_roundabout(graph, cur, (level-1), rp_iterator_end(&it), origin)) {
             seg->data.flags |= AF_ROUNDABOUT;
             return 1;
         }
@@ -747,6 +726,7 @@ static void route_path_update_done(struct route *this, int new_graph) {
             this->link_path=1;
             this->current_dst=prev_dst;
             route_graph_reset(this->graph);
+            route_graph_set_focus(this->graph, this->vehicleprofile, route_previous_destination(this));
             route_graph_init(this->graph, this->current_dst, this->vehicleprofile);
             route_graph_compute_shortest_path(this->graph, this->vehicleprofile, this->route_graph_flood_done_cb);
             return;
@@ -755,6 +735,20 @@ static void route_path_update_done(struct route *this, int new_graph) {
             route_status.u.num=route_status_path_done_incremental;
         else
             route_status.u.num=route_status_path_done_new;
+    } else if (this->graph->corridor) {
+        dbg(lvl_debug,"no route within the corridor, building the full route graph");
+        this->link_path=0;
+        this->current_dst=route_get_dst(this);
+        /* This may be called from the flood of the graph, which must not be replaced before the flood has returned.
+         * route_graph_update() and route_recalculate_partial() build the full graph once they are done. */
+        if (this->flags & route_path_flag_async) {
+            if (!this->corridor_fallback_cb)
+                this->corridor_fallback_cb=callback_new_1(callback_cast(route_corridor_fallback), this);
+            if (!this->corridor_fallback_ev)
+                this->corridor_fallback_ev=event_add_idle(50, this->corridor_fallback_cb);
+        } else
+            this->corridor_fallback=1;
+        return;
     } else
         route_status.u.num=route_status_not_found;
     this->link_path=0;
@@ -813,7 +807,8 @@ static void route_path_update_flags(struct route *this, enum route_path_flags fl
         if (! this->route_graph_flood_done_cb)
             this->route_graph_flood_done_cb=callback_new_2(callback_cast(route_path_update_done), this, (long)1);
         dbg(lvl_debug,"route_graph_update");
-        route_graph_update(this, this->route_graph_flood_done_cb, !!(flags & route_path_flag_async));
+        route_graph_update(this, this->route_graph_flood_done_cb, !!(flags & route_path_flag_async),
+                           this->vehicleprofile->route_engine);
     }
 }
 
@@ -937,6 +932,67 @@ void route_set_position_from_tracking(struct route *this, struct tracking *track
 /* Used for debuging of route_rect, what routing sees */
 struct map_selection *route_selection;
 
+/** Class of the most important roads, see `route_item_class()` */
+#define ROUTE_CLASS_MAX 5
+
+/**
+ * @brief A rectangle of a route selection
+ *
+ * `route_rect()` allocates all rectangles of route selections as this structure, so that the route graph can tell
+ * the minimum road class used within each of them without adding a routing-only field to `struct map_selection`.
+ * Map drivers and copies made with `map_selection_dup()` only see the map selection, which must remain the first
+ * member.
+ */
+struct route_selection {
+    struct map_selection sel;   /**< The rectangle */
+    int min_class;              /**< Minimum class of the roads used within the rectangle, see `route_item_class()` */
+};
+
+/**
+ * @brief Returns the minimum class of the roads used within a rectangle of a route selection
+ *
+ * @param sel The rectangle, which must have been created by `route_rect()`
+ * @return The minimum class, see `route_item_class()`
+ */
+static inline int route_selection_min_class(struct map_selection *sel) {
+    return ((struct route_selection *)sel)->min_class;
+}
+
+/**
+ * @brief Returns the class of a road, i.e. its importance for long-distance routes
+ *
+ * Roads linking roads of the highest class (ramps, roundabouts) and ferries are put into the highest class, so that
+ * the network of the most important roads remains connected.
+ *
+ * @param type The item type of the road
+ * @return The class, from 0 for minor roads to `ROUTE_CLASS_MAX` for motorways and trunk roads
+ */
+static int route_item_class(enum item_type type) {
+    switch (type) {
+    case type_highway_land:
+    case type_highway_city:
+    case type_street_n_lanes:
+    case type_ramp:
+    case type_roundabout:
+    case type_ferry:
+        return ROUTE_CLASS_MAX;
+    case type_street_4_land:
+    case type_street_4_city:
+        return 4;
+    case type_street_3_land:
+    case type_street_3_city:
+        return 3;
+    case type_street_2_land:
+    case type_street_2_city:
+        return 2;
+    case type_street_1_land:
+    case type_street_1_city:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
 /**
  * @brief Returns a single map selection
  *
@@ -954,11 +1010,9 @@ struct map_selection *route_selection;
 struct map_selection *
 route_rect(int order, struct coord *c1, struct coord *c2, int rel, int abs) {
     int dx,dy,sx=1,sy=1,d,m;
-    struct map_selection *sel=g_new(struct map_selection, 1);
-    if (!sel) {
-        printf("%s:Out of memory\n", __FUNCTION__);
-        return sel;
-    }
+    struct route_selection *rs=g_new(struct route_selection, 1);
+    struct map_selection *sel=&rs->sel;
+    rs->min_class=0;
     sel->order=order;
     sel->range.min=route_item_first;
     sel->range.max=route_item_last;
@@ -996,11 +1050,15 @@ route_rect(int order, struct coord *c1, struct coord *c2, int rel, int abs) {
 
 /**
  * @brief Appends a map selection to the selection list. Selection list may be NULL.
+ *
+ * Only roads of class `min_class` or higher (see `route_item_class()`) are used within the new rectangle, unless
+ * another rectangle of the list allows them.
  */
 static struct map_selection *route_rect_add(struct map_selection *sel, int order, struct coord *c1, struct coord *c2,
-        int rel, int abs) {
+        int rel, int abs, int min_class) {
     struct map_selection *ret;
     ret=route_rect(order, c1, c2, rel, abs);
+    ((struct route_selection *)ret)->min_class=min_class;
     ret->next=sel;
     return ret;
 }
@@ -1011,11 +1069,22 @@ static struct map_selection *route_rect_add(struct map_selection *sel, int order
  * Returns a list of  map selections useable to get a map rect from which items can be
  * retrieved to build a route graph.
  *
+ * The rectangles are given by the route depth of the vehicle profile, a comma-separated list of entries of the form
+ * `order:distance[:class]`. If `distance` ends with a percent sign, the entry is a rectangle around all route points,
+ * padded by that percentage of its size, otherwise it is a rectangle of that distance around each route point. If
+ * `class` is given, only roads of that class or higher (see `route_item_class()`) are used within the rectangle, so
+ * that e.g. only major roads are used in the middle of long routes, while all roads are used near the route points.
+ * Profiles without a route depth use "4:25%,8:40000,18:10000", which limits no road class. Of the shipped profiles,
+ * only "car" limits road classes; all others use every road throughout the selection.
+ *
  * @param c Array containing route points, including start, intermediate and destination ones.
  * @param count number of route points
  * @param proifle vehicleprofile
+ * @param local If true, only the parts of the route depth which are given as absolute distances around each route
+ * point are used, the ones relative to the area spanned by all route points are skipped
  */
-static struct map_selection *route_calc_selection(struct coord *c, int count, struct vehicleprofile *profile) {
+struct map_selection *route_calc_selection(struct coord *c, int count, struct vehicleprofile *profile,
+        int local) {
     struct map_selection *ret=NULL;
     int i;
     struct coord_rect r;
@@ -1034,13 +1103,17 @@ static struct map_selection *route_calc_selection(struct coord *c, int count, st
     depth=str=g_strdup(depth);
 
     while((tok=strtok(str,","))!=NULL) {
-        int order=0, dist=0;
+        int order=0, dist=0, min_class=0;
+        char *class_str=strchr(tok,':');
         sscanf(tok,"%d:%d",&order,&dist);
-        if(strchr(tok,'%'))
-            ret=route_rect_add(ret, order, &r.lu, &r.rl, dist, 0);
-        else
+        if (class_str && (class_str=strchr(class_str+1,':')))
+            min_class=atoi(class_str+1);
+        if(strchr(tok,'%')) {
+            if (!local)
+                ret=route_rect_add(ret, order, &r.lu, &r.rl, dist, 0, min_class);
+        } else
             for (i = 0 ; i < count ; i++) {
-                ret=route_rect_add(ret, order, &c[i], &c[i], 0, dist);
+                ret=route_rect_add(ret, order, &c[i], &c[i], 0, dist, min_class);
             }
         str=NULL;
     }
@@ -1050,6 +1123,83 @@ static struct map_selection *route_calc_selection(struct coord *c, int count, st
     return ret;
 }
 
+/**
+ * @brief Appends map selections covering a corridor along a path to the selection list
+ *
+ * The path is split into pieces of no more than `ROUTE_CORRIDOR_SPAN` in either direction. Each piece becomes a
+ * rectangle at the deepest tile level, padded by `ROUTE_CORRIDOR_MARGIN` on each side. Consecutive rectangles share
+ * the junction at which one piece ends and the next one starts.
+ *
+ * @param sel The selection list, may be NULL
+ * @param c The junctions along the path, in order
+ * @param count Number of coordinates in `c`
+ */
+static struct map_selection *route_corridor_add(struct map_selection *sel, struct coord *c, int count) {
+    struct coord_rect r;
+    int i;
+
+    if (!count)
+        return sel;
+    r.lu=c[0];
+    r.rl=c[0];
+    for (i = 1 ; i < count ; i++) {
+        if (MAX(r.rl.x, c[i].x)-MIN(r.lu.x, c[i].x) > ROUTE_CORRIDOR_SPAN
+                || MAX(r.lu.y, c[i].y)-MIN(r.rl.y, c[i].y) > ROUTE_CORRIDOR_SPAN) {
+            sel=route_rect_add(sel, 18, &r.lu, &r.rl, 0, ROUTE_CORRIDOR_MARGIN, 0);
+            r.lu=c[i-1];
+            r.rl=c[i-1];
+        }
+        coord_rect_extend(&r, &c[i]);
+    }
+    return route_rect_add(sel, 18, &r.lu, &r.rl, 0, ROUTE_CORRIDOR_MARGIN, 0);
+}
+
+/**
+ * @brief Returns a list of map selections covering the corridor along the route found in the contraction hierarchy
+ *
+ * Each leg of the route, from the current position through all waypoints to the destination, is looked up in the
+ * contraction hierarchy of the map containing the street at the current position. The resulting selection consists
+ * of the corridor along all legs (see `route_corridor_add()`) and the local parts of the route depth around each
+ * route point (see `route_calc_selection()`).
+ *
+ * @param this The route
+ * @param c Array containing the route points, as for `route_calc_selection()`
+ * @param count Number of route points
+ *
+ * @return The selection, or NULL if the map has no contraction hierarchy or a leg could not be found in it
+ */
+static struct map_selection *route_calc_corridor_selection(struct route *this, struct coord *c, int count) {
+    struct map_selection *ret;
+    struct route_info *from=this->pos,*to;
+    struct route_ch *ch;
+    struct coord *path;
+    int path_count;
+    GList *l;
+
+    if (!from || !from->street)
+        return NULL;
+    ch=route_ch_new(from->street->item.map);
+    ret=route_calc_selection(c, count, this->vehicleprofile, 1);
+    for (l = this->destinations ; l ; l = g_list_next(l)) {
+        to=l->data;
+        path_count=0;
+        if (to->street)
+            path_count=route_ch_path(ch, this->vehicleprofile, from->street, from->lenneg, from->lenpos, to->street,
+                                     to->lenneg, to->lenpos, &path);
+        if (!path_count) {
+            dbg(lvl_debug,"no path in contraction hierarchy");
+            route_free_selection(ret);
+            ret=NULL;
+            break;
+        }
+        ret=route_corridor_add(ret, path, path_count);
+        g_free(path);
+        from=to;
+    }
+    route_ch_destroy(ch);
+    return ret;
+}
+
 /**
  * @brief Retrieves the map selection for the route.
  */
@@ -1066,7 +1216,7 @@ struct map_selection * route_get_selection(struct route * this_) {
         c[i++] = dst->c;
         tmp = g_list_next(tmp);
     }
-    return route_calc_selection(c, i, this_->vehicleprofile);
+    return route_calc_selection(c, i, this_->vehicleprofile, 0);
 }
 
 /**
@@ -1310,14 +1460,62 @@ void route_remove_waypoint(struct route *this) {
         this->reached_destinations_count++;
         route_graph_reset(this->graph);
         this->current_dst = this->destinations->data;
+        route_graph_set_focus(this->graph, this->vehicleprofile, route_previous_destination(this));
         route_graph_init(this->graph, this->current_dst, this->vehicleprofile);
         route_graph_compute_shortest_path(this->graph, this->vehicleprofile, this->route_graph_flood_done_cb);
     }
 }
 
+/**
+ * @brief Interleaves the bits of a 32-bit value with zero bits
+ */
+static guint64 route_graph_spread_bits(guint64 v) {
+    v &= 0xffffffffULL;
+    v = (v | (v << 16)) & 0x0000ffff0000ffffULL;
+    v = (v | (v << 8)) & 0x00ff00ff00ff00ffULL;
+    v = (v | (v << 4)) & 0x0f0f0f0f0f0f0f0fULL;
+    v = (v | (v << 2)) & 0x3333333333333333ULL;
+    v = (v | (v << 1)) & 0x5555555555555555ULL;
+    return v;
+}
+
+/**
+ * @brief Returns the Z-order (Morton) code of a coordinate, by which the compacted points of a graph are sorted
+ */
+static guint64 route_graph_point_order_key(struct coord *c) {
+    return route_graph_spread_bits((guint32)c->x ^ 0x80000000)
+           | (route_graph_spread_bits((guint32)c->y ^ 0x80000000) << 1);
+}
+
+/**
+ * @brief Finds the first point with the specified coordinates in the compacted point array of a graph
+ *
+ * @param this The route graph
+ * @param c Coordinates to search for
+ * @return The point, or NULL if there is none
+ */
+static struct route_graph_point *route_graph_find_compacted_point(struct route_graph *this, struct coord *c) {
+    guint64 key=route_graph_point_order_key(c);
+    int lo=0,hi=this->num_points,mid;
+
+    while (lo < hi) {
+        mid=lo+(hi-lo)/2;
+        if (route_graph_point_order_key(&this->points[mid].c) < key)
+            lo=mid+1;
+        else
+            hi=mid;
+    }
+    if (lo < this->num_points && this->points[lo].c.x == c->x && this->points[lo].c.y == c->y)
+        return &this->points[lo];
+    return NULL;
+}
+
 /**
  * @brief Gets the next route_graph_point with the specified coordinates
  *
+ * Individually allocated points are returned first, newest first, followed by the points in the compacted point
+ * array, which keep the order they had before the graph was compacted.
+ *
  * @param this The route in which to search
  * @param c Coordinates to search for
  * @param last The last route graph point returned to iterate over multiple points with the same coordinates,
@@ -1327,8 +1525,15 @@ void route_remove_waypoint(struct route *this) {
 struct route_graph_point *route_graph_get_point_next(struct route_graph *this, struct coord *c,
         struct route_graph_point *last) {
     struct route_graph_point *p;
-    int seen=0,hashval=HASHCOORD(c);
-    p=this->hash[hashval];
+    int seen=0;
+
+    if (last && route_graph_point_index(this, last) >= 0) {
+        p=last+1;
+        if (p < this->points + this->num_points && p->c.x == c->x && p->c.y == c->y)
+            return p;
+        return NULL;
+    }
+    p=this->hash ? this->hash[HASHCOORD(c)] : NULL;
     while (p) {
         if (p->c.x == c->x && p->c.y == c->y) {
             if (!last || seen)
@@ -1336,9 +1541,11 @@ struct route_graph_point *route_graph_get_point_next(struct route_graph *this, s
             if (p == last)
                 seen=1;
         }
-        p=p->hash_next;
+        p=p->links->hash_next;
     }
-    return NULL;
+    if (last && !seen)
+        return NULL;
+    return route_graph_find_compacted_point(this, c);
 }
 
 /**
@@ -1361,13 +1568,9 @@ struct route_graph_point * route_graph_get_point(struct route_graph *this, struc
  */
 static struct route_graph_point *route_graph_get_point_last(struct route_graph *this, struct coord *c) {
     struct route_graph_point *p,*ret=NULL;
-    int hashval=HASHCOORD(c);
-    p=this->hash[hashval];
-    while (p) {
-        if (p->c.x == c->x && p->c.y == c->y)
-            ret=p;
-        p=p->hash_next;
-    }
+
+    for (p = route_graph_get_point(this, c) ; p ; p = route_graph_get_point_next(this, c, p))
+        ret=p;
     return ret;
 }
 
@@ -1383,13 +1586,18 @@ static struct route_graph_point *route_graph_get_point_last(struct route_graph *
 
 static struct route_graph_point *route_graph_point_new(struct route_graph *this, struct coord *f) {
     int hashval;
+    struct route_graph_point_node *node;
     struct route_graph_point *p;
 
     hashval=HASHCOORD(f);
     if (debug_route)
         printf("p (0x%x,0x%x)\n", f->x, f->y);
-    p=g_slice_new0(struct route_graph_point);
-    p->hash_next=this->hash[hashval];
+    if (!this->hash)
+        this->hash=g_new0(struct route_graph_point *, HASH_SIZE);
+    node=g_slice_new0(struct route_graph_point_node);
+    p=&node->p;
+    p->links=&node->links;
+    p->links->hash_next=this->hash[hashval];
     this->hash[hashval]=p;
     p->value=INT_MAX;
     p->dst_val = INT_MAX;
@@ -1427,15 +1635,52 @@ struct route_graph_point * route_graph_add_point(struct route_graph *this, struc
 void route_graph_free_points(struct route_graph *this) {
     struct route_graph_point *curr,*next;
     int i;
-    for (i = 0 ; i < HASH_SIZE ; i++) {
-        curr=this->hash[i];
-        while (curr) {
-            next=curr->hash_next;
-            g_slice_free(struct route_graph_point, curr);
-            curr=next;
+    if (this->hash) {
+        for (i = 0 ; i < HASH_SIZE ; i++) {
+            curr=this->hash[i];
+            while (curr) {
+                next=curr->links->hash_next;
+                g_slice_free(struct route_graph_point_node, (struct route_graph_point_node *)curr);
+                curr=next;
+            }
         }
-        this->hash[i]=NULL;
+        g_free(this->hash);
+        this->hash=NULL;
     }
+    for (i = 0 ; i < this->num_points ; i++)
+        g_free(this->points[i].links);
+    g_free(this->points);
+    this->points=NULL;
+    this->num_points=0;
+}
+
+/**
+ * @brief Returns the next point of a route graph
+ *
+ * Points in the compacted point array are returned first, followed by the individually allocated points.
+ *
+ * @param this The route graph
+ * @param last The point returned last, NULL to return the first point
+ * @return The next point, NULL if there are no more points
+ */
+struct route_graph_point *route_graph_next_point(struct route_graph *this, struct route_graph_point *last) {
+    int i=last ? route_graph_point_index(this, last) : -1,bucket=0;
+
+    if (!last && this->num_points)
+        return this->points;
+    if (i >= 0 && i+1 < this->num_points)
+        return last+1;
+    if (!this->hash)
+        return NULL;
+    if (last && i < 0) {
+        if (last->links->hash_next)
+            return last->links->hash_next;
+        bucket=HASHCOORD(&last->c)+1;
+    }
+    for ( ; bucket < HASH_SIZE ; bucket++)
+        if (this->hash[bucket])
+            return this->hash[bucket];
+    return NULL;
 }
 
 /**
@@ -1450,28 +1695,28 @@ void route_graph_free_points(struct route_graph *this) {
  * @param profile The vehicle profile to use for routing. This determines which ways are passable
  * and how their costs are calculated.
  */
-static void route_graph_init(struct route_graph *this, struct route_info *dst, struct vehicleprofile *profile) {
+void route_graph_init(struct route_graph *this, struct route_info *dst, struct vehicleprofile *profile) {
     struct route_graph_segment *s = NULL;
     int val;
 
     while ((s = route_graph_get_segment(this, dst->street, s))) {
-        val = route_value_seg(profile, NULL, s, -1);
+        val = route_value_seg(this, profile, NULL, s, -1);
         if (val != INT_MAX) {
             val = val*(100-dst->percent)/100;
             s->end->seg = s;
             s->end->dst_seg = s;
             s->end->rhs = val;
             s->end->dst_val = val;
-            s->end->el = fh_insertkey(this->heap, MIN(s->end->rhs, s->end->value), s->end);
+            route_heap_update(this->heap, s->end, route_graph_point_key(this, s->end));
         }
-        val = route_value_seg(profile, NULL, s, 1);
+        val = route_value_seg(this, profile, NULL, s, 1);
         if (val != INT_MAX) {
             val = val*dst->percent/100;
             s->start->seg = s;
             s->start->dst_seg = s;
             s->start->rhs = val;
             s->start->dst_val = val;
-            s->start->el = fh_insertkey(this->heap, MIN(s->start->rhs, s->start->value), s->start);
+            route_heap_update(this->heap, s->start, route_graph_point_key(this, s->start));
         }
     }
 }
@@ -1482,11 +1727,11 @@ static void route_graph_init(struct route_graph *this, struct route_info *dst, s
  * This iterates through all the points in the route graph, resetting them to their initial state.
  * The `value` (cost to reach the destination via `seg`) and `dst_val` (cost to destination if this point is the last
  * in the route) members of each point are reset to`INT_MAX`, the `seg` member (cheapest way to destination) is reset
- * to `NULL` and the `el` member (pointer to element in Fibonacci heap) is also reset to `NULL`.
+ * to `NULL` and the `heap` member (position on the route heap) is also reset.
  *
- * The Fibonacci heap is also cleared. Inconsistencies between `el` and Fibonacci heap membership are handled
- * gracefully, i.e. `el` is reset even if it is invalid, and points are removed from the heap regardless of their `el`
- * value.
+ * The route heap is also cleared. Inconsistencies between `heap` and route heap membership are handled
+ * gracefully, i.e. `heap` is reset even if it is invalid, and points are removed from the heap regardless of their
+ * `heap` value.
  *
  * After this method returns, the caller should call
  * {@link route_graph_init(struct route_graph *, struct route_info *, struct vehicleprofile *)} to initialize potential
@@ -1498,25 +1743,18 @@ static void route_graph_init(struct route_graph *this, struct route_info *dst, s
  * @param this The route graph to reset
  */
 static void route_graph_reset(struct route_graph *this) {
-    struct route_graph_point *curr;
-    int i;
-
-    for (i = 0 ; i < HASH_SIZE ; i++) {
-        curr=this->hash[i];
-        while (curr) {
-            curr->value=INT_MAX;
-            curr->dst_val = INT_MAX;
-            curr->rhs = INT_MAX;
-            curr->seg=NULL;
-            curr->dst_seg = NULL;
-            curr->el=NULL;
-            curr=curr->hash_next;
-        }
+    struct route_graph_point *curr=NULL;
+
+    while ((curr=route_graph_next_point(this, curr))) {
+        curr->value=INT_MAX;
+        curr->dst_val = INT_MAX;
+        curr->rhs = INT_MAX;
+        curr->seg=NULL;
+        curr->dst_seg = NULL;
+        curr->heap.el=NULL;
     }
 
-    while (fh_extractmin(this->heap)) {
-        // no operation, just remove all items (`el` has already been reset)
-    }
+    route_heap_clear(this->heap);
 }
 
 /**
@@ -1576,6 +1814,15 @@ static int route_segment_data_size(int flags) {
     return ret;
 }
 
+/**
+ * @brief Returns the size of a route graph segment, including the fields appended to its data
+ *
+ * @param flags The flags of the route_segment_data
+ */
+static int route_graph_segment_size(int flags) {
+    return sizeof(struct route_graph_segment)-sizeof(struct route_segment_data)+route_segment_data_size(flags);
+}
+
 
 /**
  * @brief Checks if the route graph already contains a particular segment.
@@ -1583,13 +1830,15 @@ static int route_segment_data_size(int flags) {
  * This function compares the item IDs of both segments. If the item is segmented, the segment offset is
  * also compared.
  *
+ * @param this The route graph
  * @param start The starting point of the segment
  * @param data The data for the segment
  */
-int route_graph_segment_is_duplicate(struct route_graph_point *start, struct route_graph_segment_data *data) {
+int route_graph_segment_is_duplicate(struct route_graph *this, struct route_graph_point *start,
+                                     struct route_graph_segment_data *data) {
+    struct route_graph_point_iterator it=rp_iterator_new(this, start);
     struct route_graph_segment *s;
-    s=start->start;
-    while (s) {
+    while ((s=rp_iterator_next(&it)) && !rp_iterator_end(&it)) {
         if (item_is_equal(*data->item, s->data.item)) {
             if (data->flags & AF_SEGMENTED) {
                 if (RSD_OFFSET(&s->data) == data->offset) {
@@ -1598,11 +1847,19 @@ int route_graph_segment_is_duplicate(struct route_graph_point *start, struct rou
             } else
                 return 1;
         }
-        s=s->start_next;
     }
     return 0;
 }
 
+/**
+ * @brief Returns the links of a point, adding them if the point has none yet
+ */
+static struct route_graph_point_links *route_graph_point_get_links(struct route_graph_point *p) {
+    if (!p->links)
+        p->links=g_new0(struct route_graph_point_links, 1);
+    return p->links;
+}
+
 /**
  * @brief Inserts a new segment into the route graph
  *
@@ -1613,21 +1870,23 @@ int route_graph_segment_is_duplicate(struct route_graph_point *start, struct rou
  */
 void route_graph_add_segment(struct route_graph *this, struct route_graph_point *start,
                              struct route_graph_point *end, struct route_graph_segment_data *data) {
+    struct route_graph_segment_node *node;
     struct route_graph_segment *s;
     int size;
 
-    size = sizeof(struct route_graph_segment)-sizeof(struct route_segment_data)+route_segment_data_size(data->flags);
-    s = g_slice_alloc0(size);
-    if (!s) {
+    size = route_graph_segment_size(data->flags);
+    node = g_slice_alloc0(offsetof(struct route_graph_segment_node, s) + size);
+    if (!node) {
         printf("%s:Out of memory\n", __FUNCTION__);
         return;
     }
+    s=&node->s;
     s->start=start;
-    s->start_next=start->start;
-    start->start=s;
+    node->links.start_next=route_graph_point_get_links(start)->start;
+    start->links->start=s;
     s->end=end;
-    s->end_next=end->end;
-    end->end=s;
+    node->links.end_next=route_graph_point_get_links(end)->end;
+    end->links->end=s;
     dbg_assert(data->len >= 0);
     s->data.len=data->len;
     s->data.item=*data->item;
@@ -1643,7 +1902,7 @@ void route_graph_add_segment(struct route_graph *this, struct route_graph_point
     if (data->flags & AF_DANGEROUS_GOODS)
         RSD_DANGEROUS_GOODS(&s->data)=data->dangerous_goods;
 
-    s->next=this->route_segments;
+    node->links.next=this->route_segments;
     this->route_segments=s;
     if (debug_route)
         printf("l (0x%x,0x%x)-(0x%x,0x%x)\n", start->c.x, start->c.y, end->c.x, end->c.y);
@@ -1739,6 +1998,7 @@ static void route_path_add_line(struct route_path *this, struct coord *start, st
  * parameter has no effect.
  *
  * @param this The path to add the item to
+ * @param graph The route graph containing `rgs`
  * @param oldpath Old path containing the segment to be added. Speeds up the function, but can be NULL.
  * @param rgs Segment of the route graph that should be "copied" to the route path
  * @param dir Order in which to add the coordinates. See route_path_add_item()
@@ -1746,8 +2006,8 @@ static void route_path_add_line(struct route_path *this, struct coord *start, st
  * @param dst  Information about end point if this is the last segment
  */
 
-static int route_path_add_item_from_graph(struct route_path *this, struct route_path *oldpath,
-        struct route_graph_segment *rgs,
+static int route_path_add_item_from_graph(struct route_path *this, struct route_graph *graph,
+        struct route_path *oldpath, struct route_graph_segment *rgs,
         int dir, struct route_info *pos, struct route_info *dst) {
     struct route_path_segment *segment=NULL;
     int i, ccnt, extra=0, ret=0;
@@ -1845,7 +2105,7 @@ static int route_path_add_item_from_graph(struct route_path *this, struct route_
     /* We check if the route graph segment is part of a roundabout here, because this
      * only matters for route graph segments which form parts of the route path */
     if (!(rgs->data.flags & AF_ROUNDABOUT)) { // We identified this roundabout earlier
-        route_check_roundabout(rgs, 13, (dir < 1), NULL);
+        route_check_roundabout(graph, rgs, 13, (dir < 1), NULL);
     }
 
     memcpy(segment->data, &rgs->data, seg_dat_size);
@@ -1869,12 +2129,41 @@ void route_graph_free_segments(struct route_graph *this) {
     int size;
     curr=this->route_segments;
     while (curr) {
-        next=curr->next;
-        size = sizeof(struct route_graph_segment)-sizeof(struct route_segment_data)+route_segment_data_size(curr->data.flags);
-        g_slice_free1(size, curr);
+        next=route_graph_segment_links(curr)->next;
+        size = offsetof(struct route_graph_segment_node, s) + route_graph_segment_size(curr->data.flags);
+        g_slice_free1(size, route_graph_segment_links(curr));
         curr=next;
     }
     this->route_segments=NULL;
+    g_free(this->segment_pool);
+    this->segment_pool=NULL;
+    this->segment_pool_size=0;
+    g_free(this->adj_index);
+    this->adj_index=NULL;
+    g_free(this->adj);
+    this->adj=NULL;
+}
+
+/**
+ * @brief Returns the next segment of a route graph
+ *
+ * Segments in the segment pool are returned first, followed by the individually allocated segments.
+ *
+ * @param this The route graph
+ * @param last The segment returned last, NULL to return the first segment
+ * @return The next segment, NULL if there are no more segments
+ */
+struct route_graph_segment *route_graph_next_segment(struct route_graph *this, struct route_graph_segment *last) {
+    char *next;
+
+    if (!last)
+        return this->segment_pool_size ? (struct route_graph_segment *)this->segment_pool : this->route_segments;
+    if (!route_graph_segment_in_pool(this, last))
+        return route_graph_segment_links(last)->next;
+    next=(char *)last + ROUTE_GRAPH_ALIGN(route_graph_segment_size(last->data.flags));
+    if (next < this->segment_pool + this->segment_pool_size)
+        return (struct route_graph_segment *)next;
+    return this->route_segments;
 }
 
 /**
@@ -1882,12 +2171,12 @@ void route_graph_free_segments(struct route_graph *this) {
  *
  * @param this The route graph to be destroyed
  */
-static void route_graph_destroy(struct route_graph *this) {
+void route_graph_destroy(struct route_graph *this) {
     if (this) {
         route_graph_build_done(this, 1);
         route_graph_free_points(this);
         route_graph_free_segments(this);
-        fh_deleteheap(this->heap);
+        route_heap_destroy(this->heap);
         g_free(this);
     }
 }
@@ -1982,6 +2271,7 @@ static int route_time_seg(struct vehicleprofile *profile, struct route_segment_d
  * If multiple traffic distortions match a segment, the return value will report the lowest speed limit
  * and greatest delay of all matching segments.
  *
+ * @param graph The route graph containing `seg`
  * @param seg The segment for which the traffic distortion is to be returned
  * @param dir The direction of `seg` for which to return traffic distortions. Positive values indicate
  * travel in the direction of the segment, negative values indicate travel against it.
@@ -1991,12 +2281,14 @@ static int route_time_seg(struct vehicleprofile *profile, struct route_segment_d
  *
  * @return true if a traffic distortion was found, 0 if not
  */
-static int route_get_traffic_distortion(struct route_graph_segment *seg, int dir, struct vehicleprofile *profile,
-                                        struct route_traffic_distortion *ret) {
+static int route_get_traffic_distortion(struct route_graph *graph, struct route_graph_segment *seg, int dir,
+                                        struct vehicleprofile *profile, struct route_traffic_distortion *ret) {
     struct route_graph_point *start=seg->start;
     struct route_graph_point *end=seg->end;
+    struct route_graph_point_iterator it=rp_iterator_new(graph, start);
     struct route_graph_segment *tmp,*found=NULL;
     struct route_traffic_distortion result;
+    int forward;
 
     if (!dir) {
         dbg(lvl_warning, "dir is zero, assuming positive");
@@ -2006,27 +2298,19 @@ static int route_get_traffic_distortion(struct route_graph_segment *seg, int dir
     result.delay = 0;
     result.maxspeed = INT_MAX;
 
-    for (tmp = start->start; tmp; tmp = tmp->start_next) {
-        if (tmp->data.item.type == type_traffic_distortion && tmp->start == start && tmp->end == end) {
-            if ((tmp->data.flags & (dir > 0 ? profile->flags_forward_mask : profile->flags_reverse_mask)) != profile->flags)
-                continue;
-            if (tmp->data.len > result.delay)
-                result.delay = tmp->data.len;
-            if ((tmp->data.flags & AF_SPEED_LIMIT) && (RSD_MAXSPEED(&tmp->data) < result.maxspeed))
-                result.maxspeed = RSD_MAXSPEED(&tmp->data);
-            found=tmp;
-        }
-    }
-    for (tmp = start->end; tmp; tmp = tmp->end_next) {
-        if (tmp->data.item.type == type_traffic_distortion && tmp->end == start && tmp->start == end) {
-            if ((tmp->data.flags & (dir < 0 ? profile->flags_forward_mask : profile->flags_reverse_mask)) != profile->flags)
-                continue;
-            if (tmp->data.len > result.delay)
-                result.delay = tmp->data.len;
-            if ((tmp->data.flags & AF_SPEED_LIMIT) && (RSD_MAXSPEED(&tmp->data) < result.maxspeed))
-                result.maxspeed = RSD_MAXSPEED(&tmp->data);
-            found=tmp;
-        }
+    while ((tmp = rp_iterator_next(&it))) {
+        /* distortions in the opposite direction of `seg` apply when traveling against it */
+        forward = !rp_iterator_end(&it);
+        if (tmp->data.item.type != type_traffic_distortion || (forward ? tmp->end : tmp->start) != end)
+            continue;
+        if ((tmp->data.flags & ((forward ? dir : -dir) > 0 ? profile->flags_forward_mask :
+                                profile->flags_reverse_mask)) != profile->flags)
+            continue;
+        if (tmp->data.len > result.delay)
+            result.delay = tmp->data.len;
+        if ((tmp->data.flags & AF_SPEED_LIMIT) && (RSD_MAXSPEED(&tmp->data) < result.maxspeed))
+            result.maxspeed = RSD_MAXSPEED(&tmp->data);
+        found=tmp;
     }
     if (found) {
         ret->delay = result.delay;
@@ -2057,6 +2341,7 @@ static int route_through_traffic_allowed(struct vehicleprofile *profile, struct
  * \li Otherwise, if `over` does not allow through traffic but `from->seg` does, the through traffic penalty of the
  * vehicle profile (`profile`) is applied.
  *
+ * @param graph The route graph containing `over`
  * @param profile The routing preferences
  * @param from The point currently being visited (or NULL), see description
  * @param over The segment we are using
@@ -2067,9 +2352,8 @@ static int route_through_traffic_allowed(struct vehicleprofile *profile, struct
  * @return The "cost" needed to travel along the segment
  */
 /* FIXME `from` as a name is highly misleading, find a better one */
-static int route_value_seg(struct vehicleprofile *profile, struct route_graph_point *from,
-                           struct route_graph_segment *over,
-                           int dir) {
+static int route_value_seg(struct route_graph *graph, struct vehicleprofile *profile,
+                           struct route_graph_point *from, struct route_graph_segment *over, int dir) {
     int ret;
     struct route_traffic_distortion dist,*distp=NULL;
     if (!dir) {
@@ -2089,7 +2373,7 @@ static int route_value_seg(struct vehicleprofile *profile, struct route_graph_po
     if (over->data.item.type == type_traffic_distortion)
         return INT_MAX;
     if ((over->start->flags & RP_TRAFFIC_DISTORTION) && (over->end->flags & RP_TRAFFIC_DISTORTION) &&
-            route_get_traffic_distortion(over, dir, profile, &dist) && dir != 2 && dir != -2) {
+            route_get_traffic_distortion(graph, over, dir, profile, &dist) && dir != 2 && dir != -2) {
         /* we have a traffic distortion */
         distp=&dist;
     }
@@ -2138,56 +2422,187 @@ static int route_value_add(int val1, int val2) {
     return val1 + val2;
 }
 
+/**
+ * @brief Returns the heap key of a point
+ *
+ * The key is the lower of `value` and `rhs`. If the route graph has a focus (see `route_graph_set_focus()`), a lower
+ * bound for the cost of getting from the start to the point is added, based on the straight-line distance and the
+ * highest speed the vehicle profile allows.
+ *
+ * @param graph The route graph
+ * @param p The point
+ *
+ * @return The key
+ */
+static int route_graph_point_key(struct route_graph *graph, struct route_graph_point *p) {
+    int val = MIN(p->rhs, p->value);
+    double dx, dy;
+
+    if (!graph->focus.count || val == INT_MAX)
+        return val;
+    dx = p->c.x - graph->focus.c.x;
+    dy = p->c.y - graph->focus.c.y;
+    return route_value_add(val, (int)(sqrt(dx * dx + dy * dy) * graph->focus.factor) + graph->focus.km);
+}
+
+/**
+ * @brief Determines the largest projection scale and the highest `maxspeed` in a route graph
+ *
+ * Both are needed to turn map distances into a lower bound for travel time. The results are stored in the graph's
+ * focus and reused for all later calls.
+ *
+ * @param graph The route graph
+ */
+static void route_graph_focus_bounds(struct route_graph *graph) {
+    struct route_graph_point *p = NULL;
+    struct route_graph_segment *s = NULL;
+    int y = 0;
+
+    graph->focus.maxspeed = 0;
+    while ((p = route_graph_next_point(graph, p)))
+        if (abs(p->c.y) > y)
+            y = abs(p->c.y);
+    while ((s = route_graph_next_segment(graph, s)))
+        if ((s->data.flags & AF_SPEED_LIMIT) && RSD_MAXSPEED(&s->data) > graph->focus.maxspeed)
+            graph->focus.maxspeed = RSD_MAXSPEED(&s->data);
+    graph->focus.scale = transform_scale(y);
+}
+
+/**
+ * @brief Directs the search in the route graph towards the start of the route
+ *
+ * If `profile` enables `route_heuristic`, this records the points through which `pos` can be reached, along with
+ * their cost, and the conversion factor for the heuristic, so that expansion can continue towards the new position
+ * without losing any work done so far.
+ *
+ * When the focus moves, the keys on the heap are not recalculated, as this would touch every point of the graph on
+ * each position update. As in D* Lite, a lower bound for the cost between the old and the new focus is added to
+ * `km` instead, which is part of all keys calculated from now on. The keys already on the heap thus remain lower
+ * bounds for their current keys, and `route_graph_compute_shortest_path()` updates the key of a point when it comes
+ * to the top of the heap. All keys are only recalculated when the graph gains or loses its focus or the conversion
+ * factor changes.
+ *
+ * Without a heuristic, or if `pos` cannot be reached through the graph, the graph has no focus and will be flooded
+ * completely. The heuristic is only available for maps in `projection_mg`.
+ *
+ * @param graph The route graph
+ * @param profile The vehicle profile
+ * @param pos The start of the route (the current position or the previous waypoint), can be NULL
+ */
+void route_graph_set_focus(struct route_graph *graph, struct vehicleprofile *profile, struct route_info *pos) {
+    struct route_graph_focus *focus = &graph->focus;
+    struct route_graph_segment *s = NULL;
+    struct route_graph_point *p;
+    struct roadprofile *roadprofile;
+    GHashTableIter iter;
+    gpointer value;
+    struct coord old_c = focus->c;
+    double old_factor = focus->factor, dx, dy;
+    int old_count = focus->count, speed = 0, val;
+
+    focus->count = 0;
+    if (profile->route_heuristic && pos && pos->street
+            && map_projection(pos->street->item.map) == projection_mg) {
+        g_hash_table_iter_init(&iter, profile->roadprofile_hash);
+        while (g_hash_table_iter_next(&iter, NULL, &value)) {
+            roadprofile = value;
+            if (roadprofile->route_weight > speed)
+                speed = roadprofile->route_weight;
+        }
+        if (!focus->scale)
+            route_graph_focus_bounds(graph);
+        if (profile->maxspeed_handling == maxspeed_enforce && focus->maxspeed > speed)
+            speed = focus->maxspeed;
+        /* same candidates and cost as in route_path_new() */
+        while (speed && (s = route_graph_get_segment(graph, pos->street, s))) {
+            if (focus->count > ROUTE_GRAPH_FOCUS_MAX - 2) {
+                dbg(lvl_debug, "too many segments for street, flooding the entire graph");
+                focus->count = 0;
+                break;
+            }
+            val = route_value_seg(graph, profile, NULL, s, 2);
+            if (val != INT_MAX) {
+                val = val * (100 - pos->percent) / 100;
+                if (route_graph_segment_match(s, graph->avoid_seg) && pos->street_direction < 0)
+                    val += profile->turn_around_penalty;
+                focus->points[focus->count] = s->end;
+                focus->cost[focus->count++] = val;
+            }
+            val = route_value_seg(graph, profile, NULL, s, -2);
+            if (val != INT_MAX) {
+                val = val * pos->percent / 100;
+                if (route_graph_segment_match(s, graph->avoid_seg) && pos->street_direction > 0)
+                    val += profile->turn_around_penalty;
+                focus->points[focus->count] = s->start;
+                focus->cost[focus->count++] = val;
+            }
+        }
+        if (focus->count) {
+            focus->c = pos->lp;
+            focus->factor = 36.0 * ROUTE_HEURISTIC_PERCENT / 100 / (focus->scale * speed);
+        }
+    }
+
+    if (!old_count && !focus->count)
+        return;
+    if (old_count && focus->count && old_factor == focus->factor) {
+        dx = focus->c.x - old_c.x;
+        dy = focus->c.y - old_c.y;
+        /* one more than the distance in keys, as the heuristic of each key is rounded down */
+        if (dx || dy)
+            focus->km += (int)(sqrt(dx * dx + dy * dy) * focus->factor) + 1;
+        return;
+    }
+    focus->km = 0;
+    for (p = route_graph_next_point(graph, NULL) ; p ; p = route_graph_next_point(graph, p))
+        if (route_heap_contains(graph->heap, p))
+            route_heap_update(graph->heap, p, route_graph_point_key(graph, p));
+}
+
 /**
  * @brief Updates the lookahead value of a point in the route graph and updates its heap membership.
  *
  * This recalculates the lookahead value (the `rhs` member) of point `p`, based on the `value` of each neighbor and the
- * cost to reach that neighbor. If the resulting `p->rhs` differs from `p->value`, `p` is inserted into `heap` using
- * the lower of the two as its key (if `p` is already a member of `heap`, its key is changed accordingly). If the
- * resulting `p->rhs` is equal to `p->value` and `p` is a member of `heap`, it is removed.
+ * cost to reach that neighbor. If the resulting `p->rhs` differs from `p->value`, `p` is inserted into the graph’s heap
+ * using the lower of the two (plus the heuristic, see `route_graph_point_key()`) as its key (if `p` is already a
+ * member of the heap, its key is changed accordingly). If
+ * the resulting `p->rhs` is equal to `p->value` and `p` is a member of the heap, it is removed.
  *
  * This is part of a modified LPA* implementation.
  *
+ * @param graph The route graph, which holds the heap
  * @param profile The vehicle profile to use for routing. This determines which ways are passable and how their costs
  * are calculated.
  * @param p The point to evaluate
- * @param heap The heap
  */
-static void route_graph_point_update(struct vehicleprofile *profile, struct route_graph_point * p,
-                                     struct fibheap * heap) {
+static void route_graph_point_update(struct route_graph *graph, struct vehicleprofile *profile,
+                                     struct route_graph_point * p) {
+    struct route_graph_point_iterator it = rp_iterator_new(graph, p);
     struct route_graph_segment *s = NULL;
+    struct route_graph_point *other;
     int new, val;
 
     p->rhs = p->dst_val;
     p->seg = p->dst_seg;
 
-    for (s = p->start; s; s = s->start_next) { /* Iterate over all the segments leading away from our point */
-        val = route_value_seg(profile, s->end, s, 1);
-        if (val != INT_MAX && s->end->seg && item_is_equal(s->data.item, s->end->seg->data.item)) {
-            if (profile->turn_around_penalty2)
-                val += profile->turn_around_penalty2;
-            else
-                val = INT_MAX;
-        }
-        if (val != INT_MAX) {
-            new = route_value_add(val, s->end->value);
-            if (new < p->rhs) {
-                p->rhs = new;
-                p->seg = s;
-            }
+    while ((s = rp_iterator_next(&it))) {
+        if (!rp_iterator_end(&it)) {
+            /* segment leading away from our point */
+            other = s->end;
+            val = route_value_seg(graph, profile, other, s, 1);
+        } else {
+            /* segment leading towards our point */
+            other = s->start;
+            val = route_value_seg(graph, profile, other, s, -1);
         }
-    }
-
-    for (s = p->end; s; s = s->end_next) { /* Iterate over all the segments leading towards our point */
-        val = route_value_seg(profile, s->start, s, -1);
-        if (val != INT_MAX && s->start->seg && item_is_equal(s->data.item, s->start->seg->data.item)) {
+        if (val != INT_MAX && other->seg && item_is_equal(s->data.item, other->seg->data.item)) {
             if (profile->turn_around_penalty2)
                 val += profile->turn_around_penalty2;
             else
                 val = INT_MAX;
         }
         if (val != INT_MAX) {
-            new = route_value_add(val, s->start->value);
+            new = route_value_add(val, other->value);
             if (new < p->rhs) {
                 p->rhs = new;
                 p->seg = s;
@@ -2195,17 +2610,47 @@ static void route_graph_point_update(struct vehicleprofile *profile, struct rout
         }
     }
 
-    if (p->el) {
-        /* Due to a limitation of the Fibonacci heap implementation, which causes fh_replacekey() to fail if the new
-         * key is greater than the current one, we always remove the point from the heap (and, if locally inconsistent,
-         * re-add it afterwards). */
-        fh_delete(heap, p->el);
-        p->el = NULL;
+    if (p->rhs != p->value)
+        /* The point is locally inconsistent, add it to the heap or update its key */
+        route_heap_update(graph->heap, p, route_graph_point_key(graph, p));
+    else
+        route_heap_remove(graph->heap, p);
+}
+
+/**
+ * @brief Expands a point taken off the route graph’s heap.
+ *
+ * This calculates the cost of the point and updates the neighbors affected by the cost change.
+ *
+ * @param graph The route graph
+ * @param profile The vehicle profile to use for routing
+ * @param p_min The point, which must have been removed from the heap
+ */
+static inline void route_graph_expand_point(struct route_graph *graph, struct vehicleprofile *profile,
+        struct route_graph_point *p_min) {
+    struct route_graph_segment *s;
+    struct route_graph_point_iterator it;
+
+    graph->expanded++;
+    if (p_min->value > p_min->rhs)
+        /* cost has decreased, update point value */
+        p_min->value = p_min->rhs;
+    else {
+        /* cost has increased, re-evaluate */
+        p_min->value = INT_MAX;
+        route_graph_point_update(graph, profile, p_min);
     }
 
-    if (p->rhs != p->value)
-        /* The point is locally inconsistent, add (or re-add) it to the heap */
-        p->el = fh_insertkey(heap, MIN(p->rhs, p->value), p);
+    /* in any case, update rhs of predecessors (nodes from which we can reach p_min via a single segment) */
+    it = rp_iterator_new(graph, p_min);
+    while ((s = rp_iterator_next(&it)))
+        if ((s->start == s->end) || (s->data.item.type < route_item_first) || (s->data.item.type > route_item_last))
+            continue;
+        else if (!rp_iterator_end(&it)) {
+            if (route_value_seg(graph, profile, NULL, s, -2) != INT_MAX)
+                route_graph_point_update(graph, profile, s->end);
+        } else if (route_value_seg(graph, profile, NULL, s, 2) != INT_MAX)
+            route_graph_point_update(graph, profile, s->start);
 }
 
 /**
@@ -2214,6 +2659,10 @@ static void route_graph_point_update(struct vehicleprofile *profile, struct rout
  * This calculates the cost for every point on the route graph’s heap, as well as any neighbors affected by the cost
  * change, and sets the next segment.
  *
+ * Without a focus, the keys on the heap are exact and the whole graph is flooded. With a focus, the key of the top
+ * point may date from an earlier focus and is re-checked before the point is expanded, and expansion stops once the
+ * path from the start is known (see `route_graph_set_focus()`).
+ *
  * This is part of a modified LPA* implementation.
  *
  * @param graph The route graph
@@ -2221,34 +2670,26 @@ static void route_graph_point_update(struct vehicleprofile *profile, struct rout
  * are calculated.
  * @param cb The callback function to call when flooding is complete (can be NULL)
  */
-static void route_graph_compute_shortest_path(struct route_graph * graph, struct vehicleprofile * profile,
+void route_graph_compute_shortest_path(struct route_graph * graph, struct vehicleprofile * profile,
         struct callback *cb) {
     struct route_graph_point *p_min;
-    struct route_graph_segment *s = NULL;
-
-    while (!route_graph_is_path_computed(graph) && (p_min = fh_extractmin(graph->heap))) {
-        p_min->el = NULL;
-        if (p_min->value > p_min->rhs)
-            /* cost has decreased, update point value */
-            p_min->value = p_min->rhs;
-        else {
-            /* cost has increased, re-evaluate */
-            p_min->value = INT_MAX;
-            route_graph_point_update(profile, p_min, graph->heap);
-        }
+    int expanded = graph->expanded, key;
 
-        /* in any case, update rhs of predecessors (nodes from which we can reach p_min via a single segment) */
-        for (s = p_min->start; s; s = s->start_next)
-            if ((s->start == s->end) || (s->data.item.type < route_item_first) || (s->data.item.type > route_item_last))
-                continue;
-            else if (route_value_seg(profile, NULL, s, -2) != INT_MAX)
-                route_graph_point_update(profile, s->end, graph->heap);
-        for (s = p_min->end; s; s = s->end_next)
-            if ((s->start == s->end) || (s->data.item.type < route_item_first) || (s->data.item.type > route_item_last))
+    if (!graph->focus.count)
+        while ((p_min = route_heap_extract_min(graph->heap)))
+            route_graph_expand_point(graph, profile, p_min);
+    else
+        while (!route_graph_is_path_computed(graph) && (p_min = route_heap_min(graph->heap))) {
+            key = route_graph_point_key(graph, p_min);
+            if (route_heap_min_key(graph->heap) < key) {
+                /* the key dates from an earlier focus, see route_graph_set_focus() */
+                route_heap_update(graph->heap, p_min, key);
                 continue;
-            else if (route_value_seg(profile, NULL, s, 2) != INT_MAX)
-                route_graph_point_update(profile, s->start, graph->heap);
-    }
+            }
+            route_heap_extract_min(graph->heap);
+            route_graph_expand_point(graph, profile, p_min);
+        }
+    dbg(lvl_debug, "expanded %d points (%d in total)", graph->expanded - expanded, graph->expanded);
     if (cb)
         callback_call_0(cb);
 }
@@ -2266,11 +2707,12 @@ static void route_graph_compute_shortest_path(struct route_graph * graph, struct
  */
 static void route_graph_set_traffic_distortion(struct route_graph *this, struct route_graph_segment *seg, int delay) {
     struct route_graph_point *start=NULL;
+    struct route_graph_point_iterator it;
     struct route_graph_segment *s;
 
     while ((start=route_graph_get_point_next(this, &seg->start->c, start))) {
-        s=start->start;
-        while (s) {
+        it=rp_iterator_new(this, start);
+        while ((s=rp_iterator_next(&it)) && !rp_iterator_end(&it)) {
             if (route_graph_segment_match(s, seg)) {
                 if (s->data.item.type != type_none && s->data.item.type != type_traffic_distortion && delay) {
                     struct route_graph_segment_data data;
@@ -2288,7 +2730,6 @@ static void route_graph_set_traffic_distortion(struct route_graph *this, struct
                     s->data.item.type = type_none;
                 }
             }
-            s=s->start_next;
         }
     }
 }
@@ -2342,9 +2783,9 @@ static void route_graph_add_traffic_distortion(struct route_graph *this, struct
         route_graph_add_segment(this, s_pnt, e_pnt, &data);
         if (update) {
             if (!(data.flags & AF_ONEWAYREV))
-                route_graph_point_update(profile, s_pnt, this->heap);
+                route_graph_point_update(this, profile, s_pnt);
             if (!(data.flags & AF_ONEWAY))
-                route_graph_point_update(profile, e_pnt, this->heap);
+                route_graph_point_update(this, profile, e_pnt);
         }
     }
 }
@@ -2361,6 +2802,7 @@ static void route_graph_add_traffic_distortion(struct route_graph *this, struct
 static void route_graph_remove_traffic_distortion(struct route_graph *this, struct vehicleprofile *profile,
         struct item *item) {
     struct route_graph_point *s_pnt = NULL, *e_pnt = NULL;
+    struct route_graph_point_iterator it;
     struct coord c, l;
     struct route_graph_segment *curr;
 
@@ -2373,9 +2815,9 @@ static void route_graph_remove_traffic_distortion(struct route_graph *this, stru
     }
     if (s_pnt && e_pnt) {
 #if 1
-        curr = s_pnt->start;
         s_pnt->flags &= ~RP_TRAFFIC_DISTORTION;
-        for (curr = s_pnt->start; curr; curr = curr->start_next) {
+        it = rp_iterator_new(this, s_pnt);
+        while ((curr = rp_iterator_next(&it)) && !rp_iterator_end(&it)) {
             if ((curr->end == e_pnt) && item_is_equal(curr->data.item, *item))
                 curr->data.item.type = type_none;
             else if (curr->data.item.type == type_traffic_distortion)
@@ -2383,8 +2825,9 @@ static void route_graph_remove_traffic_distortion(struct route_graph *this, stru
         }
 
         e_pnt->flags &= ~RP_TRAFFIC_DISTORTION;
-        for (curr = e_pnt->end; curr; curr = curr->end_next)
-            if (curr->data.item.type == type_traffic_distortion)
+        it = rp_iterator_new(this, e_pnt);
+        while ((curr = rp_iterator_next(&it)))
+            if (rp_iterator_end(&it) && curr->data.item.type == type_traffic_distortion)
                 e_pnt->flags |= RP_TRAFFIC_DISTORTION;
 #else
         struct route_graph_segment *found = NULL, *prev;
@@ -2395,13 +2838,13 @@ static void route_graph_remove_traffic_distortion(struct route_graph *this, stru
         while (curr && !found) {
             if ((curr->start == s_pnt) && (curr->end == e_pnt) && (curr->data.item == item)) {
                 if (prev)
-                    prev->next = curr->next;
+                    route_graph_segment_links(prev)->next = route_graph_segment_links(curr)->next;
                 else
-                    this->route_segments = curr->next;
+                    this->route_segments = route_graph_segment_links(curr)->next;
                 found = curr;
             } else {
                 prev = curr;
-                curr = prev->next;
+                curr = route_graph_segment_links(prev)->next;
             }
         }
 
@@ -2409,49 +2852,48 @@ static void route_graph_remove_traffic_distortion(struct route_graph *this, stru
             return;
 
         /* remove from s_pnt list */
-        curr = s_pnt->start;
+        curr = s_pnt->links ? s_pnt->links->start : NULL;
         prev = NULL;
         s_pnt->flags &= ~RP_TRAFFIC_DISTORTION;
         while (curr) {
             if (curr == found) {
                 if (prev)
-                    prev->start_next = curr->start_next;
+                    route_graph_segment_links(prev)->start_next = route_graph_segment_links(curr)->start_next;
                 else
-                    s_pnt->start = curr->start_next;
+                    s_pnt->links->start = route_graph_segment_links(curr)->start_next;
             } else {
                 if (curr->data.item.type == type_traffic_distortion)
                     s_pnt->flags |= RP_TRAFFIC_DISTORTION;
                 prev = curr;
             }
-            curr = prev->start_next;
+            curr = route_graph_segment_links(prev)->start_next;
         }
 
         /* remove from e_pnt list */
-        curr = e_pnt->end;
+        curr = e_pnt->links ? e_pnt->links->end : NULL;
         prev = NULL;
         e_pnt->flags &= ~RP_TRAFFIC_DISTORTION;
         while (curr) {
             if (curr == found) {
                 if (prev)
-                    prev->end_next = curr->end_next;
+                    route_graph_segment_links(prev)->end_next = route_graph_segment_links(curr)->end_next;
                 else
-                    s_pnt->end = curr->end_next;
+                    e_pnt->links->end = route_graph_segment_links(curr)->end_next;
             } else {
                 if (curr->data.item.type == type_traffic_distortion)
                     e_pnt->flags |= RP_TRAFFIC_DISTORTION;
                 prev = curr;
             }
-            curr = prev->end_next;
+            curr = route_graph_segment_links(prev)->end_next;
         }
 
-        size = sizeof(struct route_graph_segment) - sizeof(struct route_segment_data)
-               + route_segment_data_size(found->data.flags);
-        g_slice_free1(size, found);
+        size = offsetof(struct route_graph_segment_node, s) + route_graph_segment_size(found->data.flags);
+        g_slice_free1(size, route_graph_segment_links(found));
 #endif
 
         /* TODO figure out if we need to update both points */
-        route_graph_point_update(profile, s_pnt, this->heap);
-        route_graph_point_update(profile, e_pnt, this->heap);
+        route_graph_point_update(this, profile, s_pnt);
+        route_graph_point_update(this, profile, e_pnt);
     }
 }
 
@@ -2604,7 +3046,7 @@ static void route_graph_add_street(struct route_graph *this, struct item *item,
             e_pnt=route_graph_add_point(this,&l);
             dbg_assert(len >= 0);
             data.len=len;
-            if (!route_graph_segment_is_duplicate(s_pnt, &data))
+            if (!route_graph_segment_is_duplicate(this, s_pnt, &data))
                 route_graph_add_segment(this, s_pnt, e_pnt, &data);
         } else {
             int isseg,rc;
@@ -2618,7 +3060,7 @@ static void route_graph_add_street(struct route_graph *this, struct item *item,
                     if (isseg) {
                         e_pnt=route_graph_add_point(this,&l);
                         data.len=len;
-                        if (!route_graph_segment_is_duplicate(s_pnt, &data))
+                        if (!route_graph_segment_is_duplicate(this, s_pnt, &data))
                             route_graph_add_segment(this, s_pnt, e_pnt, &data);
                         data.offset++;
                         s_pnt=route_graph_add_point(this,&l);
@@ -2630,7 +3072,7 @@ static void route_graph_add_street(struct route_graph *this, struct item *item,
             dbg_assert(len >= 0);
             sc++;
             data.len=len;
-            if (!route_graph_segment_is_duplicate(s_pnt, &data))
+            if (!route_graph_segment_is_duplicate(this, s_pnt, &data))
                 route_graph_add_segment(this, s_pnt, e_pnt, &data);
         }
     }
@@ -2649,19 +3091,19 @@ static void route_graph_add_street(struct route_graph *this, struct item *item,
 static struct route_graph_segment *route_graph_get_segment(struct route_graph *graph, struct street_data *sd,
         struct route_graph_segment *last) {
     struct route_graph_point *start=NULL;
+    struct route_graph_point_iterator it;
     struct route_graph_segment *s;
     int seen=0;
 
     while ((start=route_graph_get_point_next(graph, &sd->c[0], start))) {
-        s=start->start;
-        while (s) {
+        it=rp_iterator_new(graph, start);
+        while ((s=rp_iterator_next(&it)) && !rp_iterator_end(&it)) {
             if (item_is_equal(sd->item, s->data.item)) {
                 if (!last || seen)
                     return s;
                 if (last == s)
                     seen=1;
             }
-            s=s->start_next;
         }
     }
     return NULL;
@@ -2674,24 +3116,35 @@ static struct route_graph_segment *route_graph_get_segment(struct route_graph *g
  * means that calculation of node cost has proceeded far enough to determine the cost of, and cheapest path from, the
  * start point.
  *
- * The current implementation returns true only when the heap is empty, i.e. all points have been calculated. This is
- * not optimal in terms of efficiency, as the cost of the start point and the cheapest path from there no longer
- * change during the last few cycles. Future versions may report true before the heap is completely empty, as soon as
- * the cost of the start point and the cheapest path are final. However, this needs to be considered for recalculations
- * which happen when the vehicle leaves the cheapest path: right now, any point in the route graph has its final cost
- * and cheapest path, thus no recalculation is needed if the vehicle leaves the cheapest path. In the future, however,
- * a (partial) recalculation may be needed if the vehicle deviates from the cheapest path.
+ * Without a focus (see `route_graph_set_focus()`), this returns true only when the heap is empty, i.e. all points have
+ * been calculated. Any point in the route graph then has its final cost and cheapest path, thus no recalculation is
+ * needed if the vehicle leaves the cheapest path.
+ *
+ * With a focus, this returns true as soon as all points through which the start can be reached are consistent and the
+ * cheapest way from the start through any of them costs no more than the lowest key on the heap. Since keys include
+ * a lower bound for the cost of getting from the start to the point, no point left on the heap can offer a cheaper
+ * path. Points further away from the start may not have their final cost yet; when the start moves there,
+ * `route_graph_set_focus()` and `route_graph_compute_shortest_path()` continue the calculation from where it stopped.
  *
  * @param this_ The route graph
  *
  * @return true if calculation is complete, false if not
  */
 static int route_graph_is_path_computed(struct route_graph *this_) {
-    /* TODO refine exit criterion */
-    if (!fh_min(this_->heap))
+    struct route_graph_point *p_min = route_heap_min(this_->heap);
+    int i, val = INT_MAX;
+
+    if (!p_min)
         return 1;
-    else
+    if (!this_->focus.count)
         return 0;
+    for (i = 0 ; i < this_->focus.count ; i++) {
+        if (route_heap_contains(this_->heap, this_->focus.points[i]))
+            return 0;
+        val = MIN(val, route_value_add(this_->focus.points[i]->value, this_->focus.cost[i]));
+    }
+    /* The keys on the heap are lower bounds for the current ones, see route_graph_set_focus() */
+    return route_value_add(val, this_->focus.km) <= route_heap_min_key(this_->heap);
 }
 
 /**
@@ -2706,7 +3159,9 @@ static int route_graph_is_path_computed(struct route_graph *this_) {
  * If segment costs have changed (as is the case with traffic distortions), all affected segments must have been added
  * to, removed from or updated in the route graph before this method is called.
  *
- * After recalculation, the route path is updated.
+ * After recalculation, the route path is updated. If the route graph only covers a corridor (see
+ * `route_calc_corridor_selection()`) and no route is found within it any more, the full route graph is built, as
+ * after building the corridor graph.
  *
  * The function uses a modified LPA* algorithm for recalculations. Most modifications were made for compatibility with
  * the old routing algorithm:
@@ -2732,6 +3187,7 @@ void route_recalculate_partial(struct route *this_) {
         return;
 
     /* exit if there is no need to recalculate */
+    route_graph_set_focus(this_->graph, this_->vehicleprofile, route_previous_destination(this_));
     if (route_graph_is_path_computed(this_->graph))
         return;
 
@@ -2747,6 +3203,10 @@ void route_recalculate_partial(struct route *this_) {
     printf("Point expansion complete, recalculating route path\n");
 
     route_path_update_done(this_, 0);
+    if (this_->corridor_fallback) {
+        this_->corridor_fallback=0;
+        route_graph_update(this_, this_->route_graph_flood_done_cb, 0, route_engine_flood);
+    }
 }
 
 /**
@@ -2862,8 +3322,12 @@ static struct route_path *route_path_new(struct route_graph *this, struct route_
     if (profile->mode == 2 || (profile->mode == 0
                                && pos->lenextra + dst->lenextra > transform_distance(map_projection(pos->street->item.map), &pos->c, &dst->c)))
         return route_path_new_offroad(this, pos, dst);
+    route_graph_set_focus(this, profile, pos);
+    if (this->focus.count && !route_graph_is_path_computed(this))
+        /* the position has moved beyond the points whose cost is known */
+        route_graph_compute_shortest_path(this, profile, NULL);
     while ((s=route_graph_get_segment(this, pos->street, s))) {
-        val=route_value_seg(profile, NULL, s, 2);
+        val=route_value_seg(this, profile, NULL, s, 2);
         if (val != INT_MAX && s->end->value != INT_MAX) {
             val=val*(100-pos->percent)/100;
             dbg(lvl_debug,"val1 %d",val);
@@ -2877,7 +3341,7 @@ static struct route_path *route_path_new(struct route_graph *this, struct route_
                 s1=s;
             }
         }
-        val=route_value_seg(profile, NULL, s, -2);
+        val=route_value_seg(this, profile, NULL, s, -2);
         if (val != INT_MAX && s->start->value != INT_MAX) {
             val=val*pos->percent/100;
             dbg(lvl_debug,"val2 %d",val);
@@ -2917,6 +3381,7 @@ static struct route_path *route_path_new(struct route_graph *this, struct route_
             this->avoid_seg=s;
             route_graph_set_traffic_distortion(this, this->avoid_seg, profile->turn_around_penalty);
             route_graph_reset(this);
+            route_graph_set_focus(this, profile, pos);
             route_graph_init(this, dst, profile);
             route_graph_compute_shortest_path(this, profile, NULL);
             return route_path_new(this, oldpath, pos, dst, profile);
@@ -2935,13 +3400,13 @@ static struct route_path *route_path_new(struct route_graph *this, struct route_
         if (s->start == start) {
             if (item_is_equal(s->data.item, dst->street->item) && (s->end->seg == s || !posinfo))
                 dstinfo=dst;
-            if (!route_path_add_item_from_graph(ret, oldpath, s, 1, posinfo, dstinfo))
+            if (!route_path_add_item_from_graph(ret, this, oldpath, s, 1, posinfo, dstinfo))
                 ret->updated=0;
             start=s->end;
         } else {
             if (item_is_equal(s->data.item, dst->street->item) && (s->start->seg == s || !posinfo))
                 dstinfo=dst;
-            if (!route_path_add_item_from_graph(ret, oldpath, s, -1, posinfo, dstinfo))
+            if (!route_path_add_item_from_graph(ret, this, oldpath, s, -1, posinfo, dstinfo))
                 ret->updated=0;
             start=s->start;
         }
@@ -2954,12 +3419,51 @@ static struct route_path *route_path_new(struct route_graph *this, struct route_
     return ret;
 }
 
+/**
+ * @brief Whether a street is used for the route graph, given the road classes allowed within the route selection
+ *
+ * A street is used if any of its coordinates lies within a rectangle of the selection which allows the class of the
+ * street, see `route_calc_selection()`.
+ *
+ * @param rg The route graph
+ * @param item The street
+ * @return True if the street is used
+ */
+static int route_graph_street_selected(struct route_graph *rg, struct item *item) {
+    struct map_selection *sel;
+    struct coord c[16];
+    int i,count,item_class=route_item_class(item->type);
+
+    if (item_class >= rg->class_limit)
+        return 1;
+    item_coord_rewind(item);
+    while ((count=item_coord_get(item, c, 16)) > 0) {
+        for (i = 0 ; i < count ; i++) {
+            for (sel = rg->sel ; sel ; sel = sel->next)
+                if (route_selection_min_class(sel) <= item_class && coord_rect_contains(&sel->u.c_rect, &c[i]))
+                    return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Opens a map rect on the next map to be read serially
+ *
+ * Maps read by the graph's route extract (if any) are skipped.
+ *
+ * @param rg The route graph
+ * @return True if a map rect was opened, false if there are no more maps
+ */
 static int route_graph_build_next_map(struct route_graph *rg) {
     do {
+        map_rect_destroy(rg->mr);
+        rg->mr=NULL;
         rg->m=mapset_next(rg->h, 2);
         if (! rg->m)
             return 0;
-        map_rect_destroy(rg->mr);
+        if (route_extract_handles_map(rg->extract, rg->m))
+            continue;
         rg->mr=map_rect_new(rg->m, rg->sel);
     } while (!rg->mr);
 
@@ -2967,10 +3471,11 @@ static int route_graph_build_next_map(struct route_graph *rg) {
 }
 
 
-static int is_turn_allowed(struct route_graph_point *p, struct route_graph_segment *from,
+static int is_turn_allowed(struct route_graph *graph, struct route_graph_point *p, struct route_graph_segment *from,
                            struct route_graph_segment *to) {
     struct route_graph_point *prev,*next;
-    struct route_graph_segment *tmp1,*tmp2;
+    struct route_graph_point_iterator it1,it2;
+    struct route_graph_segment *tmp1,*tmp2,*tmp;
     if (item_is_equal(from->data.item, to->data.item))
         return 0;
     if (from->start == p)
@@ -2981,22 +3486,26 @@ static int is_turn_allowed(struct route_graph_point *p, struct route_graph_segme
         next=to->end;
     else
         next=to->start;
-    tmp1=p->end;
-    while (tmp1) {
+    it1=rp_iterator_new(graph, p);
+    while ((tmp1=rp_iterator_next(&it1))) {
+        if (!rp_iterator_end(&it1))
+            continue;
         if (tmp1->start->c.x == prev->c.x && tmp1->start->c.y == prev->c.y &&
                 (tmp1->data.item.type == type_street_turn_restriction_no ||
                  tmp1->data.item.type == type_street_turn_restriction_only)) {
-            tmp2=p->start;
+            tmp2=NULL;
+            it2=rp_iterator_new(graph, p);
             dbg(lvl_debug,"found %s (0x%x,0x%x) (0x%x,0x%x)-(0x%x,0x%x) %p-%p",item_to_name(tmp1->data.item.type),
                 tmp1->data.item.id_hi,tmp1->data.item.id_lo,tmp1->start->c.x,tmp1->start->c.y,tmp1->end->c.x,tmp1->end->c.y,tmp1->start,
                 tmp1->end);
-            while (tmp2) {
-                dbg(lvl_debug,"compare %s (0x%x,0x%x) (0x%x,0x%x)-(0x%x,0x%x) %p-%p",item_to_name(tmp2->data.item.type),
-                    tmp2->data.item.id_hi,tmp2->data.item.id_lo,tmp2->start->c.x,tmp2->start->c.y,tmp2->end->c.x,tmp2->end->c.y,tmp2->start,
-                    tmp2->end);
-                if (item_is_equal(tmp1->data.item, tmp2->data.item))
+            while ((tmp=rp_iterator_next(&it2)) && !rp_iterator_end(&it2)) {
+                dbg(lvl_debug,"compare %s (0x%x,0x%x) (0x%x,0x%x)-(0x%x,0x%x) %p-%p",item_to_name(tmp->data.item.type),
+                    tmp->data.item.id_hi,tmp->data.item.id_lo,tmp->start->c.x,tmp->start->c.y,tmp->end->c.x,tmp->end->c.y,tmp->start,
+                    tmp->end);
+                if (item_is_equal(tmp1->data.item, tmp->data.item)) {
+                    tmp2=tmp;
                     break;
-                tmp2=tmp2->start_next;
+                }
             }
             dbg(lvl_debug,"tmp2=%p",tmp2);
             if (tmp2) {
@@ -3015,7 +3524,6 @@ static int is_turn_allowed(struct route_graph_point *p, struct route_graph_segme
                 return 0;
             }
         }
-        tmp1=tmp1->end_next;
     }
     dbg(lvl_debug,"from 0x%x,0x%x over 0x%x,0x%x to 0x%x,0x%x allowed",prev->c.x,prev->c.y,p->c.x,p->c.y,next->c.x,
         next->c.y);
@@ -3044,6 +3552,7 @@ static void route_graph_clone_segment(struct route_graph *this, struct route_gra
 
 static void route_graph_process_restriction_segment(struct route_graph *this, struct route_graph_point *p,
         struct route_graph_segment *s, int dir) {
+    struct route_graph_point_iterator it;
     struct route_graph_segment *tmp;
     struct route_graph_point *pn;
     struct coord c=p->c;
@@ -3068,67 +3577,180 @@ static void route_graph_process_restriction_segment(struct route_graph *this, st
         }
         route_graph_clone_segment(this, s, s->start, pn, AF_ONEWAY);
     }
-    tmp=p->start;
-    while (tmp) {
-        if (tmp != s && tmp->data.item.type != type_street_turn_restriction_no &&
-                tmp->data.item.type != type_street_turn_restriction_only &&
-                !(tmp->data.flags & AF_ONEWAYREV) && is_turn_allowed(p, s, tmp)) {
-            route_graph_clone_segment(this, tmp, pn, tmp->end, AF_ONEWAY);
-            dbg(lvl_debug,"To start %s",item_to_name(tmp->data.item.type));
-        }
-        tmp=tmp->start_next;
-    }
-    tmp=p->end;
-    while (tmp) {
-        if (tmp != s && tmp->data.item.type != type_street_turn_restriction_no &&
-                tmp->data.item.type != type_street_turn_restriction_only &&
-                !(tmp->data.flags & AF_ONEWAY) && is_turn_allowed(p, s, tmp)) {
-            route_graph_clone_segment(this, tmp, tmp->start, pn, AF_ONEWAYREV);
-            dbg(lvl_debug,"To end %s",item_to_name(tmp->data.item.type));
+    it=rp_iterator_new(this, p);
+    while ((tmp=rp_iterator_next(&it))) {
+        if (tmp == s || tmp->data.item.type == type_street_turn_restriction_no ||
+                tmp->data.item.type == type_street_turn_restriction_only)
+            continue;
+        if (!rp_iterator_end(&it)) {
+            if (!(tmp->data.flags & AF_ONEWAYREV) && is_turn_allowed(this, p, s, tmp)) {
+                route_graph_clone_segment(this, tmp, pn, tmp->end, AF_ONEWAY);
+                dbg(lvl_debug,"To start %s",item_to_name(tmp->data.item.type));
+            }
+        } else {
+            if (!(tmp->data.flags & AF_ONEWAY) && is_turn_allowed(this, p, s, tmp)) {
+                route_graph_clone_segment(this, tmp, tmp->start, pn, AF_ONEWAYREV);
+                dbg(lvl_debug,"To end %s",item_to_name(tmp->data.item.type));
+            }
         }
-        tmp=tmp->end_next;
     }
 }
 
 static void route_graph_process_restriction_point(struct route_graph *this, struct route_graph_point *p) {
+    struct route_graph_point_iterator it=rp_iterator_new(this, p);
     struct route_graph_segment *tmp;
-    tmp=p->start;
     dbg(lvl_debug,"node 0x%x,0x%x",p->c.x,p->c.y);
-    while (tmp) {
-        if (tmp->data.item.type != type_street_turn_restriction_no &&
-                tmp->data.item.type != type_street_turn_restriction_only)
-            route_graph_process_restriction_segment(this, p, tmp, 1);
-        tmp=tmp->start_next;
-    }
-    tmp=p->end;
-    while (tmp) {
+    while ((tmp=rp_iterator_next(&it))) {
         if (tmp->data.item.type != type_street_turn_restriction_no &&
                 tmp->data.item.type != type_street_turn_restriction_only)
-            route_graph_process_restriction_segment(this, p, tmp, -1);
-        tmp=tmp->end_next;
+            route_graph_process_restriction_segment(this, p, tmp, rp_iterator_end(&it) ? -1 : 1);
     }
     p->flags |= RP_TURN_RESTRICTION_RESOLVED;
 }
 
 static void route_graph_process_restrictions(struct route_graph *this) {
-    struct route_graph_point *curr;
-    int i;
+    struct route_graph_point *curr=NULL;
     dbg(lvl_debug,"enter");
-    for (i = 0 ; i < HASH_SIZE ; i++) {
-        curr=this->hash[i];
-        while (curr) {
-            if (curr->flags & RP_TURN_RESTRICTION)
-                route_graph_process_restriction_point(this, curr);
-            curr=curr->hash_next;
+    while ((curr=route_graph_next_point(this, curr))) {
+        if (curr->flags & RP_TURN_RESTRICTION)
+            route_graph_process_restriction_point(this, curr);
+    }
+}
+
+/**
+ * @brief A route graph point along with its sort key for compaction
+ */
+struct route_graph_point_order {
+    guint64 key;                  /**< Z-order (Morton) code of the point’s coordinates, see {@link route_graph_point_order_key(struct coord *)} */
+    int seq;                      /**< Position of the point in the hash table, keeps points with equal keys in order */
+    struct route_graph_point *p;  /**< The point */
+};
+
+static int route_graph_point_order_cmp(const void *a, const void *b) {
+    const struct route_graph_point_order *oa = a, *ob = b;
+    if (oa->key != ob->key)
+        return oa->key < ob->key ? -1 : 1;
+    return oa->seq - ob->seq;
+}
+
+#define RG_POINT_MOVED(x) ((x) ? &points[(x)->value] : NULL)
+#define RG_SEG_MOVED(x) ((x) ? route_graph_segment_links(x)->next : NULL)
+
+/**
+ * @brief Moves all points and segments of a route graph into contiguous storage and builds the CSR adjacency index.
+ *
+ * Points are stored in Z-order of their coordinates, so that points which are close to each other (and thus likely
+ * to be expanded one after the other when flooding the graph) are also close to each other in memory, and can be
+ * looked up by binary search. Segments are stored grouped by their start point, in the same order as the points,
+ * each one starting at a multiple of 8 bytes.
+ *
+ * The hash table, the list of all segments and the per-point segment lists are released: from now on, the segments
+ * of a compacted point are found through the CSR index only, in the order the lists had. Points and segments added
+ * later on (e.g. traffic distortions) are allocated individually as before and are linked in the hash table and
+ * lists, which {@link rp_iterator_next(struct route_graph_point_iterator *)} and
+ * {@link route_graph_get_point(struct route_graph *, struct coord *)} search in addition to the compacted graph.
+ *
+ * References to points or segments obtained prior to calling this function become invalid.
+ *
+ * @param this The route graph
+ */
+static void route_graph_compact(struct route_graph *this) {
+    struct route_graph_point_order *order;
+    struct route_graph_point *p = NULL, *points;
+    struct route_graph_segment *s, *next;
+    struct route_graph_segment_links *l;
+    int i, n = 0, nseg = 0, size, pos;
+
+    if (this->points)
+        return;
+    while ((p = route_graph_next_point(this, p)))
+        n++;
+    if (!n)
+        return;
+    for (s = this->route_segments ; s ; s = route_graph_segment_links(s)->next) {
+        nseg++;
+        this->segment_pool_size += ROUTE_GRAPH_ALIGN(route_graph_segment_size(s->data.flags));
+    }
+
+    order = g_new(struct route_graph_point_order, n);
+    n = 0;
+    while ((p = route_graph_next_point(this, p))) {
+        order[n].key = route_graph_point_order_key(&p->c);
+        order[n].seq = n;
+        order[n++].p = p;
+    }
+    qsort(order, n, sizeof(*order), route_graph_point_order_cmp);
+
+    /* Copy the points. From now on, the old copy of each point only holds its new index in `value`. */
+    points = g_new(struct route_graph_point, n);
+    for (i = 0 ; i < n ; i++) {
+        points[i] = *order[i].p;
+        points[i].links = NULL;
+        order[i].p->value = i;
+    }
+
+    /* Copy the segments. From now on, the links of the old copy of each segment only hold its new address in
+     * `next`. */
+    this->segment_pool = g_malloc(this->segment_pool_size);
+    pos = 0;
+    for (i = 0 ; i < n ; i++)
+        for (s = order[i].p->links->start ; s ; s = l->start_next) {
+            l = route_graph_segment_links(s);
+            memcpy(this->segment_pool + pos, s, route_graph_segment_size(s->data.flags));
+            l->next = (struct route_graph_segment *)(this->segment_pool + pos);
+            pos += ROUTE_GRAPH_ALIGN(route_graph_segment_size(s->data.flags));
+        }
+    dbg_assert(pos == this->segment_pool_size);
+
+    /* Relink everything and build the CSR adjacency index */
+    this->adj_index = g_new(int, 2 * n + 1);
+    this->adj = g_new(int, 2 * nseg);
+    pos = 0;
+    for (i = 0 ; i < n ; i++) {
+        p = &points[i];
+        p->seg = RG_SEG_MOVED(p->seg);
+        p->dst_seg = RG_SEG_MOVED(p->dst_seg);
+        this->adj_index[2 * i] = pos;
+        for (s = order[i].p->links->start ; s ; s = route_graph_segment_links(s)->start_next) {
+            next = RG_SEG_MOVED(s);
+            next->start = RG_POINT_MOVED(next->start);
+            next->end = RG_POINT_MOVED(next->end);
+            this->adj[pos++] = (char *)next - this->segment_pool;
+        }
+        this->adj_index[2 * i + 1] = pos;
+        for (s = order[i].p->links->end ; s ; s = route_graph_segment_links(s)->end_next)
+            this->adj[pos++] = (char *)RG_SEG_MOVED(s) - this->segment_pool;
+    }
+    this->adj_index[2 * n] = pos;
+    this->avoid_seg = RG_SEG_MOVED(this->avoid_seg);
+
+    /* Release the old copies */
+    for (i = 0 ; i < n ; i++) {
+        for (s = order[i].p->links->start ; s ; s = next) {
+            l = route_graph_segment_links(s);
+            next = l->start_next;
+            size = offsetof(struct route_graph_segment_node, s) + route_graph_segment_size(s->data.flags);
+            g_slice_free1(size, l);
         }
+        g_slice_free(struct route_graph_point_node, (struct route_graph_point_node *)order[i].p);
     }
+    g_free(order);
+    g_free(this->hash);
+    this->hash = NULL;
+    this->route_segments = NULL;
+    this->points = points;
+    this->num_points = n;
+    dbg(lvl_debug, "compacted %d points, %d segments (%d bytes)", n, nseg, this->segment_pool_size);
 }
 
+#undef RG_POINT_MOVED
+#undef RG_SEG_MOVED
+
 /**
  * @brief Releases all resources needed to build the route graph.
  *
- * If `cancel` is false, this function will start processing restrictions and ultimately call the route
- * graph's `done_cb` callback.
+ * If `cancel` is false, this function will start processing restrictions, compact the graph (see
+ * {@link route_graph_compact(struct route_graph *)}) and ultimately call the route graph's `done_cb` callback.
  *
  * The traffic module will always call this method with `cancel` set to true, as it does not process
  * restrictions and has no callback. Inside the routing module, `cancel` will be true if, and only if,
@@ -3143,6 +3765,8 @@ void route_graph_build_done(struct route_graph *rg, int cancel) {
         event_remove_idle(rg->idle_ev);
     if (rg->idle_cb)
         callback_destroy(rg->idle_cb);
+    route_extract_destroy(rg->extract);
+    rg->extract=NULL;
     map_rect_destroy(rg->mr);
     mapset_close(rg->h);
     route_free_selection(rg->sel);
@@ -3151,33 +3775,56 @@ void route_graph_build_done(struct route_graph *rg, int cancel) {
     rg->mr=NULL;
     rg->h=NULL;
     rg->sel=NULL;
+    rg->busy=0;
     if (! cancel) {
         route_graph_process_restrictions(rg);
+        route_graph_compact(rg);
+        /* the callback may replace the graph, do not touch it afterwards */
         if (rg->done_cb)
             callback_call_0(rg->done_cb);
     }
-    rg->busy=0;
 }
 
-static void route_graph_build_idle(struct route_graph *rg, struct vehicleprofile *profile) {
+/**
+ * @brief Adds the next batch of items to a route graph which is being built
+ *
+ * Maps which are read serially are processed first, then the items from the route extract. If the graph is built
+ * asynchronously, this function waits no more than 10 ms for the route extract to read the next item, and returns
+ * early if it has not done so by then; it will be called again on the next idle event. Otherwise, it waits for the
+ * item as long as it takes.
+ *
+ * @param rg The route graph
+ * @param profile The vehicle profile
+ */
+void route_graph_build_idle(struct route_graph *rg, struct vehicleprofile *profile) {
     int count=1000;
     struct item *item;
+    int rc;
 
     while (count > 0) {
         for (;;) {
-            item=map_rect_get_item(rg->mr);
-            if (item)
-                break;
-            if (!route_graph_build_next_map(rg)) {
-                route_graph_build_done(rg, 0);
-                return;
+            if (rg->mr) {
+                item=map_rect_get_item(rg->mr);
+                if (item)
+                    break;
+                if (route_graph_build_next_map(rg))
+                    continue;
+            }
+            if (rg->extract) {
+                rc=route_extract_get_item(rg->extract, rg->idle_ev ? 10 : -1, &item);
+                if (rc > 0)
+                    break;
+                if (rc < 0)
+                    return;
             }
+            route_graph_build_done(rg, 0);
+            return;
         }
         if (item->type == type_traffic_distortion)
             route_graph_add_traffic_distortion(rg, profile, item, 0);
         else if (item->type == type_street_turn_restriction_no || item->type == type_street_turn_restriction_only)
             route_graph_add_turn_restriction(rg, item);
-        else
+        else if (route_graph_street_selected(rg, item))
             route_graph_add_street(rg, item, profile);
         count--;
     }
@@ -3191,24 +3838,34 @@ static void route_graph_build_idle(struct route_graph *rg, struct vehicleprofile
  * function.
  *
  * @param ms The mapset to build the route graph from
- * @param c An array of coordinates for the current position, waypoints (if any) and destination
- * @param count Number of coordinates in `c`
+ * @param sel The map selection to build the route graph from, as returned by `route_calc_selection()` (its
+ * rectangles must have been created by `route_rect()`); ownership passes to the route graph
+ * @param corridor Whether `sel` is a corridor along a path found in the contraction hierarchy
  * @param done_cb The callback which will be called when graph is complete
+ * @param async Set to nonzero in order to build the route graph asynchronously
+ * @param profile The vehicle profile to use
+ * @param threads Number of threads to read thread-safe maps with, 0 for one per CPU, 1 to read all maps serially
+ * @param cache The route cache to keep the items read from thread-safe maps in, NULL to not use one
  * @return The new route graph.
  */
-static struct route_graph *route_graph_build(struct mapset *ms, struct coord *c, int count, struct callback *done_cb,
-        int async,
-        struct vehicleprofile *profile) {
+struct route_graph *route_graph_build(struct mapset *ms, struct map_selection *sel, int corridor,
+        struct callback *done_cb, int async,
+        struct vehicleprofile *profile, int threads, struct route_cache *cache) {
     struct route_graph *ret=g_new0(struct route_graph, 1);
 
     dbg(lvl_debug,"enter");
 
-    ret->sel=route_calc_selection(c, count, profile);
+    ret->sel=sel;
+    for (; sel ; sel = sel->next)
+        if (route_selection_min_class(sel) > ret->class_limit)
+            ret->class_limit=route_selection_min_class(sel);
+    ret->corridor=corridor;
     ret->h=mapset_open(ms);
     ret->done_cb=done_cb;
     ret->busy=1;
-    ret->heap = fh_makekeyheap();
-    if (route_graph_build_next_map(ret)) {
+    ret->heap = route_heap_new(route_heap_type_default);
+    ret->extract=route_extract_new(ms, ret->sel, profile, threads, cache);
+    if (route_graph_build_next_map(ret) || ret->extract) {
         if (async) {
             ret->idle_cb=callback_new_2(callback_cast(route_graph_build_idle), ret, profile);
             ret->idle_ev=event_add_idle(50, ret->idle_cb);
@@ -3219,7 +3876,34 @@ static struct route_graph *route_graph_build(struct mapset *ms, struct coord *c,
     return ret;
 }
 
+/**
+ * @brief Cancels building the full route graph after no route was found within the corridor
+ *
+ * @param this The route
+ */
+static void route_corridor_fallback_cancel(struct route *this) {
+    if (this->corridor_fallback_ev)
+        event_remove_idle(this->corridor_fallback_ev);
+    this->corridor_fallback_ev=NULL;
+    this->corridor_fallback=0;
+}
+
+/**
+ * @brief Builds the full route graph after no route was found within the corridor
+ *
+ * This is called from an idle event, once the flood of the corridor graph has returned.
+ *
+ * @param this The route
+ */
+static void route_corridor_fallback(struct route *this) {
+    route_corridor_fallback_cancel(this);
+    if (!this->pos || !this->destinations)
+        return;
+    route_graph_update(this, this->route_graph_flood_done_cb, 1, route_engine_flood);
+}
+
 static void route_graph_update_done(struct route *this, struct callback *cb) {
+    route_graph_set_focus(this->graph, this->vehicleprofile, route_previous_destination(this));
     route_graph_init(this->graph, this->current_dst, this->vehicleprofile);
     route_graph_compute_shortest_path(this->graph, this->vehicleprofile, cb);
 }
@@ -3233,14 +3917,19 @@ static void route_graph_update_done(struct route *this, struct callback *cb) {
  * @param this The route to update the graph for
  * @param cb The callback function to call when the route graph update is complete (used only in asynchronous mode)
  * @param async Set to nonzero in order to update the route graph asynchronously
+ * @param engine The routing engine to use. If `route_engine_ch` is requested but cannot be used, the full route graph
+ * is built.
  */
-static void route_graph_update(struct route *this, struct callback *cb, int async) {
+static void route_graph_update(struct route *this, struct callback *cb, int async, enum route_engine engine) {
     struct attr route_status;
     struct coord *c=g_alloca(sizeof(struct coord)*(1+g_list_length(this->destinations)));
-    int i=0;
+    struct map_selection *sel=NULL;
+    struct route_cache *cache=NULL;
+    int i=0,corridor;
     GList *tmp;
 
     route_status.type=attr_route_status;
+    route_corridor_fallback_cancel(this);
     route_graph_destroy(this->graph);
     this->graph=NULL;
     callback_destroy(this->route_graph_done_cb);
@@ -3254,10 +3943,28 @@ static void route_graph_update(struct route *this, struct callback *cb, int asyn
         c[i++]=dst->c;
         tmp=g_list_next(tmp);
     }
-    this->graph=route_graph_build(this->ms, c, i, this->route_graph_done_cb, async, this->vehicleprofile);
+    if (engine == route_engine_ch)
+        sel=route_calc_corridor_selection(this, c, i);
+    corridor=(sel != NULL);
+    if (!corridor)
+        sel=route_calc_selection(c, i, this->vehicleprofile, 0);
+    if (this->cache_size > 0) {
+        cache=mapset_get_route_cache(this->ms);
+        route_cache_set_size(cache, this->cache_size);
+        if (this->cache_file && !this->cache_loaded) {
+            route_cache_load(cache, this->cache_file, this->ms);
+            this->cache_loaded=1;
+        }
+    }
+    this->graph=route_graph_build(this->ms, sel, corridor, this->route_graph_done_cb, async, this->vehicleprofile,
+                                  this->build_threads, cache);
     if (! async) {
         while (this->graph->busy)
             route_graph_build_idle(this->graph, this->vehicleprofile);
+        if (this->corridor_fallback) {
+            this->corridor_fallback=0;
+            route_graph_update(this, cb, 0, route_engine_flood);
+        }
     }
 }
 
@@ -3345,20 +4052,21 @@ void street_data_free(struct street_data *sd) {
  * @param pc The coordinate to find a street nearby
  * @return The nearest street
  */
-static struct route_info *route_find_nearest_street(struct vehicleprofile *vehicleprofile, struct mapset *ms,
+struct route_info *route_find_nearest_street(struct vehicleprofile *vehicleprofile, struct mapset *ms,
         struct pcoord *pc) {
     struct route_info *ret=NULL;
     int max_dist=1000;
-    struct map_selection *sel;
+    struct street_index *index;
+    struct street_data **streets;
     int dist,mindist=0,pos;
+    int i,count;
     struct mapset_handle *h;
     struct map *m;
-    struct map_rect *mr;
-    struct item *item;
     struct coord lp;
-    struct street_data *sd;
+    struct street_data *sd,*nearest;
     struct coord c;
     struct coord_geo g;
+    struct coord_rect r;
 
     if(!vehicleprofile)
         return NULL;
@@ -3366,6 +4074,7 @@ static struct route_info *route_find_nearest_street(struct vehicleprofile *vehic
     ret=g_new0(struct route_info, 1);
     mindist = INT_MAX;
 
+    index=mapset_get_street_index(ms);
     h=mapset_open(ms);
     while ((m=mapset_next(h,2))) {
         c.x = pc->x;
@@ -3374,39 +4083,32 @@ static struct route_info *route_find_nearest_street(struct vehicleprofile *vehic
             transform_to_geo(pc->pro, &c, &g);
             transform_from_geo(map_projection(m), &g, &c);
         }
-        sel = route_rect(18, &c, &c, 0, max_dist);
-        if (!sel)
-            continue;
-        mr=map_rect_new(m, sel);
-        if (!mr) {
-            map_selection_destroy(sel);
-            continue;
-        }
-        while ((item=map_rect_get_item(mr))) {
-            if (item_get_default_flags(item->type)) {
-                sd=street_get_data(item);
-                if (!sd)
-                    continue;
-                dist=transform_distance_polyline_sq(sd->c, sd->count, &c, &lp, &pos);
-                if (dist < mindist && (
-                            (sd->flags & vehicleprofile->flags_forward_mask) == vehicleprofile->flags ||
-                            (sd->flags & vehicleprofile->flags_reverse_mask) == vehicleprofile->flags)) {
-                    mindist = dist;
-                    if (ret->street) {
-                        street_data_free(ret->street);
-                    }
-                    ret->c=c;
-                    ret->lp=lp;
-                    ret->pos=pos;
-                    ret->street=sd;
-                    dbg(lvl_debug,"dist=%d id 0x%x 0x%x pos=%d", dist, item->id_hi, item->id_lo, pos);
-                } else {
-                    street_data_free(sd);
-                }
+        r.lu.x=c.x-max_dist;
+        r.lu.y=c.y+max_dist;
+        r.rl.x=c.x+max_dist;
+        r.rl.y=c.y-max_dist;
+        streets=street_index_get(index, m, &r, &count);
+        nearest=NULL;
+        for (i = 0 ; i < count ; i++) {
+            sd=streets[i];
+            dist=transform_distance_polyline_sq(sd->c, sd->count, &c, &lp, &pos);
+            if (dist < mindist && (
+                        (sd->flags & vehicleprofile->flags_forward_mask) == vehicleprofile->flags ||
+                        (sd->flags & vehicleprofile->flags_reverse_mask) == vehicleprofile->flags)) {
+                mindist = dist;
+                ret->c=c;
+                ret->lp=lp;
+                ret->pos=pos;
+                nearest=sd;
+                dbg(lvl_debug,"dist=%d id 0x%x 0x%x pos=%d", dist, sd->item.id_hi, sd->item.id_lo, pos);
             }
         }
-        map_selection_destroy(sel);
-        map_rect_destroy(mr);
+        /* The street data of the index is only valid until the next query */
+        if (nearest) {
+            if (ret->street)
+                street_data_free(ret->street);
+            ret->street=street_data_dup(nearest);
+        }
     }
     mapset_close(h);
 
@@ -3465,7 +4167,6 @@ struct map_rect_priv {
     struct route_graph_point *point;
     struct route_graph_segment *rseg;
     char *str;
-    int hash_bucket;
     struct coord *coord_sel;	/**< Set this to a coordinate if you want to filter for just a single route graph point */
     struct route_graph_point_iterator it;
     /* Pointer to current waypoint element of route->destinations */
@@ -3712,18 +4413,14 @@ static int rp_attr_get(void *priv_data, enum attr_type attr_type, struct attr *a
         mr->str=NULL;
         switch (mr->item.type) {
         case type_rg_point: {
-            struct route_graph_segment *tmp;
+            struct route_graph_point_iterator it=rp_iterator_new(route->graph, p);
             int start=0;
             int end=0;
-            tmp=p->start;
-            while (tmp) {
-                start++;
-                tmp=tmp->start_next;
-            }
-            tmp=p->end;
-            while (tmp) {
-                end++;
-                tmp=tmp->end_next;
+            while (rp_iterator_next(&it)) {
+                if (rp_iterator_end(&it))
+                    end++;
+                else
+                    start++;
             }
             mr->str=g_strdup_printf("%d %d %p (0x%x,0x%x)", start, end, p, p->c.x, p->c.y);
             attr->u.str = mr->str;
@@ -3900,23 +4597,13 @@ static struct item *rp_get_item(struct map_rect_priv *mr) {
                 if (!p) {
                     mr->point = NULL; // This indicates that no point has been found
                 } else {
-                    mr->it = rp_iterator_new(p);
+                    mr->it = rp_iterator_new(r->graph, p);
                 }
             } else {
                 p = NULL;
             }
         } else {
-            if (!p) {
-                mr->hash_bucket=0;
-                p = r->graph->hash[0];
-            } else
-                p=p->hash_next;
-            while (!p) {
-                mr->hash_bucket++;
-                if (mr->hash_bucket >= HASH_SIZE)
-                    break;
-                p = r->graph->hash[mr->hash_bucket];
-            }
+            p = route_graph_next_point(r->graph, p);
         }
         if (p) {
             mr->point = p;
@@ -3935,10 +4622,7 @@ static struct item *rp_get_item(struct map_rect_priv *mr) {
         }
         seg = rp_iterator_next(&(mr->it));
     } else {
-        if (!seg)
-            seg=r->graph->route_segments;
-        else
-            seg=seg->next;
+        seg = route_graph_next_segment(r->graph, seg);
     }
 
     if (seg) {
@@ -4328,6 +5012,10 @@ int route_get_attr(struct route *this_, enum attr_type type, struct attr *attr,
         } else
             ret=0;
         break;
+    case attr_route_expansions:
+        attr->u.num=this_->graph ? this_->graph->expanded : 0;
+        ret=(this_->graph != NULL);
+        break;
     case attr_destination_length:
         if (this_->path2 && (this_->route_status == route_status_path_done_new
                              || this_->route_status == route_status_path_done_incremental)) {
@@ -4363,8 +5051,13 @@ void route_init(void) {
 
 void route_destroy(struct route *this_) {
     this_->refcount++; /* avoid recursion */
+    route_corridor_fallback_cancel(this_);
+    callback_destroy(this_->corridor_fallback_cb);
     route_path_destroy(this_->path2,1);
     route_graph_destroy(this_->graph);
+    if (this_->cache_loaded)
+        route_cache_save(mapset_get_route_cache(this_->ms), this_->cache_file);
+    g_free(this_->cache_file);
     route_clear_destinations(this_);
     route_info_free(this_->pos);
     map_destroy(this_->map);
@@ -0,0 +1,575 @@
+/**
+ * Navit, a modular navigation system.
+ * Copyright (C) 2005-2019 Navit Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public License
+ * version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+/**
+ * @file route_cache.c
+ *
+ * @brief Cache of the routable items of map tiles
+ *
+ * For each order, the plane of a map is divided into a uniform grid of square tiles, which get larger as the order
+ * decreases (see `route_cache_tile_shift()`). A tile holds the buffer a route extract job has filled while reading the
+ * tile at that order. The cache does not look into the buffers, it only stores them along with their size.
+ *
+ * Tiles are reference counted: the cache holds one reference, and every route extract using a tile holds another one
+ * until it is destroyed. When the total size of the tiles exceeds the limit set with `route_cache_set_size()`, the
+ * least recently used tiles which are not in use are dropped.
+ *
+ * The set of item types a tile was read for is part of its key. As vehicle profiles often share the same set of
+ * types (e.g. a profile for the fastest and one for the shortest route by car), sets are identified by a number,
+ * which is the same for equal sets.
+ *
+ * When saved to a file, each map is identified by its data file along with the size and modification time of that
+ * file, so tiles of maps which have changed since are not loaded again.
+ */
+
+#include "config.h"
+#include "navit_lfs.h"
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "coord.h"
+#include "item.h"
+#include "attr.h"
+#include "map.h"
+#include "mapset.h"
+#include "debug.h"
+#include "route_extract.h"
+#include "route_cache.h"
+
+/** Magic bytes at the start of a cache file */
+#define ROUTE_CACHE_MAGIC "navitrc1"
+
+/**
+ * @brief A tile of the cache
+ */
+struct route_cache_tile {
+    struct route_cache_key key;     /**< The key of the tile */
+    struct route_cache *cache;      /**< The cache holding the tile, NULL once it has been dropped from the cache */
+    int refcount;                   /**< Number of references, including the one of the cache */
+    char *data;                     /**< The buffered items */
+    int size;                       /**< Size of `data` */
+    struct route_cache_tile *prev;  /**< Previous tile in the LRU list, i.e. the one used more recently */
+    struct route_cache_tile *next;  /**< Next tile in the LRU list, i.e. the one used less recently */
+};
+
+struct route_cache {
+    GHashTable *tiles;              /**< All tiles, the key is the key of the tile */
+    int **types;                    /**< Known sets of item types, each one starts with the number of types */
+    int types_count;                /**< Number of sets in `types` */
+    struct route_cache_tile *first; /**< The most recently used tile */
+    struct route_cache_tile *last;  /**< The least recently used tile */
+    long size;                      /**< Total size of all tiles */
+    long limit;                     /**< Maximum total size of all tiles */
+    int hits;                       /**< Number of tiles found so far */
+    int misses;                     /**< Number of tiles not found so far */
+};
+
+static guint route_cache_key_hash(gconstpointer key) {
+    const struct route_cache_key *k=key;
+    return GPOINTER_TO_UINT(k->map) ^ (k->types * 257) ^ (k->order * 4099) ^ (k->x * 31) ^ (k->y * 65599);
+}
+
+static gboolean route_cache_key_equal(gconstpointer a, gconstpointer b) {
+    const struct route_cache_key *ka=a,*kb=b;
+    return ka->map == kb->map && ka->types == kb->types && ka->order == kb->order && ka->x == kb->x && ka->y == kb->y;
+}
+
+/**
+ * @brief Creates a new, empty route cache
+ *
+ * The cache does not keep any tile until a size is set with `route_cache_set_size()`.
+ *
+ * @return The new route cache
+ */
+struct route_cache *route_cache_new(void) {
+    struct route_cache *this_=g_new0(struct route_cache, 1);
+    this_->tiles=g_hash_table_new(route_cache_key_hash, route_cache_key_equal);
+    return this_;
+}
+
+/**
+ * @brief Returns the size of the tiles for an order
+ *
+ * @param order The order
+ * @return The size of a tile, as a power of two in map units
+ */
+int route_cache_tile_shift(int order) {
+    if (order < 0)
+        order=0;
+    if (order > 18)
+        order=18;
+    return 12+(18-order)/2;
+}
+
+static int route_cache_compare_int(const void *a, const void *b) {
+    const int *ia=a,*ib=b;
+    return (*ia > *ib) - (*ia < *ib);
+}
+
+/**
+ * @brief Returns the number identifying a set of item types
+ *
+ * @param this_ The route cache
+ * @param types The item types, this array is sorted by this function
+ * @param count The number of types in `types`
+ * @return The number of the set, to be used in `struct route_cache_key`
+ */
+int route_cache_get_types(struct route_cache *this_, int *types, int count) {
+    int i;
+
+    qsort(types, count, sizeof(int), route_cache_compare_int);
+    for (i = 0 ; i < this_->types_count ; i++) {
+        if (this_->types[i][0] == count && !memcmp(this_->types[i]+1, types, count*sizeof(int)))
+            return i;
+    }
+    this_->types=g_renew(int *, this_->types, this_->types_count+1);
+    this_->types[i]=g_new(int, count+1);
+    this_->types[i][0]=count;
+    memcpy(this_->types[i]+1, types, count*sizeof(int));
+    return this_->types_count++;
+}
+
+static void route_cache_unlink(struct route_cache *this_, struct route_cache_tile *tile) {
+    if (tile->prev)
+        tile->prev->next=tile->next;
+    else
+        this_->first=tile->next;
+    if (tile->next)
+        tile->next->prev=tile->prev;
+    else
+        this_->last=tile->prev;
+    tile->prev=NULL;
+    tile->next=NULL;
+}
+
+static void route_cache_link_first(struct route_cache *this_, struct route_cache_tile *tile) {
+    tile->prev=NULL;
+    tile->next=this_->first;
+    if (this_->first)
+        this_->first->prev=tile;
+    else
+        this_->last=tile;
+    this_->first=tile;
+}
+
+static void route_cache_expire(struct route_cache *this_);
+
+static void route_cache_link_last(struct route_cache *this_, struct route_cache_tile *tile) {
+    tile->next=NULL;
+    tile->prev=this_->last;
+    if (this_->last)
+        this_->last->next=tile;
+    else
+        this_->first=tile;
+    this_->last=tile;
+}
+
+/**
+ * @brief Releases a reference to a tile
+ *
+ * The tile is freed when the last reference is released. If the cache is over its size and the tile is no longer in
+ * use, tiles are dropped from the cache.
+ *
+ * @param tile The tile
+ */
+void route_cache_tile_unref(struct route_cache_tile *tile) {
+    if (--tile->refcount) {
+        if (tile->refcount == 1 && tile->cache && tile->cache->size > tile->cache->limit)
+            route_cache_expire(tile->cache);
+        return;
+    }
+    g_free(tile->data);
+    g_free(tile);
+}
+
+/**
+ * @brief Drops a tile from the cache, releasing the reference held by the cache
+ */
+static void route_cache_drop(struct route_cache *this_, struct route_cache_tile *tile) {
+    g_hash_table_remove(this_->tiles, &tile->key);
+    route_cache_unlink(this_, tile);
+    this_->size-=tile->size;
+    tile->cache=NULL;
+    route_cache_tile_unref(tile);
+}
+
+/**
+ * @brief Drops the least recently used tiles which are not in use until the size of the cache is within its limit
+ */
+static void route_cache_expire(struct route_cache *this_) {
+    struct route_cache_tile *tile=this_->last,*prev;
+
+    while (tile && this_->size > this_->limit) {
+        prev=tile->prev;
+        if (tile->refcount == 1)
+            route_cache_drop(this_, tile);
+        tile=prev;
+    }
+}
+
+/**
+ * @brief Sets the maximum total size of the tiles in the cache
+ *
+ * @param this_ The route cache
+ * @param size The size in bytes, 0 to keep no tiles
+ */
+void route_cache_set_size(struct route_cache *this_, long size) {
+    this_->limit=size;
+    route_cache_expire(this_);
+}
+
+/**
+ * @brief Looks up a tile
+ *
+ * @param this_ The route cache
+ * @param key The key of the tile
+ * @return The tile, or NULL if it is not in the cache. The caller has to release the tile with
+ * `route_cache_tile_unref()`.
+ */
+struct route_cache_tile *route_cache_get(struct route_cache *this_, struct route_cache_key *key) {
+    struct route_cache_tile *tile=g_hash_table_lookup(this_->tiles, key);
+
+    if (!tile) {
+        this_->misses++;
+        return NULL;
+    }
+    this_->hits++;
+    route_cache_unlink(this_, tile);
+    route_cache_link_first(this_, tile);
+    tile->refcount++;
+    return tile;
+}
+
+static struct route_cache_tile *route_cache_tile_new(struct route_cache *this_, struct route_cache_key *key, char *data,
+        int size) {
+    struct route_cache_tile *tile=g_new0(struct route_cache_tile, 1);
+
+    tile->key=*key;
+    tile->cache=this_;
+    tile->refcount=1;
+    tile->data=data;
+    tile->size=size;
+    g_hash_table_insert(this_->tiles, &tile->key, tile);
+    this_->size+=size;
+    return tile;
+}
+
+/**
+ * @brief Stores a tile in the cache
+ *
+ * If the cache already holds a tile for `key`, that tile is returned and `data` is freed.
+ *
+ * @param this_ The route cache
+ * @param key The key of the tile
+ * @param data The buffered items, ownership passes to the cache
+ * @param size The size of `data`
+ * @return The tile. The caller has to release the tile with `route_cache_tile_unref()`.
+ */
+struct route_cache_tile *route_cache_put(struct route_cache *this_, struct route_cache_key *key, char *data, int size) {
+    struct route_cache_tile *tile=g_hash_table_lookup(this_->tiles, key);
+
+    if (tile) {
+        g_free(data);
+        route_cache_unlink(this_, tile);
+    } else
+        tile=route_cache_tile_new(this_, key, data, size);
+    route_cache_link_first(this_, tile);
+    tile->refcount++;
+    route_cache_expire(this_);
+    return tile;
+}
+
+/**
+ * @brief Returns the buffered items of a tile
+ *
+ * @param tile The tile
+ * @param size Receives the size of the buffer
+ * @return The buffer, which remains valid as long as the caller holds a reference to the tile
+ */
+char *route_cache_tile_get_data(struct route_cache_tile *tile, int *size) {
+    *size=tile->size;
+    return tile->data;
+}
+
+/**
+ * @brief Returns the counters of a route cache
+ *
+ * @param this_ The route cache
+ * @param stats Receives the counters
+ */
+void route_cache_get_stats(struct route_cache *this_, struct route_cache_stats *stats) {
+    stats->tiles=g_hash_table_size(this_->tiles);
+    stats->size=this_->size;
+    stats->hits=this_->hits;
+    stats->misses=this_->misses;
+}
+
+/**
+ * @brief Gets the data file of a map along with its size and modification time
+ *
+ * @return True on success, false if the map has no data file
+ */
+static int route_cache_map_file(struct map *m, char **name, long long *size, long long *mtime) {
+    struct attr attr;
+    struct stat st;
+
+    if (!map_get_attr(m, attr_data, &attr, NULL) || !attr.u.str || stat(attr.u.str, &st))
+        return 0;
+    *name=attr.u.str;
+    *size=st.st_size;
+    *mtime=st.st_mtime;
+    return 1;
+}
+
+static int route_cache_write(FILE *f, const void *data, int size) {
+    return fwrite(data, size, 1, f) == 1 || !size;
+}
+
+static int route_cache_write_int(FILE *f, int value) {
+    return route_cache_write(f, &value, sizeof(value));
+}
+
+/**
+ * @brief Saves the tiles of a route cache to a file
+ *
+ * Tiles of maps without a data file are not saved.
+ *
+ * @param this_ The route cache
+ * @param filename The name of the file
+ * @return True on success, false on error
+ */
+int route_cache_save(struct route_cache *this_, const char *filename) {
+    struct route_cache_tile *tile;
+    GList *maps=NULL,*l;
+    FILE *f;
+    char *name;
+    long long size,mtime;
+    int i,count=0,ok;
+
+    f=fopen(filename, "wb");
+    if (!f) {
+        dbg(lvl_error,"failed to open %s for writing", filename);
+        return 0;
+    }
+    for (tile = this_->first ; tile ; tile = tile->next) {
+        if (g_list_find(maps, tile->key.map))
+            continue;
+        if (route_cache_map_file(tile->key.map, &name, &size, &mtime))
+            maps=g_list_append(maps, tile->key.map);
+    }
+    ok=route_cache_write(f, ROUTE_CACHE_MAGIC, strlen(ROUTE_CACHE_MAGIC))
+       && route_cache_write_int(f, route_extract_format())
+       && route_cache_write_int(f, g_list_length(maps));
+    for (l = maps ; l && ok ; l = g_list_next(l)) {
+        route_cache_map_file(l->data, &name, &size, &mtime);
+        ok=route_cache_write_int(f, strlen(name))
+           && route_cache_write(f, name, strlen(name))
+           && route_cache_write(f, &size, sizeof(size))
+           && route_cache_write(f, &mtime, sizeof(mtime));
+    }
+    ok=ok && route_cache_write_int(f, this_->types_count);
+    for (i = 0 ; i < this_->types_count && ok ; i++)
+        ok=route_cache_write(f, this_->types[i], (this_->types[i][0]+1)*sizeof(int));
+    for (tile = this_->first ; tile ; tile = tile->next)
+        if (g_list_find(maps, tile->key.map))
+            count++;
+    ok=ok && route_cache_write_int(f, count);
+    /* most recently used first, so loading a file into a smaller cache keeps the most useful tiles */
+    for (tile = this_->first ; tile && ok ; tile = tile->next) {
+        int key[6];
+        if (!g_list_find(maps, tile->key.map))
+            continue;
+        key[0]=g_list_index(maps, tile->key.map);
+        key[1]=tile->key.types;
+        key[2]=tile->key.order;
+        key[3]=tile->key.x;
+        key[4]=tile->key.y;
+        key[5]=tile->size;
+        ok=route_cache_write(f, key, sizeof(key)) && route_cache_write(f, tile->data, tile->size);
+    }
+    g_list_free(maps);
+    if (fclose(f))
+        ok=0;
+    if (!ok) {
+        dbg(lvl_error,"failed to write %s", filename);
+        remove(filename);
+        return 0;
+    }
+    dbg(lvl_debug,"saved %d tiles to %s", count, filename);
+    return 1;
+}
+
+static int route_cache_read(FILE *f, void *data, int size) {
+    return fread(data, size, 1, f) == 1 || !size;
+}
+
+static int route_cache_read_int(FILE *f, int *value, int max) {
+    return route_cache_read(f, value, sizeof(*value)) && *value >= 0 && *value <= max;
+}
+
+/**
+ * @brief Finds the map of a mapset with a given data file
+ *
+ * @return The map, or NULL if no map of `ms` uses the file, or the file has changed
+ */
+static struct map *route_cache_find_map(struct mapset *ms, char *filename, long long size, long long mtime) {
+    struct mapset_handle *h;
+    struct map *m,*ret=NULL;
+    char *name;
+    long long msize,mmtime;
+
+    h=mapset_open(ms);
+    while (!ret && (m=mapset_next(h, 0))) {
+        if (route_cache_map_file(m, &name, &msize, &mmtime) && !strcmp(name, filename) && msize == size
+                && mmtime == mtime)
+            ret=m;
+    }
+    mapset_close(h);
+    return ret;
+}
+
+/**
+ * @brief Loads the tiles saved to a file into a route cache
+ *
+ * Tiles of maps which are not part of `ms`, or whose data file has changed since the tiles were saved, are skipped.
+ * Tiles already in the cache are kept; no more tiles are loaded than fit into the size of the cache.
+ *
+ * @param this_ The route cache
+ * @param filename The name of the file
+ * @param ms The mapset the tiles are used with
+ * @return True on success, false if the file could not be read or has been written by an incompatible version
+ */
+int route_cache_load(struct route_cache *this_, const char *filename, struct mapset *ms) {
+    char magic[sizeof(ROUTE_CACHE_MAGIC)-1];
+    struct route_cache_key k;
+    struct map **maps=NULL;
+    int *types=NULL,*set;
+    FILE *f;
+    char *name,*data;
+    long long size,mtime;
+    int i,format,map_count=0,types_count=0,count=0,loaded=0,len,ok;
+
+    f=fopen(filename, "rb");
+    if (!f) {
+        dbg(lvl_debug,"no route cache in %s", filename);
+        return 0;
+    }
+    ok=route_cache_read(f, magic, sizeof(magic)) && !memcmp(magic, ROUTE_CACHE_MAGIC, sizeof(magic))
+       && route_cache_read(f, &format, sizeof(format)) && format == route_extract_format()
+       && route_cache_read_int(f, &map_count, 65535);
+    if (ok)
+        maps=g_new0(struct map *, map_count);
+    for (i = 0 ; i < map_count && ok ; i++) {
+        ok=route_cache_read_int(f, &len, 65535);
+        if (!ok)
+            break;
+        name=g_malloc(len+1);
+        ok=route_cache_read(f, name, len) && route_cache_read(f, &size, sizeof(size))
+           && route_cache_read(f, &mtime, sizeof(mtime));
+        name[len]='\0';
+        if (ok)
+            maps[i]=route_cache_find_map(ms, name, size, mtime);
+        g_free(name);
+    }
+    ok=ok && route_cache_read_int(f, &types_count, 65535);
+    if (ok)
+        types=g_new(int, types_count);
+    for (i = 0 ; i < types_count && ok ; i++) {
+        ok=route_cache_read_int(f, &len, 65535);
+        if (!ok)
+            break;
+        set=g_new(int, len);
+        ok=route_cache_read(f, set, len*sizeof(int));
+        if (ok)
+            types[i]=route_cache_get_types(this_, set, len);
+        g_free(set);
+    }
+    ok=ok && route_cache_read_int(f, &count, G_MAXINT);
+    for (i = 0 ; i < count && ok ; i++) {
+        int key[6];
+        ok=route_cache_read(f, key, sizeof(key)) && key[0] >= 0 && key[0] < map_count && key[1] >= 0
+           && key[1] < types_count && key[5] >= 0;
+        if (!ok)
+            break;
+        k.map=maps[key[0]];
+        k.types=types[key[1]];
+        k.order=key[2];
+        k.x=key[3];
+        k.y=key[4];
+        if (!k.map || this_->size + key[5] > this_->limit || g_hash_table_lookup(this_->tiles, &k)) {
+            ok=!fseek(f, key[5], SEEK_CUR);
+            continue;
+        }
+        data=g_malloc(key[5]);
+        ok=route_cache_read(f, data, key[5]);
+        if (!ok) {
+            g_free(data);
+            break;
+        }
+        route_cache_link_last(this_, route_cache_tile_new(this_, &k, data, key[5]));
+        loaded++;
+    }
+    fclose(f);
+    g_free(maps);
+    g_free(types);
+    if (!ok) {
+        dbg(lvl_error,"failed to read route cache from %s", filename);
+        return 0;
+    }
+    dbg(lvl_debug,"loaded %d of %d tiles from %s", loaded, count, filename);
+    return 1;
+}
+
+/**
+ * @brief Drops tiles from the cache
+ *
+ * Tiles still in use remain valid until they are released. This has to be called whenever a map the cache was used
+ * with is removed or changes.
+ *
+ * @param this_ The route cache
+ * @param m The map whose tiles are dropped, NULL to drop all tiles
+ */
+void route_cache_flush(struct route_cache *this_, struct map *m) {
+    struct route_cache_tile *tile=this_->first,*next;
+
+    while (tile) {
+        next=tile->next;
+        if (!m || tile->key.map == m)
+            route_cache_drop(this_, tile);
+        tile=next;
+    }
+}
+
+/**
+ * @brief Destroys a route cache
+ *
+ * @param this_ The route cache
+ */
+void route_cache_destroy(struct route_cache *this_) {
+    int i;
+
+    route_cache_flush(this_, NULL);
+    g_hash_table_destroy(this_->tiles);
+    for (i = 0 ; i < this_->types_count ; i++)
+        g_free(this_->types[i]);
+    g_free(this_->types);
+    g_free(this_);
+}
@@ -0,0 +1,86 @@
+/**
+ * Navit, a modular navigation system.
+ * Copyright (C) 2005-2019 Navit Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public License
+ * version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+/**
+ * @file route_cache.h
+ *
+ * @brief Cache of the routable items of map tiles
+ *
+ * The route cache keeps the items a route extract (see route_extract.h) has read for each tile of a map, so that
+ * building another route graph over the same area does not need to read and decode the map again. Tiles are kept
+ * separately for each set of item types routed on, i.e. for each distinct vehicle profile. The cache is shared by
+ * everything which works on the same mapset, see `mapset_get_route_cache()`, and can be saved to a file and loaded
+ * again on the next start.
+ *
+ * The cache must only be used from the main thread.
+ */
+
+#ifndef NAVIT_ROUTE_CACHE_H
+#define NAVIT_ROUTE_CACHE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct map;
+struct mapset;
+struct route_cache;
+struct route_cache_tile;
+
+/**
+ * @brief Identifies a tile of the cache
+ */
+struct route_cache_key {
+    struct map *map;              /**< The map */
+    int types;                    /**< The set of item types, see `route_cache_get_types()` */
+    int order;                    /**< The order the tile was read with */
+    int x,y;                      /**< Position of the tile in the grid of `order`, see `route_cache_tile_shift()` */
+};
+
+/**
+ * @brief Counters of a route cache, see `route_cache_get_stats()`
+ */
+struct route_cache_stats {
+    int tiles;                    /**< Number of tiles in the cache */
+    long size;                    /**< Bytes used by the tiles */
+    int hits;                     /**< Number of tiles found in the cache so far */
+    int misses;                   /**< Number of tiles not found in the cache so far */
+};
+
+/* prototypes */
+struct route_cache *route_cache_new(void);
+void route_cache_set_size(struct route_cache *this_, long size);
+int route_cache_tile_shift(int order);
+int route_cache_get_types(struct route_cache *this_, int *types, int count);
+struct route_cache_tile *route_cache_get(struct route_cache *this_, struct route_cache_key *key);
+struct route_cache_tile *route_cache_put(struct route_cache *this_, struct route_cache_key *key, char *data, int size);
+char *route_cache_tile_get_data(struct route_cache_tile *tile, int *size);
+void route_cache_tile_unref(struct route_cache_tile *tile);
+void route_cache_get_stats(struct route_cache *this_, struct route_cache_stats *stats);
+int route_cache_save(struct route_cache *this_, const char *filename);
+int route_cache_load(struct route_cache *this_, const char *filename, struct mapset *ms);
+void route_cache_flush(struct route_cache *this_, struct map *m);
+void route_cache_destroy(struct route_cache *this_);
+/* end of prototypes */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
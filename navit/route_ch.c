@@ -0,0 +1,503 @@
+/**
+ * Navit, a modular navigation system.
+ * Copyright (C) 2005-2019 Navit Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public License
+ * version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+/**
+ * @file route_ch.c
+ *
+ * @brief Queries on the contraction hierarchy stored in a binfile map
+ *
+ * Each CH node stores only the edges leading to nodes of a higher level. The query runs two Dijkstra searches at
+ * once, one forward from the start street and one backward from the destination street, each of which only follows
+ * these upward edges. The searches stop when neither of them can improve on the best path through a node reached by
+ * both.
+ *
+ * Nodes are read from the map on demand, by ID, and kept for the lifetime of the `struct route_ch`, so that further
+ * queries (e.g. for the next leg of a route with waypoints) can reuse them.
+ *
+ * Edge weights are those computed by maptool, from its own fixed speeds per road type. The hierarchy does not know
+ * about one-way streets, turn restrictions or the vehicle profile, so a path found here is only a candidate which
+ * the regular route graph still has to confirm.
+ */
+
+#include <glib.h>
+#include <limits.h>
+#include <string.h>
+#include "config.h"
+#include "coord.h"
+#include "item.h"
+#include "attr.h"
+#include "map.h"
+#include "route.h"
+#include "xmlconfig.h"
+#include "roadprofile.h"
+#include "vehicleprofile.h"
+#include "debug.h"
+#include "route_ch.h"
+
+/** The edge may be followed from the node to its target */
+#define ROUTE_CH_EDGE_FORWARD 1
+/** The edge may be followed from its target to the node */
+#define ROUTE_CH_EDGE_BACKWARD 2
+/** The edge is a shortcut, `middle` is the node it bypasses; otherwise `middle` is the street */
+#define ROUTE_CH_EDGE_SHORTCUT 4
+
+/** Maximum nesting of shortcuts, to guard against broken data */
+#define ROUTE_CH_MAX_DEPTH 64
+
+/**
+ * @brief An edge of the hierarchy, as stored in `attr_ch_edge` by maptool
+ */
+struct route_ch_edge {
+    int flags;                        /**< Combination of `ROUTE_CH_EDGE_*` flags */
+    int weight;                       /**< Travel time, in tenths of a second */
+    struct item_id target;            /**< The node at the other end of the edge */
+    struct item_id middle;            /**< The bypassed node for shortcuts, the street otherwise */
+};
+
+/**
+ * @brief A node of the hierarchy, along with the search state for both directions
+ *
+ * Index 0 of the search state arrays is used by the forward search, index 1 by the backward search.
+ */
+struct route_ch_node {
+    struct item_id id;                /**< ID of the `type_ch_node` item */
+    struct coord c;                   /**< Position of the junction */
+    int edge_count;                   /**< Number of edges in `edges` */
+    struct route_ch_edge *edges;      /**< Edges to nodes of a higher level */
+    int dist[2];                      /**< Best known cost from the start or to the destination, INT_MAX if none */
+    int settled[2];                   /**< Whether `dist` is final */
+    struct route_ch_node *pred[2];    /**< The node from which this node was reached */
+    struct route_ch_edge *pred_edge[2]; /**< The edge of the lower of the two nodes which was followed */
+};
+
+/**
+ * @brief An element of a search queue
+ */
+struct route_ch_queue_entry {
+    int key;                          /**< The value of `node->dist` at the time the entry was added */
+    struct route_ch_node *node;       /**< The node */
+};
+
+/**
+ * @brief A search queue, implemented as a binary heap
+ *
+ * Entries are not removed when the key of their node decreases; a new entry is added instead, and the stale one is
+ * skipped when it reaches the top.
+ */
+struct route_ch_queue {
+    struct route_ch_queue_entry *entries; /**< The entries, in heap order */
+    int count;                        /**< Number of entries */
+    int size;                         /**< Allocated number of entries */
+};
+
+/**
+ * @brief A growing array of coordinates
+ */
+struct route_ch_coords {
+    struct coord *c;                  /**< The coordinates */
+    int count;                        /**< Number of coordinates */
+    int size;                         /**< Allocated number of coordinates */
+};
+
+/**
+ * @brief A contraction hierarchy, or the part of it loaded so far
+ */
+struct route_ch {
+    struct map *map;                  /**< The map holding the hierarchy */
+    struct map_rect *mr;              /**< Map rect for looking up nodes by ID */
+    GHashTable *nodes;                /**< Nodes loaded so far, by ID */
+    struct route_ch_queue queue[2];   /**< Search queues, one per direction */
+};
+
+/**
+ * @brief Creates a new contraction hierarchy object for a map
+ *
+ * No data is read at this point. If the map has no hierarchy, queries will fail.
+ *
+ * @param m The map, usually the one containing the streets to route on
+ *
+ * @return The new object
+ */
+struct route_ch *route_ch_new(struct map *m) {
+    struct route_ch *this_=g_new0(struct route_ch, 1);
+
+    this_->map=m;
+    this_->mr=map_rect_new(m, NULL);
+    this_->nodes=g_hash_table_new(item_id_hash, item_id_equal);
+    return this_;
+}
+
+static void route_ch_node_free(gpointer key, gpointer value, gpointer user_data) {
+    struct route_ch_node *node=value;
+
+    g_free(node->edges);
+    g_free(node);
+}
+
+/**
+ * @brief Destroys a contraction hierarchy object
+ *
+ * @param this_ The object, may be NULL
+ */
+void route_ch_destroy(struct route_ch *this_) {
+    if (!this_)
+        return;
+    g_hash_table_foreach(this_->nodes, route_ch_node_free, NULL);
+    g_hash_table_destroy(this_->nodes);
+    g_free(this_->queue[0].entries);
+    g_free(this_->queue[1].entries);
+    map_rect_destroy(this_->mr);
+    g_free(this_);
+}
+
+static void route_ch_node_reset(struct route_ch_node *node) {
+    node->dist[0]=node->dist[1]=INT_MAX;
+    node->settled[0]=node->settled[1]=0;
+    node->pred[0]=node->pred[1]=NULL;
+    node->pred_edge[0]=node->pred_edge[1]=NULL;
+}
+
+static void route_ch_node_reset_g(gpointer key, gpointer value, gpointer user_data) {
+    route_ch_node_reset(value);
+}
+
+/**
+ * @brief Reads a CH node from a map item and adds it to the loaded nodes
+ *
+ * @param this_ The contraction hierarchy
+ * @param item The item, with its coordinates and attributes rewound
+ *
+ * @return The node, or NULL if `item` is not a CH node
+ */
+static struct route_ch_node *route_ch_node_new(struct route_ch *this_, struct item *item) {
+    struct route_ch_node *ret;
+    struct attr attr;
+    struct coord c;
+    int size=0;
+
+    if (!item || item->type != type_ch_node || item_coord_get(item, &c, 1) != 1)
+        return NULL;
+    ret=g_new0(struct route_ch_node, 1);
+    ret->id.id_hi=item->id_hi;
+    ret->id.id_lo=item->id_lo;
+    ret->c=c;
+    while (item_attr_get(item, attr_ch_edge, &attr)) {
+        if (ret->edge_count == size) {
+            size=size ? size*2 : 8;
+            ret->edges=g_renew(struct route_ch_edge, ret->edges, size);
+        }
+        memcpy(&ret->edges[ret->edge_count++], attr.u.data, sizeof(struct route_ch_edge));
+    }
+    route_ch_node_reset(ret);
+    g_hash_table_insert(this_->nodes, &ret->id, ret);
+    return ret;
+}
+
+/**
+ * @brief Returns a CH node by ID, reading it from the map if necessary
+ */
+static struct route_ch_node *route_ch_get_node(struct route_ch *this_, struct item_id *id) {
+    struct route_ch_node *ret=g_hash_table_lookup(this_->nodes, id);
+
+    if (ret)
+        return ret;
+    return route_ch_node_new(this_, map_rect_get_item_byid(this_->mr, id->id_hi, id->id_lo));
+}
+
+/**
+ * @brief Returns the CH node at a given position
+ *
+ * @param this_ The contraction hierarchy
+ * @param c The position, usually one end of a street
+ *
+ * @return The node, or NULL if there is no node at exactly that position
+ */
+static struct route_ch_node *route_ch_find_node(struct route_ch *this_, struct coord *c) {
+    struct route_ch_node *ret=NULL;
+    struct map_selection sel;
+    struct map_rect *mr;
+    struct item *item;
+    struct item_id id;
+    struct coord ci;
+
+    sel.next=NULL;
+    sel.order=18;
+    sel.range.min=type_ch_node;
+    sel.range.max=type_ch_node;
+    sel.u.c_rect.lu=*c;
+    sel.u.c_rect.rl=*c;
+    mr=map_rect_new(this_->map, &sel);
+    if (!mr)
+        return NULL;
+    while (!ret && (item=map_rect_get_item(mr))) {
+        if (item->type != type_ch_node || item_coord_get(item, &ci, 1) != 1 || ci.x != c->x || ci.y != c->y)
+            continue;
+        id.id_hi=item->id_hi;
+        id.id_lo=item->id_lo;
+        ret=g_hash_table_lookup(this_->nodes, &id);
+        if (!ret) {
+            item_coord_rewind(item);
+            ret=route_ch_node_new(this_, item);
+        }
+    }
+    map_rect_destroy(mr);
+    return ret;
+}
+
+/**
+ * @brief Returns the edge of a node which leads to a given target, or NULL if there is none
+ */
+static struct route_ch_edge *route_ch_node_get_edge(struct route_ch_node *node, struct item_id *target) {
+    int i;
+
+    for (i = 0 ; i < node->edge_count ; i++)
+        if (node->edges[i].target.id_hi == target->id_hi && node->edges[i].target.id_lo == target->id_lo)
+            return &node->edges[i];
+    return NULL;
+}
+
+static void route_ch_queue_push(struct route_ch_queue *queue, int key, struct route_ch_node *node) {
+    struct route_ch_queue_entry *e;
+    int i, parent;
+
+    if (queue->count == queue->size) {
+        queue->size=queue->size ? queue->size*2 : 256;
+        queue->entries=g_renew(struct route_ch_queue_entry, queue->entries, queue->size);
+    }
+    e=queue->entries;
+    i=queue->count++;
+    while (i > 0) {
+        parent=(i-1)/2;
+        if (e[parent].key <= key)
+            break;
+        e[i]=e[parent];
+        i=parent;
+    }
+    e[i].key=key;
+    e[i].node=node;
+}
+
+static int route_ch_queue_min(struct route_ch_queue *queue) {
+    if (!queue->count)
+        return INT_MAX;
+    return queue->entries[0].key;
+}
+
+static struct route_ch_queue_entry route_ch_queue_pop(struct route_ch_queue *queue) {
+    struct route_ch_queue_entry *e=queue->entries;
+    struct route_ch_queue_entry ret=e[0], last=e[--queue->count];
+    int i=0, child;
+
+    while ((child=2*i+1) < queue->count) {
+        if (child+1 < queue->count && e[child+1].key < e[child].key)
+            child++;
+        if (last.key <= e[child].key)
+            break;
+        e[i]=e[child];
+        i=child;
+    }
+    e[i]=last;
+    return ret;
+}
+
+static void route_ch_coords_add(struct route_ch_coords *coords, struct coord *c) {
+    if (coords->count == coords->size) {
+        coords->size=coords->size ? coords->size*2 : 64;
+        coords->c=g_renew(struct coord, coords->c, coords->size);
+    }
+    coords->c[coords->count++]=*c;
+}
+
+/**
+ * @brief Estimates the time needed to drive part of a street, in the unit of the edge weights
+ *
+ * @return The time in tenths of a second, or INT_MAX if the vehicle cannot use the street
+ */
+static int route_ch_street_cost(struct vehicleprofile *profile, struct street_data *sd, int len) {
+    struct roadprofile *roadprofile=vehicleprofile_get_roadprofile(profile, sd->item.type);
+
+    if (!roadprofile || !roadprofile->route_weight)
+        return INT_MAX;
+    return len*36/roadprofile->route_weight;
+}
+
+/**
+ * @brief Adds a node at one end of a street as a starting point for one of the searches
+ */
+static int route_ch_seed(struct route_ch *this_, int dir, struct coord *c, int cost) {
+    struct route_ch_node *node;
+
+    if (cost == INT_MAX || !(node=route_ch_find_node(this_, c)))
+        return 0;
+    if (cost < node->dist[dir]) {
+        node->dist[dir]=cost;
+        route_ch_queue_push(&this_->queue[dir], cost, node);
+    }
+    return 1;
+}
+
+/**
+ * @brief Appends the positions of all junctions passed along an edge, resolving shortcuts
+ *
+ * The position of `from` is not appended, the position of `to` is.
+ *
+ * @param this_ The contraction hierarchy
+ * @param from The node at which the edge is entered
+ * @param to The node at which the edge is left
+ * @param edge The edge, stored at the lower of `from` and `to`
+ * @param c Receives the positions
+ * @param depth Current nesting of shortcuts
+ *
+ * @return True on success, false if the data is inconsistent
+ */
+static int route_ch_unpack(struct route_ch *this_, struct route_ch_node *from, struct route_ch_node *to,
+                           struct route_ch_edge *edge, struct route_ch_coords *c, int depth) {
+    struct route_ch_node *middle;
+    struct route_ch_edge *e1,*e2;
+
+    if (!(edge->flags & ROUTE_CH_EDGE_SHORTCUT)) {
+        route_ch_coords_add(c, &to->c);
+        return 1;
+    }
+    if (depth >= ROUTE_CH_MAX_DEPTH || !(middle=route_ch_get_node(this_, &edge->middle)))
+        return 0;
+    /* the bypassed node is below both ends of the shortcut, so it stores the edges to both of them */
+    e1=route_ch_node_get_edge(middle, &from->id);
+    e2=route_ch_node_get_edge(middle, &to->id);
+    if (!e1 || !e2)
+        return 0;
+    return route_ch_unpack(this_, from, middle, e1, c, depth+1) && route_ch_unpack(this_, middle, to, e2, c, depth+1);
+}
+
+/**
+ * @brief Relaxes the edges of a node which has just been settled by one of the searches
+ *
+ * @param this_ The contraction hierarchy
+ * @param dir 0 for the forward search, 1 for the backward search
+ * @param node The node
+ * @param best Cost of the best path found so far, updated if a better one is found
+ * @param meet Node on the best path at which both searches meet, updated along with `best`
+ */
+static void route_ch_relax(struct route_ch *this_, int dir, struct route_ch_node *node, int *best,
+                           struct route_ch_node **meet) {
+    int mask=dir ? ROUTE_CH_EDGE_BACKWARD : ROUTE_CH_EDGE_FORWARD;
+    struct route_ch_node *target;
+    struct route_ch_edge *edge;
+    int i, dist;
+
+    for (i = 0 ; i < node->edge_count ; i++) {
+        edge=&node->edges[i];
+        if (!(edge->flags & mask) || edge->weight < 0)
+            continue;
+        if (!(target=route_ch_get_node(this_, &edge->target)))
+            continue;
+        dist=node->dist[dir]+edge->weight;
+        if (dist >= target->dist[dir])
+            continue;
+        target->dist[dir]=dist;
+        target->pred[dir]=node;
+        target->pred_edge[dir]=edge;
+        route_ch_queue_push(&this_->queue[dir], dist, target);
+        if (target->dist[!dir] != INT_MAX && dist+target->dist[!dir] < *best) {
+            *best=dist+target->dist[!dir];
+            *meet=target;
+        }
+    }
+}
+
+/**
+ * @brief Finds the shortest path between two streets in the contraction hierarchy
+ *
+ * The streets are entered and left at either end. `from_lenneg` and `from_lenpos` (and likewise for `to`) give the
+ * distance between the position on the street and its start and end, respectively, as in `struct route_info`.
+ *
+ * @param this_ The contraction hierarchy
+ * @param profile The vehicle profile, used to estimate the cost of the partial streets at either end
+ * @param from The street on which the path starts
+ * @param from_lenneg Distance from the start position to the start of `from`
+ * @param from_lenpos Distance from the start position to the end of `from`
+ * @param to The street on which the path ends
+ * @param to_lenneg Distance from the destination to the start of `to`
+ * @param to_lenpos Distance from the destination to the end of `to`
+ * @param c Receives a newly allocated array with the positions of all junctions on the path, in order, which must be
+ * freed with `g_free()`
+ *
+ * @return The number of positions in `c`, or 0 if no path was found
+ */
+int route_ch_path(struct route_ch *this_, struct vehicleprofile *profile, struct street_data *from, int from_lenneg,
+                  int from_lenpos, struct street_data *to, int to_lenneg, int to_lenpos, struct coord **c) {
+    struct route_ch_node *meet=NULL, *node, *pred;
+    struct route_ch_queue_entry entry;
+    struct route_ch_coords ret= {NULL, 0, 0};
+    GList *chain=NULL, *l;
+    int best=INT_MAX, dir, seeds, ok=1;
+
+    *c=NULL;
+    g_hash_table_foreach(this_->nodes, route_ch_node_reset_g, NULL);
+    this_->queue[0].count=0;
+    this_->queue[1].count=0;
+    seeds=route_ch_seed(this_, 0, &from->c[0], route_ch_street_cost(profile, from, from_lenneg));
+    seeds+=route_ch_seed(this_, 0, &from->c[from->count-1], route_ch_street_cost(profile, from, from_lenpos));
+    if (!seeds)
+        return 0;
+    seeds=route_ch_seed(this_, 1, &to->c[0], route_ch_street_cost(profile, to, to_lenneg));
+    seeds+=route_ch_seed(this_, 1, &to->c[to->count-1], route_ch_street_cost(profile, to, to_lenpos));
+    if (!seeds)
+        return 0;
+
+    for (;;) {
+        dir=route_ch_queue_min(&this_->queue[1]) < route_ch_queue_min(&this_->queue[0]);
+        if (route_ch_queue_min(&this_->queue[dir]) >= best)
+            break;
+        entry=route_ch_queue_pop(&this_->queue[dir]);
+        node=entry.node;
+        if (node->settled[dir] || entry.key != node->dist[dir])
+            continue;
+        node->settled[dir]=1;
+        if (node->dist[!dir] != INT_MAX && node->dist[0]+node->dist[1] < best) {
+            best=node->dist[0]+node->dist[1];
+            meet=node;
+        }
+        route_ch_relax(this_, dir, node, &best, &meet);
+    }
+    if (!meet)
+        return 0;
+    dbg(lvl_debug,"best path %d via 0x%x,0x%x, %d nodes loaded", best, meet->id.id_hi, meet->id.id_lo,
+        g_hash_table_size(this_->nodes));
+
+    /* forward part: collect the chain back to the start, then unpack it in driving order */
+    for (node = meet ; node->pred[0] ; node = node->pred[0])
+        chain=g_list_prepend(chain, node);
+    route_ch_coords_add(&ret, &node->c);
+    for (l = chain ; l && ok ; l = g_list_next(l)) {
+        struct route_ch_node *next=l->data;
+        ok=route_ch_unpack(this_, next->pred[0], next, next->pred_edge[0], &ret, 0);
+    }
+    g_list_free(chain);
+    /* backward part: the predecessors of the backward search are the next nodes in driving order */
+    for (node = meet ; ok && (pred=node->pred[1]) ; node = pred)
+        ok=route_ch_unpack(this_, node, pred, node->pred_edge[1], &ret, 0);
+    if (!ok) {
+        dbg(lvl_warning,"failed to unpack shortcuts, contraction hierarchy is inconsistent");
+        g_free(ret.c);
+        return 0;
+    }
+    *c=ret.c;
+    return ret.count;
+}
@@ -0,0 +1,57 @@
+/**
+ * Navit, a modular navigation system.
+ * Copyright (C) 2005-2019 Navit Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public License
+ * version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+/**
+ * @file route_ch.h
+ *
+ * @brief Queries on the contraction hierarchy stored in a binfile map
+ *
+ * `maptool -c` adds a contraction hierarchy (CH) to a map: one `type_ch_node` item per junction, each carrying its
+ * upward edges as `attr_ch_edge` attributes. A bidirectional search on this overlay finds the shortest path between
+ * two streets while visiting only a small number of nodes.
+ *
+ * The search does not produce a route path by itself. Instead, shortcuts are unpacked into the sequence of junctions
+ * the path passes, which the caller can use to limit the area from which the regular route graph is built.
+ */
+
+#ifndef NAVIT_ROUTE_CH_H
+#define NAVIT_ROUTE_CH_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct coord;
+struct map;
+struct route_ch;
+struct street_data;
+struct vehicleprofile;
+
+/* prototypes */
+struct route_ch *route_ch_new(struct map *m);
+int route_ch_path(struct route_ch *this_, struct vehicleprofile *profile, struct street_data *from, int from_lenneg,
+                  int from_lenpos, struct street_data *to, int to_lenneg, int to_lenpos, struct coord **c);
+void route_ch_destroy(struct route_ch *this_);
+/* end of prototypes */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
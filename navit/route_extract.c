@@ -0,0 +1,893 @@
+/**
+ * Navit, a modular navigation system.
+ * Copyright (C) 2005-2019 Navit Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public License
+ * version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+/**
+ * @file route_extract.c
+ *
+ * @brief Parallel extraction of routable items from maps
+ *
+ * Most of the time needed to build a route graph is spent inside the map driver: tiles have to be located,
+ * uncompressed and parsed. The route extract moves this work to worker threads. The route selection is first split
+ * into non-overlapping rectangles (see `route_extract_split()`), and each of them, for each thread-safe map, becomes
+ * a job. A worker opens its own map rect for the job and copies every item which may end up in the route graph
+ * (streets for which the vehicle profile has a road profile, turn restrictions and traffic distortions) into a
+ * buffer owned by the job. Along with the item, its coordinates, the node flags of segmented items and the
+ * attributes evaluated by the route graph are stored.
+ *
+ * `route_extract_get_item()` hands the buffered items out on the calling thread, job by job in the order in which
+ * the jobs were created. Within a job, items are in map order. Thus the result does not depend on which worker ran
+ * which job, or when. Items crossing the border between two rectangles are found by both jobs; they are handed out
+ * only the first time.
+ *
+ * The items handed out carry their original type, ID and map, but their methods read from the buffer. They remain
+ * valid until the next call to `route_extract_get_item()`.
+ *
+ * If a route cache (see route_cache.h) is used, jobs read whole tiles of the cache instead of the rectangles of the
+ * split selection, and their buffers are handed over to the cache once they have been handed out. Tiles found in the
+ * cache need not be read at all. Each rectangle then becomes a part for each tile it overlaps, and a part hands out
+ * only those items of its tile whose bounding box overlaps the rectangle. Jobs are run on the calling thread if fewer
+ * than two worker threads are to be used.
+ */
+
+#include <glib.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "config.h"
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+#include "coord.h"
+#include "item.h"
+#include "attr.h"
+#include "map.h"
+#include "mapset.h"
+#include "xmlconfig.h"
+#include "vehicleprofile.h"
+#include "debug.h"
+#include "route_cache.h"
+#include "route_extract.h"
+
+#ifdef HAVE_PTHREAD
+
+/** Number of items read from the map at once; workers check for cancellation after each batch */
+#define ROUTE_EXTRACT_BATCH_SIZE 256
+
+/** Maximum number of rectangles in a selection to split into a grid, see `route_extract_split()` */
+#define ROUTE_EXTRACT_SPLIT_MAX 32
+
+/** Version of the layout of job buffers, see `route_extract_format()` */
+#define ROUTE_EXTRACT_FORMAT 1
+
+/** Alignment of records in a job buffer */
+#define ROUTE_EXTRACT_ALIGN(size) (((size) + 7) & ~7)
+
+/**
+ * @brief Attributes which are copied for each item, as they are evaluated by the route graph
+ */
+static enum attr_type route_extract_attrs[] = {
+    attr_flags,
+    attr_maxspeed,
+    attr_delay,
+    attr_vehicle_dangerous_goods,
+    attr_vehicle_width,
+    attr_vehicle_height,
+    attr_vehicle_length,
+    attr_vehicle_weight,
+    attr_vehicle_axle_weight,
+    attr_none,
+};
+
+#define ROUTE_EXTRACT_ATTR_COUNT ((int)(sizeof(route_extract_attrs) / sizeof(route_extract_attrs[0])) - 1)
+
+/**
+ * @brief A numeric attribute of a buffered item
+ */
+struct route_extract_attr {
+    enum attr_type type;
+    long num;
+};
+
+/**
+ * @brief A buffered item
+ *
+ * The record is followed by `coord_count` coordinates, `attr_count` attributes and, if `has_nodes` is set,
+ * `coord_count` node flags. Records are padded to a multiple of 8 bytes.
+ */
+struct route_extract_record {
+    struct item item;         /**< The item as returned by the map; `map`, `meth` and `priv_data` are not used */
+    struct coord_rect bbox;   /**< Bounding box of the coordinates */
+    int size;                 /**< Size of the record including the data following it, in bytes */
+    int coord_count;          /**< Number of coordinates */
+    int attr_count;           /**< Number of attributes */
+    int has_nodes;            /**< Whether node flags (see `item_coord_is_node()`) are stored */
+};
+
+/**
+ * @brief A job: all wanted items of one map within one rectangle of the split selection, or within one tile
+ */
+struct route_extract_job {
+    struct map *map;          /**< The map to read */
+    struct map_selection sel; /**< The rectangle to read, `next` is always NULL */
+    struct route_cache_key key; /**< The tile read, if a route cache is used */
+    struct route_cache_tile *tile; /**< The tile `buffer` belongs to, NULL if it belongs to the job */
+    char *buffer;             /**< Buffered items, see `struct route_extract_record` */
+    int size;                 /**< Allocated size of `buffer` */
+    int used;                 /**< Used size of `buffer` */
+    int parts;                /**< Number of parts of the job which have not been handed out yet */
+    int complete;             /**< Whether all items have been read, set along with `done` */
+    int done;                 /**< Whether the job has been completed by a worker, protected by `mutex` */
+};
+
+/**
+ * @brief A part: the items of a job to be handed out for one rectangle of the split selection
+ */
+struct route_extract_part {
+    int job;                  /**< Index of the job */
+    struct coord_rect r;      /**< The rectangle */
+    int filter;               /**< Whether only items overlapping `r` are handed out, otherwise all items of the job are */
+    int disjoint;             /**< Whether `r` shares no more than its border with the rectangles of other parts */
+    GHashTable *seen;         /**< IDs of items already handed out for the map, NULL if the map has only one part */
+};
+
+/**
+ * @brief A route extract
+ */
+struct route_extract {
+    GHashTable *types;                    /**< Item types for which the vehicle profile has a road profile */
+    struct route_cache *cache;            /**< The route cache, NULL if not used */
+    struct route_extract_job *jobs;       /**< All jobs, in the order in which workers pick them up */
+    int job_count;                        /**< Number of jobs */
+    struct route_extract_part *parts;     /**< All parts, in the order in which their items are handed out */
+    int part_count;                       /**< Number of parts */
+    int next_job;                         /**< Next job to be picked up by a worker, protected by `mutex` */
+    int cancel;                           /**< Set to stop the workers, protected by `mutex` */
+    GList *maps;                          /**< Maps handled by this extract */
+    GList *seen;                          /**< The `seen` tables of all maps */
+    pthread_t *threads;                   /**< The worker threads */
+    int thread_count;                     /**< Number of worker threads, 0 if jobs are run by the calling thread */
+    pthread_mutex_t mutex;                /**< Protects the job queue and the `done` flags */
+    pthread_cond_t cond;                  /**< Signalled when a job is done */
+    int current;                          /**< Part whose items are currently handed out */
+    int current_done;                     /**< Whether the job of `current` is known to be done */
+    int pos;                              /**< Position of the next record in the buffer of the job of `current` */
+    struct route_extract_record *record;  /**< The record of the item last handed out */
+    struct item item;                     /**< The item last handed out */
+    int coord_pos;                        /**< Next coordinate of `item` */
+    int attr_pos;                         /**< Next attribute of `item` to be examined */
+};
+
+static inline struct coord *route_extract_record_coords(struct route_extract_record *rec) {
+    return (struct coord *)(rec + 1);
+}
+
+static inline struct route_extract_attr *route_extract_record_attrs(struct route_extract_record *rec) {
+    return (struct route_extract_attr *)(route_extract_record_coords(rec) + rec->coord_count);
+}
+
+static inline unsigned char *route_extract_record_nodes(struct route_extract_record *rec) {
+    return (unsigned char *)(route_extract_record_attrs(rec) + rec->attr_count);
+}
+
+static void route_extract_coord_rewind(void *priv_data) {
+    struct route_extract *this_=priv_data;
+    this_->coord_pos=0;
+}
+
+static int route_extract_coord_get(void *priv_data, struct coord *c, int count) {
+    struct route_extract *this_=priv_data;
+    int left=this_->record->coord_count-this_->coord_pos;
+
+    if (count > left)
+        count=left;
+    memcpy(c, route_extract_record_coords(this_->record)+this_->coord_pos, count*sizeof(struct coord));
+    this_->coord_pos+=count;
+    return count;
+}
+
+static void route_extract_attr_rewind(void *priv_data) {
+    struct route_extract *this_=priv_data;
+    this_->attr_pos=0;
+}
+
+static int route_extract_attr_get(void *priv_data, enum attr_type attr_type, struct attr *attr) {
+    struct route_extract *this_=priv_data;
+    struct route_extract_attr *attrs=route_extract_record_attrs(this_->record);
+
+    while (this_->attr_pos < this_->record->attr_count) {
+        if (attrs[this_->attr_pos].type == attr_type || attr_type == attr_any) {
+            attr->type=attrs[this_->attr_pos].type;
+            attr->u.num=attrs[this_->attr_pos].num;
+            this_->attr_pos++;
+            return 1;
+        }
+        this_->attr_pos++;
+    }
+    return 0;
+}
+
+static int route_extract_coord_is_node(void *priv_data) {
+    struct route_extract *this_=priv_data;
+
+    if (!this_->record->has_nodes || this_->coord_pos >= this_->record->coord_count)
+        return 0;
+    return route_extract_record_nodes(this_->record)[this_->coord_pos];
+}
+
+static int route_extract_coords_left(void *priv_data) {
+    struct route_extract *this_=priv_data;
+    return this_->record->coord_count-this_->coord_pos;
+}
+
+static struct item_methods methods_route_extract = {
+    route_extract_coord_rewind,
+    route_extract_coord_get,
+    route_extract_attr_rewind,
+    route_extract_attr_get,
+    route_extract_coord_is_node,
+    NULL,
+    NULL,
+    NULL,
+    route_extract_coords_left,
+};
+
+/**
+ * @brief Makes room for `size` more bytes in the buffer of a job
+ *
+ * @return Pointer to the first free byte; it is invalidated by the next call
+ */
+static char *route_extract_job_reserve(struct route_extract_job *job, int size) {
+    if (job->used + size > job->size) {
+        while (job->used + size > job->size)
+            job->size=job->size ? job->size * 2 : 65536;
+        job->buffer=g_realloc(job->buffer, job->size);
+    }
+    return job->buffer+job->used;
+}
+
+/**
+ * @brief Copies an item read as part of a batch to the buffer of a job
+ *
+ * @param job The job
+ * @param batch The batch
+ * @param bi The item
+ */
+static void route_extract_job_add(struct route_extract_job *job, struct map_batch *batch, struct map_batch_item *bi) {
+    struct route_extract_attr attrs[ROUTE_EXTRACT_ATTR_COUNT];
+    struct route_extract_record *rec;
+    struct map_batch_attr *a;
+    struct coord *c;
+    int attr_count=0,has_nodes=0;
+    int i,j,size;
+
+    for (i = 0 ; i < ROUTE_EXTRACT_ATTR_COUNT ; i++) {
+        for (j = 0 ; j < bi->attr_count ; j++) {
+            a=&batch->attrs[bi->attr_start+j];
+            if (a->type == route_extract_attrs[i]) {
+                attrs[attr_count].type=a->type;
+                attrs[attr_count].num=a->num;
+                if (a->type == attr_flags && (a->num & AF_SEGMENTED) && bi->has_nodes)
+                    has_nodes=1;
+                attr_count++;
+                break;
+            }
+        }
+    }
+    size=sizeof(*rec)+bi->coord_count*sizeof(struct coord)+attr_count*sizeof(struct route_extract_attr);
+    if (has_nodes)
+        size+=bi->coord_count;
+    size=ROUTE_EXTRACT_ALIGN(size);
+    rec=(struct route_extract_record *)route_extract_job_reserve(job, size);
+    job->used+=size;
+    memset(&rec->item, 0, sizeof(rec->item));
+    rec->item.type=bi->type;
+    rec->item.id_hi=bi->id_hi;
+    rec->item.id_lo=bi->id_lo;
+    rec->size=size;
+    rec->coord_count=bi->coord_count;
+    rec->attr_count=attr_count;
+    rec->has_nodes=has_nodes;
+    c=route_extract_record_coords(rec);
+    memcpy(c, batch->coords+bi->coord_start, bi->coord_count*sizeof(struct coord));
+    memcpy(route_extract_record_attrs(rec), attrs, attr_count*sizeof(struct route_extract_attr));
+    if (has_nodes)
+        memcpy(route_extract_record_nodes(rec), batch->nodes+bi->coord_start, bi->coord_count);
+    memset(&rec->bbox, 0, sizeof(rec->bbox));
+    if (bi->coord_count) {
+        rec->bbox.lu=c[0];
+        rec->bbox.rl=c[0];
+        for (i = 1 ; i < bi->coord_count ; i++)
+            coord_rect_extend(&rec->bbox, &c[i]);
+    }
+}
+
+/**
+ * @brief Whether the workers have been asked to stop
+ */
+static int route_extract_cancelled(struct route_extract *this_) {
+    int ret;
+
+    pthread_mutex_lock(&this_->mutex);
+    ret=this_->cancel;
+    pthread_mutex_unlock(&this_->mutex);
+    return ret;
+}
+
+/**
+ * @brief Whether items of a type are wanted, used as filter of a batch
+ */
+static int route_extract_wanted(enum item_type type, void *data) {
+    struct route_extract *this_=data;
+
+    return type == type_traffic_distortion || type == type_street_turn_restriction_no
+           || type == type_street_turn_restriction_only || g_hash_table_lookup(this_->types, (void *)(long)type);
+}
+
+/**
+ * @brief Reads all wanted items of a job into its buffer
+ *
+ * @return True if all items were read, false if the map could not be read or the workers have been asked to stop
+ */
+static int route_extract_job_run(struct route_extract *this_, struct route_extract_job *job) {
+    struct map_rect *mr;
+    struct map_batch *batch;
+    int i,count,ret=1;
+
+    mr=map_rect_new(job->map, &job->sel);
+    if (!mr)
+        return 0;
+    batch=map_batch_new(route_extract_attrs, ROUTE_EXTRACT_BATCH_SIZE);
+    batch->filter=route_extract_wanted;
+    batch->filter_data=this_;
+    while ((count=map_rect_get_batch(mr, batch)) != 0) {
+        if (route_extract_cancelled(this_)) {
+            ret=0;
+            break;
+        }
+        /* A busy map does a step of loading its data on every call, so it is just asked again */
+        if (count < 0)
+            continue;
+        for (i = 0 ; i < count ; i++)
+            route_extract_job_add(job, batch, &batch->items[i]);
+    }
+    map_batch_destroy(batch);
+    map_rect_destroy(mr);
+    return ret;
+}
+
+/**
+ * @brief Main function of a worker thread: runs jobs until there are none left
+ */
+static void *route_extract_worker(void *data) {
+    struct route_extract *this_=data;
+    struct route_extract_job *job;
+    int complete;
+
+    pthread_mutex_lock(&this_->mutex);
+    while (!this_->cancel && this_->next_job < this_->job_count) {
+        job=&this_->jobs[this_->next_job++];
+        if (job->done)
+            continue;
+        pthread_mutex_unlock(&this_->mutex);
+        complete=route_extract_job_run(this_, job);
+        pthread_mutex_lock(&this_->mutex);
+        job->complete=complete;
+        job->done=1;
+        pthread_cond_broadcast(&this_->cond);
+    }
+    pthread_mutex_unlock(&this_->mutex);
+    return NULL;
+}
+
+static int route_extract_compare_int(const void *a, const void *b) {
+    const int *ia=a,*ib=b;
+    return (*ia > *ib) - (*ia < *ib);
+}
+
+static int route_extract_unique(int *values, int count) {
+    int i,ret=0;
+
+    qsort(values, count, sizeof(int), route_extract_compare_int);
+    for (i = 0 ; i < count ; i++)
+        if (!ret || values[ret-1] != values[i])
+            values[ret++]=values[i];
+    return ret;
+}
+
+/**
+ * @brief Splits a map selection into non-overlapping rectangles
+ *
+ * The edges of all rectangles of `sel` divide the plane into a grid. Each grid cell covered by `sel` is assigned the
+ * highest order of the rectangles covering it, and cells next to each other in a grid row which have the same order
+ * are joined. Reading the resulting rectangles returns the same items as reading `sel`, but areas in which the
+ * rectangles of `sel` overlap (which, for a route selection, are those around the waypoints, where most items are)
+ * are read only once.
+ *
+ * The grid grows with the square of the number of rectangles. Selections with more than `ROUTE_EXTRACT_SPLIT_MAX`
+ * rectangles (such as a corridor along a route) are therefore used as they are; items in overlapping areas are then
+ * read more than once and only handed out the first time.
+ *
+ * @param sel The selection
+ * @param ret Receives the new rectangles, to be freed with `g_free()`. Their `next` members are not used.
+ * @param disjoint Receives whether the new rectangles share no more than their borders
+ *
+ * @return The number of rectangles in `ret`
+ */
+static int route_extract_split(struct map_selection *sel, struct map_selection **ret, int *disjoint) {
+    struct map_selection *s,*cell=NULL;
+    int *xs,*ys;
+    int i,j,count=0,nx=0,ny=0,order;
+
+    for (s = sel ; s ; s = s->next)
+        count++;
+    xs=g_new(int, 2*count);
+    ys=g_new(int, 2*count);
+    for (s = sel ; s ; s = s->next) {
+        xs[nx++]=s->u.c_rect.lu.x;
+        xs[nx++]=s->u.c_rect.rl.x;
+        ys[ny++]=s->u.c_rect.rl.y;
+        ys[ny++]=s->u.c_rect.lu.y;
+    }
+    nx=route_extract_unique(xs, nx);
+    ny=route_extract_unique(ys, ny);
+    if (nx < 2 || ny < 2 || count > ROUTE_EXTRACT_SPLIT_MAX) {
+        /* degenerate or too many rectangles, use them as they are */
+        *ret=g_new(struct map_selection, count);
+        for (s = sel, i = 0 ; s ; s = s->next, i++)
+            (*ret)[i]=*s;
+        g_free(xs);
+        g_free(ys);
+        *disjoint=(count == 1);
+        return count;
+    }
+    *ret=g_new(struct map_selection, (nx-1)*(ny-1));
+    count=0;
+    for (j = ny-2 ; j >= 0 ; j--) {
+        cell=NULL;
+        for (i = 0 ; i < nx-1 ; i++) {
+            order=-1;
+            for (s = sel ; s ; s = s->next)
+                if (s->u.c_rect.lu.x <= xs[i] && xs[i+1] <= s->u.c_rect.rl.x
+                        && s->u.c_rect.rl.y <= ys[j] && ys[j+1] <= s->u.c_rect.lu.y && s->order > order)
+                    order=s->order;
+            if (order < 0) {
+                cell=NULL;
+                continue;
+            }
+            if (cell && cell->order == order) {
+                cell->u.c_rect.rl.x=xs[i+1];
+                continue;
+            }
+            cell=&(*ret)[count++];
+            *cell=*sel;
+            cell->order=order;
+            cell->u.c_rect.lu.x=xs[i];
+            cell->u.c_rect.lu.y=ys[j+1];
+            cell->u.c_rect.rl.x=xs[i+1];
+            cell->u.c_rect.rl.y=ys[j];
+        }
+    }
+    g_free(xs);
+    g_free(ys);
+    *disjoint=1;
+    return count;
+}
+
+static void route_extract_add_type(gpointer key, gpointer value, gpointer user_data) {
+    g_hash_table_insert(user_data, key, key);
+}
+
+static void route_extract_add_type_to_list(gpointer key, gpointer value, gpointer user_data) {
+    int **types=user_data;
+    *(*types)++=GPOINTER_TO_INT(key);
+}
+
+/**
+ * @brief Adds a job
+ *
+ * @return The index of the new job
+ */
+static int route_extract_add_job(struct route_extract *this_, struct map *m, struct map_selection *sel) {
+    struct route_extract_job *job;
+
+    this_->jobs=g_renew(struct route_extract_job, this_->jobs, this_->job_count+1);
+    job=&this_->jobs[this_->job_count];
+    memset(job, 0, sizeof(*job));
+    job->map=m;
+    job->sel=*sel;
+    job->sel.next=NULL;
+    return this_->job_count++;
+}
+
+/**
+ * @brief Adds a part
+ */
+static void route_extract_add_part(struct route_extract *this_, int job, struct coord_rect *r, int filter,
+                                   int disjoint) {
+    struct route_extract_part *part;
+
+    this_->parts=g_renew(struct route_extract_part, this_->parts, this_->part_count+1);
+    part=&this_->parts[this_->part_count++];
+    part->job=job;
+    part->r=*r;
+    part->filter=filter;
+    part->disjoint=disjoint;
+    part->seen=NULL;
+    this_->jobs[job].parts++;
+}
+
+/**
+ * @brief Returns the job reading a tile of the route cache, adding it if there is none yet
+ *
+ * If the tile is in the cache, the job is done right away.
+ *
+ * @param this_ The route extract
+ * @param first The first job of the map of `key`
+ * @param key The tile
+ * @param sel The rectangle of the split selection the tile is needed for
+ *
+ * @return The index of the job
+ */
+static int route_extract_add_tile(struct route_extract *this_, int first, struct route_cache_key *key,
+                                  struct map_selection *sel) {
+    struct route_extract_job *job;
+    struct map_selection tile;
+    int i;
+
+    for (i = first ; i < this_->job_count ; i++) {
+        struct route_cache_key *k=&this_->jobs[i].key;
+        if (k->order == key->order && k->x == key->x && k->y == key->y)
+            return i;
+    }
+    tile=*sel;
+    coord_rect_from_grid(&tile.u.c_rect, key->x, key->y, route_cache_tile_shift(key->order));
+    i=route_extract_add_job(this_, key->map, &tile);
+    job=&this_->jobs[i];
+    job->key=*key;
+    job->tile=route_cache_get(this_->cache, key);
+    if (job->tile) {
+        job->buffer=route_cache_tile_get_data(job->tile, &job->used);
+        job->complete=1;
+        job->done=1;
+    }
+    return i;
+}
+
+/**
+ * @brief Adds the jobs and parts reading one rectangle of the split selection from the route cache
+ */
+static void route_extract_add_tiles(struct route_extract *this_, int first, struct map *m, int types,
+                                    struct map_selection *sel, int disjoint) {
+    struct route_cache_key key;
+    struct coord_rect r,*c=&sel->u.c_rect;
+    int job,shift=route_cache_tile_shift(sel->order);
+
+    key.map=m;
+    key.types=types;
+    key.order=sel->order;
+    for (key.y = c->lu.y >> shift ; key.y >= c->rl.y >> shift ; key.y--) {
+        for (key.x = c->lu.x >> shift ; key.x <= c->rl.x >> shift ; key.x++) {
+            job=route_extract_add_tile(this_, first, &key, sel);
+            r=this_->jobs[job].sel.u.c_rect;
+            if (r.lu.x < c->lu.x)
+                r.lu.x=c->lu.x;
+            if (r.lu.y > c->lu.y)
+                r.lu.y=c->lu.y;
+            if (r.rl.x > c->rl.x)
+                r.rl.x=c->rl.x;
+            if (r.rl.y < c->rl.y)
+                r.rl.y=c->rl.y;
+            route_extract_add_part(this_, job, &r, 1, disjoint);
+        }
+    }
+}
+
+/**
+ * @brief Starts extracting the items of all thread-safe maps of a mapset
+ *
+ * @param ms The mapset
+ * @param sel The route selection
+ * @param profile The vehicle profile, which determines the street types to extract
+ * @param threads The number of worker threads, 0 for one per online CPU
+ * @param cache The route cache to use, NULL to read all items from the maps
+ *
+ * @return The new route extract, or NULL if no map of `ms` can be read in parallel, or fewer than two threads
+ * would be used and no route cache is given
+ */
+struct route_extract *route_extract_new(struct mapset *ms, struct map_selection *sel, struct vehicleprofile *profile,
+                                        int threads, struct route_cache *cache) {
+    struct route_extract *this_;
+    struct mapset_handle *h;
+    struct map_selection *cells;
+    struct map *m;
+    struct attr attr;
+    GHashTable *seen;
+    int *types,*type;
+    int i,cell_count,disjoint,first_job,first_part,typeset=0,pending=0;
+
+#if defined(HAVE_UNISTD_H) && defined(_SC_NPROCESSORS_ONLN)
+    if (threads <= 0)
+        threads=sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    if ((threads < 2 && !cache) || !sel)
+        return NULL;
+    cell_count=route_extract_split(sel, &cells, &disjoint);
+    this_=g_new0(struct route_extract, 1);
+    pthread_mutex_init(&this_->mutex, NULL);
+    pthread_cond_init(&this_->cond, NULL);
+    this_->cache=cache;
+    this_->types=g_hash_table_new(NULL, NULL);
+    g_hash_table_foreach(profile->roadprofile_hash, route_extract_add_type, this_->types);
+    if (cache) {
+        types=g_new(int, g_hash_table_size(this_->types)+1);
+        type=types;
+        g_hash_table_foreach(this_->types, route_extract_add_type_to_list, &type);
+        typeset=route_cache_get_types(cache, types, type-types);
+        g_free(types);
+    }
+    h=mapset_open(ms);
+    while ((m=mapset_next(h, 2))) {
+        if (!map_get_attr(m, attr_thread_safe, &attr, NULL) || !attr.u.num)
+            continue;
+        this_->maps=g_list_append(this_->maps, m);
+        first_job=this_->job_count;
+        first_part=this_->part_count;
+        for (i = 0 ; i < cell_count ; i++) {
+            if (cache)
+                route_extract_add_tiles(this_, first_job, m, typeset, &cells[i], disjoint);
+            else
+                route_extract_add_part(this_, route_extract_add_job(this_, m, &cells[i]), &cells[i].u.c_rect, 0, 0);
+        }
+        if (this_->part_count - first_part > 1) {
+            seen=g_hash_table_new_full(item_id_hash, item_id_equal, g_free, NULL);
+            this_->seen=g_list_prepend(this_->seen, seen);
+            for (i = first_part ; i < this_->part_count ; i++)
+                this_->parts[i].seen=seen;
+        }
+    }
+    mapset_close(h);
+    g_free(cells);
+    if (!this_->job_count) {
+        route_extract_destroy(this_);
+        return NULL;
+    }
+    this_->item.meth=&methods_route_extract;
+    this_->item.priv_data=this_;
+    for (i = 0 ; i < this_->job_count ; i++)
+        if (!this_->jobs[i].done)
+            pending++;
+    if (threads > pending)
+        threads=pending;
+    if (threads >= 2) {
+        this_->threads=g_new(pthread_t, threads);
+        for (i = 0 ; i < threads ; i++) {
+            if (pthread_create(&this_->threads[i], NULL, route_extract_worker, this_))
+                break;
+            this_->thread_count++;
+        }
+        if (!this_->thread_count)
+            dbg(lvl_error,"failed to start worker threads, reading maps serially");
+    }
+    dbg(lvl_debug,"%d jobs (%d to read) in %d parts on %d threads", this_->job_count, pending, this_->part_count,
+        this_->thread_count);
+    return this_;
+}
+
+/**
+ * @brief Whether the items of a map are supplied by a route extract
+ *
+ * @param this_ The route extract, may be NULL
+ * @param m The map
+ *
+ * @return True if `this_` reads `m`, false if the caller has to read it
+ */
+int route_extract_handles_map(struct route_extract *this_, struct map *m) {
+    return this_ && g_list_find(this_->maps, m) != NULL;
+}
+
+/**
+ * @brief Whether an item has been handed out before, marking it as handed out if not
+ */
+static int route_extract_seen(GHashTable *seen, struct item *item) {
+    struct item_id *id;
+
+    if (!seen)
+        return 0;
+    id=g_new(struct item_id, 1);
+    id->id_hi=item->id_hi;
+    id->id_lo=item->id_lo;
+    if (g_hash_table_lookup(seen, id)) {
+        g_free(id);
+        return 1;
+    }
+    g_hash_table_insert(seen, id, id);
+    return 0;
+}
+
+/**
+ * @brief Whether a rectangle lies inside another one without touching its border
+ *
+ * An item whose bounding box lies inside the rectangle of a disjoint part cannot overlap the rectangle of any other
+ * part, thus it need not be checked for having been handed out before.
+ */
+static int route_extract_inside(struct coord_rect *r, struct coord_rect *outer) {
+    return r->lu.x > outer->lu.x && r->rl.x < outer->rl.x && r->rl.y > outer->rl.y && r->lu.y < outer->lu.y;
+}
+
+/**
+ * @brief Gets the next extracted item
+ *
+ * @param this_ The route extract
+ * @param timeout Time in milliseconds to wait for the next item if it is not available yet, -1 to wait as long as
+ * it takes
+ * @param item Receives the item, which is valid until the next call
+ *
+ * @return 1 if an item was returned, 0 if all items have been returned, -1 if the next item did not become available
+ * within `timeout`
+ */
+int route_extract_get_item(struct route_extract *this_, int timeout, struct item **item) {
+    struct route_extract_part *part;
+    struct route_extract_job *job;
+    struct route_extract_record *rec;
+    struct timespec until;
+
+    for (;;) {
+        if (this_->current >= this_->part_count)
+            return 0;
+        part=&this_->parts[this_->current];
+        job=&this_->jobs[part->job];
+        if (!this_->current_done && !this_->thread_count) {
+            if (!job->done) {
+                job->complete=route_extract_job_run(this_, job);
+                job->done=1;
+            }
+            this_->current_done=1;
+        } else if (!this_->current_done) {
+            pthread_mutex_lock(&this_->mutex);
+            if (timeout < 0) {
+                while (!job->done)
+                    pthread_cond_wait(&this_->cond, &this_->mutex);
+            } else if (timeout > 0 && !job->done) {
+                clock_gettime(CLOCK_REALTIME, &until);
+                until.tv_sec+=timeout/1000;
+                until.tv_nsec+=(timeout%1000)*1000000L;
+                if (until.tv_nsec >= 1000000000L) {
+                    until.tv_sec++;
+                    until.tv_nsec-=1000000000L;
+                }
+                while (!job->done && !pthread_cond_timedwait(&this_->cond, &this_->mutex, &until));
+            }
+            this_->current_done=job->done;
+            pthread_mutex_unlock(&this_->mutex);
+            if (!this_->current_done)
+                return -1;
+        }
+        if (this_->cache && !job->tile && job->complete) {
+            /* hand the buffer over to the cache, shrinking it to the size actually used */
+            job->buffer=g_realloc(job->buffer, job->used);
+            job->tile=route_cache_put(this_->cache, &job->key, job->buffer, job->used);
+            job->buffer=route_cache_tile_get_data(job->tile, &job->used);
+        }
+        if (this_->pos >= job->used) {
+            if (!--job->parts && !job->tile) {
+                g_free(job->buffer);
+                job->buffer=NULL;
+            }
+            this_->current++;
+            this_->current_done=0;
+            this_->pos=0;
+            continue;
+        }
+        rec=(struct route_extract_record *)(job->buffer+this_->pos);
+        this_->pos+=rec->size;
+        if (part->filter && rec->coord_count && !coord_rect_overlap(&rec->bbox, &part->r))
+            continue;
+        if (!(part->disjoint && rec->coord_count && route_extract_inside(&rec->bbox, &part->r))
+                && route_extract_seen(part->seen, &rec->item))
+            continue;
+        this_->record=rec;
+        this_->item.type=rec->item.type;
+        this_->item.id_hi=rec->item.id_hi;
+        this_->item.id_lo=rec->item.id_lo;
+        this_->item.map=job->map;
+        this_->coord_pos=0;
+        this_->attr_pos=0;
+        *item=&this_->item;
+        return 1;
+    }
+}
+
+/**
+ * @brief Destroys a route extract
+ *
+ * Workers which are still running are stopped; items not yet handed out are discarded.
+ *
+ * @param this_ The route extract
+ */
+void route_extract_destroy(struct route_extract *this_) {
+    int i;
+
+    if (!this_)
+        return;
+    if (this_->thread_count) {
+        pthread_mutex_lock(&this_->mutex);
+        this_->cancel=1;
+        pthread_mutex_unlock(&this_->mutex);
+        for (i = 0 ; i < this_->thread_count ; i++)
+            pthread_join(this_->threads[i], NULL);
+    }
+    pthread_mutex_destroy(&this_->mutex);
+    pthread_cond_destroy(&this_->cond);
+    for (i = 0 ; i < this_->job_count ; i++) {
+        if (this_->jobs[i].tile)
+            route_cache_tile_unref(this_->jobs[i].tile);
+        else
+            g_free(this_->jobs[i].buffer);
+    }
+    g_free(this_->jobs);
+    g_free(this_->parts);
+    g_free(this_->threads);
+    while (this_->seen) {
+        g_hash_table_destroy(this_->seen->data);
+        this_->seen=g_list_delete_link(this_->seen, this_->seen);
+    }
+    g_list_free(this_->maps);
+    if (this_->types)
+        g_hash_table_destroy(this_->types);
+    g_free(this_);
+}
+
+/**
+ * @brief Returns the version of the layout of the buffers stored in a route cache
+ *
+ * The version also changes with the sizes of the data types used, so that buffers saved by one build are not
+ * loaded by an incompatible one.
+ *
+ * @return The version
+ */
+int route_extract_format(void) {
+    return ROUTE_EXTRACT_FORMAT*1000000+sizeof(struct route_extract_record)*100+sizeof(long);
+}
+
+#else
+
+struct route_extract *route_extract_new(struct mapset *ms, struct map_selection *sel, struct vehicleprofile *profile,
+                                        int threads, struct route_cache *cache) {
+    return NULL;
+}
+
+int route_extract_handles_map(struct route_extract *this_, struct map *m) {
+    return 0;
+}
+
+int route_extract_get_item(struct route_extract *this_, int timeout, struct item **item) {
+    return 0;
+}
+
+void route_extract_destroy(struct route_extract *this_) {
+}
+
+int route_extract_format(void) {
+    return 0;
+}
+
+#endif
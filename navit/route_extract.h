@@ -0,0 +1,64 @@
+/**
+ * Navit, a modular navigation system.
+ * Copyright (C) 2005-2019 Navit Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public License
+ * version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+/**
+ * @file route_extract.h
+ *
+ * @brief Parallel extraction of routable items from maps
+ *
+ * A route extract reads the items needed for a route graph from all maps of a mapset which report
+ * `attr_thread_safe`, using a number of worker threads. The items are then handed out to the caller one at a time,
+ * in an order which does not depend on thread scheduling. Maps which are not handled by the extract have to be read
+ * by the caller as before, see `route_extract_handles_map()`.
+ *
+ * The items read can be kept in a route cache (see route_cache.h), so that they need not be read again for the next
+ * route graph covering the same area.
+ *
+ * If Navit is built without thread support, `route_extract_new()` always returns NULL.
+ */
+
+#ifndef NAVIT_ROUTE_EXTRACT_H
+#define NAVIT_ROUTE_EXTRACT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct item;
+struct map;
+struct map_selection;
+struct mapset;
+struct route_cache;
+struct route_extract;
+struct vehicleprofile;
+
+/* prototypes */
+struct route_extract *route_extract_new(struct mapset *ms, struct map_selection *sel, struct vehicleprofile *profile,
+                                        int threads, struct route_cache *cache);
+int route_extract_handles_map(struct route_extract *this_, struct map *m);
+int route_extract_get_item(struct route_extract *this_, int timeout, struct item **item);
+void route_extract_destroy(struct route_extract *this_);
+int route_extract_format(void);
+/* end of prototypes */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,340 @@
+/**
+ * Navit, a modular navigation system.
+ * Copyright (C) 2005-2019 Navit Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public License
+ * version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+/**
+ * @file route_heap.c
+ *
+ * @brief Priority queue for route graph points
+ *
+ * The 4-ary heap stores keys and points in two parallel arrays, so that comparisons during sift operations touch
+ * only the (densely packed) key array. Each point records its own 1-based position in `heap.slot`, which is kept up
+ * to date whenever the point moves. This allows `route_heap_update()` to change a key in either direction by moving
+ * the point up or down from its current position, rather than deleting and reinserting it.
+ *
+ * The Fibonacci heap implementation wraps fib-1.1. Since `fh_replacekey()` cannot increase keys, an update there
+ * still removes the point and inserts it again.
+ */
+
+#include <limits.h>
+#include <glib.h>
+#include "config.h"
+#include "coord.h"
+#include "item.h"
+#include "debug.h"
+#include "fib.h"
+#include "route_heap.h"
+#include "route_protected.h"
+
+/** Number of children per node in the d-ary heap */
+#define ROUTE_HEAP_ARITY 4
+
+/** Initial capacity of the d-ary heap, in elements */
+#define ROUTE_HEAP_INITIAL_SIZE 256
+
+/**
+ * @brief A priority queue for route graph points
+ */
+struct route_heap {
+    enum route_heap_type type;         /**< The implementation used by this heap */
+    struct fibheap *fh;                /**< The Fibonacci heap, if `type` is `route_heap_type_fib` */
+    int *keys;                         /**< Keys of the d-ary heap, in heap order */
+    struct route_graph_point **points; /**< Points of the d-ary heap, parallel to `keys` */
+    int count;                         /**< Number of elements in the d-ary heap */
+    int size;                          /**< Allocated number of elements in `keys` and `points` */
+    int fib_count;                     /**< Number of elements in the Fibonacci heap */
+    struct route_heap_stats stats;     /**< Operation counts, see `route_heap_get_stats()` */
+};
+
+/**
+ * @brief Creates a new, empty route heap
+ *
+ * @param type The implementation to use, `route_heap_type_default` selects the compile-time default
+ *
+ * @return The new heap
+ */
+struct route_heap *route_heap_new(enum route_heap_type type) {
+    struct route_heap *ret = g_new0(struct route_heap, 1);
+
+    if (type == route_heap_type_default)
+#ifdef USE_FIBHEAP
+        type = route_heap_type_fib;
+#else
+        type = route_heap_type_dary;
+#endif
+    ret->type = type;
+    if (type == route_heap_type_fib)
+        ret->fh = fh_makekeyheap();
+    return ret;
+}
+
+/**
+ * @brief Destroys a route heap
+ *
+ * The points still on the heap are not touched; their handles become invalid.
+ *
+ * @param heap The heap
+ */
+void route_heap_destroy(struct route_heap *heap) {
+    if (!heap)
+        return;
+    if (heap->fh)
+        fh_deleteheap(heap->fh);
+    g_free(heap->keys);
+    g_free(heap->points);
+    g_free(heap);
+}
+
+/**
+ * @brief Places a point at a given position of the d-ary heap and records the position in the point.
+ */
+static inline void route_heap_dary_set(struct route_heap *heap, int i, int key, struct route_graph_point *p) {
+    heap->keys[i] = key;
+    heap->points[i] = p;
+    p->heap.slot = i + 1;
+}
+
+/**
+ * @brief Moves the element with the given key up from position `i` until the heap property is restored.
+ */
+static void route_heap_dary_sift_up(struct route_heap *heap, int i, int key, struct route_graph_point *p) {
+    int parent;
+
+    while (i > 0) {
+        parent = (i - 1) / ROUTE_HEAP_ARITY;
+        if (heap->keys[parent] <= key)
+            break;
+        route_heap_dary_set(heap, i, heap->keys[parent], heap->points[parent]);
+        i = parent;
+    }
+    route_heap_dary_set(heap, i, key, p);
+}
+
+/**
+ * @brief Moves the element with the given key down from position `i` until the heap property is restored.
+ */
+static void route_heap_dary_sift_down(struct route_heap *heap, int i, int key, struct route_graph_point *p) {
+    int child, last, min, j;
+
+    for (;;) {
+        child = i * ROUTE_HEAP_ARITY + 1;
+        if (child >= heap->count)
+            break;
+        last = MIN(child + ROUTE_HEAP_ARITY, heap->count);
+        min = child;
+        for (j = child + 1 ; j < last ; j++)
+            if (heap->keys[j] < heap->keys[min])
+                min = j;
+        if (heap->keys[min] >= key)
+            break;
+        route_heap_dary_set(heap, i, heap->keys[min], heap->points[min]);
+        i = min;
+    }
+    route_heap_dary_set(heap, i, key, p);
+}
+
+/**
+ * @brief Removes the element at position `i` from the d-ary heap.
+ */
+static void route_heap_dary_remove_at(struct route_heap *heap, int i) {
+    struct route_graph_point *last;
+    int key;
+
+    heap->points[i]->heap.slot = 0;
+    heap->count--;
+    if (i == heap->count)
+        return;
+    key = heap->keys[heap->count];
+    last = heap->points[heap->count];
+    if (i > 0 && key < heap->keys[(i - 1) / ROUTE_HEAP_ARITY])
+        route_heap_dary_sift_up(heap, i, key, last);
+    else
+        route_heap_dary_sift_down(heap, i, key, last);
+}
+
+/**
+ * @brief Whether a point is currently a member of the heap
+ *
+ * For the d-ary heap, stale handles (e.g. left over from a heap which has since been destroyed) are detected and
+ * reported as non-members.
+ *
+ * @param heap The heap
+ * @param p The point
+ *
+ * @return True if `p` is on `heap`, false if not
+ */
+int route_heap_contains(struct route_heap *heap, struct route_graph_point *p) {
+    if (heap->type == route_heap_type_fib)
+        return p->heap.el != NULL;
+    return (p->heap.slot > 0) && (p->heap.slot <= heap->count) && (heap->points[p->heap.slot - 1] == p);
+}
+
+/**
+ * @brief Inserts a point into the heap, or changes its key if it is already a member.
+ *
+ * The new key may be higher or lower than the current one.
+ *
+ * @param heap The heap
+ * @param p The point
+ * @param key The new key
+ */
+void route_heap_update(struct route_heap *heap, struct route_graph_point *p, int key) {
+    int i;
+
+    if (heap->type == route_heap_type_fib) {
+        if (p->heap.el) {
+            fh_delete(heap->fh, p->heap.el);
+            heap->stats.updates++;
+        } else {
+            heap->stats.inserts++;
+            if (++heap->fib_count > heap->stats.max_size)
+                heap->stats.max_size = heap->fib_count;
+        }
+        p->heap.el = fh_insertkey(heap->fh, key, p);
+        return;
+    }
+    if (route_heap_contains(heap, p)) {
+        heap->stats.updates++;
+        i = p->heap.slot - 1;
+        if (key < heap->keys[i])
+            route_heap_dary_sift_up(heap, i, key, p);
+        else if (key > heap->keys[i])
+            route_heap_dary_sift_down(heap, i, key, p);
+        return;
+    }
+    if (heap->count == heap->size) {
+        heap->size = heap->size ? heap->size * 2 : ROUTE_HEAP_INITIAL_SIZE;
+        heap->keys = g_renew(int, heap->keys, heap->size);
+        heap->points = g_renew(struct route_graph_point *, heap->points, heap->size);
+    }
+    route_heap_dary_sift_up(heap, heap->count++, key, p);
+    heap->stats.inserts++;
+    if (heap->count > heap->stats.max_size)
+        heap->stats.max_size = heap->count;
+}
+
+/**
+ * @brief Removes a point from the heap
+ *
+ * If the point is not a member of the heap, this is a no-op.
+ *
+ * @param heap The heap
+ * @param p The point
+ */
+void route_heap_remove(struct route_heap *heap, struct route_graph_point *p) {
+    if (heap->type == route_heap_type_fib) {
+        if (p->heap.el) {
+            fh_delete(heap->fh, p->heap.el);
+            p->heap.el = NULL;
+            heap->fib_count--;
+            heap->stats.removes++;
+        }
+        return;
+    }
+    if (route_heap_contains(heap, p)) {
+        route_heap_dary_remove_at(heap, p->heap.slot - 1);
+        heap->stats.removes++;
+    }
+}
+
+/**
+ * @brief Returns the point with the lowest key without removing it
+ *
+ * @param heap The heap
+ *
+ * @return The point, or NULL if the heap is empty
+ */
+struct route_graph_point *route_heap_min(struct route_heap *heap) {
+    if (heap->type == route_heap_type_fib)
+        return fh_min(heap->fh);
+    return heap->count ? heap->points[0] : NULL;
+}
+
+/**
+ * @brief Returns the lowest key on the heap
+ *
+ * @param heap The heap
+ *
+ * @return The key, or `INT_MAX` if the heap is empty
+ */
+int route_heap_min_key(struct route_heap *heap) {
+    if (heap->type == route_heap_type_fib)
+        return heap->fib_count ? fh_minkey(heap->fh) : INT_MAX;
+    return heap->count ? heap->keys[0] : INT_MAX;
+}
+
+/**
+ * @brief Removes the point with the lowest key from the heap and returns it
+ *
+ * @param heap The heap
+ *
+ * @return The point, or NULL if the heap is empty
+ */
+struct route_graph_point *route_heap_extract_min(struct route_heap *heap) {
+    struct route_graph_point *ret;
+
+    if (heap->type == route_heap_type_fib) {
+        ret = fh_extractmin(heap->fh);
+        if (ret) {
+            ret->heap.el = NULL;
+            heap->fib_count--;
+            heap->stats.extracts++;
+        }
+        return ret;
+    }
+    if (!heap->count)
+        return NULL;
+    ret = heap->points[0];
+    route_heap_dary_remove_at(heap, 0);
+    heap->stats.extracts++;
+    return ret;
+}
+
+/**
+ * @brief Removes all points from the heap
+ *
+ * The heap handles of all points which were on the heap are reset.
+ *
+ * @param heap The heap
+ */
+void route_heap_clear(struct route_heap *heap) {
+    struct route_graph_point *p;
+    int i;
+
+    if (heap->type == route_heap_type_fib) {
+        while ((p = fh_extractmin(heap->fh)))
+            p->heap.el = NULL;
+        heap->fib_count = 0;
+        return;
+    }
+    for (i = 0 ; i < heap->count ; i++)
+        heap->points[i]->heap.slot = 0;
+    heap->count = 0;
+}
+
+/**
+ * @brief Returns the operation counts of a heap
+ *
+ * Clearing the heap is not counted as removing its points.
+ *
+ * @param heap The heap
+ * @param stats Receives the counts
+ */
+void route_heap_get_stats(struct route_heap *heap, struct route_heap_stats *stats) {
+    *stats = heap->stats;
+}
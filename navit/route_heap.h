@@ -0,0 +1,97 @@
+/**
+ * Navit, a modular navigation system.
+ * Copyright (C) 2005-2019 Navit Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public License
+ * version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+/**
+ * @file route_heap.h
+ *
+ * @brief Priority queue for route graph points
+ *
+ * The route heap holds the points of a route graph which are still to be expanded, ordered by their key (usually
+ * the lower of `value` and `rhs`). Two implementations are available:
+ *
+ * \li `route_heap_type_dary`, an array-backed 4-ary heap. The heap position of each point is kept in the point
+ * itself (`route_graph_point->heap.slot`), which allows keys to be increased or decreased in place without
+ * allocating memory for each element. This is the default.
+ * \li `route_heap_type_fib`, the Fibonacci heap from fib-1.1. This is kept as a fallback and can be made the default
+ * by building with `USE_FIBHEAP`.
+ *
+ * A point can be a member of only one heap at a time.
+ */
+
+#ifndef NAVIT_ROUTE_HEAP_H
+#define NAVIT_ROUTE_HEAP_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct route_graph_point;
+struct route_heap;
+
+/**
+ * @brief Implementations of the route heap
+ */
+enum route_heap_type {
+    route_heap_type_default,   /**< The compile-time default */
+    route_heap_type_dary,      /**< Array-backed 4-ary heap with in-place key updates */
+    route_heap_type_fib,       /**< Fibonacci heap (fib-1.1) */
+};
+
+/**
+ * @brief Position of a route graph point in a route heap
+ *
+ * Which member is used depends on the type of heap the point is in. Setting `el` to `NULL` clears either member.
+ */
+union route_heap_handle {
+    struct fibheap_el *el;     /**< Element of a Fibonacci heap, `NULL` if not on the heap */
+    int slot;                  /**< 1-based position in a 4-ary heap, 0 if not on the heap */
+};
+
+/**
+ * @brief Operation counts of a route heap
+ *
+ * The counts cover all operations since the heap was created. They are meant for profiling, e.g. to compare
+ * heuristics or heap implementations.
+ */
+struct route_heap_stats {
+    int inserts;               /**< Points added to the heap */
+    int updates;               /**< Key changes of points already on the heap */
+    int removes;               /**< Points removed from the heap other than by extracting the minimum */
+    int extracts;              /**< Points taken off the heap by `route_heap_extract_min()` */
+    int max_size;              /**< Highest number of points on the heap at the same time */
+};
+
+/* prototypes */
+struct route_heap *route_heap_new(enum route_heap_type type);
+void route_heap_destroy(struct route_heap *heap);
+int route_heap_contains(struct route_heap *heap, struct route_graph_point *p);
+void route_heap_update(struct route_heap *heap, struct route_graph_point *p, int key);
+void route_heap_remove(struct route_heap *heap, struct route_graph_point *p);
+struct route_graph_point *route_heap_min(struct route_heap *heap);
+int route_heap_min_key(struct route_heap *heap);
+struct route_graph_point *route_heap_extract_min(struct route_heap *heap);
+void route_heap_clear(struct route_heap *heap);
+void route_heap_get_stats(struct route_heap *heap, struct route_heap_stats *stats);
+/* end of prototypes */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
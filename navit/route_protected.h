@@ -30,10 +30,16 @@
 #ifndef NAVIT_ROUTE_PROTECTED_H
 #define NAVIT_ROUTE_PROTECTED_H
 
+#include <stddef.h>
+#include "route_heap.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+struct route_cache;
+struct route_info;
+struct vehicleprofile;
 
 #define RP_TRAFFIC_DISTORTION 1
 #define RP_TURN_RESTRICTION 2
@@ -41,22 +47,38 @@ extern "C" {
 
 #define RSD_MAXSPEED(x) *((int *)route_segment_data_field_pos((x), attr_maxspeed))
 
+/**
+ * @brief The links of a route graph point which are not part of the compacted graph
+ *
+ * Points which are allocated individually, i.e. while the graph is being built or after it has been compacted, are
+ * linked into the hash table of the graph and hold lists of the segments connected to them. Points in the compacted
+ * point array of the graph only get links if segments are added to them after the graph has been compacted; all
+ * other segments are found through the CSR index of the graph.
+ */
+struct route_graph_point_links {
+	struct route_graph_point *hash_next; /**< Pointer to a chained hashlist of all route_graph_points with this hash,
+	                                      *  unused for points in the compacted point array */
+	struct route_graph_segment *start;   /**< Pointer to a list of segments of which this point is the start. The links
+	                                      *  of this linked-list are in route_graph_segment_links->start_next.*/
+	struct route_graph_segment *end;     /**< Pointer to a list of segments of which this pointer is the end. The links
+	                                      *  of this linked-list are in route_graph_segment_links->end_next. */
+};
+
 /**
  * @brief A point in the route graph
  *
  * This represents a point in the route graph. A point usually connects two or more segments,
  * but there are also points which don't do that (e.g. at the end of a dead-end).
+ *
+ * Use `rp_iterator_new()` to get the segments connected to a point.
  */
 struct route_graph_point {
-	struct route_graph_point *hash_next; /**< Pointer to a chained hashlist of all route_graph_points with this hash */
-	struct route_graph_segment *start;   /**< Pointer to a list of segments of which this point is the start. The links
-	                                      *  of this linked-list are in route_graph_segment->start_next.*/
-	struct route_graph_segment *end;     /**< Pointer to a list of segments of which this pointer is the end. The links
-	                                      *  of this linked-list are in route_graph_segment->end_next. */
+	struct route_graph_point_links *links; /**< Links of this point, NULL for points in the compacted point array of
+	                                      *  the graph which have not had segments added since */
 	struct route_graph_segment *seg;     /**< Pointer to the segment one should use to reach the destination at
 	                                      *  least costs */
-	struct fibheap_el *el;				 /**< When this point is put on a Fibonacci heap, this is a pointer
-	                                      *  to this point's heap element */
+	union route_heap_handle heap;        /**< When this point is put on a route heap, this is its position on the
+	                                      *  heap */
 	int value;                           /**< The cost at which one can reach the destination from this point on.
 	                                      *  {@code INT_MAX} indicates that the destination is unreachable from this
 	                                      *  point, or that this point has not yet been examined. */
@@ -117,22 +139,65 @@ struct route_graph_segment_data {
 	                                       *   segments over others */
 };
 
+/**
+ * @brief The links of a route graph segment which has been allocated individually
+ *
+ * Segments which are allocated individually, i.e. while the graph is being built or after it has been compacted, are
+ * stored right after their links. Segments in the segment pool of a compacted graph have no links.
+ */
+struct route_graph_segment_links {
+	struct route_graph_segment *next;		/**< Linked-list pointer to a list of all individually allocated
+	                                         *  route_graph_segments */
+	struct route_graph_segment *start_next;	/**< Pointer to the next element in the list of segments that start at the
+	                                         *  same point. Start of this list is in route_graph_point_links->start. */
+	struct route_graph_segment *end_next;	/**< Pointer to the next element in the list of segments that end at the
+	                                         *  same point. Start of this list is in route_graph_point_links->end. */
+};
+
 /**
  * @brief A segment in the route graph
  *
  * This is a segment in the route graph. A segment represents a driveable way.
  */
 struct route_graph_segment {
-	struct route_graph_segment *next;		/**< Linked-list pointer to a list of all route_graph_segments */
-	struct route_graph_segment *start_next;	/**< Pointer to the next element in the list of segments that start at the
-	                                         *  same point. Start of this list is in route_graph_point->start. */
-	struct route_graph_segment *end_next;	/**< Pointer to the next element in the list of segments that end at the
-	                                         *  same point. Start of this list is in route_graph_point->end. */
 	struct route_graph_point *start;		/**< Pointer to the point this segment starts at. */
 	struct route_graph_point *end;			/**< Pointer to the point this segment ends at. */
 	struct route_segment_data data;			/**< The segment data */
 };
 
+/**
+ * @brief An individually allocated route graph segment, preceded by its links
+ *
+ * The fields appended to the segment data follow, see `route_graph_segment_size()`.
+ */
+struct route_graph_segment_node {
+	struct route_graph_segment_links links;
+	struct route_graph_segment s;
+};
+
+/** Maximum number of points through which the start of a route can be reached in the route graph */
+#define ROUTE_GRAPH_FOCUS_MAX 8
+
+/**
+ * @brief The start of a route, towards which the search in the route graph is directed
+ *
+ * If the vehicle profile enables `route_heuristic`, the key of each point on the heap is its cost plus a lower bound
+ * for the cost of getting from the start to that point. Flooding then stops as soon as the cost of the start is
+ * final, see `route_graph_is_path_computed()`.
+ */
+struct route_graph_focus {
+	int count;                                  /**< Number of entries in `points`, 0 if the heuristic is not used */
+	struct coord c;                             /**< The start, projected onto its street */
+	double factor;                              /**< Converts a distance in map units into a lower bound for the cost
+	                                             *   of traveling it */
+	struct route_graph_point *points[ROUTE_GRAPH_FOCUS_MAX]; /**< Points at either end of the start's street */
+	int cost[ROUTE_GRAPH_FOCUS_MAX];            /**< Cost of getting from the start to the point in `points` */
+	double scale;                               /**< Largest projection scale found in the graph, 0 if not yet known */
+	int maxspeed;                               /**< Highest `maxspeed` of any segment in the graph */
+	int km;                                     /**< Lower bounds for the cost between each focus and the next,
+	                                             *   summed up and added to all keys, see `route_graph_set_focus()` */
+};
+
 /**
  * @brief A complete route graph
  *
@@ -144,20 +209,150 @@ struct route_graph {
 	                                             *   flooded or the path is being built (a more detailed status can be
 	                                             *   obtained from the route’s status attribute) */
 	struct map_selection *sel;                  /**< The rectangle selection for the graph */
+	int class_limit;                            /**< Highest minimum road class of the rectangles in `sel`; streets
+	                                             *   of a lower class are only used where `sel` allows them */
+	int corridor;                               /**< The graph only covers the corridor along a path found in the
+	                                             *   contraction hierarchy, see `route_engine_ch` */
 	struct mapset_handle *h;                    /**< Handle to the mapset */
 	struct map *m;                              /**< Pointer to the currently active map */
 	struct map_rect *mr;                        /**< Pointer to the currently active map rectangle */
+	struct route_extract *extract;              /**< Reads thread-safe maps in parallel, NULL if not used */
 	struct vehicleprofile *vehicleprofile;      /**< The vehicle profile */
 	struct callback *idle_cb;                   /**< Idle callback to process the graph */
 	struct callback *done_cb;                   /**< Callback when graph is done */
 	struct event_idle *idle_ev;                 /**< The pointer to the idle event */
-	struct route_graph_segment *route_segments; /**< Pointer to the first route_graph_segment in the linked list of all segments */
+	struct route_graph_segment *route_segments; /**< Pointer to the first route_graph_segment in the linked list of all
+	                                             *   individually allocated segments */
 	struct route_graph_segment *avoid_seg;      /**< Segment to which a turnaround penalty (if active) applies */
-	struct fibheap *heap;                       /**< Priority queue for points to be expanded */
+	struct route_heap *heap;                    /**< Priority queue for points to be expanded */
+	struct route_graph_focus focus;             /**< The start of the route, for the heuristic */
+	int expanded;                               /**< Number of points taken off the heap since the graph was built */
 #define HASH_SIZE 8192
-	struct route_graph_point *hash[HASH_SIZE];  /**< A hashtable containing all route_graph_points in this graph */
+	struct route_graph_point **hash;            /**< A hashtable of `HASH_SIZE` buckets containing all individually
+	                                             *   allocated route_graph_points in this graph, NULL if there are
+	                                             *   none */
+	struct route_graph_point *points;           /**< Contiguous storage for all points present when the graph was
+	                                             *   compacted, sorted by `route_graph_point_order_key()`, NULL if
+	                                             *   the graph has not been compacted */
+	int num_points;                             /**< Number of points in `points` */
+	char *segment_pool;                         /**< Contiguous storage for all segments present when the graph was
+	                                             *   compacted, each starting at a multiple of 8 bytes */
+	int segment_pool_size;                      /**< Size of `segment_pool` in bytes */
+	int *adj_index;                             /**< CSR index into `adj`, 2 * `num_points` + 1 entries. For the point
+	                                             *   at index i in `points`, the segments starting at this point are
+	                                             *   stored from `adj_index[2*i]`, the segments ending at it from
+	                                             *   `adj_index[2*i+1]` up to (but excluding) `adj_index[2*i+2]`. */
+	int *adj;                                   /**< CSR adjacency array holding the offset of each segment in
+	                                             *   `segment_pool`, see `adj_index` */
+};
+
+/**
+ * @brief Iterator to iterate through all route graph segments in a route graph point
+ *
+ * This structure can be used to iterate through all route graph segments connected to a
+ * route graph point. Use this with the rp_iterator_* functions.
+ *
+ * For each end of the segments, the segments in the lists of the point's links are returned first, followed by
+ * those in the CSR index if the point is stored in the compacted point array of the graph.
+ */
+struct route_graph_point_iterator {
+	struct route_graph_point *p;		/**< The route graph point whose segments should be iterated */
+	int end;							/**< Indicates if we have finished iterating through the "start" segments */
+	struct route_graph_segment *next;	/**< The next segment to be returned from the lists of the point's links */
+	char *pool;							/**< The segment pool of the graph */
+	int *adj;							/**< CSR adjacency list of `p`, NULL if `p` is not in the CSR index */
+	int pos;							/**< Position of the next segment in `adj` */
+	int end_pos;						/**< Position of the first segment in `adj` which ends at `p` */
+	int count;							/**< Number of segments in `adj` */
 };
 
+/**
+ * @brief Returns the index of a point in the compacted point array of the graph
+ *
+ * @param graph The route graph
+ * @param p The point
+ * @return The index of `p` in `graph->points`, or -1 if `p` has been allocated individually
+ */
+static inline int route_graph_point_index(struct route_graph *graph, struct route_graph_point *p) {
+	if (p < graph->points || p >= graph->points + graph->num_points)
+		return -1;
+	return p - graph->points;
+}
+
+/**
+ * @brief Returns the links of an individually allocated segment
+ */
+static inline struct route_graph_segment_links *route_graph_segment_links(struct route_graph_segment *s) {
+	return &((struct route_graph_segment_node *)((char *)s - offsetof(struct route_graph_segment_node, s)))->links;
+}
+
+/**
+ * @brief Creates a new graph point iterator
+ *
+ * This function creates a new route graph point iterator, that can be used to
+ * iterate through all segments connected to the point.
+ *
+ * Segments of which `p` is the start are returned first, followed by the segments of which `p` is the end.
+ *
+ * @param graph The route graph containing `p`
+ * @param p The route graph point to create the iterator from
+ * @return A new iterator.
+ */
+static inline struct route_graph_point_iterator rp_iterator_new(struct route_graph *graph, struct route_graph_point *p) {
+	struct route_graph_point_iterator it;
+	int i = route_graph_point_index(graph, p);
+
+	it.p = p;
+	it.end = 0;
+	it.next = p->links ? p->links->start : NULL;
+	it.pool = graph->segment_pool;
+	it.adj = NULL;
+	it.pos = 0;
+	it.end_pos = 0;
+	it.count = 0;
+	if (i >= 0) {
+		it.adj = graph->adj + graph->adj_index[2 * i];
+		it.end_pos = graph->adj_index[2 * i + 1] - graph->adj_index[2 * i];
+		it.count = graph->adj_index[2 * i + 2] - graph->adj_index[2 * i];
+	}
+
+	return it;
+}
+
+/**
+ * @brief Gets the next segment connected to a route graph point from an iterator
+ *
+ * @param it The route graph point iterator to get the segment from
+ * @return The next segment or NULL if there are no more segments
+ */
+static inline struct route_graph_segment *rp_iterator_next(struct route_graph_point_iterator *it) {
+	struct route_graph_segment *ret;
+
+	for (;;) {
+		ret = it->next;
+		if (ret) {
+			it->next = it->end ? route_graph_segment_links(ret)->end_next : route_graph_segment_links(ret)->start_next;
+			return ret;
+		}
+		if (it->pos < (it->end ? it->count : it->end_pos))
+			return (struct route_graph_segment *)(it->pool + it->adj[it->pos++]);
+		if (it->end)
+			return NULL;
+		it->end = 1;
+		it->next = it->p->links ? it->p->links->end : NULL;
+	}
+}
+
+/**
+ * @brief Checks if the last segment returned from a route_graph_point_iterator comes from the end
+ *
+ * @param it The route graph point iterator to be checked
+ * @return 1 if the last segment returned comes from the end of the route graph point, 0 otherwise
+ */
+static inline int rp_iterator_end(struct route_graph_point_iterator *it) {
+	return it->end;
+}
+
 
 /* prototypes */
 struct route_graph * route_get_graph(struct route *this_);
@@ -169,16 +364,31 @@ void route_change_traffic_distortion(struct route *this_, struct item *item);
 struct route_graph_point * route_graph_add_point(struct route_graph *this, struct coord *f);
 void route_graph_add_turn_restriction(struct route_graph *this, struct item *item);
 void route_graph_free_points(struct route_graph *this);
+struct route_graph_point *route_graph_next_point(struct route_graph *this, struct route_graph_point *last);
+struct route_graph_segment *route_graph_next_segment(struct route_graph *this, struct route_graph_segment *last);
 struct route_graph_point *route_graph_get_point(struct route_graph *this, struct coord *c);
 struct route_graph_point *route_graph_get_point_next(struct route_graph *this, struct coord *c,
         struct route_graph_point *last);
 void route_graph_add_segment(struct route_graph *this, struct route_graph_point *start,
 		struct route_graph_point *end, struct route_graph_segment_data *data);
-int route_graph_segment_is_duplicate(struct route_graph_point *start, struct route_graph_segment_data *data);
+int route_graph_segment_is_duplicate(struct route_graph *this, struct route_graph_point *start,
+                                     struct route_graph_segment_data *data);
 void route_graph_free_segments(struct route_graph *this);
 void route_graph_build_done(struct route_graph *rg, int cancel);
 void route_recalculate_partial(struct route *this_);
 void * route_segment_data_field_pos(struct route_segment_data *seg, enum attr_type type);
+struct map_selection *route_calc_selection(struct coord *c, int count, struct vehicleprofile *profile, int local);
+struct route_graph *route_graph_build(struct mapset *ms, struct map_selection *sel, int corridor,
+                                      struct callback *done_cb, int async, struct vehicleprofile *profile, int threads,
+                                      struct route_cache *cache);
+void route_graph_build_idle(struct route_graph *rg, struct vehicleprofile *profile);
+void route_graph_set_focus(struct route_graph *graph, struct vehicleprofile *profile, struct route_info *pos);
+void route_graph_init(struct route_graph *this, struct route_info *dst, struct vehicleprofile *profile);
+void route_graph_compute_shortest_path(struct route_graph * graph, struct vehicleprofile * profile,
+                                       struct callback *cb);
+void route_graph_destroy(struct route_graph *this);
+struct route_info *route_find_nearest_street(struct vehicleprofile *vehicleprofile, struct mapset *ms,
+        struct pcoord *pc);
 /* end of prototypes */
 #ifdef __cplusplus
 }
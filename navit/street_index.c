@@ -0,0 +1,324 @@
+/**
+ * Navit, a modular navigation system.
+ * Copyright (C) 2005-2019 Navit Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public License
+ * version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+/**
+ * @file street_index.c
+ *
+ * @brief In-memory index of the streets of a mapset
+ *
+ * The plane of each map is divided into a uniform grid of square tiles. A tile is loaded the first time a query
+ * touches it: a map rect is opened for the tile, and the street data of every street whose bounding box overlaps the
+ * tile is stored along with that bounding box. Streets crossing tile borders are stored only once and shared by all
+ * the tiles they overlap.
+ *
+ * A query returns the streets of the tiles it touches whose bounding box overlaps the requested rectangle. Only a
+ * limited number of tiles is kept; when more are loaded, the ones which have not been used for the longest time are
+ * dropped.
+ *
+ * Only maps which report `attr_thread_safe` are kept in tiles, since they do not change while they are open. Other
+ * maps, such as the traffic map or the route map, are read anew for every query, into a tile covering just the
+ * requested rectangle which is dropped with the next query.
+ */
+
+#include <glib.h>
+#include <string.h>
+#include "coord.h"
+#include "item.h"
+#include "attr.h"
+#include "map.h"
+#include "route.h"
+#include "debug.h"
+#include "street_index.h"
+
+/** Size of a tile, as a power of two in map units */
+#define STREET_INDEX_TILE_SHIFT 12
+
+/** Number of tiles kept in memory */
+#define STREET_INDEX_TILES 32
+
+/**
+ * @brief A street stored in the index
+ */
+struct street_index_entry {
+    struct street_data *street;      /**< The street data */
+    struct coord_rect r;             /**< Bounding box of the street */
+    int refcount;                    /**< Number of tiles referencing this entry */
+    int stamp;                       /**< Query which last returned this entry, to return it only once */
+    int load;                        /**< Tile load which last referenced this entry, to reference it only once */
+};
+
+/**
+ * @brief A tile of the index
+ */
+struct street_index_tile {
+    struct map *map;                 /**< The map the tile belongs to */
+    int x,y;                         /**< Position of the tile in the grid */
+    int count;                       /**< Number of streets overlapping the tile */
+    struct street_index_entry **entries;
+    int used;                        /**< Query which last used this tile */
+};
+
+struct street_index {
+    GHashTable *tiles;               /**< All tiles, the key is the tile itself */
+    GHashTable *entries;             /**< All entries, keyed by the item of their street */
+    int stamp;                       /**< Number of queries so far */
+    int loads;                       /**< Number of tiles loaded so far */
+    struct street_data **result;     /**< Buffer for the result of the last query */
+    int result_size;
+    struct street_index_tile *uncached; /**< Tile read for the last query on a map which is not kept in tiles */
+};
+
+static guint street_index_tile_hash(gconstpointer key) {
+    const struct street_index_tile *tile=key;
+    return GPOINTER_TO_UINT(tile->map) ^ (tile->x * 31) ^ (tile->y * 65599);
+}
+
+static gboolean street_index_tile_equal(gconstpointer a, gconstpointer b) {
+    const struct street_index_tile *ta=a,*tb=b;
+    return ta->map == tb->map && ta->x == tb->x && ta->y == tb->y;
+}
+
+static guint street_index_item_hash(gconstpointer key) {
+    const struct item *item=key;
+    return GPOINTER_TO_UINT(item->map) ^ item->id_hi ^ (item->id_lo * 31);
+}
+
+static gboolean street_index_item_equal(gconstpointer a, gconstpointer b) {
+    const struct item *ia=a,*ib=b;
+    return ia->map == ib->map && ia->id_hi == ib->id_hi && ia->id_lo == ib->id_lo;
+}
+
+/**
+ * @brief Creates a new, empty street index
+ *
+ * @return The new street index
+ */
+struct street_index *street_index_new(void) {
+    struct street_index *this_=g_new0(struct street_index, 1);
+    this_->tiles=g_hash_table_new(street_index_tile_hash, street_index_tile_equal);
+    this_->entries=g_hash_table_new(street_index_item_hash, street_index_item_equal);
+    return this_;
+}
+
+static void street_index_tile_load(struct street_index *this_, struct street_index_tile *tile, struct coord_rect *r) {
+    struct map_selection sel;
+    struct map_rect *mr;
+    struct item *item;
+    struct street_data *sd;
+    struct street_index_entry *entry;
+    int i,allocated=0;
+
+    this_->loads++;
+    memset(&sel, 0, sizeof(sel));
+    sel.order=18;
+    sel.range.min=route_item_first;
+    sel.range.max=route_item_last;
+    sel.u.c_rect=*r;
+    mr=map_rect_new(tile->map, &sel);
+    if (!mr)
+        return;
+    while ((item=map_rect_get_item(mr))) {
+        if (!item_get_default_flags(item->type))
+            continue;
+        entry=g_hash_table_lookup(this_->entries, item);
+        if (!entry) {
+            sd=street_get_data(item);
+            if (!sd)
+                continue;
+            entry=g_new(struct street_index_entry, 1);
+            entry->street=sd;
+            entry->r.lu=sd->c[0];
+            entry->r.rl=sd->c[0];
+            for (i = 1 ; i < sd->count ; i++)
+                coord_rect_extend(&entry->r, &sd->c[i]);
+            entry->refcount=0;
+            entry->stamp=0;
+            entry->load=0;
+            if (!coord_rect_overlap(&entry->r, &sel.u.c_rect)) {
+                street_data_free(sd);
+                g_free(entry);
+                continue;
+            }
+            g_hash_table_insert(this_->entries, &sd->item, entry);
+        } else if (entry->load == this_->loads || !coord_rect_overlap(&entry->r, &sel.u.c_rect)) {
+            /* A map may return an item twice for the same selection */
+            continue;
+        }
+        entry->load=this_->loads;
+        if (tile->count == allocated) {
+            allocated=allocated ? allocated*2 : 64;
+            tile->entries=g_renew(struct street_index_entry *, tile->entries, allocated);
+        }
+        entry->refcount++;
+        tile->entries[tile->count++]=entry;
+    }
+    map_rect_destroy(mr);
+    dbg(lvl_debug,"tile %d,%d of map %p: %d streets", tile->x, tile->y, tile->map, tile->count);
+}
+
+static void street_index_tile_free(struct street_index *this_, struct street_index_tile *tile) {
+    struct street_index_entry *entry;
+    int i;
+
+    for (i = 0 ; i < tile->count ; i++) {
+        entry=tile->entries[i];
+        if (--entry->refcount)
+            continue;
+        g_hash_table_remove(this_->entries, &entry->street->item);
+        street_data_free(entry->street);
+        g_free(entry);
+    }
+    g_free(tile->entries);
+    g_free(tile);
+}
+
+static void street_index_find_oldest(gpointer key, gpointer value, gpointer user_data) {
+    struct street_index_tile *tile=value,**oldest=user_data;
+    if (!*oldest || tile->used < (*oldest)->used)
+        *oldest=tile;
+}
+
+/**
+ * @brief Drops the least recently used tiles until no more than `STREET_INDEX_TILES` remain
+ *
+ * Tiles used by the current query are never dropped, as the result of the query points to their streets.
+ */
+static void street_index_expire(struct street_index *this_) {
+    struct street_index_tile *oldest;
+
+    while (g_hash_table_size(this_->tiles) > STREET_INDEX_TILES) {
+        oldest=NULL;
+        g_hash_table_foreach(this_->tiles, street_index_find_oldest, &oldest);
+        if (oldest->used == this_->stamp)
+            break;
+        g_hash_table_remove(this_->tiles, oldest);
+        street_index_tile_free(this_, oldest);
+    }
+}
+
+static void street_index_result_add(struct street_index *this_, struct street_index_tile *tile, struct coord_rect *r,
+                                    int *count) {
+    struct street_index_entry *entry;
+    int i;
+
+    for (i = 0 ; i < tile->count ; i++) {
+        entry=tile->entries[i];
+        if (entry->stamp == this_->stamp || !coord_rect_overlap(&entry->r, r))
+            continue;
+        entry->stamp=this_->stamp;
+        if (*count == this_->result_size) {
+            this_->result_size=this_->result_size ? this_->result_size*2 : 256;
+            this_->result=g_renew(struct street_data *, this_->result, this_->result_size);
+        }
+        this_->result[(*count)++]=entry->street;
+    }
+}
+
+/**
+ * @brief Returns the streets of a map near an area
+ *
+ * Tiles of the index which are not loaded yet are read from the map. Each street is returned only once, regardless
+ * of how many tiles it overlaps. The order of the result only depends on the map data and the rectangle, not on which
+ * tiles were already loaded. Maps which do not report `attr_thread_safe` are read for every call.
+ *
+ * @param this_ The street index
+ * @param m The map
+ * @param r The area, in the projection of `m`
+ * @param count Receives the number of streets returned
+ * @return The streets whose bounding box overlaps `r`. The street data is owned by the index and only valid until the
+ * next call to any of the street index functions, so callers wishing to keep it must use `street_data_dup()`.
+ */
+struct street_data **street_index_get(struct street_index *this_, struct map *m, struct coord_rect *r, int *count) {
+    struct street_index_tile key,*tile;
+    struct coord_rect tr;
+    struct attr attr;
+    int x,y,x1,x2,y1,y2;
+
+    *count=0;
+    this_->stamp++;
+    if (this_->uncached) {
+        street_index_tile_free(this_, this_->uncached);
+        this_->uncached=NULL;
+    }
+    if (!map_get_attr(m, attr_thread_safe, &attr, NULL) || !attr.u.num) {
+        this_->uncached=g_new0(struct street_index_tile, 1);
+        this_->uncached->map=m;
+        street_index_tile_load(this_, this_->uncached, r);
+        street_index_result_add(this_, this_->uncached, r, count);
+        return this_->result;
+    }
+    x1=r->lu.x >> STREET_INDEX_TILE_SHIFT;
+    x2=r->rl.x >> STREET_INDEX_TILE_SHIFT;
+    y1=r->rl.y >> STREET_INDEX_TILE_SHIFT;
+    y2=r->lu.y >> STREET_INDEX_TILE_SHIFT;
+    key.map=m;
+    for (y = y2 ; y >= y1 ; y--) {
+        for (x = x1 ; x <= x2 ; x++) {
+            key.x=x;
+            key.y=y;
+            tile=g_hash_table_lookup(this_->tiles, &key);
+            if (!tile) {
+                tile=g_new0(struct street_index_tile, 1);
+                tile->map=m;
+                tile->x=x;
+                tile->y=y;
+                coord_rect_from_grid(&tr, tile->x, tile->y, STREET_INDEX_TILE_SHIFT);
+                street_index_tile_load(this_, tile, &tr);
+                g_hash_table_insert(this_->tiles, tile, tile);
+            }
+            tile->used=this_->stamp;
+            street_index_result_add(this_, tile, r, count);
+        }
+    }
+    street_index_expire(this_);
+    return this_->result;
+}
+
+static gboolean street_index_flush_tile(gpointer key, gpointer value, gpointer user_data) {
+    street_index_tile_free(user_data, value);
+    return TRUE;
+}
+
+/**
+ * @brief Drops all streets from the index
+ *
+ * This has to be called whenever the maps the index was used with change.
+ *
+ * @param this_ The street index
+ */
+void street_index_flush(struct street_index *this_) {
+    g_hash_table_foreach_remove(this_->tiles, street_index_flush_tile, this_);
+    if (this_->uncached) {
+        street_index_tile_free(this_, this_->uncached);
+        this_->uncached=NULL;
+    }
+}
+
+/**
+ * @brief Destroys a street index
+ *
+ * @param this_ The street index
+ */
+void street_index_destroy(struct street_index *this_) {
+    street_index_flush(this_);
+    g_hash_table_destroy(this_->tiles);
+    g_hash_table_destroy(this_->entries);
+    g_free(this_->result);
+    g_free(this_);
+}
@@ -0,0 +1,55 @@
+/**
+ * Navit, a modular navigation system.
+ * Copyright (C) 2005-2019 Navit Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public License
+ * version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+/**
+ * @file street_index.h
+ *
+ * @brief In-memory index of the streets of a mapset
+ *
+ * The street index keeps the street data (see `street_get_data()`) of the streets around the places recently asked
+ * for, so that looking up the streets near a position does not need to read and decode the map again. It is shared
+ * by everything which works on the same mapset, see `mapset_get_street_index()`.
+ *
+ * The index must only be used from the main thread.
+ */
+
+#ifndef NAVIT_STREET_INDEX_H
+#define NAVIT_STREET_INDEX_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct coord_rect;
+struct map;
+struct street_data;
+struct street_index;
+
+/* prototypes */
+struct street_index *street_index_new(void);
+struct street_data **street_index_get(struct street_index *this_, struct map *m, struct coord_rect *r, int *count);
+void street_index_flush(struct street_index *this_);
+void street_index_destroy(struct street_index *this_);
+/* end of prototypes */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
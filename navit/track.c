@@ -39,6 +39,7 @@
 #include "util.h"
 #include "config.h"
 #include "callback.h"
+#include "street_index.h"
 
 struct object_func tracking_func;
 
@@ -48,6 +49,18 @@ struct tracking_line {
     int angle[0];
 };
 
+/**
+ * @brief A segment of a tracking line, between two consecutive coordinates of its street
+ */
+struct tracking_segment {
+    struct tracking_line *line;
+    int pos;                                 /**< Index of the first coordinate of the segment */
+    int stamp;                               /**< Position update which last scored this segment */
+};
+
+/** Maximum number of cells of the segment grid in each direction */
+#define TRACKING_GRID_SIZE 64
+
 
 /**
  * @brief Conatins a list of previous speeds
@@ -92,6 +105,14 @@ struct tracking {
     struct coord last_updated;
     struct tracking_line *lines;
     struct tracking_line *curr_line;
+    struct tracking_segment *segments;       /**< All segments of lines, in the order in which they are scored */
+    int segment_count;
+    int segment_stamp;
+    struct coord_rect grid_rect;             /**< Area covered by the segment grid */
+    int grid_shift;                          /**< Size of a grid cell, as a power of two */
+    int grid_width, grid_height;             /**< Number of grid cells */
+    int *grid_start;                         /**< For each cell, index of its first segment in grid_segments */
+    int *grid_segments;                      /**< Indexes of the segments overlapping each cell */
     int pos;
     struct coord curr[2], curr_in, curr_out;
     int curr_angle;
@@ -409,50 +430,109 @@ static void tracking_get_angles(struct tracking_line *tl) {
         tl->angle[i]=transform_get_angle_delta(&sd->c[i], &sd->c[i+1], 0);
 }
 
-static int street_data_within_selection(struct street_data *sd, struct map_selection *sel) {
+/**
+ * @brief Sorts the segments of the tracking lines into a grid
+ *
+ * The grid allows `tracking_find_segment()` to score only the segments near the current position. Each segment is
+ * added to all cells its bounding box overlaps.
+ *
+ * @param tr The tracking object
+ */
+static void tracking_grid_build(struct tracking *tr) {
+    struct tracking_line *tl;
+    struct tracking_segment *seg;
     struct coord_rect r;
-    struct map_selection *curr;
-    int i;
+    int i,j,x,y,x1,x2,y1,y2,pass,cells,*next=NULL;
 
-    if (!sel)
-        return 1;
-    r.lu=sd->c[0];
-    r.rl=sd->c[0];
-    for (i = 1 ; i < sd->count ; i++) {
-        if (r.lu.x > sd->c[i].x)
-            r.lu.x=sd->c[i].x;
-        if (r.rl.x < sd->c[i].x)
-            r.rl.x=sd->c[i].x;
-        if (r.rl.y > sd->c[i].y)
-            r.rl.y=sd->c[i].y;
-        if (r.lu.y < sd->c[i].y)
-            r.lu.y=sd->c[i].y;
+    tr->segment_count=0;
+    for (tl = tr->lines ; tl ; tl=tl->next)
+        if (tl->street->count > 1)
+            tr->segment_count+=tl->street->count-1;
+    if (!tr->segment_count)
+        return;
+    tr->segments=g_new(struct tracking_segment, tr->segment_count);
+    seg=tr->segments;
+    for (tl = tr->lines ; tl ; tl=tl->next) {
+        for (i = 0 ; i < tl->street->count-1 ; i++) {
+            seg->line=tl;
+            seg->pos=i;
+            seg->stamp=0;
+            if (seg == tr->segments) {
+                tr->grid_rect.lu=tl->street->c[i];
+                tr->grid_rect.rl=tl->street->c[i];
+            }
+            coord_rect_extend(&tr->grid_rect, &tl->street->c[i]);
+            coord_rect_extend(&tr->grid_rect, &tl->street->c[i+1]);
+            seg++;
+        }
     }
-    curr=sel;
-    while (curr) {
-        struct coord_rect *sr=&curr->u.c_rect;
-        if (r.lu.x <= sr->rl.x && r.rl.x >= sr->lu.x &&
-                r.lu.y >= sr->rl.y && r.rl.y <= sr->lu.y)
-            return 1;
-        curr=curr->next;
+    tr->grid_shift=6;
+    while (((tr->grid_rect.rl.x-tr->grid_rect.lu.x) >> tr->grid_shift) >= TRACKING_GRID_SIZE
+            || ((tr->grid_rect.lu.y-tr->grid_rect.rl.y) >> tr->grid_shift) >= TRACKING_GRID_SIZE)
+        tr->grid_shift++;
+    tr->grid_width=((tr->grid_rect.rl.x-tr->grid_rect.lu.x) >> tr->grid_shift)+1;
+    tr->grid_height=((tr->grid_rect.lu.y-tr->grid_rect.rl.y) >> tr->grid_shift)+1;
+    cells=tr->grid_width*tr->grid_height;
+    tr->grid_start=g_new0(int, cells+1);
+    /* First pass counts the segments of each cell, second pass stores them */
+    for (pass = 0 ; pass < 2 ; pass++) {
+        for (i = 0 ; i < tr->segment_count ; i++) {
+            seg=&tr->segments[i];
+            r.lu=seg->line->street->c[seg->pos];
+            r.rl=r.lu;
+            coord_rect_extend(&r, &seg->line->street->c[seg->pos+1]);
+            x1=(r.lu.x-tr->grid_rect.lu.x) >> tr->grid_shift;
+            x2=(r.rl.x-tr->grid_rect.lu.x) >> tr->grid_shift;
+            y1=(r.rl.y-tr->grid_rect.rl.y) >> tr->grid_shift;
+            y2=(r.lu.y-tr->grid_rect.rl.y) >> tr->grid_shift;
+            for (y = y1 ; y <= y2 ; y++) {
+                for (x = x1 ; x <= x2 ; x++) {
+                    j=y*tr->grid_width+x;
+                    if (pass)
+                        tr->grid_segments[next[j]++]=i;
+                    else
+                        tr->grid_start[j+1]++;
+                }
+            }
+        }
+        if (!pass) {
+            for (j = 0 ; j < cells ; j++)
+                tr->grid_start[j+1]+=tr->grid_start[j];
+            tr->grid_segments=g_new(int, tr->grid_start[cells]);
+            next=g_new(int, cells);
+            memcpy(next, tr->grid_start, cells*sizeof(int));
+        }
     }
-    return 0;
+    g_free(next);
+    dbg(lvl_debug,"%d segments in %dx%d cells of size %d", tr->segment_count, tr->grid_width, tr->grid_height,
+        1 << tr->grid_shift);
 }
 
+static void tracking_grid_free(struct tracking *tr) {
+    g_free(tr->segments);
+    g_free(tr->grid_start);
+    g_free(tr->grid_segments);
+    tr->segments=NULL;
+    tr->segment_count=0;
+    tr->grid_start=NULL;
+    tr->grid_segments=NULL;
+}
 
 static void tracking_doupdate_lines(struct tracking *tr, struct coord *pc, enum projection pro) {
     int max_dist=1000;
-    struct map_selection *sel;
+    struct street_index *index;
+    struct street_data **streets;
     struct mapset_handle *h;
     struct map *m;
-    struct map_rect *mr;
-    struct item *item;
     struct street_data *street;
     struct tracking_line *tl;
     struct coord_geo g;
     struct coord cc;
+    struct coord_rect r;
+    int i,count;
 
     dbg(lvl_debug,"enter");
+    index=mapset_get_street_index(tr->ms);
     h=mapset_open(tr->ms);
     while ((m=mapset_next(h,2))) {
         cc.x = pc->x;
@@ -461,27 +541,22 @@ static void tracking_doupdate_lines(struct tracking *tr, struct coord *pc, enum
             transform_to_geo(pro, &cc, &g);
             transform_from_geo(map_projection(m), &g, &cc);
         }
-        sel = route_rect(18, &cc, &cc, 0, max_dist);
-        mr=map_rect_new(m, sel);
-        if (!mr)
-            continue;
-        while ((item=map_rect_get_item(mr))) {
-            if (item_get_default_flags(item->type)) {
-                street=street_get_data(item);
-                if (street_data_within_selection(street, sel)) {
-                    tl=g_malloc(sizeof(struct tracking_line)+(street->count-1)*sizeof(int));
-                    tl->street=street;
-                    tracking_get_angles(tl);
-                    tl->next=tr->lines;
-                    tr->lines=tl;
-                } else
-                    street_data_free(street);
-            }
+        r.lu.x=cc.x-max_dist;
+        r.lu.y=cc.y+max_dist;
+        r.rl.x=cc.x+max_dist;
+        r.rl.y=cc.y-max_dist;
+        streets=street_index_get(index, m, &r, &count);
+        for (i = 0 ; i < count ; i++) {
+            street=street_data_dup(streets[i]);
+            tl=g_malloc(sizeof(struct tracking_line)+(street->count-1)*sizeof(int));
+            tl->street=street;
+            tracking_get_angles(tl);
+            tl->next=tr->lines;
+            tr->lines=tl;
         }
-        map_selection_destroy(sel);
-        map_rect_destroy(mr);
     }
     mapset_close(h);
+    tracking_grid_build(tr);
     dbg(lvl_debug, "exit");
 }
 
@@ -496,6 +571,7 @@ void tracking_flush(struct tracking *tr) {
         g_free(tl);
         tl=next;
     }
+    tracking_grid_free(tr);
     tr->lines=NULL;
     tr->curr_line = NULL;
 }
@@ -606,6 +682,100 @@ static int tracking_value(struct tracking *tr, struct tracking_line *t, int offs
 }
 
 
+/**
+ * @brief Checks whether any of the terms of `tracking_value()` other than the distance may be negative
+ *
+ * If so, a segment far away may still get the lowest value, so all segments have to be scored.
+ */
+static int tracking_value_may_decrease(struct tracking *tr) {
+    return tr->angle_pref < 0 || tr->connected_pref < 0 || tr->nostop_pref < 0 || tr->route_pref < 0
+           || tr->overspeed_pref < 0;
+}
+
+static void tracking_score_segment(struct tracking *tr, int idx, int *min, int *best, struct coord *lpnt) {
+    struct tracking_segment *seg=&tr->segments[idx];
+    struct coord lp;
+    int value;
+
+    if (seg->stamp == tr->segment_stamp)
+        return;
+    seg->stamp=tr->segment_stamp;
+    value=tracking_value(tr, seg->line, seg->pos, &lp, *min+1, -1);
+    if (value < *min || (value == *min && *best != -1 && idx < *best)) {
+        *min=value;
+        *best=idx;
+        *lpnt=lp;
+    }
+}
+
+/**
+ * @brief Finds the segment of the tracking lines which matches the current position best
+ *
+ * The result is the same as scoring all segments in the order of `tr->segments` and taking the first one with the
+ * lowest value: on a tie, the segment which comes first wins. However, only the cells of the segment grid around the
+ * current position are visited, ring by ring, until the distance to the next ring alone exceeds the best value found.
+ * This requires that no term of the value is negative, otherwise all segments are scored.
+ *
+ * @param tr The tracking object
+ * @param min On entry, the value a segment must stay below. On return, the value of the segment found.
+ * @param lpnt Receives the point on the segment found nearest to the current position
+ * @return The index of the segment in `tr->segments`, or -1 if none matches
+ */
+static int tracking_find_segment(struct tracking *tr, int *min, struct coord *lpnt) {
+    struct coord *c=&tr->curr_in;
+    int best=-1,cell,cx,cy,d,r,x,y,i,j;
+    long long lb;
+
+    if (!tr->segment_count)
+        return -1;
+    tr->segment_stamp++;
+    if (!coord_rect_contains(&tr->grid_rect, c) || tracking_value_may_decrease(tr)) {
+        struct coord lp;
+        for (i = 0 ; i < tr->segment_count ; i++) {
+            j=tracking_value(tr, tr->segments[i].line, tr->segments[i].pos, &lp, *min, -1);
+            if (j < *min) {
+                *min=j;
+                best=i;
+                *lpnt=lp;
+            }
+        }
+        return best;
+    }
+    cell=1 << tr->grid_shift;
+    cx=(c->x-tr->grid_rect.lu.x) >> tr->grid_shift;
+    cy=(c->y-tr->grid_rect.rl.y) >> tr->grid_shift;
+    /* Distance from the position to the border of its own cell */
+    d=MIN(c->x-tr->grid_rect.lu.x-cx*cell, tr->grid_rect.lu.x+(cx+1)*cell-c->x);
+    d=MIN(d, MIN(c->y-tr->grid_rect.rl.y-cy*cell, tr->grid_rect.rl.y+(cy+1)*cell-c->y));
+    for (r = 0 ; ; r++) {
+        if (cx-r < 0 && cy-r < 0 && cx+r >= tr->grid_width && cy+r >= tr->grid_height)
+            break;
+        if (r) {
+            /* All segments not scored yet are outside of the cells within a distance of r-1 */
+            lb=(long long)(r-1)*cell+d;
+            if (lb*lb > *min)
+                break;
+        }
+        for (y = cy-r ; y <= cy+r ; y++) {
+            if (y < 0 || y >= tr->grid_height)
+                continue;
+            for (x = cx-r ; x <= cx+r ; x++) {
+                if (x < 0 || x >= tr->grid_width)
+                    continue;
+                if (y != cy-r && y != cy+r && x != cx-r) {
+                    x=cx+r;
+                    if (x >= tr->grid_width)
+                        break;
+                }
+                j=y*tr->grid_width+x;
+                for (i = tr->grid_start[j] ; i < tr->grid_start[j+1] ; i++)
+                    tracking_score_segment(tr, tr->grid_segments[i], min, &best, lpnt);
+            }
+        }
+    }
+    return best;
+}
+
 /**
  * @brief Processes a position update.
  *
@@ -617,7 +787,7 @@ static int tracking_value(struct tracking *tr, struct tracking_line *t, int offs
 void tracking_update(struct tracking *tr, struct vehicle *v, struct vehicleprofile *vehicleprofile,
                      enum projection pro) {
     struct tracking_line *t;
-    int i,value,min,time;
+    int i,min,best,time;
     struct coord lpnt;
     struct coord cin;
     struct attr valid,speed_attr,direction_attr,coord_geo,lag,time_attr,static_speed,static_distance;
@@ -719,41 +889,38 @@ void tracking_update(struct tracking *tr, struct vehicle *v, struct vehicleprofi
     }
 
     tr->street_direction=0;
-    t=tr->lines;
     tr->curr_line=NULL;
     min=INT_MAX/2;
-    while (t) {
-        struct street_data *sd=t->street;
-        for (i = 0; i < sd->count-1 ; i++) {
-            value=tracking_value(tr,t,i,&lpnt,min,-1);
-            if (value < min) {
-                struct coord lpnt_tmp;
-                int angle_delta=tracking_angle_abs_diff(tr->curr_angle, t->angle[i], 360);
-                tr->curr_line=t;
-                tr->pos=i;
-                tr->curr[0]=sd->c[i];
-                tr->curr[1]=sd->c[i+1];
-                tr->direction_matched=t->angle[i];
-                dbg(lvl_debug,"lpnt.x=0x%x,lpnt.y=0x%x pos=%d %d+%d+%d+%d=%d", lpnt.x, lpnt.y, i,
-                    transform_distance_line_sq(&sd->c[i], &sd->c[i+1], &cin, &lpnt_tmp),
-                    tracking_angle_delta(tr, tr->curr_angle, t->angle[i], 0)*tr->angle_pref,
-                    tracking_is_connected(tr, tr->last, &sd->c[i]) ? tr->connected_pref : 0,
-                    lpnt.x == tr->last_out.x && lpnt.y == tr->last_out.y ? tr->nostop_pref : 0,
-                    value
-                   );
-                tr->curr_out.x=lpnt.x;
-                tr->curr_out.y=lpnt.y;
-                tr->coord_geo_valid=0;
-                if (angle_delta < 70)
-                    tr->street_direction=1;
-                else if (angle_delta > 110)
-                    tr->street_direction=-1;
-                else
-                    tr->street_direction=0;
-                min=value;
-            }
-        }
-        t=t->next;
+    best=tracking_find_segment(tr, &min, &lpnt);
+    if (best != -1) {
+        struct coord lpnt_tmp;
+        struct street_data *sd;
+        int angle_delta;
+        t=tr->segments[best].line;
+        i=tr->segments[best].pos;
+        sd=t->street;
+        angle_delta=tracking_angle_abs_diff(tr->curr_angle, t->angle[i], 360);
+        tr->curr_line=t;
+        tr->pos=i;
+        tr->curr[0]=sd->c[i];
+        tr->curr[1]=sd->c[i+1];
+        tr->direction_matched=t->angle[i];
+        dbg(lvl_debug,"lpnt.x=0x%x,lpnt.y=0x%x pos=%d %d+%d+%d+%d=%d", lpnt.x, lpnt.y, i,
+            transform_distance_line_sq(&sd->c[i], &sd->c[i+1], &cin, &lpnt_tmp),
+            tracking_angle_delta(tr, tr->curr_angle, t->angle[i], 0)*tr->angle_pref,
+            tracking_is_connected(tr, tr->last, &sd->c[i]) ? tr->connected_pref : 0,
+            lpnt.x == tr->last_out.x && lpnt.y == tr->last_out.y ? tr->nostop_pref : 0,
+            min
+           );
+        tr->curr_out.x=lpnt.x;
+        tr->curr_out.y=lpnt.y;
+        tr->coord_geo_valid=0;
+        if (angle_delta < 70)
+            tr->street_direction=1;
+        else if (angle_delta > 110)
+            tr->street_direction=-1;
+        else
+            tr->street_direction=0;
     }
     dbg(lvl_debug,"tr->curr_line=%p min=%d", tr->curr_line, min);
     if (!tr->curr_line || min > tr->offroad_limit_pref) {
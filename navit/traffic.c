@@ -47,7 +47,7 @@
 #include "xmlconfig.h"
 #include "traffic.h"
 #include "plugin.h"
-#include "fib.h"
+#include "route_heap.h"
 #include "event.h"
 #include "callback.h"
 #include "vehicleprofile.h"
@@ -1488,14 +1488,15 @@ static int traffic_point_match_attributes(struct traffic_point * this_, struct i
  * If no points can be attained (because no attributes which must match are supplied), the score is 0 for any point.
  *
  * @param this_ The traffic point
+ * @param rg The route graph
  * @param p The point shared by all segments to examine
  * @param start The first point of the path
  * @param match_start True to evaluate for the start point of a route, false for the end point
  *
  * @return The score, as a percentage value
  */
-static int traffic_point_match_segment_attributes(struct traffic_point * this_, struct route_graph_point *p,
-        struct route_graph_point * start, int match_start) {
+static int traffic_point_match_segment_attributes(struct traffic_point * this_, struct route_graph *rg,
+        struct route_graph_point *p, struct route_graph_point * start, int match_start) {
 
     /*
      * Whether we want a match for the route segment starting at p (leading away from it) or the route segment ending
@@ -1518,6 +1519,9 @@ static int traffic_point_match_segment_attributes(struct traffic_point * this_,
     /* The route segment being examined */
     struct route_graph_segment *s;
 
+    /* Iterator over the segments of `p` */
+    struct route_graph_point_iterator it;
+
     /* Map rect for retrieving item data */
     struct map_rect *mr;
 
@@ -1613,34 +1617,8 @@ static int traffic_point_match_segment_attributes(struct traffic_point * this_,
         route_follows_road |= !compare_name_systematic(start_ref, end_ref);
 
     /* check if we have a match for an off-route segment */
-    /* TODO consolidate these two loops, which differ only in their loop statement while the body is identical */
-    for (s = p->start; s && !(has_offroute_match && route_leaves_road); s = s->start_next) {
-        if ((p->seg == s) || (p_prev && (p_prev->seg == s)))
-            /* segments is on the route, skip */
-            continue;
-        mr = map_rect_new(s->data.item.map, NULL);
-        if ((item = map_rect_get_item_byid(mr, s->data.item.id_hi, s->data.item.id_lo))) {
-            if (item_attr_get(item, attr_street_name, &attr)) {
-                // TODO crude comparison in need of refinement
-                if (!strcmp(this_->junction_name, attr.u.str))
-                    has_offroute_match = 1;
-                if (start_name)
-                    route_leaves_road |= !strcmp(start_name, attr.u.str);
-                if (end_name)
-                    route_leaves_road |= !strcmp(end_name, attr.u.str);
-            }
-            item_attr_rewind(item);
-            if (!route_leaves_road && item_attr_get(item, attr_street_name_systematic, &attr)) {
-                if (start_ref)
-                    route_leaves_road |= !compare_name_systematic(start_ref, attr.u.str);
-                if (end_ref)
-                    route_leaves_road |= !compare_name_systematic(end_ref, attr.u.str);
-            }
-        }
-        map_rect_destroy(mr);
-    }
-
-    for (s = p->end; s && !(has_offroute_match && route_leaves_road); s = s->end_next) {
+    it = rp_iterator_new(rg, p);
+    while ((s = rp_iterator_next(&it)) && !(has_offroute_match && route_leaves_road)) {
         if ((p->seg == s) || (p_prev && (p_prev->seg == s)))
             /* segments is on the route, skip */
             continue;
@@ -2009,7 +1987,7 @@ static void traffic_location_populate_route_graph(struct traffic_location * this
                         e_pnt = route_graph_add_point(rg, &l);
                         dbg_assert(len >= 0);
                         data.len = len;
-                        if (!route_graph_segment_is_duplicate(s_pnt, &data))
+                        if (!route_graph_segment_is_duplicate(rg, s_pnt, &data))
                             route_graph_add_segment(rg, s_pnt, e_pnt, &data);
                     } else {
                         int isseg, rc;
@@ -2023,7 +2001,7 @@ static void traffic_location_populate_route_graph(struct traffic_location * this
                                 if (isseg) {
                                     e_pnt = route_graph_add_point(rg, &l);
                                     data.len = len;
-                                    if (!route_graph_segment_is_duplicate(s_pnt, &data))
+                                    if (!route_graph_segment_is_duplicate(rg, s_pnt, &data))
                                         route_graph_add_segment(rg, s_pnt, e_pnt, &data);
                                     data.offset++;
                                     s_pnt = route_graph_add_point(rg, &l);
@@ -2035,7 +2013,7 @@ static void traffic_location_populate_route_graph(struct traffic_location * this
                         dbg_assert(len >= 0);
                         sc++;
                         data.len = len;
-                        if (!route_graph_segment_is_duplicate(s_pnt, &data))
+                        if (!route_graph_segment_is_duplicate(rg, s_pnt, &data))
                             route_graph_add_segment(rg, s_pnt, e_pnt, &data);
                     }
                 }
@@ -2187,12 +2165,12 @@ static struct route_graph_point * traffic_route_flood_graph(struct route_graph *
         struct coord * c_start, struct coord * c_dst, struct route_graph_point * start_existing) {
     struct route_graph_point * ret;
 
-    int i;
+    struct route_graph_point_iterator it;
 
     GList * existing = NULL;
 
     /* This heap will hold all points with "temporarily" calculated costs */
-    struct fibheap *heap;
+    struct route_heap *heap;
 
     /* Cost of the start position */
     int start_value;
@@ -2227,43 +2205,44 @@ static struct route_graph_point * traffic_route_flood_graph(struct route_graph *
     }
 
     /* prime the route graph */
-    heap = fh_makekeyheap();
+    heap = route_heap_new(route_heap_type_default);
 
     start_value = PENALTY_OFFROAD * transform_distance(projection_mg, c_start, c_dst);
     ret = NULL;
 
     dbg(lvl_debug, "start flooding route graph, start_value=%d", start_value);
 
-    for (i = 0; i < HASH_SIZE; i++) {
-        p = rg->hash[i];
-        while (p) {
-            if (!g_list_find(existing, p)) {
-                if (!(p->flags & RP_TURN_RESTRICTION)) {
-                    p->value = PENALTY_OFFROAD * transform_distance(projection_mg, &p->c, c_dst);
-                    p->el = fh_insertkey(heap, p->value, p);
-                } else {
-                    /* ignore points which are part of turn restrictions */
-                    p->value = INT_MAX;
-                    p->el = NULL;
-                }
-                p->seg = NULL;
+    p = NULL;
+    while ((p = route_graph_next_point(rg, p))) {
+        if (!g_list_find(existing, p)) {
+            if (!(p->flags & RP_TURN_RESTRICTION)) {
+                p->value = PENALTY_OFFROAD * transform_distance(projection_mg, &p->c, c_dst);
+                route_heap_update(heap, p, p->value);
+            } else {
+                /* ignore points which are part of turn restrictions */
+                p->value = INT_MAX;
+                p->heap.el = NULL;
             }
-            p = p->hash_next;
+            p->seg = NULL;
         }
     }
 
     /* flood the route graph */
     for (;;) {
-        p = fh_extractmin(heap); /* Starting Dijkstra by selecting the point with the minimum costs on the heap */
+        /* Starting Dijkstra by selecting the point with the minimum costs on the heap */
+        p = route_heap_extract_min(heap);
         if (!p) /* There are no more points with temporarily calculated costs, Dijkstra has finished */
             break;
 
         dbg(lvl_debug, "p=%p, value=%d", p, p->value);
 
         min = p->value;
-        p->el = NULL; /* This point is permanently calculated now, we've taken it out of the heap */
-        s = p->start;
-        while (s) { /* Iterating all the segments leading away from our point to update the points at their ends */
+        /* This point is permanently calculated now, we've taken it out of the heap */
+        it = rp_iterator_new(rg, p);
+        while ((s = rp_iterator_next(&it))) {
+            if (rp_iterator_end(&it))
+                break;
+            /* Iterating all the segments leading away from our point to update the points at their ends */
             val = traffic_route_get_seg_cost(s, data, -1);
 
             dbg(lvl_debug, "  negative segment, val=%d", val);
@@ -2273,11 +2252,7 @@ static struct route_graph_point * traffic_route_flood_graph(struct route_graph *
                 if (new < s->end->value) { /* We've found a less costly way to reach the end of s, update it */
                     s->end->value = new;
                     s->end->seg = s;
-                    if (!s->end->el) {
-                        s->end->el = fh_insertkey(heap, new, s->end);
-                    } else {
-                        fh_replacekey(heap, s->end->el, new);
-                    }
+                    route_heap_update(heap, s->end, new);
                     new += PENALTY_OFFROAD * transform_distance(projection_mg, &s->end->c, c_start);
                     if (new < start_value) { /* We've found a less costly way from the start point, update */
                         start_value = new;
@@ -2285,10 +2260,9 @@ static struct route_graph_point * traffic_route_flood_graph(struct route_graph *
                     }
                 }
             }
-            s = s->start_next;
         }
-        s = p->end;
-        while (s) { /* Doing the same as above with the segments leading towards our point */
+        while (s) {
+            /* Doing the same as above with the segments leading towards our point */
             val = traffic_route_get_seg_cost(s, data, 1);
 
             dbg(lvl_debug, "  positive segment, val=%d", val);
@@ -2298,11 +2272,7 @@ static struct route_graph_point * traffic_route_flood_graph(struct route_graph *
                 if (new < s->start->value) {
                     s->start->value = new;
                     s->start->seg = s;
-                    if (!s->start->el) {
-                        s->start->el = fh_insertkey(heap, new, s->start);
-                    } else {
-                        fh_replacekey(heap, s->start->el, new);
-                    }
+                    route_heap_update(heap, s->start, new);
                     new += PENALTY_OFFROAD * transform_distance(projection_mg, &s->start->c, c_start);
                     if (new < start_value) {
                         start_value = new;
@@ -2310,11 +2280,11 @@ static struct route_graph_point * traffic_route_flood_graph(struct route_graph *
                     }
                 }
             }
-            s = s->end_next;
+            s = rp_iterator_next(&it);
         }
     }
 
-    fh_deleteheap(heap);
+    route_heap_destroy(heap);
     g_list_free(existing);
     return ret;
 }
@@ -2348,6 +2318,7 @@ static struct route_graph_segment * traffic_route_append(struct route_graph *rg,
         struct route_graph_segment * last, struct route_graph_point * end) {
     struct route_graph_segment * ret = NULL, * s = last, * s_cmp, * s_next;
     struct route_graph_point * p = end;
+    struct route_graph_point_iterator it;
     int num_seg;
     int id_match;
     int is_ambiguous;
@@ -2371,7 +2342,8 @@ static struct route_graph_segment * traffic_route_append(struct route_graph *rg,
         id_match = 0;
         is_ambiguous = 0;
         s_next = NULL;
-        for (s_cmp = p->start; s_cmp; s_cmp = s_cmp->start_next) {
+        it = rp_iterator_new(rg, p);
+        while ((s_cmp = rp_iterator_next(&it)) && !rp_iterator_end(&it)) {
             num_seg++;
             if ((s_cmp == s) || (s_cmp->data.flags & AF_ONEWAYREV) || (s_cmp->end->flags & RP_TURN_RESTRICTION))
                 continue;
@@ -2386,7 +2358,7 @@ static struct route_graph_segment * traffic_route_append(struct route_graph *rg,
                     s_next = s_cmp;
             }
         }
-        for (s_cmp = p->end; s_cmp; s_cmp = s_cmp->end_next) {
+        for ( ; s_cmp; s_cmp = rp_iterator_next(&it)) {
             num_seg++;
             if ((s_cmp == s) || (s_cmp->data.flags & AF_ONEWAY) || (s_cmp->end->flags & RP_TURN_RESTRICTION))
                 continue;
@@ -2450,6 +2422,7 @@ static struct route_graph_point * traffic_route_prepend(struct route_graph * rg,
         struct route_graph_point * start) {
     struct route_graph_point * ret = start;
     struct route_graph_segment * s, * s_cmp, * s_prev = NULL;
+    struct route_graph_point_iterator it;
     int num_seg;
     int id_match;
     int is_ambiguous;
@@ -2464,7 +2437,8 @@ static struct route_graph_point * traffic_route_prepend(struct route_graph * rg,
         num_seg = 0;
         id_match = 0;
         is_ambiguous = 0;
-        for (s_cmp = ret->start; s_cmp; s_cmp = s_cmp->start_next) {
+        it = rp_iterator_new(rg, ret);
+        while ((s_cmp = rp_iterator_next(&it)) && !rp_iterator_end(&it)) {
             num_seg++;
             if (s_cmp == s)
                 continue;
@@ -2483,7 +2457,7 @@ static struct route_graph_point * traffic_route_prepend(struct route_graph * rg,
                     s_prev = s_cmp;
             }
         }
-        for (s_cmp = ret->end; s_cmp; s_cmp = s_cmp->end_next) {
+        for ( ; s_cmp; s_cmp = rp_iterator_next(&it)) {
             num_seg++;
             if (s_cmp == s)
                 continue;
@@ -2595,7 +2569,7 @@ static int traffic_location_get_point_match(struct traffic_location * this_, str
         return 0;
 
     /* First examine route graph points and connected segments */
-    score = traffic_point_match_segment_attributes(trpoint, p, start, match_start);
+    score = traffic_point_match_segment_attributes(trpoint, rg, p, start, match_start);
     if (ret < score)
         ret = score;
     return ret;
@@ -2722,10 +2696,11 @@ static int traffic_location_is_valid(struct traffic_location * this_) {
 /**
  * @brief Whether the current point is a candidate for low-res endpoint matching.
  *
+ * @param rg The route graph
  * @param this_ The point to examine
  * @param s_prev The route segment leading to `this_` (NULL for the start point)
  */
-static int route_graph_point_is_endpoint_candidate(struct route_graph_point *this_,
+static int route_graph_point_is_endpoint_candidate(struct route_graph *rg, struct route_graph_point *this_,
         struct route_graph_segment *s_prev) {
     int ret;
 
@@ -2735,6 +2710,9 @@ static int route_graph_point_is_endpoint_candidate(struct route_graph_point *thi
     /* Segment used for comparison */
     struct route_graph_segment *s_cmp;
 
+    /* Iterator over the segments of `this_` */
+    struct route_graph_point_iterator it;
+
     /* Current segment */
     struct route_graph_segment *s = this_->seg;
 
@@ -2747,11 +2725,8 @@ static int route_graph_point_is_endpoint_candidate(struct route_graph_point *thi
     if (!ret) {
         /* detect junctions */
         is_junction = (s && s_prev) ? 0 : -1;
-        for (s_cmp = this_->start; s_cmp; s_cmp = s_cmp->start_next) {
-            if ((s_cmp != s) && (s_cmp != s_prev))
-                is_junction += 1;
-        }
-        for (s_cmp = this_->end; s_cmp; s_cmp = s_cmp->end_next) {
+        it = rp_iterator_new(rg, this_);
+        while ((s_cmp = rp_iterator_next(&it))) {
             if ((s_cmp != s) && (s_cmp != s_prev))
                 is_junction += 1;
         }
@@ -3111,7 +3086,7 @@ static int traffic_message_add_segments(struct traffic_message * this_, struct m
                 transform_to_geo(projection_mg, &(p_iter->c), &wgs);
                 dbg(lvl_debug, "*****checkpoint ADD-4.2.3, p_iter=%p (value=%d)\nhttps://www.openstreetmap.org?mlat=%f&mlon=%f/#map=13",
                     p_iter, p_iter->value, wgs.lat, wgs.lng);
-                if (route_graph_point_is_endpoint_candidate(p_iter, s_prev)) {
+                if (route_graph_point_is_endpoint_candidate(rg, p_iter, s_prev)) {
                     score = traffic_location_get_point_match(this_->location, p_iter,
                             this_->location->at ? 1 : (dir > 0) ? 2 : 0,
                             rg, p_start, 0, ms);
@@ -3173,7 +3148,7 @@ static int traffic_message_add_segments(struct traffic_message * this_, struct m
                 transform_to_geo(projection_mg, &(p_iter->c), &wgs);
                 dbg(lvl_debug, "*****checkpoint ADD-4.2.7, p_iter=%p (value=%d)\nhttps://www.openstreetmap.org?mlat=%f&mlon=%f/#map=13",
                     p_iter, p_iter->value, wgs.lat, wgs.lng);
-                if (route_graph_point_is_endpoint_candidate(p_iter, s_prev)) {
+                if (route_graph_point_is_endpoint_candidate(rg, p_iter, s_prev)) {
                     score = traffic_location_get_point_match(this_->location, p_iter,
                             this_->location->at ? 1 : (dir > 0) ? 0 : 2,
                             rg, p_start, 1, ms);
@@ -321,11 +321,81 @@ void transform_from_geo(enum projection pro, const struct coord_geo *g, struct c
     }
 }
 
+/**
+ * @brief Converts the x coordinates of a number of points between two of the projections mg and garmin
+ *
+ * For these projections, x only depends on the longitude and is a plain linear function of it, so each case is a
+ * simple loop the compiler can turn into vector instructions. The expressions are the ones used by transform_to_geo()
+ * and transform_from_geo(), including the rounding to navit_float in between, so the result is exactly the same as
+ * converting point by point.
+ *
+ * @param cfrom The points to convert, may be the same as cto
+ * @param from The projection of cfrom, projection_mg or projection_garmin
+ * @param cto The buffer for the converted points
+ * @param to The projection of cto, projection_mg or projection_garmin
+ * @param count The number of points
+ */
+static void transform_from_to_count_x(struct coord *cfrom, enum projection from, struct coord *cto,
+                                      enum projection to, int count) {
+    navit_float lng;
+    int i;
+
+    if (from == projection_mg && to == projection_mg) {
+        for (i = 0 ; i < count ; i++) {
+            lng=cfrom[i].x/6371000.0/M_PI*180;
+            cto[i].x=lng*6371000.0*M_PI/180;
+        }
+    } else if (from == projection_mg) {
+        for (i = 0 ; i < count ; i++) {
+            lng=cfrom[i].x/6371000.0/M_PI*180;
+            cto[i].x=lng*geo2gar_units;
+        }
+    } else if (to == projection_mg) {
+        for (i = 0 ; i < count ; i++) {
+            lng=cfrom[i].x*gar2geo_units;
+            cto[i].x=lng*6371000.0*M_PI/180;
+        }
+    } else {
+        for (i = 0 ; i < count ; i++) {
+            lng=cfrom[i].x*gar2geo_units;
+            cto[i].x=lng*geo2gar_units;
+        }
+    }
+}
+
+/**
+ * @brief Converts a number of points from one projection to another
+ *
+ * This gives the same result as calling transform_to_geo() and transform_from_geo() for each point. Between the
+ * projections mg and garmin, x and y are independent of each other, so the x coordinates are converted in a separate
+ * pass (see transform_from_to_count_x()) and only y, which needs the trigonometric functions for mg, is converted
+ * point by point.
+ *
+ * @param cfrom The points to convert, may be the same as cto
+ * @param from The projection of cfrom
+ * @param cto The buffer for the converted points
+ * @param to The projection of cto
+ * @param count The number of points
+ */
 void transform_from_to_count(struct coord *cfrom, enum projection from, struct coord *cto, enum projection to,
                              int count) {
     struct coord_geo g;
     int i;
 
+    if ((from == projection_mg || from == projection_garmin) && (to == projection_mg || to == projection_garmin)) {
+        transform_from_to_count_x(cfrom, from, cto, to, count);
+        for (i = 0 ; i < count ; i++) {
+            if (from == projection_mg)
+                g.lat=navit_atan(exp(cfrom[i].y/6371000.0))/M_PI*360-90;
+            else
+                g.lat=cfrom[i].y*gar2geo_units;
+            if (to == projection_mg)
+                cto[i].y=log(navit_tan(M_PI_4+g.lat*M_PI/360))*6371000.0;
+            else
+                cto[i].y=g.lat*geo2gar_units;
+        }
+        return;
+    }
     for (i = 0 ; i < count ; i++) {
         transform_to_geo(from, cfrom, &g);
         transform_from_geo(to, &g, cto);
@@ -448,43 +518,48 @@ void transform_utm_to_geo(const double UTMEasting, const double UTMNorthing, int
     geo->lng=Long;
 }
 
-static struct coord transform_correct_projection(struct transformation *t, enum projection required_projection,
-        struct coord c) {
-    struct coord result;
-    struct coord_geo g;
-    if (required_projection == t->pro) {
-        result=c;
-    } else {
-        transform_to_geo(required_projection, &c, &g);
-        transform_from_geo(t->pro, &g, &result);
-    }
-    return result;
-}
-
-static struct coord transform_shift_by_center_and_scale(struct transformation *t, struct coord c) {
-    struct coord result;
-    result.x = c.x - t->map_center.x;
-    result.y = c.y - t->map_center.y;
-    result.x >>= t->scale_shift;
-    result.y >>= t->scale_shift;
-    return result;
-}
-
 struct coord_3d {
     int x;
     int y;
     int z;
 };
 
+/** Number of points transform_point_buf() passes through transform_rotate_count() at once */
+#define TRANSFORM_BATCH_SIZE 256
 
-static struct coord_3d transform_rotate(struct transformation *t, struct coord c) {
-    struct coord_3d result;
-    result.x=c.x*t->m00+c.y*t->m01+HOG(*t)*t->m02;
-    result.y=c.x*t->m10+c.y*t->m11+HOG(*t)*t->m12;
-    result.z=(c.x*t->m20+c.y*t->m21+HOG(*t)*t->m22);
-    result.z+=t->offz << POST_SHIFT;
-    dbg(lvl_debug, "result: (%d,%d,%d)", result.x,result.y,result.z);
-    return result;
+/**
+ * @brief Moves a number of points into the view coordinate system
+ *
+ * This is the part of transform_point_buf() which does not depend on the neighbouring points: the points are
+ * converted into the projection of the transformation if necessary, shifted by the map center, scaled and multiplied
+ * by the rotation matrix. All of this is integer arithmetic done by a simple loop over the points, which allows the
+ * compiler to use vector instructions for it.
+ *
+ * @param t The transformation
+ * @param required_projection The projection of the points in input
+ * @param input The points to transform
+ * @param result Buffer for the transformed points
+ * @param count The number of points, at most TRANSFORM_BATCH_SIZE
+ */
+static void transform_rotate_count(struct transformation *t, enum projection required_projection,
+                                   struct coord *input, struct coord_3d *result, int count) {
+    struct coord projected[TRANSFORM_BATCH_SIZE];
+    int cx=t->map_center.x,cy=t->map_center.y,shift=t->scale_shift;
+    int m00=t->m00,m01=t->m01,m10=t->m10,m11=t->m11,m20=t->m20,m21=t->m21;
+    int hx=HOG(*t)*t->m02,hy=HOG(*t)*t->m12,hz=HOG(*t)*t->m22,offz=t->offz << POST_SHIFT;
+    int i,x,y;
+
+    if (required_projection != t->pro) {
+        transform_from_to_count(input, required_projection, projected, t->pro, count);
+        input=projected;
+    }
+    for (i = 0 ; i < count ; i++) {
+        x=(input[i].x-cx) >> shift;
+        y=(input[i].y-cy) >> shift;
+        result[i].x=x*m00+y*m01+hx;
+        result[i].y=x*m10+y*m11+hy;
+        result[i].z=x*m20+y*m21+hz+offz;
+    }
 }
 
 static struct coord_3d transform_z_clip(struct coord_3d c, struct coord_3d c_old, int zlimit) {
@@ -552,16 +627,23 @@ int transform_point(struct transformation *t, enum projection required_projectio
 
 int transform_point_buf(struct transformation *t, enum projection required_projection, struct coord *input,
                         struct point *result, long result_size, int count, int mindist, int width, int *width_result) {
-    struct coord projected_coord, shifted_coord;
+    struct coord_3d rotated[TRANSFORM_BATCH_SIZE];
     struct coord_3d rotated_coord;
     struct point screen_point;
     int zlimit=t->znear;
     struct z_clip_result clip_result, clip_result_old= {{0,0}, -1, 0, 0};
-    int i,result_idx = 0,result_idx_last=0;
+    int i,batch=0,batch_end=0,result_idx = 0,result_idx_last=0;
     long max_results = result_size / sizeof(struct point);
 
     dbg(lvl_debug,"count=%d", count);
     for (i=0; i < count; i++) {
+        if (i >= batch_end) {
+            batch=i;
+            batch_end=batch+TRANSFORM_BATCH_SIZE;
+            if (batch_end > count)
+                batch_end=count;
+            transform_rotate_count(t, required_projection, input+batch, rotated, batch_end-batch);
+        }
         dbg(lvl_debug, "input coord %d: (%d, %d)", i, input[i].x, input[i].y);
 #if 0 /* doesn't work as wanted */
         if (i && input[i].x == input[0].x && input[i].y == input[0].y && result_idx && !width_result) {
@@ -569,9 +651,8 @@ int transform_point_buf(struct transformation *t, enum projection required_proje
             continue;
         }
 #endif
-        projected_coord = transform_correct_projection(t, required_projection, input[i]);
-        shifted_coord = transform_shift_by_center_and_scale(t, projected_coord);
-        rotated_coord = transform_rotate(t, shifted_coord);
+        rotated_coord = rotated[i-batch];
+        dbg(lvl_debug, "rotated: (%d,%d,%d)", rotated_coord.x,rotated_coord.y,rotated_coord.z);
 
         if (t->ddd) {
             clip_result=transform_z_clip_if_necessary(rotated_coord, zlimit, clip_result_old);
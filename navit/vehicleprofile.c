@@ -89,6 +89,12 @@ static void vehicleprofile_set_attr_do(struct vehicleprofile *this_, struct attr
     case attr_turn_around_penalty2:
         this_->turn_around_penalty2=attr->u.num;
         break;
+    case attr_route_engine:
+        this_->route_engine=attr->u.num;
+        break;
+    case attr_route_heuristic:
+        this_->route_heuristic=!!attr->u.num;
+        break;
     default:
         break;
     }
@@ -125,6 +131,8 @@ static void vehicleprofile_clear(struct vehicleprofile *this_) {
     this_->weight=-1;
     this_->axle_weight=-1;
     this_->through_traffic_penalty=9000;
+    this_->route_engine=route_engine_flood;
+    this_->route_heuristic=0;
     vehicleprofile_free_hash(this_);
     this_->roadprofile_hash=g_hash_table_new(NULL, NULL);
 }
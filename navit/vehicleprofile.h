@@ -29,6 +29,11 @@ enum maxspeed_handling {
     maxspeed_ignore = 2,		/*!< Ignore maxspeed of segment, always use {@code route_weight} of road profile */
 };
 
+enum route_engine {
+    route_engine_flood = 0,		/*!< Build the route graph for the whole area around the route points and flood it */
+    route_engine_ch = 1,		/*!< Build the route graph only along the path found in the map's contraction hierarchy */
+};
+
 
 struct vehicleprofile {
     NAVIT_OBJECT
@@ -52,6 +57,9 @@ struct vehicleprofile {
     struct attr active_callback;
     int turn_around_penalty;		/**< Penalty when turning around */
     int turn_around_penalty2;		/**< Penalty when turning around, for planned turn arounds */
+    int route_engine;			/**< How to find the route, see {@code enum route_engine} */
+    int route_heuristic;			/**< Boolean: 1 to direct the flood towards the start using the straight-line
+						  *   distance, 0 to flood the entire route graph */
 };
 
 struct vehicleprofile * vehicleprofile_new(struct attr *parent, struct attr **attrs);
@@ -335,6 +335,8 @@ static char *element_fixmes[]= {
 };
 
 static void initStatic(void) {
+    if (elements)
+        return;
     elements=g_new0(struct element_func, 46); //45 is a number of elements + ending NULL element
 
     elements[0].name="config";
@@ -1280,6 +1282,51 @@ gboolean config_load(const char *filename, xmlerror **error) {
     return result;
 }
 
+/**
+ * @brief Loads a config file fragment into an existing object
+ *
+ * The file is parsed as if its contents were placed within the element of `parent`, e.g. a layout file can be
+ * loaded into a navit object. This is meant for tools which set up only part of Navit.
+ *
+ * @param filename FQFN of the file
+ * @param parent The object the elements of the file are added to
+ * @param error ptr to error details, if any
+ * @returns boolean TRUE or FALSE (if error detected)
+ */
+gboolean config_load_into(const char *filename, struct attr *parent, xmlerror **error) {
+    struct xmldocument document;
+    struct xmlstate root,*curr=&root;
+    gboolean result;
+
+    attr_create_hash();
+    item_create_hash();
+    initStatic();
+
+    dbg(lvl_debug,"enter filename='%s'", filename);
+    memset(&root, 0, sizeof(root));
+    root.element_attr=*parent;
+    root.element=attr_to_name(parent->type);
+    root.error=error;
+    root.object_func=object_func_lookup(parent->type);
+    memset(&document, 0, sizeof(document));
+    document.href=filename;
+    document.user_data=&curr;
+    result=parse_file(&document, error);
+    if (result && curr != &root) {
+        g_set_error(error,G_MARKUP_ERROR,G_MARKUP_ERROR_PARSE, "element '%s' not closed", curr->element);
+        result=FALSE;
+    }
+    while (curr && curr != &root) {
+        struct xmlstate *parent_state=curr->parent;
+        g_free(curr);
+        curr=parent_state;
+    }
+    attr_destroy_hash();
+    item_destroy_hash();
+    dbg(lvl_debug,"return %d", result);
+    return result;
+}
+
 int navit_object_set_methods(void *in, int in_size, void *out, int out_size) {
     int ret,size=out_size;
     if (out_size > in_size) {
@@ -149,6 +149,7 @@ int xml_parse_text(const char *document, void *data, void (*start)(xml_context *
                    const char **, void *, GError **), void (*end)(xml_context *, const char *, void *, GError **),
                    void (*text)(xml_context*, const char *, gsize, void *, GError **));
 gboolean config_load(const char *filename, xmlerror **error);
+gboolean config_load_into(const char *filename, struct attr *parent, xmlerror **error);
 //static void xinclude(GMarkupParseContext *context, const gchar **attribute_names, const gchar **attribute_values, struct xmldocument *doc_old, xmlerror **error);
 
 /* end of prototypes */
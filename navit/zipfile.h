@@ -103,6 +103,23 @@ struct zip_cd {
 */
 #define zip_extra_header_id_zip64 0x0001
 
+/**
+* @brief Header ID for the extra field which pads a local file header so that the member data starts at an aligned
+* offset. The field holds the alignment as a 16 bit value, followed by padding (same layout as Android's zipalign).
+*/
+#define zip_extra_header_id_align 0xd935
+
+/**
+* @brief Flag in the internal attributes of a central directory entry: the member is stored uncompressed, starting at
+* a page-aligned offset, so it can be used directly from a memory-mapped map file.
+*/
+#define zip_int_page_aligned 0x8000
+
+/**
+* @brief Alignment of members written with `zip_int_page_aligned`.
+*/
+#define zip_page_size 4096
+
 //! ZIP extra field structure.
 
 //! See the documentation of the ZIP format for the meaning
@@ -113,6 +130,13 @@ struct zip_cd_ext {
 	unsigned long long zipofst;  //!< offset to start of local file header (only valid if the struct is for a ZIP64 extra field)
 } ATTRIBUTE_PACKED;
 
+//! ZIP extra field for member alignment, see zip_extra_header_id_align.
+struct zip_extra_align {
+	unsigned short tag;                  //!< extra field header ID
+	short size;                  //!< extra field data size
+	short alignment;             //!< alignment of the member data, followed by padding
+} ATTRIBUTE_PACKED;
+
 struct zip_enc {
 	short efield_header;
 	short efield_size;